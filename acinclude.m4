@@ -1670,9 +1670,11 @@ AC_CHECK_FUNCS([ \
 	pwrite \
 	pwritev \
 	pwritev64 \
+	recvmmsg \
 	regcomp \
 	regerror \
 	regexec \
+	sendmmsg \
 	setitimer \
 	setvbuf \
 	sigaction \
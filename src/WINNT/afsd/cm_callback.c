@@ -1275,6 +1275,16 @@ SRXAFSCB_TellMeAboutYourself( struct rx_call *callp,
     return 0;
 }
 
+/* directory deltas are not asked for; the file server breaks the callback */
+int
+SRXAFSCB_CallBackDirDelta( struct rx_call *callp,
+                           struct AFSFid *dirFidp,
+                           struct AFSDirDeltaStatus *dirStatusp,
+                           AFSDirDeltas *deltasp)
+{
+    return RXGEN_OPCODE;
+}
+
 /*------------------------------------------------------------------------
  * EXPORTED SRXAFSCB_GetServerPrefs
  *
@@ -644,6 +644,53 @@ SRXAFSCB_CallBack(struct rx_call *a_call, struct AFSCBFids *a_fids,
 }				/*SRXAFSCB_CallBack */
 
 
+/*------------------------------------------------------------------------
+ * EXPORTED SRXAFSCB_CallBackDirDelta
+ *
+ * Description:
+ *	Routine called by the server-side callback RPC interface to
+ *	pass on changes made to a directory, in place of breaking its
+ *	callback.  The callback service isn't authenticated, so anyone
+ *	could send us changes to write into our copy of the directory.
+ *	We don't ask for them, and treat any we are sent as the breaking
+ *	of the directory's callback.
+ *
+ * Arguments:
+ *	a_call     : Ptr to Rx call on which this request came in.
+ *	a_dirFid   : Ptr to the fid of the directory.
+ *	a_dirStatus: Ptr to the status of the directory after the changes.
+ *	a_deltas   : Ptr to the changes.
+ *
+ * Returns:
+ *	0 (always).
+ *
+ * Environment:
+ *	Nothing interesting.
+ *
+ * Side Effects:
+ *	As advertised.
+ *------------------------------------------------------------------------*/
+
+int
+SRXAFSCB_CallBackDirDelta(struct rx_call *a_call, struct AFSFid *a_dirFid,
+			  struct AFSDirDeltaStatus *a_dirStatus,
+			  struct AFSDirDeltas *a_deltas)
+{
+    struct rx_connection *tconn;
+
+    RX_AFS_GLOCK();
+
+    AFS_STATCNT(SRXAFSCB_CallBackDirDelta);
+    if ((tconn = rx_ConnectionOf(a_call)))
+	ClearCallBack(tconn, a_dirFid);
+
+    RX_AFS_GUNLOCK();
+
+    return (0);
+
+}				/*SRXAFSCB_CallBackDirDelta */
+
+
 /*------------------------------------------------------------------------
  * EXPORTED SRXAFSCB_Probe
  *
@@ -745,3 +745,20 @@ SRXAFSCB_GetCellByNum(struct rx_call *a_call, afs_int32 a_index,
 {
     return RXGEN_OPCODE;
 }				/* SRXAFSCB_GetCellByNum */
+
+/*!
+ * Routine called by the server-side callback RPC interface to
+ * pass on changes to a directory.  We don't ask for these.
+ *
+ * \param[in]	rxcall	Ptr to the associated Rx call structure.
+ *
+ * \post Returns RXGEN_OPCODE (always)
+ *
+ */
+int
+SRXAFSCB_CallBackDirDelta(struct rx_call *a_call, struct AFSFid *a_dirFid,
+			  struct AFSDirDeltaStatus *a_dirStatus,
+			  AFSDirDeltas *a_deltas)
+{
+    return RXGEN_OPCODE;
+}				/* SRXAFSCB_CallBackDirDelta */
@@ -242,6 +242,7 @@ _xdr_free(bool_t(*fn) (XDR * xdrs, void *obj), void *obj)
 {
     XDR xdrs;
     xdrs.x_op = XDR_FREE;
+    xdrs.x_arena = NULL;
     fn(&xdrs, obj);
 }
 
@@ -314,10 +315,11 @@ afscp_ServerById(struct afscp_cell *thecell, afsUUID * u)
     ret->naddrs = nentries;
     for (i = 0; i < nentries; i++) {
 	ret->addrs[i] = htonl(addrs.bulkaddrs_val[i]);
-	ret->conns[i] = rx_NewConnection(ret->addrs[i],
-					 htons(AFSCONF_FILEPORT),
-					 1, thecell->security,
-					 thecell->scindex);
+	ret->conns[i] = rx_NewWideConnection(ret->addrs[i],
+					     htons(AFSCONF_FILEPORT),
+					     1, thecell->security,
+					     thecell->scindex,
+					     RX_MAXWIDECALLS);
     }
     _xdr_free(_xdr_bulkaddrs, &addrs);
     thecell->nservers++;
@@ -395,10 +397,11 @@ afscp_ServerByAddr(struct afscp_cell *thecell, afs_uint32 addr)
 	memset(&ret->id, 0, sizeof(uuid));
 	ret->naddrs = 1;
 	ret->addrs[0] = htonl(addr);
-	ret->conns[0] = rx_NewConnection(ret->addrs[0],
-					 htons(AFSCONF_FILEPORT),
-					 1, thecell->security,
-					 thecell->scindex);
+	ret->conns[0] = rx_NewWideConnection(ret->addrs[0],
+					     htons(AFSCONF_FILEPORT),
+					     1, thecell->security,
+					     thecell->scindex,
+					     RX_MAXWIDECALLS);
     } else {
 	char s[512];
 
@@ -415,10 +418,11 @@ afscp_ServerByAddr(struct afscp_cell *thecell, afs_uint32 addr)
 	ret->naddrs = nentries;
 	for (i = 0; i < nentries; i++) {
 	    ret->addrs[i] = htonl(addrs.bulkaddrs_val[i]);
-	    ret->conns[i] = rx_NewConnection(ret->addrs[i],
-					     htons(AFSCONF_FILEPORT),
-					     1, thecell->security,
-					     thecell->scindex);
+	    ret->conns[i] = rx_NewWideConnection(ret->addrs[i],
+						 htons(AFSCONF_FILEPORT),
+						 1, thecell->security,
+						 thecell->scindex,
+						 RX_MAXWIDECALLS);
 	}
 	_xdr_free(_xdr_bulkaddrs, &addrs);
     }
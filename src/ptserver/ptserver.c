@@ -153,6 +153,7 @@ extern afs_int32 depthsg;
 int restricted = 0;
 int restrict_anonymous = 0;
 int rxMaxMTU = -1;
+int rxListeners = 1;
 int rxBind = 0;
 int rxkadDisableDotCheck = 0;
 
@@ -233,6 +234,7 @@ enum optionsList {
     OPT_process,
     OPT_rxbind,
     OPT_rxmaxmtu,
+    OPT_rxlisteners,
     OPT_dotted,
     OPT_transarc_logs
 };
@@ -357,6 +359,8 @@ main(int argc, char **argv)
 		        CMD_OPTIONAL, "bind only to the primary interface");
     cmd_AddParmAtOffset(opts, OPT_rxmaxmtu, "-rxmaxmtu", CMD_SINGLE,
 		        CMD_OPTIONAL, "maximum MTU for RX");
+    cmd_AddParmAtOffset(opts, OPT_rxlisteners, "-rxlisteners", CMD_SINGLE,
+		        CMD_OPTIONAL, "number of rx listener threads");
 
     /* rxkad options */
     cmd_AddParmAtOffset(opts, OPT_dotted, "-allow-dotted-principals",
@@ -455,6 +459,7 @@ main(int argc, char **argv)
     cmd_OptionAsFlag(opts, OPT_rxbind, &rxBind);
 
     cmd_OptionAsInt(opts, OPT_rxmaxmtu, &rxMaxMTU);
+    cmd_OptionAsInt(opts, OPT_rxlisteners, &rxListeners);
 
     /* rxkad options */
     cmd_OptionAsFlag(opts, OPT_dotted, &rxkadDisableDotCheck);
@@ -526,6 +531,13 @@ main(int argc, char **argv)
      * required. */
     ubik_nBuffers = 120 + /*fudge */ 40;
 
+    if (rxListeners != 1) {
+	if (rx_SetNumListeners(rxListeners) != 0) {
+	    printf("rxlisteners %d is invalid\n", rxListeners);
+	    PT_EXIT(1);
+	}
+    }
+
     if (rxBind) {
 	afs_int32 ccode;
 	if (AFSDIR_SERVER_NETRESTRICT_FILEPATH ||
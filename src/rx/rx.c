@@ -73,6 +73,7 @@ extern afs_int32 afs_termState;
 #endif /* KERNEL */
 
 #include <opr/queue.h>
+#include <opr/ffs.h>
 #include <hcrypto/rand.h>
 
 #include "rx.h"
@@ -80,6 +81,7 @@ extern afs_int32 afs_termState;
 #include "rx_atomic.h"
 #include "rx_globals.h"
 #include "rx_trace.h"
+#include "rx_tracering.h"
 #include "rx_internal.h"
 #include "rx_stats.h"
 #include "rx_event.h"
@@ -89,6 +91,7 @@ extern afs_int32 afs_termState;
 #include "rx_call.h"
 #include "rx_packet.h"
 #include "rx_server.h"
+#include "rx_cc.h"
 
 #include <afs/rxgen_consts.h>
 
@@ -111,6 +114,10 @@ static void rxi_ComputeRoundTripTime(struct rx_packet *, struct rx_ackPacket *,
 				     struct clock *);
 static void rxi_Resend(struct rxevent *event, void *arg0, void *arg1,
 		       int istack);
+static void rxi_LossProbe(struct rxevent *event, void *arg0, void *arg1,
+			  int istack);
+static void rxi_ReorderTimeout(struct rxevent *event, void *arg0, void *arg1,
+			       int istack);
 static void rxi_SendDelayedAck(struct rxevent *event, void *call,
                                void *dummy, int dummy2);
 static void rxi_SendDelayedCallAbort(struct rxevent *event, void *arg1,
@@ -159,6 +166,7 @@ static void rxi_CancelKeepAliveEvent(struct rx_call *call);
 static void rxi_CancelDelayedAbortEvent(struct rx_call *call);
 static void rxi_CancelGrowMTUEvent(struct rx_call *call);
 static void update_nextCid(void);
+static void rxi_FreePeerRpcStats(struct rx_peer *peer);
 
 #ifdef RX_ENABLE_LOCKS
 struct rx_tq_debug {
@@ -186,34 +194,34 @@ struct clock rx_lastAckDelay = {0, 400000};
  */
 struct clock rx_softAckDelay = {0, 100000};
 
-/*
- * rxi_rpc_peer_stat_cnt counts the total number of peer stat structures
- * currently allocated within rx.  This number is used to allocate the
- * memory required to return the statistics when queried.
- * Protected by the rx_rpc_stats mutex.
- */
-
-static unsigned int rxi_rpc_peer_stat_cnt;
-
-/*
- * rxi_rpc_process_stat_cnt counts the total number of local process stat
- * structures currently allocated within rx.  The number is used to allocate
- * the memory required to return the statistics when queried.
- * Protected by the rx_rpc_stats mutex.
- */
-
-static unsigned int rxi_rpc_process_stat_cnt;
-
 rx_atomic_t rx_nWaiting = RX_ATOMIC_INIT(0);
 rx_atomic_t rx_nWaited = RX_ATOMIC_INIT(0);
 
-/* Incoming calls wait on this queue when there are no available
- * server processes */
-struct opr_queue rx_incomingCallQueue;
+/* Incoming calls wait on a call queue when there are no available server
+ * processes, and server processes wait on one when there are no appropriate
+ * calls to process. There are as many call queues as listeners, so that
+ * listeners and server threads don't all contend for one lock; calls are
+ * spread across them by connection. Each server
+ * process has a home queue, on which it waits; when its own queue is empty,
+ * it takes ("steals") calls from the others.
+ *
+ * Calls are placed on a queue by rxi_AttachServerProc, and server processes
+ * by rx_GetCall. A call is only queued when no server process was idle on
+ * any queue, and a server process only goes idle when there was no call on
+ * any queue, so each side checks the other queues after adding to its own:
+ * a server process by looking for calls, and a call by waking an idle
+ * process to look for it. */
+struct rx_callQueue {
+#ifdef RX_ENABLE_LOCKS
+    afs_kmutex_t lock;
+#endif
+    struct opr_queue calls[RX_NPRIORITIES];	/* waiting calls, by priority */
+    struct opr_queue idle;	/* idle server processes */
+    afs_uint32 nStolen;		/* calls taken by processes from elsewhere */
+};
 
-/* Server processes wait on this queue when there are no appropriate
- * calls to process */
-struct opr_queue rx_idleServerQueue;
+struct rx_callQueue *rx_callQueues;
+static int rx_nCallQueues;
 
 #if !defined(offsetof)
 #include <stddef.h>		/* for definition of offsetof() */
@@ -262,10 +270,13 @@ static afs_kmutex_t epoch_mutex;
 static afs_kmutex_t rx_init_mutex;
 static afs_kmutex_t rx_debug_mutex;
 static afs_kmutex_t rx_rpc_stats;
+static afs_kmutex_t rx_nextCid_lock;
 
 static void
 rxi_InitPthread(void)
 {
+    int i;
+
     MUTEX_INIT(&rx_quota_mutex, "quota", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&rx_pthread_mutex, "pthread", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&rx_packets_mutex, "packets", MUTEX_DEFAULT, 0);
@@ -273,10 +284,16 @@ rxi_InitPthread(void)
 #ifndef KERNEL
     MUTEX_INIT(&rx_clock_mutex, "clock", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&rxi_connCacheMutex, "conn cache", MUTEX_DEFAULT, 0);
+    MUTEX_INIT(&rxi_traceMutex, "trace", MUTEX_DEFAULT, 0);
+    MUTEX_INIT(&rxi_impairMutex, "impair", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&event_handler_mutex, "event handler", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&listener_mutex, "listener", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&rx_if_init_mutex, "if init", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&rx_if_mutex, "if", MUTEX_DEFAULT, 0);
+#endif
+#ifdef RX_ENABLE_FILEMAP
+    MUTEX_INIT(&rxi_fileMapMutex, "file map", MUTEX_DEFAULT, 0);
+    CV_INIT(&rxi_fileMapCond, "file map", CV_DEFAULT, 0);
 #endif
     MUTEX_INIT(&rx_stats_mutex, "stats", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&rx_atomic_mutex, "atomic", MUTEX_DEFAULT, 0);
@@ -290,7 +307,11 @@ rxi_InitPthread(void)
 #endif
 
     osi_Assert(pthread_key_create(&rx_thread_id_key, NULL) == 0);
+#ifdef KERNEL
     osi_Assert(pthread_key_create(&rx_ts_info_key, NULL) == 0);
+#else
+    osi_Assert(pthread_key_create(&rx_ts_info_key, rx_ts_info_destroy) == 0);
+#endif
 
     MUTEX_INIT(&rx_rpc_stats, "rx_rpc_stats", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&rx_freePktQ_lock, "rx_freePktQ_lock", MUTEX_DEFAULT, 0);
@@ -306,11 +327,13 @@ rxi_InitPthread(void)
 	       0);
     CV_INIT(&rx_waitingForPackets_cv, "rx_waitingForPackets_cv", CV_DEFAULT,
 	    0);
-    MUTEX_INIT(&rx_peerHashTable_lock, "rx_peerHashTable_lock", MUTEX_DEFAULT,
-	       0);
-    MUTEX_INIT(&rx_connHashTable_lock, "rx_connHashTable_lock", MUTEX_DEFAULT,
-	       0);
-    MUTEX_INIT(&rx_serverPool_lock, "rx_serverPool_lock", MUTEX_DEFAULT, 0);
+    for (i = 0; i < RX_HASH_SHARDS; i++) {
+	MUTEX_INIT(&rx_peerHashTable_lock[i], "rx_peerHashTable_lock",
+		   MUTEX_DEFAULT, 0);
+	MUTEX_INIT(&rx_connHashTable_lock[i], "rx_connHashTable_lock",
+		   MUTEX_DEFAULT, 0);
+    }
+    MUTEX_INIT(&rx_nextCid_lock, "rx_nextCid_lock", MUTEX_DEFAULT, 0);
 #ifndef KERNEL
     MUTEX_INIT(&rxi_keyCreate_lock, "rxi_keyCreate_lock", MUTEX_DEFAULT, 0);
 #endif
@@ -336,6 +359,7 @@ pthread_once_t rx_once_init = PTHREAD_ONCE_INIT;
  * rxi_minDeficit
  * rxi_availProcs
  * rxi_totalMin
+ * and the nRequestsRunning field of each service.
  */
 
 /*
@@ -386,28 +410,50 @@ pthread_once_t rx_once_init = PTHREAD_ONCE_INIT;
 static afs_kmutex_t rx_rpc_stats;
 #endif
 
-/* We keep a "last conn pointer" in rxi_FindConnection. The odds are
-** pretty good that the next packet coming in is from the same connection
-** as the last packet, since we're send multiple packets in a transmit window.
+/* We keep a "last conn pointer" for each shard of the connection hash
+** table in rxi_FindConnection. The odds are pretty good that the next
+** packet coming in is from the same connection as the last packet, since
+** we're send multiple packets in a transmit window.
 */
-struct rx_connection *rxLastConn = 0;
+static struct rx_connection *rxLastConn[RX_HASH_SHARDS];
+
+/* Connections which have been destroyed, but not yet cleaned up, by shard
+ * of the connection hash table, under the shard's lock */
+static struct rx_connection *rx_connCleanup_list[RX_HASH_SHARDS];
+
+/* Entries in the connection and peer hash tables; a table is doubled in
+ * size once it holds RX_HASH_LOAD entries a bucket, up to RX_HASH_MAXSIZE
+ * buckets */
+#define RX_HASH_LOAD 2
+#define RX_HASH_MAXSIZE (1 << 20)
+static rx_atomic_t rx_connHashCount = RX_ATOMIC_INIT(0);
+static rx_atomic_t rx_peerHashCount = RX_ATOMIC_INIT(0);
+
+#define RX_HASH_SHARD(hash) ((hash) % RX_HASH_SHARDS)
+
+#ifdef RX_ENABLE_LOCKS
+static afs_kmutex_t rx_nextCid_lock;
+#endif
 
 #ifdef RX_ENABLE_LOCKS
 /* The locking hierarchy for rx fine grain locking is composed of these
  * tiers:
  *
- * rx_connHashTable_lock - synchronizes conn creation, rx_connHashTable access
- *                         also protects updates to rx_nextCid
+ * rx_connHashTable_lock[] - synchronize access to the conns in a shard of
+ *                           rx_connHashTable, and to rx_connHashTable itself
+ *                           while the table grows, when all are held
  * conn_call_lock - used to synchonize rx_EndCall and rx_NewCall
  * call->lock - locks call data fields.
  * These are independent of each other:
  *	rx_freeCallQueue_lock
  *	rxi_keyCreate_lock
- * rx_serverPool_lock
+ * rx_callQueues[].lock - no more than one is held at a time
  * freeSQEList_lock
  *
  * serverQueueEntry->lock
- * rx_peerHashTable_lock - locked under rx_connHashTable_lock
+ * rx_peerHashTable_lock[] - locked under rx_connHashTable_lock[], and
+ *                           protecting peer refCounts as well as the peers
+ *                           in a shard of rx_peerHashTable
  * rx_rpc_stats
  * peer->lock - locks peer data fields.
  * conn_data_lock - that more than one thread is not updating a conn data
@@ -421,6 +467,7 @@ struct rx_connection *rxLastConn = 0;
  *	rx_stats_mutex
  *      rx_refcnt_mutex
  *	rx_atomic_mutex
+ *	rx_nextCid_lock
  *
  * Do we need a lock to protect the peer field in the conn structure?
  *      conn->peer was previously a constant for all intents and so has no
@@ -442,6 +489,25 @@ static int rxdb_fileID = RXDB_FILE_RX;
 #endif /* RX_ENABLE_LOCKS */
 struct rx_serverQueueEntry *rx_waitForPacket = 0;
 
+/* Set up a call queue for each listener. rx_nListeners may not change once
+ * rx has been initialized. */
+static void
+rxi_InitCallQueues(void)
+{
+    struct rx_callQueue *cq;
+    int i;
+
+    rx_nCallQueues = rx_nListeners;
+    rx_callQueues = osi_Alloc(rx_nCallQueues * sizeof(struct rx_callQueue));
+    for (cq = rx_callQueues; cq < rx_callQueues + rx_nCallQueues; cq++) {
+	MUTEX_INIT(&cq->lock, "rx_callQueue lock", MUTEX_DEFAULT, 0);
+	for (i = 0; i < RX_NPRIORITIES; i++)
+	    opr_queue_Init(&cq->calls[i]);
+	opr_queue_Init(&cq->idle);
+	cq->nStolen = 0;
+    }
+}
+
 /* ------------Exported Interfaces------------- */
 
 /* Initialize rx.  A port number may be mentioned, in which case this
@@ -511,11 +577,17 @@ rx_InitHost(u_int host, u_int port)
 	       0);
     CV_INIT(&rx_waitingForPackets_cv, "rx_waitingForPackets_cv", CV_DEFAULT,
 	    0);
-    MUTEX_INIT(&rx_peerHashTable_lock, "rx_peerHashTable_lock", MUTEX_DEFAULT,
-	       0);
-    MUTEX_INIT(&rx_connHashTable_lock, "rx_connHashTable_lock", MUTEX_DEFAULT,
-	       0);
-    MUTEX_INIT(&rx_serverPool_lock, "rx_serverPool_lock", MUTEX_DEFAULT, 0);
+    {
+	int i;
+
+	for (i = 0; i < RX_HASH_SHARDS; i++) {
+	    MUTEX_INIT(&rx_peerHashTable_lock[i], "rx_peerHashTable_lock",
+		       MUTEX_DEFAULT, 0);
+	    MUTEX_INIT(&rx_connHashTable_lock[i], "rx_connHashTable_lock",
+		       MUTEX_DEFAULT, 0);
+	}
+    }
+    MUTEX_INIT(&rx_nextCid_lock, "rx_nextCid_lock", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&rx_mallocedPktQ_lock, "rx_mallocedPktQ_lock", MUTEX_DEFAULT,
 	       0);
 
@@ -529,12 +601,20 @@ rx_InitHost(u_int host, u_int port)
     rx_connDeadTime = 12;
     rx_tranquil = 0;		/* reset flag */
     rxi_ResetStatistics();
-    htable = osi_Alloc(rx_hashTableSize * sizeof(struct rx_connection *));
-    PIN(htable, rx_hashTableSize * sizeof(struct rx_connection *));	/* XXXXX */
-    memset(htable, 0, rx_hashTableSize * sizeof(struct rx_connection *));
-    ptable = osi_Alloc(rx_hashTableSize * sizeof(struct rx_peer *));
-    PIN(ptable, rx_hashTableSize * sizeof(struct rx_peer *));	/* XXXXX */
-    memset(ptable, 0, rx_hashTableSize * sizeof(struct rx_peer *));
+    /* The hash tables start at a power of two, with a bucket or more for
+     * each shard */
+    for (rx_connHashTableSize = RX_HASH_SHARDS;
+	 rx_connHashTableSize < rx_hashTableSize
+	 && rx_connHashTableSize < RX_HASH_MAXSIZE;
+	 rx_connHashTableSize <<= 1)
+	;
+    rx_peerHashTableSize = rx_connHashTableSize;
+    htable = osi_Alloc(rx_connHashTableSize * sizeof(struct rx_connection *));
+    PIN(htable, rx_connHashTableSize * sizeof(struct rx_connection *));	/* XXXXX */
+    memset(htable, 0, rx_connHashTableSize * sizeof(struct rx_connection *));
+    ptable = osi_Alloc(rx_peerHashTableSize * sizeof(struct rx_peer *));
+    PIN(ptable, rx_peerHashTableSize * sizeof(struct rx_peer *));	/* XXXXX */
+    memset(ptable, 0, rx_peerHashTableSize * sizeof(struct rx_peer *));
 
     /* Malloc up a bunch of packets & buffers */
     rx_nFreePackets = 0;
@@ -581,7 +661,7 @@ rx_InitHost(u_int host, u_int port)
 #endif
 	if (getsockname((intptr_t)rx_socket, (struct sockaddr *)&addr, &addrlen)) {
 	    rx_Finalize();
-	    osi_Free(htable, rx_hashTableSize * sizeof(struct rx_connection *));
+	    osi_Free(htable, rx_connHashTableSize * sizeof(struct rx_connection *));
 	    return -1;
 	}
 	rx_port = addr.sin_port;
@@ -607,10 +687,12 @@ rx_InitHost(u_int host, u_int port)
     rx_hardAckDelay.usec = 100000;	/* 100 milliseconds */
 
     rxevent_Init(20, rxi_ReScheduleEvents);
+#ifdef RX_ENABLE_IMPAIR
+    rxi_ImpairInit();
+#endif
 
     /* Initialize various global queues */
-    opr_queue_Init(&rx_idleServerQueue);
-    opr_queue_Init(&rx_incomingCallQueue);
+    rxi_InitCallQueues();
     opr_queue_Init(&rx_freeCallQueue);
 
 #if defined(AFS_NT40_ENV) && !defined(KERNEL)
@@ -658,7 +740,8 @@ rx_Init(u_int port)
 static_inline void
 rxi_rto_startTimer(struct rx_call *call, int lastPacket, int istack)
 {
-    struct clock now, retryTime;
+    struct clock now, retryTime, probeTime;
+    void (*func) (struct rxevent *, void *, void *, int) = rxi_Resend;
 
     clock_GetTime(&now);
     retryTime = now;
@@ -668,11 +751,24 @@ rxi_rto_startTimer(struct rx_call *call, int lastPacket, int istack)
     /* If we're sending the last packet, and we're the client, then the server
      * may wait for an additional 400ms before returning the ACK, wait for it
      * rather than hitting a timeout */
-    if (lastPacket && call->conn->type == RX_CLIENT_CONNECTION)
+    if (lastPacket && call->conn->type == RX_CLIENT_CONNECTION) {
 	clock_Addmsec(&retryTime, 400);
+    } else if (call->rtt > 0 && !(call->flags & RX_CALL_PROBE_SENT)) {
+	/* If nothing is heard for two round trips, plus the time the peer
+	 * may delay its ACK, send a tail loss probe, unless the retransmit
+	 * timer would go off first anyway */
+	probeTime = now;
+	clock_Add(&probeTime,
+		  lastPacket ? &rx_lastAckDelay : &rx_softAckDelay);
+	clock_Addmsec(&probeTime, call->rtt >> 2);
+	if (clock_Lt(&probeTime, &retryTime)) {
+	    retryTime = probeTime;
+	    func = rxi_LossProbe;
+	}
+    }
 
     CALL_HOLD(call, RX_CALL_REFCOUNT_RESEND);
-    call->resendEvent = rxevent_Post(&retryTime, &now, rxi_Resend,
+    call->resendEvent = rxevent_Post(&retryTime, &now, func,
 				     call, NULL, istack);
 }
 
@@ -754,6 +850,155 @@ rxi_rto_packet_acked(struct rx_call *call, int istack)
     }
 }
 
+/* Loss Detection
+ * --------------
+ *
+ * Packets are declared lost by comparing the times at which they were sent,
+ * in the style of RACK (RFC8985), rather than by counting negative
+ * acknowledgements. Whenever an ACK arrives, we note when the most recently
+ * sent of the packets it newly acknowledges was sent. Any packet which was
+ * sent before that one, and is still outstanding a round trip plus a
+ * reordering allowance after it was sent, has been lost.
+ *
+ * If a packet is still within its reordering allowance, the reorder timer
+ * checks it again once the allowance has run out. The reorder timer and
+ * the tail loss probe share the call's resendEvent with the RTO timer.
+ */
+
+/*!
+ * Tell the loss detector that a packet has been acknowledged for the first
+ * time.
+ *
+ * @param[in] call
+ * 	the RX call that the packet was sent on
+ * @param[in] p
+ * 	the packet which has been acknowledged
+ * @param[in] now
+ * 	the time at which the ACK was received
+ *
+ * @pre call must be locked before calling this function
+ */
+static_inline void
+rxi_rack_packet_acked(struct rx_call *call, struct rx_packet *p,
+		      struct clock *now)
+{
+    struct clock rtt;
+
+    rtt = *now;
+    clock_Sub(&rtt, &p->timeSent);
+
+    /* If a retransmitted packet is acknowledged within half a round trip
+     * of being resent, the ACK was most likely for an earlier copy, which
+     * we no longer have a send time for. */
+    if (!clock_Eq(&p->timeSent, &p->firstSent)
+	&& MSEC(&rtt) < (call->rtt >> 4))
+	return;
+
+    if (clock_Gt(&p->timeSent, &call->rackSent)
+	|| (clock_Eq(&p->timeSent, &call->rackSent)
+	    && p->header.seq > call->rackSeq)) {
+	call->rackSent = p->timeSent;
+	call->rackSeq = p->header.seq;
+	call->rackRtt = rtt;
+    }
+}
+
+/*!
+ * Find the packets on a call which have been lost.
+ *
+ * Lost packets have their RX_PKTFLAG_SENT flag cleared, so that rxi_Start
+ * will send them again.
+ *
+ * @param[in] call
+ * 	the RX call to check
+ * @param[in] now
+ * 	the current time
+ * @param[out] reorderTime
+ * 	set to the time at which the next packet which is still within its
+ * 	reordering allowance should be checked again, or to zero if there
+ * 	is none
+ *
+ * @return
+ * 	the number of lost packets which were sent after the congestion
+ * 	window was last reduced
+ *
+ * @pre call must be locked before calling this function
+ */
+static int
+rxi_rack_DetectLoss(struct rx_call *call, struct clock *now,
+		    struct clock *reorderTime)
+{
+    struct opr_queue *cursor;
+    struct clock deadline;
+    int reorderWindow;
+    int lost = 0;
+
+    clock_Zero(reorderTime);
+    if (clock_IsZero(&call->rackSent))
+	return 0;
+
+    /* Allow a quarter of the smoothed round trip time for reordering */
+    reorderWindow = MAX(call->rtt >> 5, 1);
+
+    for (opr_queue_Scan(&call->tq, cursor)) {
+	struct rx_packet *p = opr_queue_Entry(cursor, struct rx_packet, entry);
+
+	/* Packets are first sent in sequence order, so once we reach one
+	 * which was first sent after the last to be acknowledged, none of
+	 * the rest can have been sent before it */
+	if (p->header.serial == 0
+	    || (p->header.seq > call->rackSeq
+		&& clock_Ge(&p->firstSent, &call->rackSent)))
+	    break;
+
+	if (!(p->flags & RX_PKTFLAG_SENT) || (p->flags & RX_PKTFLAG_ACKED))
+	    continue;
+
+	/* Packets sent after the last one to be acknowledged may still be
+	 * in flight */
+	if (clock_Gt(&p->timeSent, &call->rackSent)
+	    || (clock_Eq(&p->timeSent, &call->rackSent)
+		&& p->header.seq > call->rackSeq))
+	    continue;
+
+	deadline = p->timeSent;
+	clock_Add(&deadline, &call->rackRtt);
+	clock_Addmsec(&deadline, reorderWindow);
+	if (clock_Le(&deadline, now)) {
+	    p->flags &= ~RX_PKTFLAG_SENT;
+	    if (clock_Gt(&p->timeSent, &call->recoverTime))
+		lost++;
+	} else if (clock_IsZero(reorderTime)
+		   || clock_Lt(&deadline, reorderTime)) {
+	    *reorderTime = deadline;
+	}
+    }
+    return lost;
+}
+
+/*!
+ * Start the reorder timer for a call, replacing any RTO timer.
+ *
+ * @param[in] call
+ * 	the RX call to start the timer for
+ * @param[in] when
+ * 	the time at which the timer should fire
+ *
+ * @pre call must be locked before calling this function
+ */
+static_inline void
+rxi_rack_startTimer(struct rx_call *call, struct clock *when, int istack)
+{
+    struct clock now;
+
+    rxi_rto_cancel(call);
+
+    clock_GetTime(&now);
+    CALL_HOLD(call, RX_CALL_REFCOUNT_RESEND);
+    call->resendEvent = rxevent_Post(when, &now, rxi_ReorderTimeout,
+				     call, NULL, istack);
+}
+
 
 /**
  * Set an initial round trip timeout for a peer connection
@@ -812,14 +1057,17 @@ rxi_CancelDelayedAckEvent(struct rx_call *call)
  * max quota, or would prevent others from reaching their min quota.
  */
 #ifdef RX_ENABLE_LOCKS
-/* This verion of QuotaOK reserves quota if it's ok while the
- * rx_serverPool_lock is held.  Return quota using ReturnToServerPool().
+/* This verion of QuotaOK reserves quota if it's ok, under the
+ * rx_quota_mutex.  Return quota using ReturnToServerPool().
  */
 static int
 QuotaOK(struct rx_service *aservice)
 {
+    MUTEX_ENTER(&rx_quota_mutex);
+
     /* check if over max quota */
     if (aservice->nRequestsRunning >= aservice->maxProcs) {
+	MUTEX_EXIT(&rx_quota_mutex);
 	return 0;
     }
 
@@ -828,7 +1076,6 @@ QuotaOK(struct rx_service *aservice)
      * to go to their min quota after this guy starts.
      */
 
-    MUTEX_ENTER(&rx_quota_mutex);
     if ((aservice->nRequestsRunning < aservice->minProcs)
 	|| (rxi_availProcs > rxi_minDeficit)) {
 	aservice->nRequestsRunning++;
@@ -848,8 +1095,8 @@ QuotaOK(struct rx_service *aservice)
 static void
 ReturnToServerPool(struct rx_service *aservice)
 {
-    aservice->nRequestsRunning--;
     MUTEX_ENTER(&rx_quota_mutex);
+    aservice->nRequestsRunning--;
     if (aservice->nRequestsRunning < aservice->minProcs)
 	rxi_minDeficit++;
     rxi_availProcs++;
@@ -999,6 +1246,124 @@ rx_StartServer(int donateMe)
     return;
 }
 
+/*
+ * Count a connection added to the connection hash table, and double the
+ * table's size if it's getting full.  Must be called without any of the
+ * connection hash locks held.
+ */
+static void
+rxi_ConnHashAdded(void)
+{
+    struct rx_connection **table, **old, *conn, *next;
+    afs_uint32 size, oldSize, i, hash;
+
+    oldSize = rx_connHashTableSize;
+    if (rx_atomic_inc_and_read(&rx_connHashCount) <= oldSize * RX_HASH_LOAD
+	|| oldSize >= RX_HASH_MAXSIZE)
+	return;
+
+    size = oldSize * 2;
+    table = osi_Alloc(size * sizeof(struct rx_connection *));
+    if (table == NULL)
+	return;
+    PIN(table, size * sizeof(struct rx_connection *));
+    memset(table, 0, size * sizeof(struct rx_connection *));
+
+    for (i = 0; i < RX_HASH_SHARDS; i++)
+	MUTEX_ENTER(&rx_connHashTable_lock[i]);
+    if (rx_connHashTableSize != oldSize) {
+	/* Someone else has grown it already */
+	old = table;
+	oldSize = size;
+    } else {
+	old = rx_connHashTable;
+	for (i = 0; i < oldSize; i++) {
+	    for (conn = old[i]; conn; conn = next) {
+		next = conn->next;
+		hash = CONN_HASH(0, 0, conn->cid, 0, 0);
+		conn->next = table[hash & (size - 1)];
+		table[hash & (size - 1)] = conn;
+	    }
+	}
+	rx_connHashTable = table;
+	rx_connHashTableSize = size;
+    }
+    for (i = RX_HASH_SHARDS; i > 0; i--)
+	MUTEX_EXIT(&rx_connHashTable_lock[i - 1]);
+
+    UNPIN(old, oldSize * sizeof(struct rx_connection *));
+    osi_Free(old, oldSize * sizeof(struct rx_connection *));
+}
+
+/*
+ * Count a peer added to the peer hash table, and double the table's size
+ * if it's getting full.  Must be called without any of the peer hash locks
+ * held.
+ */
+static void
+rxi_PeerHashAdded(void)
+{
+    struct rx_peer **table, **old, *peer, *next;
+    afs_uint32 size, oldSize, i, hash;
+
+    oldSize = rx_peerHashTableSize;
+    if (rx_atomic_inc_and_read(&rx_peerHashCount) <= oldSize * RX_HASH_LOAD
+	|| oldSize >= RX_HASH_MAXSIZE)
+	return;
+
+    size = oldSize * 2;
+    table = osi_Alloc(size * sizeof(struct rx_peer *));
+    if (table == NULL)
+	return;
+    PIN(table, size * sizeof(struct rx_peer *));
+    memset(table, 0, size * sizeof(struct rx_peer *));
+
+    for (i = 0; i < RX_HASH_SHARDS; i++)
+	MUTEX_ENTER(&rx_peerHashTable_lock[i]);
+    if (rx_peerHashTableSize != oldSize) {
+	/* Someone else has grown it already */
+	old = table;
+	oldSize = size;
+    } else {
+	old = rx_peerHashTable;
+	for (i = 0; i < oldSize; i++) {
+	    for (peer = old[i]; peer; peer = next) {
+		next = peer->next;
+		hash = PEER_HASH(peer->host, peer->port);
+		peer->next = table[hash & (size - 1)];
+		table[hash & (size - 1)] = peer;
+	    }
+	}
+	rx_peerHashTable = table;
+	rx_peerHashTableSize = size;
+    }
+    for (i = RX_HASH_SHARDS; i > 0; i--)
+	MUTEX_EXIT(&rx_peerHashTable_lock[i - 1]);
+
+    UNPIN(old, oldSize * sizeof(struct rx_peer *));
+    osi_Free(old, oldSize * sizeof(struct rx_peer *));
+}
+
+/*
+ * Remove a peer from the peer hash table.  The caller holds the lock for
+ * the peer's shard.
+ */
+static void
+rxi_UnhashPeer(struct rx_peer *peer)
+{
+    struct rx_peer **peer_ptr;
+
+    for (peer_ptr = &rx_peerHashTable[PEER_BUCKET(PEER_HASH(peer->host,
+							     peer->port))];
+	 *peer_ptr; peer_ptr = &(*peer_ptr)->next) {
+	if (*peer_ptr == peer) {
+	    *peer_ptr = peer->next;
+	    rx_atomic_dec(&rx_peerHashCount);
+	    break;
+	}
+    }
+}
+
 /* Create a new client connection to the specified service, using the
  * specified security object to implement the security model for this
  * connection. */
@@ -1007,7 +1372,8 @@ rx_NewConnection(afs_uint32 shost, u_short sport, u_short sservice,
 		 struct rx_securityClass *securityObject,
 		 int serviceSecurityIndex)
 {
-    int hashindex, i;
+    afs_uint32 hash;
+    int i;
     struct rx_connection *conn;
 
     SPLVAR;
@@ -1027,11 +1393,12 @@ rx_NewConnection(afs_uint32 shost, u_short sport, u_short sservice,
     CV_INIT(&conn->conn_call_cv, "conn call cv", CV_DEFAULT, 0);
 #endif
     NETPRI;
-    MUTEX_ENTER(&rx_connHashTable_lock);
-    conn->type = RX_CLIENT_CONNECTION;
-    conn->epoch = rx_epoch;
+    MUTEX_ENTER(&rx_nextCid_lock);
     conn->cid = rx_nextCid;
     update_nextCid();
+    MUTEX_EXIT(&rx_nextCid_lock);
+    conn->type = RX_CLIENT_CONNECTION;
+    conn->epoch = rx_epoch;
     conn->peer = rxi_FindPeer(shost, sport, 1);
     conn->serviceId = sservice;
     conn->securityObject = securityObject;
@@ -1053,19 +1420,117 @@ rx_NewConnection(afs_uint32 shost, u_short sport, u_short sservice,
     }
 
     RXS_NewConnection(securityObject, conn);
-    hashindex =
+    hash =
 	CONN_HASH(shost, sport, conn->cid, conn->epoch, RX_CLIENT_CONNECTION);
 
     conn->refCount++;		/* no lock required since only this thread knows... */
-    conn->next = rx_connHashTable[hashindex];
-    rx_connHashTable[hashindex] = conn;
+    MUTEX_ENTER(CONN_HASH_LOCK(hash));
+    conn->next = rx_connHashTable[CONN_BUCKET(hash)];
+    rx_connHashTable[CONN_BUCKET(hash)] = conn;
+    MUTEX_EXIT(CONN_HASH_LOCK(hash));
     if (rx_stats_active)
 	rx_atomic_inc(&rx_stats.nClientConns);
-    MUTEX_EXIT(&rx_connHashTable_lock);
     USERPRI;
+    rxi_ConnHashAdded();
+    return conn;
+}
+
+/*
+ * Create a new client connection which can have up to nchannels calls in
+ * progress at once, rather than RX_MAXCALLS.  On the wire, each group of
+ * RX_MAXCALLS channels past the first is an ordinary connection to the
+ * same service, with the same security object; these are made as
+ * rx_NewCall needs them, and destroyed along with this one.  Nothing new
+ * is asked of the server, so any peer will do.
+ */
+struct rx_connection *
+rx_NewWideConnection(afs_uint32 shost, u_short sport, u_short sservice,
+		     struct rx_securityClass *securityObject,
+		     int serviceSecurityIndex, int nchannels)
+{
+    struct rx_connection *conn;
+    int groups;
+
+    conn = rx_NewConnection(shost, sport, sservice, securityObject,
+			    serviceSecurityIndex);
+    if (nchannels > RX_MAXWIDECALLS)
+	nchannels = RX_MAXWIDECALLS;
+    groups = (nchannels + RX_MAXCALLS - 1) / RX_MAXCALLS - 1;
+    if (groups > 0) {
+	conn->wideConns = rxi_Alloc(groups * sizeof(*conn->wideConns));
+	conn->maxWideConns = groups;
+	conn->wideCid = conn->cid;
+    }
     return conn;
 }
 
+/*
+ * Make another connection to carry the channels of a wide connection,
+ * unless it has all it may have.
+ */
+static struct rx_connection *
+rxi_NewWideGroup(struct rx_connection *conn)
+{
+    struct rx_connection *tconn;
+    afs_int32 natPing;
+
+    MUTEX_ENTER(&conn->conn_data_lock);
+    if (conn->nWideConns >= conn->maxWideConns) {
+	MUTEX_EXIT(&conn->conn_data_lock);
+	return NULL;
+    }
+    MUTEX_EXIT(&conn->conn_data_lock);
+
+    /* Connections can't be made under conn_data_lock, since destroying
+     * them takes the locks in the other order. */
+    tconn = rx_NewConnection(conn->peer->host, conn->peer->port,
+			     conn->serviceId, conn->securityObject,
+			     conn->securityIndex);
+    tconn->secondsUntilDead = conn->secondsUntilDead;
+    tconn->secondsUntilPing = conn->secondsUntilPing;
+    tconn->hardDeadTime = conn->hardDeadTime;
+    tconn->idleDeadTime = conn->idleDeadTime;
+    tconn->wideCid = conn->cid;
+
+    MUTEX_ENTER(&conn->conn_data_lock);
+    if (conn->nWideConns >= conn->maxWideConns) {
+	/* Another thread got there first */
+	MUTEX_EXIT(&conn->conn_data_lock);
+	rx_DestroyConnection(tconn);
+	return NULL;
+    }
+    tconn->wideGroup = conn->nWideConns + 1;
+    conn->wideConns[conn->nWideConns++] = tconn;
+    natPing = conn->secondsUntilNatPing;
+    MUTEX_EXIT(&conn->conn_data_lock);
+
+    if (natPing != 0)
+	rx_SetConnSecondsUntilNatPing(tconn, natPing);
+    return tconn;
+}
+
+/*
+ * Pass a wide connection's timeouts on to the connections carrying its
+ * further channels.
+ */
+static void
+rxi_SetWideConnTimeouts(struct rx_connection *conn)
+{
+    struct rx_connection *tconn;
+    int i, n;
+
+    MUTEX_ENTER(&conn->conn_data_lock);
+    n = conn->nWideConns;
+    MUTEX_EXIT(&conn->conn_data_lock);
+    for (i = 0; i < n; i++) {
+	tconn = conn->wideConns[i];
+	tconn->secondsUntilDead = conn->secondsUntilDead;
+	tconn->secondsUntilPing = conn->secondsUntilPing;
+	tconn->hardDeadTime = conn->hardDeadTime;
+	tconn->idleDeadTime = conn->idleDeadTime;
+    }
+}
+
 /**
  * Ensure a connection's timeout values are valid.
  *
@@ -1107,6 +1572,8 @@ rx_SetConnDeadTime(struct rx_connection *conn, int seconds)
     conn->secondsUntilDead = seconds;
     rxi_CheckConnTimeouts(conn);
     conn->secondsUntilPing = conn->secondsUntilDead / 6;
+    if (conn->maxWideConns)
+	rxi_SetWideConnTimeouts(conn);
 }
 
 void
@@ -1114,6 +1581,8 @@ rx_SetConnHardDeadTime(struct rx_connection *conn, int seconds)
 {
     conn->hardDeadTime = seconds;
     rxi_CheckConnTimeouts(conn);
+    if (conn->maxWideConns)
+	rxi_SetWideConnTimeouts(conn);
 }
 
 void
@@ -1121,6 +1590,8 @@ rx_SetConnIdleDeadTime(struct rx_connection *conn, int seconds)
 {
     conn->idleDeadTime = seconds;
     rxi_CheckConnTimeouts(conn);
+    if (conn->maxWideConns)
+	rxi_SetWideConnTimeouts(conn);
 }
 
 int rxi_lowPeerRefCount = 0;
@@ -1128,11 +1599,13 @@ int rxi_lowConnRefCount = 0;
 
 /*
  * Cleanup a connection that was destroyed in rxi_DestroyConnectioNoLock.
- * NOTE: must not be called with rx_connHashTable_lock held.
+ * NOTE: must not be called with any rx_connHashTable_lock held.
  */
 static void
 rxi_CleanupConnection(struct rx_connection *conn)
 {
+    struct rx_peer *peer = conn->peer;
+
     /* Notify the service exporter, if requested, that this connection
      * is being destroyed */
     if (conn->type == RX_SERVER_CONNECTION && conn->service->destroyConnProc)
@@ -1141,15 +1614,26 @@ rxi_CleanupConnection(struct rx_connection *conn)
     /* Notify the security module that this connection is being destroyed */
     RXS_DestroyConnection(conn->securityObject, conn);
 
+    /* A wide connection takes the connections carrying its further
+     * channels with it */
+    if (conn->wideConns) {
+	int i;
+	for (i = 0; i < conn->nWideConns; i++)
+	    rxi_DestroyConnection(conn->wideConns[i]);
+	rxi_Free(conn->wideConns,
+		 conn->maxWideConns * sizeof(*conn->wideConns));
+	conn->wideConns = NULL;
+    }
+
     /* If this is the last connection using the rx_peer struct, set its
      * idle time to now. rxi_ReapConnections will reap it if it's still
      * idle (refCount == 0) after rx_idlePeerTime (60 seconds) have passed.
      */
-    MUTEX_ENTER(&rx_peerHashTable_lock);
-    if (conn->peer->refCount < 2) {
-	conn->peer->idleWhen = clock_Sec();
-	if (conn->peer->refCount < 1) {
-	    conn->peer->refCount = 1;
+    MUTEX_ENTER(PEER_HASH_LOCK(PEER_HASH(peer->host, peer->port)));
+    if (peer->refCount < 2) {
+	peer->idleWhen = clock_Sec();
+	if (peer->refCount < 1) {
+	    peer->refCount = 1;
             if (rx_stats_active) {
                 MUTEX_ENTER(&rx_stats_mutex);
                 rxi_lowPeerRefCount++;
@@ -1157,8 +1641,8 @@ rxi_CleanupConnection(struct rx_connection *conn)
             }
 	}
     }
-    conn->peer->refCount--;
-    MUTEX_EXIT(&rx_peerHashTable_lock);
+    peer->refCount--;
+    MUTEX_EXIT(PEER_HASH_LOCK(PEER_HASH(peer->host, peer->port)));
 
     if (rx_stats_active)
     {
@@ -1188,21 +1672,43 @@ rxi_CleanupConnection(struct rx_connection *conn)
     rxi_FreeConnection(conn);
 }
 
+#ifdef RX_ENABLE_LOCKS
+/* Clean up the connections destroyed in one shard of the connection hash
+ * table.  The caller holds the shard's lock, which is dropped and regained
+ * around each. */
+static void
+rxi_CleanupConnections(int shard)
+{
+    struct rx_connection *conn;
+
+    while (rx_connCleanup_list[shard]) {
+	conn = rx_connCleanup_list[shard];
+	rx_connCleanup_list[shard] = conn->next;
+	MUTEX_EXIT(&rx_connHashTable_lock[shard]);
+	rxi_CleanupConnection(conn);
+	MUTEX_ENTER(&rx_connHashTable_lock[shard]);
+    }
+}
+#endif /* RX_ENABLE_LOCKS */
+
 /* Destroy the specified connection */
 void
 rxi_DestroyConnection(struct rx_connection *conn)
 {
-    MUTEX_ENTER(&rx_connHashTable_lock);
+    afs_uint32 hash = CONN_HASH(0, 0, conn->cid, conn->epoch, conn->type);
+    int shard = RX_HASH_SHARD(hash);
+
+    MUTEX_ENTER(CONN_HASH_LOCK(hash));
     rxi_DestroyConnectionNoLock(conn);
     /* conn should be at the head of the cleanup list */
-    if (conn == rx_connCleanup_list) {
-	rx_connCleanup_list = rx_connCleanup_list->next;
-	MUTEX_EXIT(&rx_connHashTable_lock);
+    if (conn == rx_connCleanup_list[shard]) {
+	rx_connCleanup_list[shard] = conn->next;
+	MUTEX_EXIT(CONN_HASH_LOCK(hash));
 	rxi_CleanupConnection(conn);
     }
 #ifdef RX_ENABLE_LOCKS
     else {
-	MUTEX_EXIT(&rx_connHashTable_lock);
+	MUTEX_EXIT(CONN_HASH_LOCK(hash));
     }
 #endif /* RX_ENABLE_LOCKS */
 }
@@ -1211,6 +1717,7 @@ static void
 rxi_DestroyConnectionNoLock(struct rx_connection *conn)
 {
     struct rx_connection **conn_ptr;
+    afs_uint32 hash;
     int havecalls = 0;
     struct rx_packet *packet;
     int i;
@@ -1315,20 +1822,20 @@ rxi_DestroyConnectionNoLock(struct rx_connection *conn)
     }
 
     /* Remove from connection hash table before proceeding */
-    conn_ptr =
-	&rx_connHashTable[CONN_HASH
-			  (peer->host, peer->port, conn->cid, conn->epoch,
-			   conn->type)];
-    for (; *conn_ptr; conn_ptr = &(*conn_ptr)->next) {
+    hash = CONN_HASH(peer->host, peer->port, conn->cid, conn->epoch,
+		     conn->type);
+    for (conn_ptr = &rx_connHashTable[CONN_BUCKET(hash)]; *conn_ptr;
+	 conn_ptr = &(*conn_ptr)->next) {
 	if (*conn_ptr == conn) {
 	    *conn_ptr = conn->next;
+	    rx_atomic_dec(&rx_connHashCount);
 	    break;
 	}
     }
     /* if the conn that we are destroying was the last connection, then we
      * clear rxLastConn as well */
-    if (rxLastConn == conn)
-	rxLastConn = 0;
+    if (rxLastConn[RX_HASH_SHARD(hash)] == conn)
+	rxLastConn[RX_HASH_SHARD(hash)] = 0;
 
     /* Make sure the connection is completely reset before deleting it. */
     /* get rid of pending events that could zap us later */
@@ -1340,8 +1847,8 @@ rxi_DestroyConnectionNoLock(struct rx_connection *conn)
      * need to be cleaned up. This is necessary to avoid deadlocks
      * in the routines we call to inform others that this connection is
      * being destroyed. */
-    conn->next = rx_connCleanup_list;
-    rx_connCleanup_list = conn;
+    conn->next = rx_connCleanup_list[RX_HASH_SHARD(hash)];
+    rx_connCleanup_list[RX_HASH_SHARD(hash)] = conn;
 }
 
 /* Externally available version */
@@ -1400,29 +1907,23 @@ rxi_WakeUpTransmitQueue(struct rx_call *call)
     }
 }
 
-/* Start a new rx remote procedure call, on the specified connection.
- * If wait is set to 1, wait for a free call channel; otherwise return
- * 0.  Maxtime gives the maximum number of seconds this call may take,
- * after rx_NewCall returns.  After this time interval, a call to any
- * of rx_SendData, rx_ReadData, etc. will fail with RX_CALL_TIMEOUT.
+/* Start a new rx remote procedure call, on one of the specified
+ * connection's channels.  Unless nowait is set, wait for a free call
+ * channel; otherwise return NULL if there isn't one to be had at once.
  * For fine grain locking, we hold the conn_call_lock in order to
  * to ensure that we don't get signalle after we found a call in an active
  * state and before we go to sleep.
  */
-struct rx_call *
-rx_NewCall(struct rx_connection *conn)
+static struct rx_call *
+rxi_NewCallOnConn(struct rx_connection *conn, int nowait,
+		  struct clock *queueTime)
 {
     int i, wait, ignoreBusy = 1;
     struct rx_call *call;
-    struct clock queueTime;
     afs_uint32 leastBusy = 0;
     SPLVAR;
 
-    clock_NewTime();
-    dpf(("rx_NewCall(conn %"AFS_PTR_FMT")\n", conn));
-
     NETPRI;
-    clock_GetTime(&queueTime);
     /*
      * Check if there are others waiting for a new call.
      * If so, let them go first to avoid starving them.
@@ -1441,6 +1942,13 @@ rx_NewCall(struct rx_connection *conn)
     MUTEX_ENTER(&conn->conn_call_lock);
     MUTEX_ENTER(&conn->conn_data_lock);
     while (conn->flags & RX_CONN_MAKECALL_ACTIVE) {
+	if (nowait) {
+	    /* Whoever is active has first claim on any free channel */
+	    MUTEX_EXIT(&conn->conn_data_lock);
+	    MUTEX_EXIT(&conn->conn_call_lock);
+	    USERPRI;
+	    return NULL;
+	}
         conn->flags |= RX_CONN_MAKECALL_WAITING;
 	conn->makeCallWaiters++;
         MUTEX_EXIT(&conn->conn_data_lock);
@@ -1566,6 +2074,22 @@ rx_NewCall(struct rx_connection *conn)
 	    continue;
 	}
 
+	if (nowait) {
+	    /* Give up our turn, and let anyone who queued behind us have
+	     * theirs */
+	    MUTEX_ENTER(&conn->conn_data_lock);
+	    conn->flags &= ~RX_CONN_MAKECALL_ACTIVE;
+	    MUTEX_EXIT(&conn->conn_data_lock);
+#ifdef	RX_ENABLE_LOCKS
+	    CV_BROADCAST(&conn->conn_call_cv);
+#else
+	    osi_rxWakeup(conn);
+#endif
+	    MUTEX_EXIT(&conn->conn_call_lock);
+	    USERPRI;
+	    return NULL;
+	}
+
 	MUTEX_ENTER(&conn->conn_data_lock);
 	conn->flags |= RX_CONN_MAKECALL_WAITING;
 	conn->makeCallWaiters++;
@@ -1598,10 +2122,11 @@ rx_NewCall(struct rx_connection *conn)
 #endif
 
     /* remember start time for call in case we have hard dead time limit */
-    call->queueTime = queueTime;
+    call->queueTime = *queueTime;
     clock_GetTime(&call->startTime);
     call->app.bytesSent = 0;
     call->app.bytesRcvd = 0;
+    RXI_TRACE_CALL(RX_TRACE_CALL_START, call, conn->serviceId);
 
     /* Turn on busy protocol. */
     rxi_KeepAliveOn(call);
@@ -1633,21 +2158,64 @@ rx_NewCall(struct rx_connection *conn)
     MUTEX_EXIT(&call->lock);
     USERPRI;
 
-    dpf(("rx_NewCall(call %"AFS_PTR_FMT")\n", call));
     return call;
 }
 
-static int
-rxi_HasActiveCalls(struct rx_connection *aconn)
+/* Start a new rx remote procedure call, on the specified connection,
+ * waiting for a free call channel if need be.  A wide connection takes
+ * the first channel free in any of its connections, makes another
+ * connection if they are all busy and it may, and only then waits.
+ */
+struct rx_call *
+rx_NewCall(struct rx_connection *conn)
 {
-    int i;
-    struct rx_call *tcall;
-    SPLVAR;
+    struct rx_connection *tconn;
+    struct rx_call *call;
+    struct clock queueTime;
+    int i, n;
 
-    NETPRI;
-    for (i = 0; i < RX_MAXCALLS; i++) {
-	if ((tcall = aconn->call[i])) {
-	    if ((tcall->state == RX_STATE_ACTIVE)
+    clock_NewTime();
+    dpf(("rx_NewCall(conn %"AFS_PTR_FMT")\n", conn));
+
+    clock_GetTime(&queueTime);
+    if (conn->maxWideConns == 0) {
+	call = rxi_NewCallOnConn(conn, 0, &queueTime);
+    } else {
+	call = rxi_NewCallOnConn(conn, 1, &queueTime);
+	MUTEX_ENTER(&conn->conn_data_lock);
+	n = conn->nWideConns;
+	MUTEX_EXIT(&conn->conn_data_lock);
+	for (i = 0; call == NULL && i < n; i++)
+	    call = rxi_NewCallOnConn(conn->wideConns[i], 1, &queueTime);
+	if (call == NULL) {
+	    tconn = rxi_NewWideGroup(conn);
+	    if (tconn == NULL) {
+		/* Wait on each of the connections in turn */
+		MUTEX_ENTER(&conn->conn_data_lock);
+		n = conn->nWideConns;
+		i = conn->wideRotor++ % (n + 1);
+		MUTEX_EXIT(&conn->conn_data_lock);
+		tconn = (i == 0) ? conn : conn->wideConns[i - 1];
+	    }
+	    call = rxi_NewCallOnConn(tconn, 0, &queueTime);
+	}
+    }
+
+    dpf(("rx_NewCall(call %"AFS_PTR_FMT")\n", call));
+    return call;
+}
+
+static int
+rxi_HasActiveCalls(struct rx_connection *aconn)
+{
+    int i;
+    struct rx_call *tcall;
+    SPLVAR;
+
+    NETPRI;
+    for (i = 0; i < RX_MAXCALLS; i++) {
+	if ((tcall = aconn->call[i])) {
+	    if ((tcall->state == RX_STATE_ACTIVE)
 		|| (tcall->state == RX_STATE_PRECALL)) {
 		USERPRI;
 		return 1;
@@ -1789,6 +2357,8 @@ rx_NewServiceHost(afs_uint32 host, u_short port, u_short serviceId,
 	    service->checkReach = 0;
 	    service->nSpecific = 0;
 	    service->specific = NULL;
+	    service->priority = RX_PRIORITY_NORMAL;
+	    service->bulkPriority = RX_PRIORITY_NORMAL;
 	    rx_services[i] = service;	/* not visible until now */
 	    USERPRI;
 	    return service;
@@ -1910,11 +2480,11 @@ void
 rx_WakeupServerProcs(void)
 {
     struct rx_serverQueueEntry *np, *tqp;
+    struct rx_callQueue *cq;
     struct opr_queue *cursor;
     SPLVAR;
 
     NETPRI;
-    MUTEX_ENTER(&rx_serverPool_lock);
 
 #ifdef RX_ENABLE_LOCKS
     if (rx_waitForPacket)
@@ -1933,18 +2503,76 @@ rx_WakeupServerProcs(void)
 #endif /* RX_ENABLE_LOCKS */
     }
     MUTEX_EXIT(&freeSQEList_lock);
-    for (opr_queue_Scan(&rx_idleServerQueue, cursor)) {
-        np = opr_queue_Entry(cursor, struct rx_serverQueueEntry, entry);
+    for (cq = rx_callQueues; cq < rx_callQueues + rx_nCallQueues; cq++) {
+	MUTEX_ENTER(&cq->lock);
+	for (opr_queue_Scan(&cq->idle, cursor)) {
+	    np = opr_queue_Entry(cursor, struct rx_serverQueueEntry, entry);
 #ifdef RX_ENABLE_LOCKS
-	CV_BROADCAST(&np->cv);
+	    CV_BROADCAST(&np->cv);
 #else /* RX_ENABLE_LOCKS */
-	osi_rxWakeup(np);
+	    osi_rxWakeup(np);
 #endif /* RX_ENABLE_LOCKS */
+	}
+	MUTEX_EXIT(&cq->lock);
     }
-    MUTEX_EXIT(&rx_serverPool_lock);
     USERPRI;
 }
 
+/* Count the server processes idle and the calls waiting on all the call
+ * queues, the latter by priority class, for rxdebug. */
+void
+rxi_CallQueueStats(afs_int32 *idleThreads, afs_int32 *nQueues,
+		   afs_int32 *nQueued, afs_int32 *nStolen)
+{
+    struct rx_callQueue *cq;
+    int i;
+
+    *idleThreads = *nStolen = 0;
+    for (i = 0; i < RX_NPRIORITIES; i++)
+	nQueued[i] = 0;
+    for (cq = rx_callQueues; cq < rx_callQueues + rx_nCallQueues; cq++) {
+	MUTEX_ENTER(&cq->lock);
+	*idleThreads += opr_queue_Count(&cq->idle);
+	for (i = 0; i < RX_NPRIORITIES; i++)
+	    nQueued[i] += opr_queue_Count(&cq->calls[i]);
+	*nStolen += cq->nStolen;
+	MUTEX_EXIT(&cq->lock);
+    }
+    *nQueues = rx_nCallQueues;
+}
+
+/* The call queue on which a call waits for a server process. Calls are
+ * spread across the queues by connection, so that a call stays on the
+ * same queue however many times it is attached. */
+static struct rx_callQueue *
+rxi_CallQueueOf(struct rx_call *call)
+{
+    if (rx_nCallQueues > 1)
+	return &rx_callQueues[(call->conn->cid >> RX_CIDSHIFT)
+			      % rx_nCallQueues];
+    return rx_callQueues;
+}
+
+/* The priority class in which a call waits for a server process. The
+ * opcode of a request can't be seen until the security object has checked
+ * the packet, so calls are classed by the shape of the request instead: a
+ * request which doesn't fit in one packet is presumably sending bulk data,
+ * and isn't held up by the server as much as it holds up the server. */
+static int
+rxi_CallPriority(struct rx_call *call)
+{
+    struct rx_service *service = call->conn->service;
+    struct rx_packet *rp;
+    int priority = service->priority;
+
+    if (!opr_queue_IsEmpty(&call->rq)) {
+	rp = opr_queue_First(&call->rq, struct rx_packet, entry);
+	if (rp->header.seq != 1 || !(rp->header.flags & RX_LAST_PACKET))
+	    priority = service->bulkPriority;
+    }
+    return MIN(priority, RX_NPRIORITIES - 1);
+}
+
 /* meltdown:
  * One thing that seems to happen is that all the server threads get
  * tied up on some empty or slow call, and then a whole bunch of calls
@@ -1973,15 +2601,143 @@ rx_WakeupServerProcs(void)
  * sit on the idle server queue and are assigned by "...ReceivePacket" as soon
  * as a new call arrives.
  */
+
+/* Choose a call waiting on a call queue for a server process to run, and
+ * take it off the queue. Calls are taken from the highest priority class
+ * first, except by the fcfs thread, which starts with the class whose
+ * first call has waited longest, so that no class is starved. With
+ * RX_ENABLE_LOCKS, quota is reserved for the chosen call's service.
+ *
+ * LOCKS HELD: the call queue's lock.
+ */
+static struct rx_call *
+rxi_ChooseCall(struct rx_callQueue *cq, int tno,
+	       struct rx_service **aservice)
+{
+    struct rx_call *tcall, *call = NULL, *choice2;
+    struct rx_service *service = NULL;
+    struct opr_queue *q, *cursor;
+    int order[RX_NPRIORITIES];
+    int i, fcfs, oldest = 0;
+
+    MUTEX_ENTER(&rx_pthread_mutex);
+    fcfs = (tno == rxi_fcfs_thread_num);
+    MUTEX_EXIT(&rx_pthread_mutex);
+
+    if (fcfs) {
+	struct rx_call *first = NULL;
+
+	for (i = 0; i < RX_NPRIORITIES; i++) {
+	    if (opr_queue_IsEmpty(&cq->calls[i]))
+		continue;
+	    tcall = opr_queue_First(&cq->calls[i], struct rx_call, entry);
+	    if (!first || clock_Lt(&tcall->queueTime, &first->queueTime)) {
+		first = tcall;
+		oldest = i;
+	    }
+	}
+    }
+    order[0] = oldest;
+    for (i = 1; i < RX_NPRIORITIES; i++)
+	order[i] = (i <= oldest) ? i - 1 : i;
+
+    for (i = 0; i < RX_NPRIORITIES && !call; i++) {
+	q = &cq->calls[order[i]];
+	choice2 = NULL;
+
+	/* Scan for eligible incoming calls.  A call is not eligible
+	 * if the maximum number of calls for its service type are
+	 * already executing */
+	/* One thread will process calls FCFS (to prevent starvation),
+	 * while the other threads may run ahead looking for calls which
+	 * have all their input data available immediately.  This helps
+	 * keep threads from blocking, waiting for data from the client. */
+	for (opr_queue_Scan(q, cursor)) {
+	    tcall = opr_queue_Entry(cursor, struct rx_call, entry);
+
+	    service = tcall->conn->service;
+	    if (!QuotaOK(service)) {
+		continue;
+	    }
+	    if (fcfs || opr_queue_IsLast(q, cursor)) {
+		/* If we're the fcfs thread , then  we'll just use
+		 * this call. If we haven't been able to find an optimal
+		 * choice, and we're at the end of the list, then use a
+		 * 2d choice if one has been identified.  Otherwise... */
+		call = (choice2 ? choice2 : tcall);
+		service = call->conn->service;
+	    } else if (!opr_queue_IsEmpty(&tcall->rq)) {
+		struct rx_packet *rp;
+		rp = opr_queue_First(&tcall->rq, struct rx_packet, entry);
+		if (rp->header.seq == 1) {
+		    if (!meltdown_1pkt
+			|| (rp->header.flags & RX_LAST_PACKET)) {
+			call = tcall;
+		    } else if (rxi_2dchoice && !choice2
+			       && !(tcall->flags & RX_CALL_CLEARED)
+			       && (tcall->rprev > rxi_HardAckRate)) {
+			choice2 = tcall;
+		    } else
+			rxi_md2cnt++;
+		}
+	    }
+	    if (call) {
+		break;
+	    }
+#ifdef RX_ENABLE_LOCKS
+	    ReturnToServerPool(service);
+#endif
+	}
+    }
+
+    if (call) {
+	opr_queue_Remove(&call->entry);
+	*aservice = service;
+    }
+    return call;
+}
+
+#ifdef RX_ENABLE_LOCKS
+/* Is there a call on a call queue other than the given one which a server
+ * process could run now? */
+static int
+rxi_CallsWaitingElsewhere(struct rx_callQueue *skip)
+{
+    struct rx_callQueue *cq;
+    struct rx_call *tcall;
+    struct opr_queue *cursor;
+    int i, found = 0;
+
+    for (cq = rx_callQueues; cq < rx_callQueues + rx_nCallQueues && !found;
+	 cq++) {
+	if (cq == skip)
+	    continue;
+	MUTEX_ENTER(&cq->lock);
+	for (i = 0; i < RX_NPRIORITIES && !found; i++) {
+	    for (opr_queue_Scan(&cq->calls[i], cursor)) {
+		tcall = opr_queue_Entry(cursor, struct rx_call, entry);
+		if (QuotaOK(tcall->conn->service)) {
+		    ReturnToServerPool(tcall->conn->service);
+		    found = 1;
+		    break;
+		}
+	    }
+	}
+	MUTEX_EXIT(&cq->lock);
+    }
+    return found;
+}
+
 /* Sleep until a call arrives.  Returns a pointer to the call, ready
  * for an rx_Read. */
-#ifdef RX_ENABLE_LOCKS
 struct rx_call *
 rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
 {
     struct rx_serverQueueEntry *sq;
     struct rx_call *call = (struct rx_call *)0;
     struct rx_service *service = NULL;
+    struct rx_callQueue *home, *cq;
+    int i;
 
     MUTEX_ENTER(&freeSQEList_lock);
 
@@ -1995,119 +2751,100 @@ rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
 	CV_INIT(&sq->cv, "server Queue lock", CV_DEFAULT, 0);
     }
 
-    MUTEX_ENTER(&rx_serverPool_lock);
     if (cur_service != NULL) {
 	ReturnToServerPool(cur_service);
     }
+    home = &rx_callQueues[(unsigned int)tno % rx_nCallQueues];
     while (1) {
-	if (!opr_queue_IsEmpty(&rx_incomingCallQueue)) {
-	    struct rx_call *tcall, *choice2 = NULL;
-	    struct opr_queue *cursor;
-
-	    /* Scan for eligible incoming calls.  A call is not eligible
-	     * if the maximum number of calls for its service type are
-	     * already executing */
-	    /* One thread will process calls FCFS (to prevent starvation),
-	     * while the other threads may run ahead looking for calls which
-	     * have all their input data available immediately.  This helps
-	     * keep threads from blocking, waiting for data from the client. */
-	    for (opr_queue_Scan(&rx_incomingCallQueue, cursor)) {
-		tcall = opr_queue_Entry(cursor, struct rx_call, entry);
+	/* Take a call from our own queue if there is one, and otherwise
+	 * steal one from another. */
+	call = NULL;
+	if (rx_nCallQueues > 1) {
+	    for (i = 0; i < rx_nCallQueues && !call; i++) {
+		cq = &rx_callQueues[(home - rx_callQueues + i)
+				    % rx_nCallQueues];
+		MUTEX_ENTER(&cq->lock);
+		call = rxi_ChooseCall(cq, tno, &service);
+		if (call && cq != home)
+		    cq->nStolen++;
+		MUTEX_EXIT(&cq->lock);
+	    }
+	}
 
-		service = tcall->conn->service;
-		if (!QuotaOK(service)) {
-		    continue;
+	if (!call) {
+	    MUTEX_ENTER(&home->lock);
+	    call = rxi_ChooseCall(home, tno, &service);
+	    if (call) {
+		MUTEX_EXIT(&home->lock);
+	    } else {
+		/* If there are no eligible incoming calls, add this process
+		 * to the idle server queue, to wait for one */
+		sq->newcall = 0;
+		sq->tno = tno;
+		if (socketp) {
+		    *socketp = OSI_NULLSOCKET;
 		}
-		MUTEX_ENTER(&rx_pthread_mutex);
-		if (tno == rxi_fcfs_thread_num
-			|| opr_queue_IsEnd(&rx_incomingCallQueue, cursor)) {
-		    MUTEX_EXIT(&rx_pthread_mutex);
-		    /* If we're the fcfs thread , then  we'll just use
-		     * this call. If we haven't been able to find an optimal
-		     * choice, and we're at the end of the list, then use a
-		     * 2d choice if one has been identified.  Otherwise... */
-		    call = (choice2 ? choice2 : tcall);
-		    service = call->conn->service;
-		} else {
-		    MUTEX_EXIT(&rx_pthread_mutex);
-		    if (!opr_queue_IsEmpty(&tcall->rq)) {
-			struct rx_packet *rp;
-			rp = opr_queue_First(&tcall->rq, struct rx_packet,
-					    entry);
-			if (rp->header.seq == 1) {
-			    if (!meltdown_1pkt
-				|| (rp->header.flags & RX_LAST_PACKET)) {
-				call = tcall;
-			    } else if (rxi_2dchoice && !choice2
-				       && !(tcall->flags & RX_CALL_CLEARED)
-				       && (tcall->rprev > rxi_HardAckRate)) {
-				choice2 = tcall;
-			    } else
-				rxi_md2cnt++;
-			}
+		sq->socketp = socketp;
+		opr_queue_Append(&home->idle, &sq->entry);
+#ifndef AFS_AIX41_ENV
+		rx_waitForPacket = sq;
+#endif /* AFS_AIX41_ENV */
+		if (rx_nCallQueues > 1) {
+		    /* A call may have been queued elsewhere since we looked,
+		     * by a listener which found nobody idle here. */
+		    MUTEX_EXIT(&home->lock);
+		    i = rxi_CallsWaitingElsewhere(home);
+		    MUTEX_ENTER(&home->lock);
+		    if (i && opr_queue_IsOnQueue(&sq->entry)) {
+			opr_queue_Remove(&sq->entry);
+			MUTEX_EXIT(&home->lock);
+			continue;
 		    }
 		}
+		/* We may also be taken off the idle queue without a call,
+		 * to look for one queued elsewhere */
+		while (!(call = sq->newcall)
+		       && !(socketp && *socketp != OSI_NULLSOCKET)
+		       && opr_queue_IsOnQueue(&sq->entry)) {
+		    CV_WAIT(&sq->cv, &home->lock);
+#ifdef	KERNEL
+		    if (afs_termState == AFSOP_STOP_RXCALLBACK) {
+			MUTEX_EXIT(&home->lock);
+			return (struct rx_call *)0;
+		    }
+#endif
+		}
+		MUTEX_EXIT(&home->lock);
 		if (call) {
+		    MUTEX_ENTER(&call->lock);
 		    break;
-		} else {
-		    ReturnToServerPool(service);
 		}
+		if (socketp && *socketp != OSI_NULLSOCKET)
+		    break;
+		continue;
 	    }
 	}
 
-	if (call) {
-	    opr_queue_Remove(&call->entry);
-	    MUTEX_EXIT(&rx_serverPool_lock);
-	    MUTEX_ENTER(&call->lock);
+	MUTEX_ENTER(&call->lock);
 
-	    if (call->flags & RX_CALL_WAIT_PROC) {
-		call->flags &= ~RX_CALL_WAIT_PROC;
-		rx_atomic_dec(&rx_nWaiting);
-	    }
+	if (call->flags & RX_CALL_WAIT_PROC) {
+	    call->flags &= ~RX_CALL_WAIT_PROC;
+	    rx_atomic_dec(&rx_nWaiting);
+	}
 
-	    if (call->state != RX_STATE_PRECALL || call->error) {
-		MUTEX_EXIT(&call->lock);
-		MUTEX_ENTER(&rx_serverPool_lock);
-		ReturnToServerPool(service);
-		call = NULL;
-		continue;
-	    }
+	if (call->state != RX_STATE_PRECALL || call->error) {
+	    MUTEX_EXIT(&call->lock);
+	    ReturnToServerPool(service);
+	    call = NULL;
+	    continue;
+	}
 
-	    if (opr_queue_IsEmpty(&call->rq)
-		|| opr_queue_First(&call->rq, struct rx_packet, entry)->header.seq != 1)
-		rxi_SendAck(call, 0, 0, RX_ACK_DELAY, 0);
+	if (opr_queue_IsEmpty(&call->rq)
+	    || opr_queue_First(&call->rq, struct rx_packet, entry)->header.seq != 1)
+	    rxi_SendAck(call, 0, 0, RX_ACK_DELAY, 0);
 
-	    CLEAR_CALL_QUEUE_LOCK(call);
-	    break;
-	} else {
-	    /* If there are no eligible incoming calls, add this process
-	     * to the idle server queue, to wait for one */
-	    sq->newcall = 0;
-	    sq->tno = tno;
-	    if (socketp) {
-		*socketp = OSI_NULLSOCKET;
-	    }
-	    sq->socketp = socketp;
-	    opr_queue_Append(&rx_idleServerQueue, &sq->entry);
-#ifndef AFS_AIX41_ENV
-	    rx_waitForPacket = sq;
-#endif /* AFS_AIX41_ENV */
-	    do {
-		CV_WAIT(&sq->cv, &rx_serverPool_lock);
-#ifdef	KERNEL
-		if (afs_termState == AFSOP_STOP_RXCALLBACK) {
-		    MUTEX_EXIT(&rx_serverPool_lock);
-		    return (struct rx_call *)0;
-		}
-#endif
-	    } while (!(call = sq->newcall)
-		     && !(socketp && *socketp != OSI_NULLSOCKET));
-	    MUTEX_EXIT(&rx_serverPool_lock);
-	    if (call) {
-		MUTEX_ENTER(&call->lock);
-	    }
-	    break;
-	}
+	CLEAR_CALL_QUEUE_LOCK(call);
+	break;
     }
 
     MUTEX_ENTER(&freeSQEList_lock);
@@ -2133,6 +2870,7 @@ rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
 #endif
 
 	rxi_calltrace(RX_CALL_START, call);
+	RXI_TRACE_CALL(RX_TRACE_CALL_START, call, call->conn->serviceId);
 	dpf(("rx_GetCall(port=%d, service=%d) ==> call %"AFS_PTR_FMT"\n",
 	     call->conn->service->servicePort, call->conn->service->serviceId,
 	     call));
@@ -2146,12 +2884,16 @@ rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
     return call;
 }
 #else /* RX_ENABLE_LOCKS */
+/* Sleep until a call arrives.  Returns a pointer to the call, ready
+ * for an rx_Read. */
 struct rx_call *
 rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
 {
     struct rx_serverQueueEntry *sq;
-    struct rx_call *call = (struct rx_call *)0, *choice2;
+    struct rx_call *call = (struct rx_call *)0;
     struct rx_service *service = NULL;
+    struct rx_callQueue *home, *cq;
+    int i;
     SPLVAR;
 
     NETPRI;
@@ -2176,58 +2918,15 @@ rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
 	rxi_availProcs++;
         MUTEX_EXIT(&rx_quota_mutex);
     }
-    if (!opr_queue_IsEmpty(&rx_incomingCallQueue)) {
-	struct rx_call *tcall;
-	struct opr_queue *cursor;
-	/* Scan for eligible incoming calls.  A call is not eligible
-	 * if the maximum number of calls for its service type are
-	 * already executing */
-	/* One thread will process calls FCFS (to prevent starvation),
-	 * while the other threads may run ahead looking for calls which
-	 * have all their input data available immediately.  This helps
-	 * keep threads from blocking, waiting for data from the client. */
-	choice2 = (struct rx_call *)0;
-	for (opr_queue_Scan(&rx_incomingCallQueue, cursor)) {
-	    tcall = opr_queue_Entry(cursor, struct rx_call, entry);
-	    service = tcall->conn->service;
-	    if (QuotaOK(service)) {
-		MUTEX_ENTER(&rx_pthread_mutex);
-		/* XXX - If tcall->entry.next is NULL, then we're no longer
-		 * on a queue at all. This shouldn't happen. */
-		if (tno == rxi_fcfs_thread_num || !tcall->entry.next) {
-		    MUTEX_EXIT(&rx_pthread_mutex);
-		    /* If we're the fcfs thread, then  we'll just use
-		     * this call. If we haven't been able to find an optimal
-		     * choice, and we're at the end of the list, then use a
-		     * 2d choice if one has been identified.  Otherwise... */
-		    call = (choice2 ? choice2 : tcall);
-		    service = call->conn->service;
-		} else {
-		    MUTEX_EXIT(&rx_pthread_mutex);
-		    if (!opr_queue_IsEmpty(&tcall->rq)) {
-			struct rx_packet *rp;
-			rp = opr_queue_First(&tcall->rq, struct rx_packet,
-					    entry);
-			if (rp->header.seq == 1
-			    && (!meltdown_1pkt
-				|| (rp->header.flags & RX_LAST_PACKET))) {
-			    call = tcall;
-			} else if (rxi_2dchoice && !choice2
-				   && !(tcall->flags & RX_CALL_CLEARED)
-				   && (tcall->rprev > rxi_HardAckRate)) {
-			    choice2 = tcall;
-			} else
-			    rxi_md2cnt++;
-		    }
-		}
-	    }
-	    if (call)
-		break;
-	}
+    home = &rx_callQueues[(unsigned int)tno % rx_nCallQueues];
+    for (i = 0; i < rx_nCallQueues && !call; i++) {
+	cq = &rx_callQueues[(home - rx_callQueues + i) % rx_nCallQueues];
+	call = rxi_ChooseCall(cq, tno, &service);
+	if (call && cq != home)
+	    cq->nStolen++;
     }
 
     if (call) {
-	opr_queue_Remove(&call->entry);
 	/* we can't schedule a call if there's no data!!! */
 	/* send an ack if there's no data, if we're missing the
 	 * first packet, or we're missing something between first
@@ -2256,7 +2955,7 @@ rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
 	    *socketp = OSI_NULLSOCKET;
 	}
 	sq->socketp = socketp;
-	opr_queue_Append(&rx_idleServerQueue, &sq->entry);
+	opr_queue_Append(&home->idle, &sq->entry);
 	do {
 	    osi_rxSleep(sq);
 #ifdef	KERNEL
@@ -2294,6 +2993,7 @@ rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
 #endif
 
 	rxi_calltrace(RX_CALL_START, call);
+	RXI_TRACE_CALL(RX_TRACE_CALL_START, call, call->conn->serviceId);
 	dpf(("rx_GetCall(port=%d, service=%d) ==> call %p\n",
 	     call->conn->service->servicePort, call->conn->service->serviceId,
 	     call));
@@ -2345,6 +3045,10 @@ rx_EndCall(struct rx_call *call, afs_int32 rc)
     dpf(("rx_EndCall(call %"AFS_PTR_FMT" rc %d error %d abortCode %d)\n",
           call, rc, call->error, call->abortCode));
 
+    /* Whatever a server stub decoded goes with the call */
+    if (call->arena != NULL)
+	rxi_ReleaseCallArena(call);
+
     NETPRI;
     MUTEX_ENTER(&call->lock);
 
@@ -2374,6 +3078,7 @@ rx_EndCall(struct rx_call *call, afs_int32 rc)
 	    rxi_FlushWriteLocked(call);
 	}
 	rxi_calltrace(RX_CALL_END, call);
+	RXI_TRACE_CALL(RX_TRACE_CALL_END, call, call->error);
 	/* Call goes to hold state until reply packets are acknowledged */
 	if (call->tfirst + call->nSoftAcked < call->tnext) {
 	    call->state = RX_STATE_HOLD;
@@ -2402,6 +3107,7 @@ rx_EndCall(struct rx_call *call, afs_int32 rc)
 	    rxi_CancelDelayedAckEvent(call);
 	    rxi_SendDelayedAck(NULL, call, NULL, 0);
 	}
+	RXI_TRACE_CALL(RX_TRACE_CALL_END, call, call->error);
 
 	/* We need to release the call lock since it's lower than the
 	 * conn_call_lock and we don't want to hold the conn_call_lock
@@ -2500,20 +3206,18 @@ rx_EndCall(struct rx_call *call, afs_int32 rc)
 void
 rx_Finalize(void)
 {
-    struct rx_connection **conn_ptr, **conn_end;
+    afs_uint32 i;
 
     INIT_PTHREAD_LOCKS;
     if (rx_atomic_test_and_set_bit(&rxinit_status, 0))
 	return;			/* Already shutdown. */
 
     rxi_DeleteCachedConnections();
-    if (rx_connHashTable) {
-	MUTEX_ENTER(&rx_connHashTable_lock);
-	for (conn_ptr = &rx_connHashTable[0], conn_end =
-	     &rx_connHashTable[rx_hashTableSize]; conn_ptr < conn_end;
-	     conn_ptr++) {
+    for (i = 0; rx_connHashTable && i < rx_connHashTableSize; i++) {
+	MUTEX_ENTER(CONN_HASH_LOCK(i));
+	if (i < rx_connHashTableSize) {
 	    struct rx_connection *conn, *next;
-	    for (conn = *conn_ptr; conn; conn = next) {
+	    for (conn = rx_connHashTable[i]; conn; conn = next) {
 		next = conn->next;
 		if (conn->type == RX_CLIENT_CONNECTION) {
                     MUTEX_ENTER(&rx_refcnt_mutex);
@@ -2528,16 +3232,9 @@ rx_Finalize(void)
 	    }
 	}
 #ifdef RX_ENABLE_LOCKS
-	while (rx_connCleanup_list) {
-	    struct rx_connection *conn;
-	    conn = rx_connCleanup_list;
-	    rx_connCleanup_list = rx_connCleanup_list->next;
-	    MUTEX_EXIT(&rx_connHashTable_lock);
-	    rxi_CleanupConnection(conn);
-	    MUTEX_ENTER(&rx_connHashTable_lock);
-	}
-	MUTEX_EXIT(&rx_connHashTable_lock);
+	rxi_CleanupConnections(RX_HASH_SHARD(i));
 #endif /* RX_ENABLE_LOCKS */
+	MUTEX_EXIT(CONN_HASH_LOCK(i));
     }
     rxi_flushtrace();
 
@@ -2583,6 +3280,12 @@ rxi_FindService(osi_socket socket, u_short serviceId)
 	if ((*sp)->serviceId == serviceId && (*sp)->socket == socket)
 	    return *sp;
     }
+#ifndef KERNEL
+    /* The packet may have come in on an extra listener for the port */
+    socket = rxi_SharedSocket(socket);
+    if (socket != OSI_NULLSOCKET)
+	return rxi_FindService(socket, serviceId);
+#endif
     return 0;
 }
 
@@ -2827,44 +3530,9 @@ rxi_Free(void *addr, size_t size)
     osi_Free(addr, size);
 }
 
-void
-rxi_SetPeerMtu(struct rx_peer *peer, afs_uint32 host, afs_uint32 port, int mtu)
+static void
+rxi_SetOnePeerMtu(struct rx_peer *peer, int mtu)
 {
-    struct rx_peer **peer_ptr = NULL, **peer_end = NULL;
-    struct rx_peer *next = NULL;
-    int hashIndex;
-
-    if (!peer) {
-	MUTEX_ENTER(&rx_peerHashTable_lock);
-	if (port == 0) {
-	    peer_ptr = &rx_peerHashTable[0];
-	    peer_end = &rx_peerHashTable[rx_hashTableSize];
-	    next = NULL;
-	resume:
-	    for ( ; peer_ptr < peer_end; peer_ptr++) {
-		if (!peer)
-		    peer = *peer_ptr;
-		for ( ; peer; peer = next) {
-		    next = peer->next;
-		    if (host == peer->host)
-			break;
-		}
-	    }
-	} else {
-	    hashIndex = PEER_HASH(host, port);
-	    for (peer = rx_peerHashTable[hashIndex]; peer; peer = peer->next) {
-		if ((peer->host == host) && (peer->port == port))
-		    break;
-	    }
-	}
-    } else {
-	MUTEX_ENTER(&rx_peerHashTable_lock);
-    }
-
-    if (peer) {
-        peer->refCount++;
-        MUTEX_EXIT(&rx_peerHashTable_lock);
-
         MUTEX_ENTER(&peer->peer_lock);
 	/* We don't handle dropping below min, so don't */
 	mtu = MAX(mtu, RX_MIN_PACKET_SIZE);
@@ -2879,35 +3547,81 @@ rxi_SetPeerMtu(struct rx_peer *peer, afs_uint32 host, afs_uint32 port, int mtu)
 	if (peer->maxPacketSize + RX_HEADER_SIZE > peer->ifMTU)
 	    peer->maxPacketSize = 0;
         MUTEX_EXIT(&peer->peer_lock);
+}
 
-        MUTEX_ENTER(&rx_peerHashTable_lock);
-        peer->refCount--;
-        if (host && !port) {
-            peer = next;
-	    /* pick up where we left off */
-            goto resume;
-        }
+void
+rxi_SetPeerMtu(struct rx_peer *peer, afs_uint32 host, afs_uint32 port, int mtu)
+{
+    afs_uint32 hash, i;
+
+    if (peer) {
+	hash = PEER_HASH(peer->host, peer->port);
+	MUTEX_ENTER(PEER_HASH_LOCK(hash));
+	peer->refCount++;
+	MUTEX_EXIT(PEER_HASH_LOCK(hash));
+
+	rxi_SetOnePeerMtu(peer, mtu);
+
+	MUTEX_ENTER(PEER_HASH_LOCK(hash));
+	peer->refCount--;
+	MUTEX_EXIT(PEER_HASH_LOCK(hash));
+    } else if (port == 0) {
+	/* Every peer at this host.  The peer we hold stays in the shard
+	 * while we drop its lock, even if the table grows, so we can carry
+	 * on from it afterwards. */
+	for (i = 0; i < rx_peerHashTableSize; i++) {
+	    MUTEX_ENTER(PEER_HASH_LOCK(i));
+	    for (peer = rx_peerHashTable[i]; peer; peer = peer->next) {
+		if (host != peer->host)
+		    continue;
+		peer->refCount++;
+		MUTEX_EXIT(PEER_HASH_LOCK(i));
+
+		rxi_SetOnePeerMtu(peer, mtu);
+
+		MUTEX_ENTER(PEER_HASH_LOCK(i));
+		peer->refCount--;
+	    }
+	    MUTEX_EXIT(PEER_HASH_LOCK(i));
+	}
+    } else {
+	hash = PEER_HASH(host, port);
+	MUTEX_ENTER(PEER_HASH_LOCK(hash));
+	for (peer = rx_peerHashTable[PEER_BUCKET(hash)]; peer;
+	     peer = peer->next) {
+	    if ((peer->host == host) && (peer->port == port))
+		break;
+	}
+	if (peer) {
+	    peer->refCount++;
+	    MUTEX_EXIT(PEER_HASH_LOCK(hash));
+
+	    rxi_SetOnePeerMtu(peer, mtu);
+
+	    MUTEX_ENTER(PEER_HASH_LOCK(hash));
+	    peer->refCount--;
+	}
+	MUTEX_EXIT(PEER_HASH_LOCK(hash));
     }
-    MUTEX_EXIT(&rx_peerHashTable_lock);
 }
 
 #ifdef AFS_RXERRQ_ENV
 static void
 rxi_SetPeerDead(struct sock_extended_err *err, afs_uint32 host, afs_uint16 port)
 {
-    int hashIndex = PEER_HASH(host, port);
+    afs_uint32 hash = PEER_HASH(host, port);
     struct rx_peer *peer;
 
-    MUTEX_ENTER(&rx_peerHashTable_lock);
+    MUTEX_ENTER(PEER_HASH_LOCK(hash));
 
-    for (peer = rx_peerHashTable[hashIndex]; peer; peer = peer->next) {
+    for (peer = rx_peerHashTable[PEER_BUCKET(hash)]; peer; peer = peer->next) {
 	if (peer->host == host && peer->port == port) {
 	    peer->refCount++;
 	    break;
 	}
     }
 
-    MUTEX_EXIT(&rx_peerHashTable_lock);
+    MUTEX_EXIT(PEER_HASH_LOCK(hash));
 
     if (peer) {
 	rx_atomic_inc(&peer->neterrs);
@@ -2917,9 +3631,9 @@ rxi_SetPeerDead(struct sock_extended_err *err, afs_uint32 host, afs_uint16 port)
 	peer->last_err_code = err->ee_code;
 	MUTEX_EXIT(&peer->peer_lock);
 
-	MUTEX_ENTER(&rx_peerHashTable_lock);
+	MUTEX_ENTER(PEER_HASH_LOCK(hash));
 	peer->refCount--;
-	MUTEX_EXIT(&rx_peerHashTable_lock);
+	MUTEX_EXIT(PEER_HASH_LOCK(hash));
     }
 }
 
@@ -3028,10 +3742,11 @@ struct rx_peer *
 rxi_FindPeer(afs_uint32 host, u_short port, int create)
 {
     struct rx_peer *pp;
-    int hashIndex;
-    hashIndex = PEER_HASH(host, port);
-    MUTEX_ENTER(&rx_peerHashTable_lock);
-    for (pp = rx_peerHashTable[hashIndex]; pp; pp = pp->next) {
+    afs_uint32 hash;
+    int added = 0;
+    hash = PEER_HASH(host, port);
+    MUTEX_ENTER(PEER_HASH_LOCK(hash));
+    for (pp = rx_peerHashTable[PEER_BUCKET(hash)]; pp; pp = pp->next) {
 	if ((pp->host == host) && (pp->port == port))
 	    break;
     }
@@ -3044,9 +3759,9 @@ rxi_FindPeer(afs_uint32 host, u_short port, int create)
 	    rx_atomic_set(&pp->neterrs, 0);
 #endif
 	    MUTEX_INIT(&pp->peer_lock, "peer_lock", MUTEX_DEFAULT, 0);
-	    opr_queue_Init(&pp->rpcStats);
-	    pp->next = rx_peerHashTable[hashIndex];
-	    rx_peerHashTable[hashIndex] = pp;
+	    pp->next = rx_peerHashTable[PEER_BUCKET(hash)];
+	    rx_peerHashTable[PEER_BUCKET(hash)] = pp;
+	    added = 1;
 	    rxi_InitPeerParams(pp);
             if (rx_stats_active)
 		rx_atomic_inc(&rx_stats.nPeerStructs);
@@ -3055,7 +3770,9 @@ rxi_FindPeer(afs_uint32 host, u_short port, int create)
     if (pp && create) {
 	pp->refCount++;
     }
-    MUTEX_EXIT(&rx_peerHashTable_lock);
+    MUTEX_EXIT(PEER_HASH_LOCK(hash));
+    if (added)
+	rxi_PeerHashAdded();
     return pp;
 }
 
@@ -3078,14 +3795,15 @@ rxi_FindConnection(osi_socket socket, afs_uint32 host,
 		   afs_uint32 epoch, int type, u_int securityIndex,
                    int *unknownService)
 {
-    int hashindex, flag, i;
+    int flag, i, shard, added = 0;
+    afs_uint32 hash;
     struct rx_connection *conn;
     *unknownService = 0;
-    hashindex = CONN_HASH(host, port, cid, epoch, type);
-    MUTEX_ENTER(&rx_connHashTable_lock);
-    rxLastConn ? (conn = rxLastConn, flag = 0) : (conn =
-						  rx_connHashTable[hashindex],
-						  flag = 1);
+    hash = CONN_HASH(host, port, cid, epoch, type);
+    shard = RX_HASH_SHARD(hash);
+    MUTEX_ENTER(CONN_HASH_LOCK(hash));
+    rxLastConn[shard] ? (conn = rxLastConn[shard], flag = 0)
+		      : (conn = rx_connHashTable[CONN_BUCKET(hash)], flag = 1);
     for (; conn;) {
 	if ((conn->type == type) && ((cid & RX_CIDMASK) == conn->cid)
 	    && (epoch == conn->epoch)) {
@@ -3095,7 +3813,7 @@ rxi_FindConnection(osi_socket socket, afs_uint32 host,
 		 * like this, and there seems to be some CM bug that makes this
 		 * happen from time to time -- in which case, the fileserver
 		 * asserts. */
-		MUTEX_EXIT(&rx_connHashTable_lock);
+		MUTEX_EXIT(CONN_HASH_LOCK(hash));
 		return (struct rx_connection *)0;
 	    }
 	    if (pp->host == host && pp->port == port)
@@ -3111,20 +3829,20 @@ rxi_FindConnection(osi_socket socket, afs_uint32 host,
 	    /* the connection rxLastConn that was used the last time is not the
 	     ** one we are looking for now. Hence, start searching in the hash */
 	    flag = 1;
-	    conn = rx_connHashTable[hashindex];
+	    conn = rx_connHashTable[CONN_BUCKET(hash)];
 	} else
 	    conn = conn->next;
     }
     if (!conn) {
 	struct rx_service *service;
 	if (type == RX_CLIENT_CONNECTION) {
-	    MUTEX_EXIT(&rx_connHashTable_lock);
+	    MUTEX_EXIT(CONN_HASH_LOCK(hash));
 	    return (struct rx_connection *)0;
 	}
 	service = rxi_FindService(socket, serviceId);
 	if (!service || (securityIndex >= service->nSecurityObjects)
 	    || (service->securityObjects[securityIndex] == 0)) {
-	    MUTEX_EXIT(&rx_connHashTable_lock);
+	    MUTEX_EXIT(CONN_HASH_LOCK(hash));
             *unknownService = 1;
 	    return (struct rx_connection *)0;
 	}
@@ -3132,8 +3850,9 @@ rxi_FindConnection(osi_socket socket, afs_uint32 host,
 	MUTEX_INIT(&conn->conn_call_lock, "conn call lock", MUTEX_DEFAULT, 0);
 	MUTEX_INIT(&conn->conn_data_lock, "conn data lock", MUTEX_DEFAULT, 0);
 	CV_INIT(&conn->conn_call_cv, "conn call cv", CV_DEFAULT, 0);
-	conn->next = rx_connHashTable[hashindex];
-	rx_connHashTable[hashindex] = conn;
+	conn->next = rx_connHashTable[CONN_BUCKET(hash)];
+	rx_connHashTable[CONN_BUCKET(hash)] = conn;
+	added = 1;
 	conn->peer = rxi_FindPeer(host, port, 1);
 	conn->type = RX_SERVER_CONNECTION;
 	conn->lastSendTime = clock_Sec();	/* don't GC immediately */
@@ -3165,8 +3884,10 @@ rxi_FindConnection(osi_socket socket, afs_uint32 host,
     conn->refCount++;
     MUTEX_EXIT(&rx_refcnt_mutex);
 
-    rxLastConn = conn;		/* store this connection as the last conn used */
-    MUTEX_EXIT(&rx_connHashTable_lock);
+    rxLastConn[shard] = conn;	/* store this connection as the last conn used */
+    MUTEX_EXIT(CONN_HASH_LOCK(hash));
+    if (added)
+	rxi_ConnHashAdded();
     return conn;
 }
 
@@ -3438,6 +4159,8 @@ rxi_ReceivePacket(struct rx_packet *np, osi_socket socket,
                              np, 0);
         return np;
     }
+    if (np->header.type != RX_PACKET_TYPE_ACK)
+	RXI_TRACE_PACKET(RX_TRACE_RECV, conn, np);
 
 #ifdef AFS_RXERRQ_ENV
     if (rx_atomic_read(&conn->peer->neterrs)) {
@@ -4167,6 +4890,64 @@ rx_ack_reason(int reason)
 }
 #endif
 
+/* The length of an ACK packet carrying nAcks acknowledgements, including
+ * the trailer and, if ext is set, the extended trailer and acknowledgements */
+static_inline int
+rxi_AckLength(int nAcks, int ext)
+{
+    if (!ext)
+	return rx_AckDataSize(MIN(nAcks, RX_MAXACKS))
+	    + RX_ACKTRAILER_WORDS * sizeof(afs_int32);
+    if (nAcks <= RX_MAXACKS)
+	return rx_AckDataSize(nAcks)
+	    + RX_EXTACKTRAILER_WORDS * sizeof(afs_int32);
+    return rx_AckDataSize(RX_MAXACKS)
+	+ RX_EXTACKTRAILER_WORDS * sizeof(afs_int32)
+	+ (nAcks - RX_MAXACKS + 7) / 8;
+}
+
+/* Return the acknowledgement type given for the packet at offset in an
+ * ACK packet. Extended acknowledgements are read from the packet a byte
+ * at a time; *extByte and *extBits cache the last one read, and *extByte
+ * must start out as -1. */
+static int
+rxi_GetAck(struct rx_packet *np, struct rx_ackPacket *ap, int nAcks,
+	   int offset, int *extByte, u_char *extBits)
+{
+    int ext;
+
+    if (offset < nAcks)
+	return ap->acks[offset];
+
+    ext = offset - RX_MAXACKS;
+    if ((ext >> 3) != *extByte) {
+	*extByte = ext >> 3;
+	rx_packetread(np, rx_AckDataSize(RX_MAXACKS)
+		      + RX_EXTACKTRAILER_WORDS * sizeof(afs_int32) + *extByte,
+		      1, extBits);
+    }
+    return (*extBits >> (ext & 7)) & 1 ? RX_ACK_TYPE_ACK : RX_ACK_TYPE_NACK;
+}
+
+/* Packets have been lost: shrink the congestion window, and start fast
+ * recovery. Called with the call and peer locks held. */
+static void
+rxi_FastRecover(struct rx_call *call, struct rx_peer *peer, struct clock *now)
+{
+    call->flags |= RX_CALL_FAST_RECOVER;
+    RXCC_OnLoss(call, peer, 0);
+    call->recoverTime = *now;
+    call->cwind =
+	MIN((int)(call->ssthresh + rx_nackThreshold), rx_maxSendWindow);
+    call->nDgramPackets = MAX(2, (int)call->nDgramPackets) >> 1;
+    call->nextCwind = call->ssthresh;
+    call->nAcks = 0;
+    peer->MTU = call->MTU;
+    peer->cwind = call->nextCwind;
+    peer->nDgramPackets = call->nDgramPackets;
+    peer->congestSeq++;
+    call->congestSeq = peer->congestSeq;
+}
 
 /* The real smarts of the whole thing.  */
 static struct rx_packet *
@@ -4175,22 +4956,27 @@ rxi_ReceiveAckPacket(struct rx_call *call, struct rx_packet *np,
 {
     struct rx_ackPacket *ap;
     int nAcks;
+    int nExtAcks;
     struct rx_packet *tp;
     struct rx_connection *conn = call->conn;
     struct rx_peer *peer = conn->peer;
-    struct opr_queue *cursor;
     struct clock now;		/* Current time, for RTT calculations */
+    struct clock reorderTime;
     afs_uint32 first;
     afs_uint32 prev;
     afs_uint32 serial;
     int nbytes;
     int missing;
-    int acked;
+    int extByte = -1;
+    u_char extBits = 0;
+    afs_uint32 caps;
     int nNacked = 0;
+    int nLost;
     int newAckCount = 0;
     int maxDgramPackets = 0;	/* Set if peer supports AFS 3.5 jumbo datagrams */
     int pktsize = 0;            /* Set if we need to update the peer mtu */
     int conn_data_locked = 0;
+    u_short cwind = call->cwind;
 
     if (rx_stats_active)
         rx_atomic_inc(&rx_stats.ackPacketsRead);
@@ -4217,11 +5003,24 @@ rxi_ReceiveAckPacket(struct rx_call *call, struct rx_packet *np,
     }
 
     call->tprev = prev;
+    RXI_TRACE_ACK(RX_TRACE_ACK_RECV, call, first, serial, ap->reason);
 
     if (np->header.flags & RX_SLOW_START_OK) {
 	call->flags |= RX_CALL_SLOW_START_OK;
     }
 
+    /* The trailer says whether the peer reads extended ACKs, and whether
+     * this is one.  Send it extended ACKs only while it says it can. */
+    caps = 0;
+    if (np->length >= rx_AckDataSize(ap->nAcks)
+		      + RX_ACKTRAILER_WORDS * sizeof(afs_int32)) {
+	rx_packetread(np, rx_AckDataSize(ap->nAcks) + 4 * sizeof(afs_int32),
+		      sizeof(afs_int32), &caps);
+	caps = ntohl(caps);
+    }
+    if (!(caps & RX_ACKCAP_EXTACKS) != !rx_atomic_read(&peer->extAcks))
+	rx_atomic_set(&peer->extAcks, (caps & RX_ACKCAP_EXTACKS) != 0);
+
     if (ap->reason == RX_ACK_PING_RESPONSE)
 	rxi_UpdatePeerReach(conn, call);
 
@@ -4344,6 +5143,7 @@ rxi_ReceiveAckPacket(struct rx_call *call, struct rx_packet *np,
 	if (!(tp->flags & RX_PKTFLAG_ACKED)) {
 	    newAckCount++;
 	    rxi_ComputeRoundTripTime(tp, ap, call, peer, &now);
+	    rxi_rack_packet_acked(call, tp, &now);
 	}
 
 #ifdef RX_ENABLE_LOCKS
@@ -4388,20 +5188,37 @@ rxi_ReceiveAckPacket(struct rx_call *call, struct rx_packet *np,
      * of any missing packets (those packets that must be missing
      * because this packet was out of sequence) */
 
+    /* Acknowledgements beyond the first RX_MAXACKS are in a bitmap after
+     * the extended trailer */
+    nExtAcks = 0;
+    if ((caps & RX_ACKCAP_EXTENDED) && nAcks == RX_MAXACKS
+	&& np->length >= rxi_AckLength(RX_MAXACKS, 1)) {
+	afs_uint32 tSize;
+
+	rx_packetread(np, rx_AckDataSize(RX_MAXACKS) + 6 * sizeof(afs_int32),
+		      sizeof(afs_int32), &tSize);
+	nExtAcks = ntohl(tSize);
+	if (nExtAcks < 0 || nExtAcks > RX_MAXEXTWINDOW - RX_MAXACKS
+	    || np->length < rxi_AckLength(RX_MAXACKS + nExtAcks, 1))
+	    nExtAcks = 0;
+    }
+
     call->nSoftAcked = 0;
     missing = 0;
-    while (!opr_queue_IsEnd(&call->tq, &tp->entry) 
-	   && tp->header.seq < first + nAcks) {
+    while (!opr_queue_IsEnd(&call->tq, &tp->entry)
+	   && tp->header.seq < first + nAcks + nExtAcks) {
 	/* Set the acknowledge flag per packet based on the
 	 * information in the ack packet. An acknowlegded packet can
 	 * be downgraded when the server has discarded a packet it
 	 * soacked previously, or when an ack packet is received
 	 * out of sequence. */
-	if (ap->acks[tp->header.seq - first] == RX_ACK_TYPE_ACK) {
+	if (rxi_GetAck(np, ap, nAcks, tp->header.seq - first,
+		       &extByte, &extBits) == RX_ACK_TYPE_ACK) {
 	    if (!(tp->flags & RX_PKTFLAG_ACKED)) {
 		newAckCount++;
 		tp->flags |= RX_PKTFLAG_ACKED;
 		rxi_ComputeRoundTripTime(tp, ap, call, peer, &now);
+		rxi_rack_packet_acked(call, tp, &now);
 	    }
 	    if (missing) {
 		nNacked++;
@@ -4478,6 +5295,21 @@ rxi_ReceiveAckPacket(struct rx_call *call, struct rx_packet *np,
 			  rx_AckDataSize(ap->nAcks) + 2 * (int)sizeof(afs_int32),
 			  sizeof(afs_int32), &tSize);
 	    tSize = (afs_uint32) ntohl(tSize);
+
+	    /* Peers which send extended ACKs follow the trailer with their
+	     * full receive window, which may be larger than RX_MAXACKS */
+	    if ((caps & RX_ACKCAP_EXTENDED)
+		&& np->length >= rxi_AckLength(ap->nAcks, 1)) {
+		afs_uint32 extWind;
+
+		rx_packetread(np,
+			      rx_AckDataSize(ap->nAcks) + 5 * (int)sizeof(afs_int32),
+			      sizeof(afs_int32), &extWind);
+		extWind = ntohl(extWind);
+		if (extWind > tSize)
+		    tSize = MIN(extWind, RX_MAXEXTWINDOW);
+	    }
+
 	    /*
 	     * As of AFS 3.5 we set the send window to match the receive window.
 	     */
@@ -4544,29 +5376,28 @@ rxi_ReceiveAckPacket(struct rx_call *call, struct rx_packet *np,
 	}
     }
 
+    /* Find out whether any packets sent before those which have just been
+     * acknowledged are now overdue */
+    nLost = rxi_rack_DetectLoss(call, &now, &reorderTime);
+
     if (nNacked) {
-	/*
-	 * Calculate how many datagrams were successfully received after
-	 * the first missing packet and adjust the negative ack counter
-	 * accordingly.
-	 */
 	call->nAcks = 0;
-	call->nNacks++;
-	nNacked = (nNacked + call->nDgramPackets - 1) / call->nDgramPackets;
-	if (call->nNacks < nNacked) {
-	    call->nNacks = nNacked;
-	}
     } else {
 	call->nAcks += newAckCount;
-	call->nNacks = 0;
     }
 
     /* If the packet contained new acknowledgements, rather than just
      * being a duplicate of one we have previously seen, then we can restart
-     * the RTT timer
+     * the RTT timer. If some packets may yet turn out to have been
+     * reordered rather than lost, check on them when they're due instead.
      */
-    if (newAckCount > 0)
-	rxi_rto_packet_acked(call, istack);
+    if (newAckCount > 0) {
+	call->flags &= ~RX_CALL_PROBE_SENT;
+	if (clock_IsZero(&reorderTime))
+	    rxi_rto_packet_acked(call, istack);
+	else
+	    rxi_rack_startTimer(call, &reorderTime, istack);
+    }
 
     if (call->flags & RX_CALL_FAST_RECOVER) {
 	if (newAckCount == 0) {
@@ -4578,56 +5409,13 @@ rxi_ReceiveAckPacket(struct rx_call *call, struct rx_packet *np,
 	    call->nAcks = 0;
 	}
 	call->nCwindAcks = 0;
-    } else if (nNacked && call->nNacks >= (u_short) rx_nackThreshold) {
-	/* Three negative acks in a row trigger congestion recovery */
-	call->flags |= RX_CALL_FAST_RECOVER;
-	call->ssthresh = MAX(4, MIN((int)call->cwind, (int)call->twind)) >> 1;
-	call->cwind =
-	    MIN((int)(call->ssthresh + rx_nackThreshold), rx_maxSendWindow);
-	call->nDgramPackets = MAX(2, (int)call->nDgramPackets) >> 1;
-	call->nextCwind = call->ssthresh;
-	call->nAcks = 0;
-	call->nNacks = 0;
-	peer->MTU = call->MTU;
-	peer->cwind = call->nextCwind;
-	peer->nDgramPackets = call->nDgramPackets;
-	peer->congestSeq++;
-	call->congestSeq = peer->congestSeq;
-
-	/* Reset the resend times on the packets that were nacked
-	 * so we will retransmit as soon as the window permits
-	 */
-
-	acked = 0;
-	for (opr_queue_ScanBackwards(&call->tq, cursor)) {
-	    struct rx_packet *tp =
-		opr_queue_Entry(cursor, struct rx_packet, entry);
-	    if (acked) {
-		if (!(tp->flags & RX_PKTFLAG_ACKED)) {
-		    tp->flags &= ~RX_PKTFLAG_SENT;
-		}
-	    } else if (tp->flags & RX_PKTFLAG_ACKED) {
-		acked = 1;
-	    }
-	}
+    } else if (nLost > 0) {
+	/* Lost packets trigger congestion recovery. The loss detector has
+	 * already marked them to be resent as soon as the window permits */
+	rxi_FastRecover(call, peer, &now);
     } else {
-	/* If cwind is smaller than ssthresh, then increase
-	 * the window one packet for each ack we receive (exponential
-	 * growth).
-	 * If cwind is greater than or equal to ssthresh then increase
-	 * the congestion window by one packet for each cwind acks we
-	 * receive (linear growth).  */
-	if (call->cwind < call->ssthresh) {
-	    call->cwind =
-		MIN((int)call->ssthresh, (int)(call->cwind + newAckCount));
-	    call->nCwindAcks = 0;
-	} else {
-	    call->nCwindAcks += newAckCount;
-	    if (call->nCwindAcks >= call->cwind) {
-		call->nCwindAcks = 0;
-		call->cwind = MIN((int)(call->cwind + 1), rx_maxSendWindow);
-	    }
-	}
+	/* Let the congestion control algorithm open the window */
+	RXCC_OnAck(call, peer, newAckCount);
 	/*
 	 * If we have received several acknowledgements in a row then
 	 * it is time to increase the size of our datagrams
@@ -4650,6 +5438,8 @@ rxi_ReceiveAckPacket(struct rx_call *call, struct rx_packet *np,
 	    call->nAcks = 0;
 	}
     }
+    if (call->cwind != cwind)
+	RXI_TRACE_WINDOW(call);
 
     MUTEX_EXIT(&peer->peer_lock);	/* rxi_Start will lock peer. */
 
@@ -4793,6 +5583,105 @@ rxi_ReceiveChallengePacket(struct rx_connection *conn,
 }
 
 
+/* Give a call to the server process which has been idle longest on a call
+ * queue, which must have one.
+ *
+ * LOCKS HELD: the call's lock, and the call queue's lock.
+ */
+static void
+rxi_HandCallToServerProc(struct rx_callQueue *cq, struct rx_call *call,
+			 osi_socket socket, int *tnop,
+			 struct rx_call **newcallp)
+{
+    struct rx_serverQueueEntry *sq;
+#ifndef RX_ENABLE_LOCKS
+    struct rx_service *service = call->conn->service;
+#endif
+
+    sq = opr_queue_Last(&cq->idle, struct rx_serverQueueEntry, entry);
+
+    /* If hot threads are enabled, and both newcallp and sq->socketp
+     * are non-null, then this thread will process the call, and the
+     * idle server thread will start listening on this threads socket.
+     */
+    opr_queue_Remove(&sq->entry);
+
+    if (rx_enable_hot_thread && newcallp && sq->socketp) {
+	*newcallp = call;
+	*tnop = sq->tno;
+	*sq->socketp = socket;
+	clock_GetTime(&call->startTime);
+	CALL_HOLD(call, RX_CALL_REFCOUNT_BEGIN);
+    } else {
+	sq->newcall = call;
+    }
+    if (call->flags & RX_CALL_WAIT_PROC) {
+	/* Conservative:  I don't think this should happen */
+	call->flags &= ~RX_CALL_WAIT_PROC;
+	rx_atomic_dec(&rx_nWaiting);
+	if (opr_queue_IsOnQueue(&call->entry)) {
+	    opr_queue_Remove(&call->entry);
+	}
+    }
+    call->state = RX_STATE_ACTIVE;
+    call->app.mode = RX_MODE_RECEIVING;
+#ifdef RX_KERNEL_TRACE
+    {
+	int glockOwner = ISAFS_GLOCK();
+	if (!glockOwner)
+	    AFS_GLOCK();
+	afs_Trace3(afs_iclSetp, CM_TRACE_WASHERE, ICL_TYPE_STRING,
+		   __FILE__, ICL_TYPE_INT32, __LINE__, ICL_TYPE_POINTER,
+		   call);
+	if (!glockOwner)
+	    AFS_GUNLOCK();
+    }
+#endif
+    if (call->flags & RX_CALL_CLEARED) {
+	/* send an ack now to start the packet flow up again */
+	call->flags &= ~RX_CALL_CLEARED;
+	rxi_SendAck(call, 0, 0, RX_ACK_DELAY, 0);
+    }
+#ifdef	RX_ENABLE_LOCKS
+    CV_SIGNAL(&sq->cv);
+#else
+    service->nRequestsRunning++;
+    MUTEX_ENTER(&rx_quota_mutex);
+    if (service->nRequestsRunning <= service->minProcs)
+	rxi_minDeficit--;
+    rxi_availProcs--;
+    MUTEX_EXIT(&rx_quota_mutex);
+    osi_rxWakeup(sq);
+#endif
+}
+
+/* Wake a server process idle on a call queue other than the given one, to
+ * look for a call which was queued there after it went idle. */
+static void
+rxi_WakeIdleServerProc(struct rx_callQueue *skip)
+{
+    struct rx_serverQueueEntry *sq;
+    struct rx_callQueue *cq;
+
+    for (cq = rx_callQueues; cq < rx_callQueues + rx_nCallQueues; cq++) {
+	if (cq == skip)
+	    continue;
+	MUTEX_ENTER(&cq->lock);
+	if (!opr_queue_IsEmpty(&cq->idle)) {
+	    sq = opr_queue_Last(&cq->idle, struct rx_serverQueueEntry, entry);
+	    opr_queue_Remove(&sq->entry);
+#ifdef	RX_ENABLE_LOCKS
+	    CV_SIGNAL(&sq->cv);
+#else
+	    osi_rxWakeup(sq);
+#endif
+	    MUTEX_EXIT(&cq->lock);
+	    return;
+	}
+	MUTEX_EXIT(&cq->lock);
+    }
+}
+
 /* Find an available server process to service the current request in
  * the given call structure.  If one isn't available, queue up this
  * call so it eventually gets one */
@@ -4801,94 +5690,71 @@ rxi_AttachServerProc(struct rx_call *call,
 		     osi_socket socket, int *tnop,
 		     struct rx_call **newcallp)
 {
-    struct rx_serverQueueEntry *sq;
     struct rx_service *service = call->conn->service;
+    struct rx_callQueue *home, *cq;
     int haveQuota = 0;
+    int i;
 
     /* May already be attached */
     if (call->state == RX_STATE_ACTIVE)
 	return;
 
-    MUTEX_ENTER(&rx_serverPool_lock);
-
+    home = rxi_CallQueueOf(call);
     haveQuota = QuotaOK(service);
-    if ((!haveQuota) || opr_queue_IsEmpty(&rx_idleServerQueue)) {
-	/* If there are no processes available to service this call,
-	 * put the call on the incoming call queue (unless it's
-	 * already on the queue).
-	 */
-#ifdef RX_ENABLE_LOCKS
-	if (haveQuota)
-	    ReturnToServerPool(service);
-#endif /* RX_ENABLE_LOCKS */
-
-	if (!(call->flags & RX_CALL_WAIT_PROC)) {
-	    call->flags |= RX_CALL_WAIT_PROC;
-	    rx_atomic_inc(&rx_nWaiting);
-	    rx_atomic_inc(&rx_nWaited);
-	    rxi_calltrace(RX_CALL_ARRIVAL, call);
-	    SET_CALL_QUEUE_LOCK(call, &rx_serverPool_lock);
-	    opr_queue_Append(&rx_incomingCallQueue, &call->entry);
-	}
-    } else {
-	sq = opr_queue_Last(&rx_idleServerQueue,
-			    struct rx_serverQueueEntry, entry);
 
-	/* If hot threads are enabled, and both newcallp and sq->socketp
-	 * are non-null, then this thread will process the call, and the
-	 * idle server thread will start listening on this threads socket.
-	 */
-	opr_queue_Remove(&sq->entry);
-
-	if (rx_enable_hot_thread && newcallp && sq->socketp) {
-	    *newcallp = call;
-	    *tnop = sq->tno;
-	    *sq->socketp = socket;
-	    clock_GetTime(&call->startTime);
-	    CALL_HOLD(call, RX_CALL_REFCOUNT_BEGIN);
-	} else {
-	    sq->newcall = call;
-	}
-	if (call->flags & RX_CALL_WAIT_PROC) {
-	    /* Conservative:  I don't think this should happen */
-	    call->flags &= ~RX_CALL_WAIT_PROC;
-	    rx_atomic_dec(&rx_nWaiting);
-	    if (opr_queue_IsOnQueue(&call->entry)) {
-		opr_queue_Remove(&call->entry);
+    /* Prefer an idle server process on the call's own queue, and only
+     * take one from another queue if it has none.  Only one queue lock is
+     * held at a time, so the home queue is checked again after looking
+     * elsewhere.  A call which is already queued can only be taken off
+     * its queue under that queue's lock. */
+    MUTEX_ENTER(&home->lock);
+    if (haveQuota && !opr_queue_IsEmpty(&home->idle)) {
+	rxi_HandCallToServerProc(home, call, socket, tnop, newcallp);
+	MUTEX_EXIT(&home->lock);
+	return;
+    }
+    if (haveQuota && rx_nCallQueues > 1
+	&& !(call->flags & RX_CALL_WAIT_PROC)) {
+	MUTEX_EXIT(&home->lock);
+	for (i = 1; i < rx_nCallQueues; i++) {
+	    cq = &rx_callQueues[(home - rx_callQueues + i) % rx_nCallQueues];
+	    MUTEX_ENTER(&cq->lock);
+	    if (!opr_queue_IsEmpty(&cq->idle)) {
+		rxi_HandCallToServerProc(cq, call, socket, tnop, newcallp);
+		MUTEX_EXIT(&cq->lock);
+		return;
 	    }
+	    MUTEX_EXIT(&cq->lock);
 	}
-	call->state = RX_STATE_ACTIVE;
-	call->app.mode = RX_MODE_RECEIVING;
-#ifdef RX_KERNEL_TRACE
-	{
-	    int glockOwner = ISAFS_GLOCK();
-	    if (!glockOwner)
-		AFS_GLOCK();
-	    afs_Trace3(afs_iclSetp, CM_TRACE_WASHERE, ICL_TYPE_STRING,
-		       __FILE__, ICL_TYPE_INT32, __LINE__, ICL_TYPE_POINTER,
-		       call);
-	    if (!glockOwner)
-		AFS_GUNLOCK();
-	}
-#endif
-	if (call->flags & RX_CALL_CLEARED) {
-	    /* send an ack now to start the packet flow up again */
-	    call->flags &= ~RX_CALL_CLEARED;
-	    rxi_SendAck(call, 0, 0, RX_ACK_DELAY, 0);
+	MUTEX_ENTER(&home->lock);
+	if (!opr_queue_IsEmpty(&home->idle)) {
+	    rxi_HandCallToServerProc(home, call, socket, tnop, newcallp);
+	    MUTEX_EXIT(&home->lock);
+	    return;
 	}
-#ifdef	RX_ENABLE_LOCKS
-	CV_SIGNAL(&sq->cv);
-#else
-	service->nRequestsRunning++;
-        MUTEX_ENTER(&rx_quota_mutex);
-	if (service->nRequestsRunning <= service->minProcs)
-	    rxi_minDeficit--;
-	rxi_availProcs--;
-        MUTEX_EXIT(&rx_quota_mutex);
-	osi_rxWakeup(sq);
-#endif
     }
-    MUTEX_EXIT(&rx_serverPool_lock);
+
+    /* If there are no processes available to service this call,
+     * put the call on the incoming call queue (unless it's
+     * already on the queue).
+     */
+#ifdef RX_ENABLE_LOCKS
+    if (haveQuota)
+	ReturnToServerPool(service);
+#endif /* RX_ENABLE_LOCKS */
+
+    if (!(call->flags & RX_CALL_WAIT_PROC)) {
+	call->flags |= RX_CALL_WAIT_PROC;
+	rx_atomic_inc(&rx_nWaiting);
+	rx_atomic_inc(&rx_nWaited);
+	rxi_calltrace(RX_CALL_ARRIVAL, call);
+	SET_CALL_QUEUE_LOCK(call, &home->lock);
+	opr_queue_Append(&home->calls[rxi_CallPriority(call)], &call->entry);
+    }
+    MUTEX_EXIT(&home->lock);
+
+    if (haveQuota && rx_nCallQueues > 1)
+	rxi_WakeIdleServerProc(home);
 }
 
 /* Delay the sending of an acknowledge event for a short while, while
@@ -5296,7 +6162,6 @@ rxi_ResetCall(struct rx_call *call, int newcall)
     call->nSoftAcked = 0;
     call->nextCwind = 0;
     call->nAcks = 0;
-    call->nNacks = 0;
     call->nCwindAcks = 0;
     call->nSoftAcks = 0;
     call->nHardAcks = 0;
@@ -5304,6 +6169,10 @@ rxi_ResetCall(struct rx_call *call, int newcall)
     call->tfirst = call->rnext = call->tnext = 1;
     call->tprev = 0;
     call->rprev = 0;
+    clock_Zero(&call->rackSent);
+    call->rackSeq = 0;
+    clock_Zero(&call->rackRtt);
+    clock_Zero(&call->recoverTime);
     call->lastAcked = 0;
     call->localStatus = call->remoteStatus = 0;
 
@@ -5384,6 +6253,31 @@ rxi_ResetCall(struct rx_call *call, int newcall)
 #define RX_ZEROS 1024
 static char rx_zeros[RX_ZEROS];
 
+/* Record the acknowledgement type of the packet at offset in an ACK packet
+ * being built. Those beyond the first RX_MAXACKS are gathered into *extBits,
+ * which is written to the packet as each byte of the bitmap fills up. */
+static void
+rxi_PutAck(struct rx_packet *p, struct rx_ackPacket *ap, int offset,
+	   int type, u_char *extBits)
+{
+    int ext;
+
+    if (offset < RX_MAXACKS) {
+	ap->acks[offset] = type;
+	return;
+    }
+
+    ext = offset - RX_MAXACKS;
+    if (type == RX_ACK_TYPE_ACK)
+	*extBits |= 1 << (ext & 7);
+    if ((ext & 7) == 7) {
+	rx_packetwrite(p, rx_AckDataSize(RX_MAXACKS)
+		       + RX_EXTACKTRAILER_WORDS * sizeof(afs_int32) + (ext >> 3),
+		       1, extBits);
+	*extBits = 0;
+    }
+}
+
 struct rx_packet *
 rxi_SendAck(struct rx_call *call,
 	    struct rx_packet *optionalPacket, int serial, int reason,
@@ -5392,7 +6286,10 @@ rxi_SendAck(struct rx_call *call,
     struct rx_ackPacket *ap;
     struct rx_packet *p;
     struct opr_queue *cursor;
-    u_char offset = 0;
+    int offset = 0;
+    int nAcks;
+    int ext = rx_atomic_read(&call->conn->peer->extAcks);
+    u_char extBits = 0;
     afs_int32 templ;
     afs_uint32 padbytes = 0;
 #ifdef RX_ENABLE_TSFPQ
@@ -5423,7 +6320,10 @@ rxi_SendAck(struct rx_call *call,
 	padbytes = MAX(padbytes, RX_MIN_PACKET_SIZE+RX_IPUDP_SIZE+4);
 
 	/* subtract the ack payload */
-	padbytes -= (rx_AckDataSize(call->rwind) + 4 * sizeof(afs_int32));
+	if (padbytes > rxi_AckLength(call->rwind, ext))
+	    padbytes -= rxi_AckLength(call->rwind, ext);
+	else
+	    padbytes = 0;
 	reason = RX_ACK_PING;
     }
 
@@ -5454,9 +6354,7 @@ rxi_SendAck(struct rx_call *call,
     }
 #endif
 
-    templ = padbytes +
-	rx_AckDataSize(call->rwind) + 4 * sizeof(afs_int32) -
-	rx_GetDataSize(p);
+    templ = padbytes + rxi_AckLength(call->rwind, ext) - rx_GetDataSize(p);
     if (templ > 0) {
 	if (rxi_AllocDataBuf(p, templ, RX_PACKET_CLASS_SPECIAL) > 0) {
 #ifndef RX_ENABLE_TSFPQ
@@ -5465,7 +6363,8 @@ rxi_SendAck(struct rx_call *call,
 #endif
 	    return optionalPacket;
 	}
-	templ = rx_AckDataSize(call->rwind) + 2 * sizeof(afs_int32);
+	templ = rx_AckDataSize(MIN(call->rwind, RX_MAXACKS))
+	    + 2 * sizeof(afs_int32);
 	if (rx_Contiguous(p) < templ) {
 #ifndef RX_ENABLE_TSFPQ
 	    if (!optionalPacket)
@@ -5525,11 +6424,16 @@ rxi_SendAck(struct rx_call *call,
 		return optionalPacket;
 	    }
 
+	    /* A peer which can't read extended ACKs was never offered a
+	     * window bigger than RX_MAXACKS */
+	    if (!ext && rqp->header.seq >= call->rnext + RX_MAXACKS)
+		break;
+
 	    while (rqp->header.seq > call->rnext + offset)
-		ap->acks[offset++] = RX_ACK_TYPE_NACK;
-	    ap->acks[offset++] = RX_ACK_TYPE_ACK;
+		rxi_PutAck(p, ap, offset++, RX_ACK_TYPE_NACK, &extBits);
+	    rxi_PutAck(p, ap, offset++, RX_ACK_TYPE_ACK, &extBits);
 
-	    if ((offset > (u_char) rx_maxReceiveWindow) || (offset > call->rwind)) {
+	    if ((offset > rx_maxReceiveWindow) || (offset > call->rwind)) {
 #ifndef RX_ENABLE_TSFPQ
 		if (!optionalPacket)
 		    rxi_FreePacket(p);
@@ -5540,33 +6444,53 @@ rxi_SendAck(struct rx_call *call,
 	}
     }
 
-    ap->nAcks = offset;
-    p->length = rx_AckDataSize(offset) + 4 * sizeof(afs_int32);
+    /* Flush any partly filled byte of the extended bitmap */
+    if (offset > RX_MAXACKS && ((offset - RX_MAXACKS) & 7) != 0)
+	rx_packetwrite(p, rxi_AckLength(offset, ext) - 1, 1, &extBits);
+
+    nAcks = MIN(offset, RX_MAXACKS);
+    ap->nAcks = nAcks;
+    p->length = rxi_AckLength(offset, ext);
 
     /* Must zero the 3 octets that rx_AckDataSize skips at the end of the
      * ACK list.
      */
-    rx_packetwrite(p, rx_AckDataSize(offset) - 3, 3, rx_zeros);
+    rx_packetwrite(p, rx_AckDataSize(nAcks) - 3, 3, rx_zeros);
 
     /* these are new for AFS 3.3 */
     templ = rxi_AdjustMaxMTU(call->conn->peer->ifMTU, rx_maxReceiveSize);
     templ = htonl(templ);
-    rx_packetwrite(p, rx_AckDataSize(offset), sizeof(afs_int32), &templ);
+    rx_packetwrite(p, rx_AckDataSize(nAcks), sizeof(afs_int32), &templ);
     templ = htonl(call->conn->peer->ifMTU);
-    rx_packetwrite(p, rx_AckDataSize(offset) + sizeof(afs_int32),
+    rx_packetwrite(p, rx_AckDataSize(nAcks) + sizeof(afs_int32),
 		   sizeof(afs_int32), &templ);
 
     /* new for AFS 3.4 */
-    templ = htonl(call->rwind);
-    rx_packetwrite(p, rx_AckDataSize(offset) + 2 * sizeof(afs_int32),
+    templ = htonl(MIN(call->rwind, RX_MAXACKS));
+    rx_packetwrite(p, rx_AckDataSize(nAcks) + 2 * sizeof(afs_int32),
 		   sizeof(afs_int32), &templ);
 
     /* new for AFS 3.5 */
     templ = htonl(call->conn->peer->ifDgramPackets);
-    rx_packetwrite(p, rx_AckDataSize(offset) + 3 * sizeof(afs_int32),
+    rx_packetwrite(p, rx_AckDataSize(nAcks) + 3 * sizeof(afs_int32),
+		   sizeof(afs_int32), &templ);
+
+    /* What else we can do, and whether this ACK is extended */
+    templ = htonl(RX_ACKCAP_EXTACKS | (ext ? RX_ACKCAP_EXTENDED : 0));
+    rx_packetwrite(p, rx_AckDataSize(nAcks) + 4 * sizeof(afs_int32),
 		   sizeof(afs_int32), &templ);
 
-    p->length = rx_AckDataSize(offset) + 4 * sizeof(afs_int32);
+    /* The full receive window, and the number of extended acknowledgements */
+    if (ext) {
+	templ = htonl(call->rwind);
+	rx_packetwrite(p, rx_AckDataSize(nAcks) + 5 * sizeof(afs_int32),
+		       sizeof(afs_int32), &templ);
+	templ = htonl(offset - nAcks);
+	rx_packetwrite(p, rx_AckDataSize(nAcks) + 6 * sizeof(afs_int32),
+		       sizeof(afs_int32), &templ);
+    }
+
+    p->length = rxi_AckLength(offset, ext);
 
     p->header.serviceId = call->conn->serviceId;
     p->header.cid = (call->conn->cid | call->channel);
@@ -5593,6 +6517,8 @@ rxi_SendAck(struct rx_call *call,
 
     if (call->conn->type == RX_CLIENT_CONNECTION)
 	p->header.flags |= RX_CLIENT_INITIATED;
+    RXI_TRACE_ACK(RX_TRACE_ACK_SEND, call, ntohl(ap->firstPacket), serial,
+		  reason);
 
 #ifdef RXDEBUG
 #ifdef AFS_NT40_ENV
@@ -5664,15 +6590,29 @@ struct xmitlist {
    int resending;
 };
 
-/* Send all of the packets in the list in single datagram */
+/* Datagrams which have been queued by rxi_SendXmitList, but not yet sent.
+ * Where the platform allows it, several datagrams go to the kernel with a
+ * single system call. */
+#ifdef RX_ENABLE_MMSG
+# define RX_XMITBATCH RX_MAXMMSG
+#else
+# define RX_XMITBATCH 1
+#endif
+
+struct xmitbatch {
+   struct xmitlist lists[RX_XMITBATCH];
+   int moreFlags[RX_XMITBATCH];
+   int len;
+};
+
+/* Prepare a list of packets to be sent in a single datagram */
 static void
-rxi_SendList(struct rx_call *call, struct xmitlist *xmit,
-	     int istack, int moreFlag)
+rxi_PrepareList(struct rx_call *call, struct xmitlist *xmit,
+		struct clock *now, int moreFlag)
 {
     int i;
     int requestAck = 0;
     int lastPacket = 0;
-    struct clock now;
     struct rx_connection *conn = call->conn;
     struct rx_peer *peer = conn->peer;
 
@@ -5689,8 +6629,6 @@ rxi_SendList(struct rx_call *call, struct xmitlist *xmit,
             rx_atomic_add(&rx_stats.dataPacketsSent, xmit->len);
     }
 
-    clock_GetTime(&now);
-
     if (xmit->list[xmit->len - 1]->header.flags & RX_LAST_PACKET) {
 	lastPacket = 1;
     }
@@ -5701,7 +6639,7 @@ rxi_SendList(struct rx_call *call, struct xmitlist *xmit,
 	struct rx_packet *packet = xmit->list[i];
 
 	/* Record the time sent */
-	packet->timeSent = now;
+	packet->timeSent = *now;
 	packet->flags |= RX_PKTFLAG_SENT;
 
 	/* Ask for an ack on retransmitted packets,  on every other packet
@@ -5710,7 +6648,7 @@ rxi_SendList(struct rx_call *call, struct xmitlist *xmit,
 	if (packet->header.serial) {
 	    requestAck = 1;
 	} else {
-	    packet->firstSent = now;
+	    packet->firstSent = *now;
 	    if (!lastPacket && (call->cwind <= (u_short) (conn->ackRate + 1)
 				|| (!(call->flags & RX_CALL_SLOW_START_OK)
 				    && (packet->header.seq & 1)))) {
@@ -5728,6 +6666,24 @@ rxi_SendList(struct rx_call *call, struct xmitlist *xmit,
     if (requestAck) {
 	xmit->list[xmit->len - 1]->header.flags |= RX_REQUEST_ACK;
     }
+}
+
+/* Send all of the packets in each list of the batch, one datagram per
+ * list */
+static void
+rxi_SendLists(struct rx_call *call, struct xmitbatch *batch, int istack)
+{
+    int i;
+    struct clock now;
+    struct rx_connection *conn = call->conn;
+
+    if (batch->len == 0)
+	return;
+
+    clock_GetTime(&now);
+
+    for (i = 0; i < batch->len; i++)
+	rxi_PrepareList(call, &batch->lists[i], &now, batch->moreFlags[i]);
 
     /* Since we're about to send a data packet to the peer, it's
      * safe to nuke any scheduled end-of-packets ack */
@@ -5735,27 +6691,71 @@ rxi_SendList(struct rx_call *call, struct xmitlist *xmit,
 
     MUTEX_EXIT(&call->lock);
     CALL_HOLD(call, RX_CALL_REFCOUNT_SEND);
-    if (xmit->len > 1) {
-	rxi_SendPacketList(call, conn, xmit->list, xmit->len, istack);
+#ifdef RX_ENABLE_MMSG
+    if (batch->len > 1) {
+	struct rx_packet **lists[RX_XMITBATCH];
+	int lens[RX_XMITBATCH];
+
+	for (i = 0; i < batch->len; i++) {
+	    lists[i] = batch->lists[i].list;
+	    lens[i] = batch->lists[i].len;
+	}
+	rxi_SendPacketLists(call, conn, lists, lens, batch->len, istack);
+    } else
+#endif
+    if (batch->lists[0].len > 1) {
+	rxi_SendPacketList(call, conn, batch->lists[0].list,
+			   batch->lists[0].len, istack);
     } else {
-	rxi_SendPacket(call, conn, xmit->list[0], istack);
+	rxi_SendPacket(call, conn, batch->lists[0].list[0], istack);
     }
     MUTEX_ENTER(&call->lock);
     CALL_RELE(call, RX_CALL_REFCOUNT_SEND);
 
     /* Tell the RTO calculation engine that we have sent a packet, and
      * if it was the last one */
-    rxi_rto_packet_sent(call, lastPacket, istack);
+    for (i = 0; i < batch->len; i++) {
+	struct xmitlist *xmit = &batch->lists[i];
+	int lastPacket = (xmit->list[xmit->len - 1]->header.flags
+			  & RX_LAST_PACKET) ? 1 : 0;
+
+	rxi_rto_packet_sent(call, lastPacket, istack);
+    }
 
     /* Update last send time for this call (for keep-alive
      * processing), and for the connection (so that we can discover
      * idle connections) */
     conn->lastSendTime = call->lastSendTime = clock_Sec();
+
+    batch->len = 0;
+}
+
+/* Queue a list of packets to be sent as a single datagram, sending the
+ * whole batch once it is full. Returns non-zero if anything sent so far
+ * means that the caller should stop sending. */
+static int
+rxi_QueueList(struct rx_call *call, struct xmitbatch *batch,
+	      struct xmitlist *xmit, int istack, int moreFlag, int recovery)
+{
+    batch->lists[batch->len] = *xmit;
+    batch->moreFlags[batch->len] = moreFlag;
+    batch->len++;
+
+    if (batch->len < RX_XMITBATCH && rx_enable_batch_io)
+	return 0;
+
+    rxi_SendLists(call, batch, istack);
+
+    /* If the call enters an error state stop sending, or if
+     * we entered congestion recovery mode, stop sending */
+    return (call->error
+	    || (!recovery && (call->flags & RX_CALL_FAST_RECOVER)));
 }
 
 /* When sending packets we need to follow these rules:
  * 1. Never send more than maxDgramPackets in a jumbogram.
- * 2. Never send a packet with more than two iovecs in a jumbogram.
+ * 2. Never send a packet with more than two iovecs in a jumbogram, unless
+ *    its data lies in a file mapping.
  * 3. Never send a retransmitted packet in a jumbogram.
  * 4. Never send more than cwind/4 packets in a jumbogram
  * We always keep the last list we should have sent so we
@@ -5770,6 +6770,7 @@ rxi_SendXmitList(struct rx_call *call, struct rx_packet **list, int len,
     int recovery;
     struct xmitlist working;
     struct xmitlist last;
+    struct xmitbatch batch;
 
     struct rx_peer *peer = call->conn->peer;
     int morePackets = 0;
@@ -5778,6 +6779,7 @@ rxi_SendXmitList(struct rx_call *call, struct rx_packet **list, int len,
     working.list = &list[0];
     working.len = 0;
     working.resending = 0;
+    batch.len = 0;
 
     recovery = call->flags & RX_CALL_FAST_RECOVER;
 
@@ -5787,15 +6789,11 @@ rxi_SendXmitList(struct rx_call *call, struct rx_packet **list, int len,
 	    && (list[i]->header.serial || (list[i]->flags & RX_PKTFLAG_ACKED)
 		|| list[i]->length > RX_JUMBOBUFFERSIZE)) {
 
-	    /* This sends the 'last' list and then rolls the current working
+	    /* This queues the 'last' list and then rolls the current working
 	     * set into the 'last' one, and resets the working set */
 
 	    if (last.len > 0) {
-		rxi_SendList(call, &last, istack, 1);
-		/* If the call enters an error state stop sending, or if
-		 * we entered congestion recovery mode, stop sending */
-		if (call->error
-		    || (!recovery && (call->flags & RX_CALL_FAST_RECOVER)))
+		if (rxi_QueueList(call, &batch, &last, istack, 1, recovery))
 		    return;
 	    }
 	    last = working;
@@ -5818,11 +6816,8 @@ rxi_SendXmitList(struct rx_call *call, struct rx_packet **list, int len,
 		|| list[i]->header.serial
 		|| list[i]->length != RX_JUMBOBUFFERSIZE) {
 		if (last.len > 0) {
-		    rxi_SendList(call, &last, istack, 1);
-		    /* If the call enters an error state stop sending, or if
-		     * we entered congestion recovery mode, stop sending */
-		    if (call->error
-			|| (!recovery && (call->flags & RX_CALL_FAST_RECOVER)))
+		    if (rxi_QueueList(call, &batch, &last, istack, 1,
+				      recovery))
 			return;
 		}
 		last = working;
@@ -5855,20 +6850,20 @@ rxi_SendXmitList(struct rx_call *call, struct rx_packet **list, int len,
 	    morePackets = 1;
 	}
 	if (last.len > 0) {
-	    rxi_SendList(call, &last, istack, morePackets);
-	    /* If the call enters an error state stop sending, or if
-	     * we entered congestion recovery mode, stop sending */
-	    if (call->error
-		|| (!recovery && (call->flags & RX_CALL_FAST_RECOVER)))
+	    if (rxi_QueueList(call, &batch, &last, istack, morePackets,
+			      recovery))
 		return;
 	}
 	if (morePackets) {
-	    rxi_SendList(call, &working, istack, 0);
+	    rxi_QueueList(call, &batch, &working, istack, 0, recovery);
 	}
     } else if (last.len > 0) {
-	rxi_SendList(call, &last, istack, 0);
+	rxi_QueueList(call, &batch, &last, istack, 0, recovery);
 	/* Packets which are in 'working' are not sent by this call */
     }
+
+    /* Send whatever is left in the batch */
+    rxi_SendLists(call, &batch, istack);
 }
 
 /**
@@ -5969,19 +6964,104 @@ rxi_Resend(struct rxevent *event, void *arg0, void *arg1, int istack)
 	call->MTU = RX_JUMBOBUFFERSIZE + RX_HEADER_SIZE;
         call->MTU = MIN(peer->natMTU, peer->maxMTU);
     }
-    call->ssthresh = MAX(4, MIN((int)call->cwind, (int)call->twind)) >> 1;
+    MUTEX_ENTER(&peer->peer_lock);
+    RXCC_OnLoss(call, peer, 1);
+    clock_GetTime(&call->recoverTime);
     call->nDgramPackets = 1;
     call->cwind = 1;
     call->nextCwind = 1;
     call->nAcks = 0;
-    call->nNacks = 0;
-    MUTEX_ENTER(&peer->peer_lock);
     peer->MTU = call->MTU;
     peer->cwind = call->cwind;
     peer->nDgramPackets = 1;
     peer->congestSeq++;
     call->congestSeq = peer->congestSeq;
     MUTEX_EXIT(&peer->peer_lock);
+    RXI_TRACE_WINDOW(call);
+
+    rxi_Start(call, istack);
+
+out:
+    MUTEX_EXIT(&call->lock);
+}
+
+/* Nothing has been heard from the peer since the end of the last flight of
+ * packets was sent. Rather than waiting for the retransmit timer, send the
+ * most recent packet again. The ACK for it will tell the loss detector
+ * which, if any, of the packets before it have been lost. */
+static void
+rxi_LossProbe(struct rxevent *event, void *arg0, void *arg1, int istack)
+{
+    struct rx_call *call = arg0;
+    struct opr_queue *cursor;
+
+    MUTEX_ENTER(&call->lock);
+
+    /* If the timer has been cancelled or restarted since we were
+     * triggered, then whoever did that has already taken care of it */
+    if (event != call->resendEvent) {
+	MUTEX_EXIT(&call->lock);
+	return;
+    }
+    CALL_RELE(call, RX_CALL_REFCOUNT_RESEND);
+    rxevent_Put(&call->resendEvent);
+
+    for (opr_queue_ScanBackwards(&call->tq, cursor)) {
+	struct rx_packet *p = opr_queue_Entry(cursor, struct rx_packet, entry);
+	if ((p->flags & RX_PKTFLAG_SENT) && !(p->flags & RX_PKTFLAG_ACKED)) {
+	    p->flags &= ~RX_PKTFLAG_SENT;
+	    call->flags |= RX_CALL_PROBE_SENT;
+	    break;
+	}
+    }
+
+    if (call->flags & RX_CALL_PROBE_SENT) {
+	rxi_Start(call, istack);
+
+	/* Only one probe is sent; if that goes unanswered too, the
+	 * retransmit timer takes over */
+	if (call->resendEvent == NULL && !opr_queue_IsEmpty(&call->tq))
+	    rxi_rto_startTimer(call, 0, istack);
+    }
+
+    MUTEX_EXIT(&call->lock);
+}
+
+/* Packets which might have been reordered on the way to the peer have now
+ * been outstanding for long enough to be treated as lost. */
+static void
+rxi_ReorderTimeout(struct rxevent *event, void *arg0, void *arg1, int istack)
+{
+    struct rx_call *call = arg0;
+    struct rx_peer *peer;
+    struct clock now, reorderTime;
+
+    MUTEX_ENTER(&call->lock);
+
+    /* As for rxi_LossProbe */
+    if (event != call->resendEvent) {
+	MUTEX_EXIT(&call->lock);
+	return;
+    }
+    CALL_RELE(call, RX_CALL_REFCOUNT_RESEND);
+    rxevent_Put(&call->resendEvent);
+
+    if (opr_queue_IsEmpty(&call->tq))
+	goto out;
+
+    clock_GetTime(&now);
+    if (rxi_rack_DetectLoss(call, &now, &reorderTime) > 0
+	&& !(call->flags & RX_CALL_FAST_RECOVER)) {
+	peer = call->conn->peer;
+	MUTEX_ENTER(&peer->peer_lock);
+	rxi_FastRecover(call, peer, &now);
+	MUTEX_EXIT(&peer->peer_lock);
+    }
+
+    if (clock_IsZero(&reorderTime))
+	rxi_rto_packet_acked(call, istack);
+    else
+	rxi_rack_startTimer(call, &reorderTime, istack);
 
     rxi_Start(call, istack);
 
@@ -6003,6 +7083,7 @@ rxi_Start(struct rx_call *call, int istack)
 #endif
     int nXmitPackets;
     int maxXmitPackets;
+    int nIgnored;
 
     if (call->error) {
 #ifdef RX_ENABLE_LOCKS
@@ -6038,15 +7119,16 @@ rxi_Start(struct rx_call *call, int istack)
 		call->flags &= ~RX_CALL_NEED_START;
 #endif /* RX_ENABLE_LOCKS */
 		nXmitPackets = 0;
-		maxXmitPackets = MIN(call->twind, call->cwind);
+		nIgnored = 0;
+		maxXmitPackets = MIN(MIN(call->twind, call->cwind),
+				     RX_MAXACKS);
 		for (opr_queue_Scan(&call->tq, cursor)) {
 		    struct rx_packet *p
 			= opr_queue_Entry(cursor, struct rx_packet, entry);
 
 		    if (p->flags & RX_PKTFLAG_ACKED) {
 			/* Since we may block, don't trust this */
-                        if (rx_stats_active)
-                            rx_atomic_inc(&rx_stats.ignoreAckedPacket);
+			nIgnored++;
 			continue;	/* Ignore this packet if it has been acknowledged */
 		    }
 
@@ -6071,6 +7153,9 @@ rxi_Start(struct rx_call *call, int istack)
 		    /* Transmit the packet if it needs to be sent. */
 		    if (!(p->flags & RX_PKTFLAG_SENT)) {
 			if (nXmitPackets == maxXmitPackets) {
+			    if (rx_stats_active && nIgnored)
+				rx_atomic_add(&rx_stats.ignoreAckedPacket,
+					      nIgnored);
 			    rxi_SendXmitList(call, call->xmitList,
 					     nXmitPackets, istack);
 			    goto restart;
@@ -6081,6 +7166,9 @@ rxi_Start(struct rx_call *call, int istack)
 		    }
 		} /* end of the queue_Scan */
 
+		if (rx_stats_active && nIgnored)
+		    rx_atomic_add(&rx_stats.ignoreAckedPacket, nIgnored);
+
 		/* xmitList now hold pointers to all of the packets that are
 		 * ready to send. Now we loop to send the packets */
 		if (nXmitPackets > 0) {
@@ -6179,7 +7267,8 @@ rxi_Send(struct rx_call *call, struct rx_packet *p,
      * idle connections) */
     if ((p->header.type != RX_PACKET_TYPE_ACK) ||
 	(((struct rx_ackPacket *)rx_DataOf(p))->reason == RX_ACK_PING) ||
-	(p->length <= (rx_AckDataSize(call->rwind) + 4 * sizeof(afs_int32))))
+	(p->length <= rxi_AckLength(call->rwind,
+				  rx_atomic_read(&call->conn->peer->extAcks))))
     {
 	conn->lastSendTime = call->lastSendTime = clock_Sec();
     }
@@ -6414,6 +7503,8 @@ rxi_ScheduleNatKeepAliveEvent(struct rx_connection *conn)
 void
 rx_SetConnSecondsUntilNatPing(struct rx_connection *conn, afs_int32 seconds)
 {
+    int i, n;
+
     MUTEX_ENTER(&conn->conn_data_lock);
     conn->secondsUntilNatPing = seconds;
     if (seconds != 0) {
@@ -6422,7 +7513,12 @@ rx_SetConnSecondsUntilNatPing(struct rx_connection *conn, afs_int32 seconds)
 	else
 	    conn->flags |= RX_CONN_NAT_PING;
     }
+    n = conn->nWideConns;
     MUTEX_EXIT(&conn->conn_data_lock);
+
+    /* A wide connection's further channels keep their mappings too */
+    for (i = 0; i < n; i++)
+	rx_SetConnSecondsUntilNatPing(conn->wideConns[i], seconds);
 }
 
 /* When a call is in progress, this routine is called occasionally to
@@ -6567,11 +7663,9 @@ rxi_CancelGrowMTUEvent(struct rx_call *call)
 static void
 update_nextCid(void)
 {
-    /* Overflow is technically undefined behavior; avoid it. */
-    if (rx_nextCid > MAX_AFS_INT32 - (1 << RX_CIDSHIFT))
-	rx_nextCid = -1 * ((MAX_AFS_INT32 / RX_CIDSHIFT) * RX_CIDSHIFT);
-    else
-	rx_nextCid += 1 << RX_CIDSHIFT;
+    /* rx_nextCid is unsigned, so it may simply wrap; but the channel bits
+     * must stay clear, or no reply will ever match the connection. */
+    rx_nextCid = (rx_nextCid + (1 << RX_CIDSHIFT)) & RX_CIDMASK;
 }
 
 static void
@@ -6898,16 +7992,19 @@ rxi_ReapConnections(struct rxevent *unused, void *unused1, void *unused2,
     /* Find server connection structures that haven't been used for
      * greater than rx_idleConnectionTime */
     {
-	struct rx_connection **conn_ptr, **conn_end;
+	struct rx_connection **conn_ptr;
+	afs_uint32 b;
 	int i, havecalls = 0;
-	MUTEX_ENTER(&rx_connHashTable_lock);
-	for (conn_ptr = &rx_connHashTable[0], conn_end =
-	     &rx_connHashTable[rx_hashTableSize]; conn_ptr < conn_end;
-	     conn_ptr++) {
+
+	/* The table may grow while we are between buckets, but never while
+	 * we hold the lock of the shard we are in. */
+	for (b = 0; b < rx_connHashTableSize; b++) {
 	    struct rx_connection *conn, *next;
 	    struct rx_call *call;
 	    int result;
 
+	    MUTEX_ENTER(CONN_HASH_LOCK(b));
+	    conn_ptr = &rx_connHashTable[b];
 	  rereap:
 	    for (conn = *conn_ptr; conn; conn = next) {
 		/* XXX -- Shouldn't the connection be locked? */
@@ -6957,30 +8054,23 @@ rxi_ReapConnections(struct rxevent *unused, void *unused1, void *unused2,
 #endif /* RX_ENABLE_LOCKS */
 		}
 	    }
-	}
 #ifdef RX_ENABLE_LOCKS
-	while (rx_connCleanup_list) {
-	    struct rx_connection *conn;
-	    conn = rx_connCleanup_list;
-	    rx_connCleanup_list = rx_connCleanup_list->next;
-	    MUTEX_EXIT(&rx_connHashTable_lock);
-	    rxi_CleanupConnection(conn);
-	    MUTEX_ENTER(&rx_connHashTable_lock);
-	}
-	MUTEX_EXIT(&rx_connHashTable_lock);
+	    rxi_CleanupConnections(RX_HASH_SHARD(b));
 #endif /* RX_ENABLE_LOCKS */
+	    MUTEX_EXIT(CONN_HASH_LOCK(b));
+	}
     }
 
     /* Find any peer structures that haven't been used (haven't had an
      * associated connection) for greater than rx_idlePeerTime */
     {
-	struct rx_peer **peer_ptr, **peer_end;
+	afs_uint32 b;
 	int code;
 
         /*
-         * Why do we need to hold the rx_peerHashTable_lock across
-         * the incrementing of peer_ptr since the rx_peerHashTable
-         * array is not changing?  We don't.
+         * Why do we need to hold a rx_peerHashTable_lock across
+         * the move from one bucket to the next?  We don't, so long as
+         * we find the table afresh each time, since it may have grown.
          *
          * By dropping the lock periodically we can permit other
          * activities to be performed while a rxi_ReapConnections
@@ -6989,20 +8079,15 @@ rxi_ReapConnections(struct rxevent *unused, void *unused1, void *unused2,
          * of contention.  Therefore, it is important that global
          * mutexes not be held for extended periods of time.
          */
-	for (peer_ptr = &rx_peerHashTable[0], peer_end =
-	     &rx_peerHashTable[rx_hashTableSize]; peer_ptr < peer_end;
-	     peer_ptr++) {
-	    struct rx_peer *peer, *next, *prev;
+	for (b = 0; b < rx_peerHashTableSize; b++) {
+	    struct rx_peer *peer, *next;
 
-            MUTEX_ENTER(&rx_peerHashTable_lock);
-            for (prev = peer = *peer_ptr; peer; peer = next) {
+            MUTEX_ENTER(PEER_HASH_LOCK(b));
+            for (peer = rx_peerHashTable[b]; peer; peer = next) {
 		next = peer->next;
 		code = MUTEX_TRYENTER(&peer->peer_lock);
 		if ((code) && (peer->refCount == 0)
 		    && ((peer->idleWhen + rx_idlePeerTime) < now.sec)) {
-		    struct opr_queue *cursor, *store;
-		    size_t space;
-
                     /*
                      * now know that this peer object is one to be
                      * removed from the hash table.  Once it is removed
@@ -7010,72 +8095,42 @@ rxi_ReapConnections(struct rxevent *unused, void *unused1, void *unused2,
                      * Lets remove it first and decrement the struct
                      * nPeerStructs count.
                      */
-		    if (peer == *peer_ptr) {
-			*peer_ptr = next;
-			prev = next;
-		    } else
-			prev->next = next;
+		    rxi_UnhashPeer(peer);
 
                     if (rx_stats_active)
                         rx_atomic_dec(&rx_stats.nPeerStructs);
 
                     /*
-                     * Now if we hold references on 'prev' and 'next'
-                     * we can safely drop the rx_peerHashTable_lock
-                     * while we destroy this 'peer' object.
+                     * Now if we hold a reference on 'next' we can
+                     * safely drop the shard's rx_peerHashTable_lock
+                     * while we destroy this 'peer' object.  If the
+                     * table grows meanwhile, 'next' stays in this
+                     * shard, though perhaps not in this bucket.
                      */
                     if (next)
                         next->refCount++;
-                    if (prev)
-                        prev->refCount++;
-                    MUTEX_EXIT(&rx_peerHashTable_lock);
+                    MUTEX_EXIT(PEER_HASH_LOCK(b));
 
 		    MUTEX_EXIT(&peer->peer_lock);
 		    MUTEX_DESTROY(&peer->peer_lock);
 
-		    for (opr_queue_ScanSafe(&peer->rpcStats, cursor, store)) {
-			unsigned int num_funcs;
-    			struct rx_interface_stat *rpc_stat
-			    = opr_queue_Entry(cursor, struct rx_interface_stat,
-					     entry);
-			if (!rpc_stat)
-			    break;
-
-			opr_queue_Remove(&rpc_stat->entry);
-			opr_queue_Remove(&rpc_stat->entryPeers);
-
-			num_funcs = rpc_stat->stats[0].func_total;
-			space =
-			    sizeof(rx_interface_stat_t) +
-			    rpc_stat->stats[0].func_total *
-			    sizeof(rx_function_entry_v1_t);
-
-			rxi_Free(rpc_stat, space);
-
-                        MUTEX_ENTER(&rx_rpc_stats);
-			rxi_rpc_peer_stat_cnt -= num_funcs;
-                        MUTEX_EXIT(&rx_rpc_stats);
-		    }
+		    rxi_FreePeerRpcStats(peer);
 		    rxi_FreePeer(peer);
 
                     /*
-                     * Regain the rx_peerHashTable_lock and
-                     * decrement the reference count on 'prev'
-                     * and 'next'.
+                     * Regain the shard's rx_peerHashTable_lock and
+                     * decrement the reference count on 'next'.
                      */
-                    MUTEX_ENTER(&rx_peerHashTable_lock);
+                    MUTEX_ENTER(PEER_HASH_LOCK(b));
                     if (next)
                         next->refCount--;
-                    if (prev)
-                        prev->refCount--;
 		} else {
 		    if (code) {
 			MUTEX_EXIT(&peer->peer_lock);
 		    }
-		    prev = peer;
 		}
 	    }
-            MUTEX_EXIT(&rx_peerHashTable_lock);
+            MUTEX_EXIT(PEER_HASH_LOCK(b));
 	}
     }
 
@@ -7266,6 +8321,14 @@ rx_PrintTheseStats(FILE * file, struct rx_statistics *s, int size,
 	    "   \t(these should be small) sendFailed %u, " "fatalErrors %u\n",
 	    s->netSendFailures, (int)s->fatalErrors);
 
+    if (s->recvBatches || s->sendBatches) {
+	fprintf(file,
+		"   batched reads %u (%u packets), "
+		"batched sends %u (%u packets)\n",
+		s->recvBatches, s->recvBatchPackets, s->sendBatches,
+		s->sendBatchPackets);
+    }
+
     if (s->nRttSamples) {
 	fprintf(file, "   Average rtt is %0.3f, with %d samples\n",
 		clock_Float(&s->totalRtt) / s->nRttSamples, s->nRttSamples);
@@ -7443,6 +8506,7 @@ rx_GetServerDebug(osi_socket socket, afs_uint32 remoteAddr,
 #if defined(RXDEBUG) || defined(MAKEDEBUGCALL)
     afs_int32 rc = 0;
     struct rx_debugIn in;
+    int i;
 
     *supportedValues = 0;
     in.type = htonl(RX_DEBUGI_GETSTATS);
@@ -7485,6 +8549,15 @@ rx_GetServerDebug(osi_socket socket, afs_uint32 remoteAddr,
 	if (stat->version >= RX_DEBUGI_VERSION_W_PACKETS) {
 	    *supportedValues |= RX_SERVER_DEBUG_PACKETS_CNT;
 	}
+	if (stat->version >= RX_DEBUGI_VERSION_W_CALLCC) {
+	    *supportedValues |= RX_SERVER_DEBUG_CALL_CC;
+	}
+	if (stat->version >= RX_DEBUGI_VERSION_W_CALLQUEUES) {
+	    *supportedValues |= RX_SERVER_DEBUG_CALL_QUEUES;
+	}
+	if (stat->version >= RX_DEBUGI_VERSION_W_WIDECONN) {
+	    *supportedValues |= RX_SERVER_DEBUG_WIDE_CONN;
+	}
 	stat->nFreePackets = ntohl(stat->nFreePackets);
 	stat->packetReclaims = ntohl(stat->packetReclaims);
 	stat->callsExecuted = ntohl(stat->callsExecuted);
@@ -7492,6 +8565,10 @@ rx_GetServerDebug(osi_socket socket, afs_uint32 remoteAddr,
 	stat->idleThreads = ntohl(stat->idleThreads);
         stat->nWaited = ntohl(stat->nWaited);
         stat->nPackets = ntohl(stat->nPackets);
+	stat->nCallQueues = ntohl(stat->nCallQueues);
+	for (i = 0; i < RX_NPRIORITIES; i++)
+	    stat->nQueued[i] = ntohl(stat->nQueued[i]);
+	stat->nStolen = ntohl(stat->nStolen);
     }
 #else
     afs_int32 rc = -1;
@@ -7623,6 +8700,8 @@ rx_GetServerConnections(osi_socket socket, afs_uint32 remoteAddr,
 	conn->serial = ntohl(conn->serial);
 	for (i = 0; i < RX_MAXCALLS; i++) {
 	    conn->callNumber[i] = ntohl(conn->callNumber[i]);
+	    conn->callCwind[i] = ntohl(conn->callCwind[i]);
+	    conn->callRtt[i] = ntohl(conn->callRtt[i]);
 	}
 	conn->error = ntohl(conn->error);
 	conn->secStats.flags = ntohl(conn->secStats.flags);
@@ -7634,6 +8713,7 @@ rx_GetServerConnections(osi_socket socket, afs_uint32 remoteAddr,
 	conn->secStats.bytesSent = ntohl(conn->secStats.bytesSent);
 	conn->epoch = ntohl(conn->epoch);
 	conn->natMTU = ntohl(conn->natMTU);
+	conn->wideCid = ntohl(conn->wideCid);
     }
 #else
     afs_int32 rc = -1;
@@ -7709,8 +8789,8 @@ rx_GetLocalPeers(afs_uint32 peerHost, afs_uint16 peerPort,
 	afs_int32 error = 1; /* default to "did not succeed" */
 	afs_uint32 hashValue = PEER_HASH(peerHost, peerPort);
 
-	MUTEX_ENTER(&rx_peerHashTable_lock);
-	for(tp = rx_peerHashTable[hashValue];
+	MUTEX_ENTER(PEER_HASH_LOCK(hashValue));
+	for(tp = rx_peerHashTable[PEER_BUCKET(hashValue)];
 	      tp != NULL; tp = tp->next) {
 		if (tp->host == peerHost)
 			break;
@@ -7718,7 +8798,7 @@ rx_GetLocalPeers(afs_uint32 peerHost, afs_uint16 peerPort,
 
 	if (tp) {
                 tp->refCount++;
-                MUTEX_EXIT(&rx_peerHashTable_lock);
+                MUTEX_EXIT(PEER_HASH_LOCK(hashValue));
 
 		error = 0;
 
@@ -7753,10 +8833,10 @@ rx_GetLocalPeers(afs_uint32 peerHost, afs_uint16 peerPort,
 				= tp->bytesReceived & MAX_AFS_UINT32;
                 MUTEX_EXIT(&tp->peer_lock);
 
-                MUTEX_ENTER(&rx_peerHashTable_lock);
+                MUTEX_ENTER(PEER_HASH_LOCK(hashValue));
                 tp->refCount--;
 	}
-	MUTEX_EXIT(&rx_peerHashTable_lock);
+	MUTEX_EXIT(PEER_HASH_LOCK(hashValue));
 
 	return error;
 }
@@ -7765,6 +8845,7 @@ void
 shutdown_rx(void)
 {
     struct rx_serverQueueEntry *np;
+    struct rx_callQueue *cq;
     int i, j;
 #ifndef KERNEL
     struct rx_call *call;
@@ -7794,68 +8875,43 @@ shutdown_rx(void)
     while (!opr_queue_IsEmpty(&rx_freeCallQueue)) {
 	call = opr_queue_First(&rx_freeCallQueue, struct rx_call, entry);
 	opr_queue_Remove(&call->entry);
+	if (call->arena != NULL)
+	    rxi_FreeCallArena(call);
 	rxi_Free(call, sizeof(struct rx_call));
     }
 
-    while (!opr_queue_IsEmpty(&rx_idleServerQueue)) {
-	sq = opr_queue_First(&rx_idleServerQueue, struct rx_serverQueueEntry,
-			    entry);
-	opr_queue_Remove(&sq->entry);
+    for (cq = rx_callQueues; cq < rx_callQueues + rx_nCallQueues; cq++) {
+	while (!opr_queue_IsEmpty(&cq->idle)) {
+	    sq = opr_queue_First(&cq->idle, struct rx_serverQueueEntry,
+				entry);
+	    opr_queue_Remove(&sq->entry);
+	}
     }
 #endif /* KERNEL */
 
+    rxi_FreePeerRpcStats(NULL);
     {
-	struct rx_peer **peer_ptr, **peer_end;
-	for (peer_ptr = &rx_peerHashTable[0], peer_end =
-	     &rx_peerHashTable[rx_hashTableSize]; peer_ptr < peer_end;
-	     peer_ptr++) {
+	afs_uint32 b;
+	for (b = 0; b < rx_peerHashTableSize; b++) {
 	    struct rx_peer *peer, *next;
 
-            MUTEX_ENTER(&rx_peerHashTable_lock);
-            for (peer = *peer_ptr; peer; peer = next) {
-		struct opr_queue *cursor, *store;
-		size_t space;
-
-                MUTEX_ENTER(&rx_rpc_stats);
-                MUTEX_ENTER(&peer->peer_lock);
-		for (opr_queue_ScanSafe(&peer->rpcStats, cursor, store)) {
-		    unsigned int num_funcs;
-		    struct rx_interface_stat *rpc_stat
-			= opr_queue_Entry(cursor, struct rx_interface_stat,
-					 entry);
-		    if (!rpc_stat)
-			break;
-		    opr_queue_Remove(&rpc_stat->entry);
-		    opr_queue_Remove(&rpc_stat->entryPeers);
-		    num_funcs = rpc_stat->stats[0].func_total;
-		    space =
-			sizeof(rx_interface_stat_t) +
-			rpc_stat->stats[0].func_total *
-			sizeof(rx_function_entry_v1_t);
-
-		    rxi_Free(rpc_stat, space);
-
-                    /* rx_rpc_stats must be held */
-		    rxi_rpc_peer_stat_cnt -= num_funcs;
-		}
-                MUTEX_EXIT(&peer->peer_lock);
-                MUTEX_EXIT(&rx_rpc_stats);
-
+            MUTEX_ENTER(PEER_HASH_LOCK(b));
+            for (peer = rx_peerHashTable[b]; peer; peer = next) {
 		next = peer->next;
 		rxi_FreePeer(peer);
                 if (rx_stats_active)
                     rx_atomic_dec(&rx_stats.nPeerStructs);
 	    }
-            MUTEX_EXIT(&rx_peerHashTable_lock);
+            MUTEX_EXIT(PEER_HASH_LOCK(b));
 	}
     }
     for (i = 0; i < RX_MAX_SERVICES; i++) {
 	if (rx_services[i])
 	    rxi_Free(rx_services[i], sizeof(*rx_services[i]));
     }
-    for (i = 0; i < rx_hashTableSize; i++) {
+    for (i = 0; i < rx_connHashTableSize; i++) {
 	struct rx_connection *tc, *ntc;
-	MUTEX_ENTER(&rx_connHashTable_lock);
+	MUTEX_ENTER(CONN_HASH_LOCK(i));
 	for (tc = rx_connHashTable[i]; tc; tc = ntc) {
 	    ntc = tc->next;
 	    for (j = 0; j < RX_MAXCALLS; j++) {
@@ -7865,7 +8921,7 @@ shutdown_rx(void)
 	    }
 	    rxi_Free(tc, sizeof(*tc));
 	}
-	MUTEX_EXIT(&rx_connHashTable_lock);
+	MUTEX_EXIT(CONN_HASH_LOCK(i));
     }
 
     MUTEX_ENTER(&freeSQEList_lock);
@@ -7879,17 +8935,25 @@ shutdown_rx(void)
     MUTEX_EXIT(&freeSQEList_lock);
     MUTEX_DESTROY(&freeSQEList_lock);
     MUTEX_DESTROY(&rx_freeCallQueue_lock);
-    MUTEX_DESTROY(&rx_connHashTable_lock);
-    MUTEX_DESTROY(&rx_peerHashTable_lock);
-    MUTEX_DESTROY(&rx_serverPool_lock);
+#ifdef RX_ENABLE_LOCKS
+    for (i = 0; i < RX_HASH_SHARDS; i++) {
+	MUTEX_DESTROY(&rx_connHashTable_lock[i]);
+	MUTEX_DESTROY(&rx_peerHashTable_lock[i]);
+    }
+    MUTEX_DESTROY(&rx_nextCid_lock);
+#endif /* RX_ENABLE_LOCKS */
+    for (cq = rx_callQueues; cq < rx_callQueues + rx_nCallQueues; cq++)
+	MUTEX_DESTROY(&cq->lock);
 
+    osi_Free(rx_callQueues, rx_nCallQueues * sizeof(struct rx_callQueue));
     osi_Free(rx_connHashTable,
-	     rx_hashTableSize * sizeof(struct rx_connection *));
-    osi_Free(rx_peerHashTable, rx_hashTableSize * sizeof(struct rx_peer *));
+	     rx_connHashTableSize * sizeof(struct rx_connection *));
+    osi_Free(rx_peerHashTable,
+	     rx_peerHashTableSize * sizeof(struct rx_peer *));
 
     UNPIN(rx_connHashTable,
-	  rx_hashTableSize * sizeof(struct rx_connection *));
-    UNPIN(rx_peerHashTable, rx_hashTableSize * sizeof(struct rx_peer *));
+	  rx_connHashTableSize * sizeof(struct rx_connection *));
+    UNPIN(rx_peerHashTable, rx_peerHashTableSize * sizeof(struct rx_peer *));
 
     MUTEX_ENTER(&rx_quota_mutex);
     rxi_dataQuota = RX_MAX_QUOTA;
@@ -7999,22 +9063,59 @@ rx_GetServiceSpecific(struct rx_service *svc, int key)
 #endif /* !KERNEL */
 
 /*
- * processStats is a queue used to store the statistics for the local
- * process.  Its contents are similar to the contents of the rpcStats
- * queue on a rx_peer structure, but the actual data stored within
- * this queue contains totals across the lifetime of the process (assuming
- * the stats have not been reset) - unlike the per peer structures
- * which can come and go based upon the peer lifetime.
+ * RPC statistics are kept in shards, one for each thread which records them,
+ * so that threads needn't contend for a lock as each call completes. Each
+ * shard's stats queue holds the process statistics counted by its thread,
+ * across the lifetime of the process (assuming the stats have not been
+ * reset). Its peerStats hash table holds the per peer statistics counted by
+ * its thread, keyed by the peer's host and port; these are freed along with
+ * the peer structure.
+ *
+ * A shard's counters are only ever updated by its own thread, under the
+ * shard's lock, which is otherwise only taken by readers and resetters.
+ * Readers total up all of the shards on rxi_rpcShards, under the
+ * rx_rpc_stats mutex. Shards are never freed, as their counts outlive their
+ * threads. Without thread-specific data there is only one shard, which is
+ * updated under the rx_rpc_stats mutex.
  */
 
-static struct opr_queue processStats = { &processStats, &processStats };
+struct rx_rpc_shard {
+    struct opr_queue entry;	/* On rxi_rpcShards */
+#ifdef RX_ENABLE_LOCKS
+    afs_kmutex_t lock;
+#endif
+    struct opr_queue stats;	/* rx_interface_stat, for process stats */
+    struct opr_queue *peerStats;	/* RX_RPC_PEER_BUCKETS hash chains of
+					 * rx_interface_stat, for peer stats */
+    unsigned int peerStatCnt;	/* function entries held in peerStats */
+    struct opr_queue latency;	/* rxi_rpc_latency, for every server call */
+};
+
+static struct opr_queue rxi_rpcShards = { &rxi_rpcShards, &rxi_rpcShards };
+
+#define RX_RPC_PEER_BUCKETS 127
+#define RX_RPC_PEER_HASH(host, port) (((host) ^ (port)) % RX_RPC_PEER_BUCKETS)
 
 /*
- * peerStats is a queue used to store the statistics for all peer structs.
- * Its contents are the union of all the peer rpcStats queues.
+ * The execution times of the calls served by each interface function are
+ * counted in a log-linear histogram, whether or not process stats are on.
+ * Times of under RX_LATENCY_SUB usec are counted exactly. Above that, each
+ * power of two is split into RX_LATENCY_SUB buckets, so that no bucket is
+ * wider than 1/RX_LATENCY_SUB of the times it holds. Times of over 2^32
+ * usec all land in the last bucket.
  */
 
-static struct opr_queue peerStats = { &peerStats, &peerStats };
+#define RX_LATENCY_SUBBITS 3
+#define RX_LATENCY_SUB (1 << RX_LATENCY_SUBBITS)
+#define RX_LATENCY_BUCKETS ((32 - RX_LATENCY_SUBBITS + 1) * RX_LATENCY_SUB)
+
+struct rxi_rpc_latency {
+    struct opr_queue entry;
+    afs_uint32 rxInterface;
+    afs_uint32 totalFunc;
+    afs_uint32 *counts[1];	/* RX_LATENCY_BUCKETS per function, allocated
+				 * when the function is first called */
+};
 
 /*
  * rxi_monitor_processStats is used to turn process wide stat collection
@@ -8055,32 +9156,76 @@ rxi_ClearRPCOpStat(rx_function_entry_v1_p rpc_stat)
 }
 
 /*!
- * Given all of the information for a particular rpc
- * call, find or create (if requested) the stat structure for the rpc.
+ * Allocate a stat structure for an rpc interface, and add it to a queue.
  *
  * @param stats
- * 	the queue of stats that will be updated with the new value
+ * 	the queue of stats that the new structure is added to
  *
  * @param rxInterface
  * 	a unique number that identifies the rpc interface
  *
  * @param totalFunc
- * 	the total number of functions in this interface. this is only
- *      required if create is true
+ * 	the total number of functions in this interface
  *
  * @param isServer
  * 	if true, this invocation was made to a server
  *
  * @param remoteHost
- * 	the ip address of the remote host. this is only required if create
- *      and addToPeerList are true
+ * 	the ip address of the remote host, for peer stats
  *
  * @param remotePort
- * 	the port of the remote host. this is only required if create
- *      and addToPeerList are true
+ * 	the port of the remote host, for peer stats
  *
- * @param addToPeerList
- * 	if != 0, add newly created stat to the global peer list
+ * @param counter
+ * 	updated with the new number of allocated function entries
+ */
+
+static rx_interface_stat_p
+rxi_NewRpcStat(struct opr_queue *stats, afs_uint32 rxInterface,
+	       afs_uint32 totalFunc, int isServer, afs_uint32 remoteHost,
+	       afs_uint32 remotePort, unsigned int *counter)
+{
+    rx_interface_stat_p rpc_stat;
+    size_t space;
+    int i;
+
+    space = sizeof(rx_interface_stat_t) +
+	totalFunc * sizeof(rx_function_entry_v1_t);
+
+    rpc_stat = rxi_Alloc(space);
+    if (rpc_stat == NULL)
+	return NULL;
+
+    *counter += totalFunc;
+    for (i = 0; i < totalFunc; i++) {
+	rxi_ClearRPCOpStat(&(rpc_stat->stats[i]));
+	rpc_stat->stats[i].remote_peer = remoteHost;
+	rpc_stat->stats[i].remote_port = remotePort;
+	rpc_stat->stats[i].remote_is_server = isServer;
+	rpc_stat->stats[i].interfaceId = rxInterface;
+	rpc_stat->stats[i].func_total = totalFunc;
+	rpc_stat->stats[i].func_index = i;
+    }
+    opr_queue_Prepend(stats, &rpc_stat->entry);
+    return rpc_stat;
+}
+
+/*!
+ * Given all of the information for a particular rpc
+ * call, find or create (if requested) the process stat structure for the rpc.
+ *
+ * @param stats
+ * 	the queue of stats that will be updated with the new value
+ *
+ * @param rxInterface
+ * 	a unique number that identifies the rpc interface
+ *
+ * @param totalFunc
+ * 	the total number of functions in this interface. this is only
+ *      required if create is true
+ *
+ * @param isServer
+ * 	if true, this invocation was made to a server
  *
  * @param counter
  * 	if a new stats structure is allocated, the counter will
@@ -8094,11 +9239,10 @@ rxi_ClearRPCOpStat(rx_function_entry_v1_p rpc_stat)
 
 static rx_interface_stat_p
 rxi_FindRpcStat(struct opr_queue *stats, afs_uint32 rxInterface,
-		afs_uint32 totalFunc, int isServer, afs_uint32 remoteHost,
-		afs_uint32 remotePort, int addToPeerList,
-		unsigned int *counter, int create)
+		afs_uint32 totalFunc, int isServer, unsigned int *counter,
+		int create)
 {
-    rx_interface_stat_p rpc_stat = NULL;
+    rx_interface_stat_p rpc_stat;
     struct opr_queue *cursor;
 
     /*
@@ -8110,74 +9254,306 @@ rxi_FindRpcStat(struct opr_queue *stats, afs_uint32 rxInterface,
 
 	if ((rpc_stat->stats[0].interfaceId == rxInterface)
 	    && (rpc_stat->stats[0].remote_is_server == isServer))
-	    break;
+	    return rpc_stat;
     }
 
-    /* if they didn't ask us to create, we're done */
-    if (!create) {
-        if (opr_queue_IsEnd(stats, cursor))
-            return NULL;
-        else
-            return rpc_stat;
+    /* can't proceed without these */
+    if (!create || !totalFunc || !counter)
+	return NULL;
+
+    return rxi_NewRpcStat(stats, rxInterface, totalFunc, isServer,
+			  0xffffffff, 0xffffffff, counter);
+}
+
+/*!
+ * Allocate a hash table of peer stats.
+ */
+static struct opr_queue *
+rxi_AllocPeerRpcStats(void)
+{
+    struct opr_queue *buckets;
+    int i;
+
+    buckets = rxi_Alloc(RX_RPC_PEER_BUCKETS * sizeof(struct opr_queue));
+    if (buckets != NULL) {
+	for (i = 0; i < RX_RPC_PEER_BUCKETS; i++)
+	    opr_queue_Init(&buckets[i]);
     }
+    return buckets;
+}
 
-    /* can't proceed without these */
-    if (!totalFunc || !counter)
+/*!
+ * Find or create (if requested) the stat structure for an rpc interface
+ * used with a peer, in a hash table of peer stats.
+ *
+ * The parameters are as for rxi_FindRpcStat, with the peer's host and port
+ * in remoteHost and remotePort.
+ */
+static rx_interface_stat_p
+rxi_FindPeerRpcStat(struct opr_queue *buckets, afs_uint32 rxInterface,
+		    afs_uint32 totalFunc, int isServer, afs_uint32 remoteHost,
+		    afs_uint32 remotePort, unsigned int *counter, int create)
+{
+    struct opr_queue *bucket;
+    struct opr_queue *cursor;
+
+    bucket = &buckets[RX_RPC_PEER_HASH(remoteHost, remotePort)];
+    for (opr_queue_Scan(bucket, cursor)) {
+	rx_interface_stat_p rpc_stat
+	    = opr_queue_Entry(cursor, struct rx_interface_stat, entry);
+
+	if (rpc_stat->stats[0].remote_peer == remoteHost
+	    && rpc_stat->stats[0].remote_port == remotePort
+	    && rpc_stat->stats[0].interfaceId == rxInterface
+	    && rpc_stat->stats[0].remote_is_server == isServer)
+	    return rpc_stat;
+    }
+
+    if (!create || !totalFunc || !counter)
 	return NULL;
 
-    /*
-     * Didn't find a match so allocate a new structure and add it to the
-     * queue.
-     */
+    return rxi_NewRpcStat(bucket, rxInterface, totalFunc, isServer,
+			  remoteHost, remotePort, counter);
+}
 
-    if (opr_queue_IsEnd(stats, cursor) || (rpc_stat == NULL)
-	|| (rpc_stat->stats[0].interfaceId != rxInterface)
-	|| (rpc_stat->stats[0].remote_is_server != isServer)) {
-	int i;
-	size_t space;
+/*!
+ * Find the calling thread's shard of the process statistics, creating it
+ * if need be. Without thread-specific data, the caller must hold the
+ * rx_rpc_stats mutex.
+ */
+static struct rx_rpc_shard *
+rxi_GetRpcShard(void)
+{
+#ifdef RX_ENABLE_RPC_SHARDS
+    struct rx_ts_info_t *rx_ts_info;
+    struct rx_rpc_shard **shardp;
 
-	space =
-	    sizeof(rx_interface_stat_t) +
-	    totalFunc * sizeof(rx_function_entry_v1_t);
+    RX_TS_INFO_GET(rx_ts_info);
+    shardp = &rx_ts_info->rpc_shard;
+#else
+    static struct rx_rpc_shard *shard = NULL;
+    struct rx_rpc_shard **shardp = &shard;
+#endif
 
-	rpc_stat = rxi_Alloc(space);
-	if (rpc_stat == NULL)
-	    return NULL;
+    if (*shardp == NULL) {
+	struct rx_rpc_shard *newShard;
 
-	*counter += totalFunc;
-	for (i = 0; i < totalFunc; i++) {
-	    rxi_ClearRPCOpStat(&(rpc_stat->stats[i]));
-	    rpc_stat->stats[i].remote_peer = remoteHost;
-	    rpc_stat->stats[i].remote_port = remotePort;
-	    rpc_stat->stats[i].remote_is_server = isServer;
-	    rpc_stat->stats[i].interfaceId = rxInterface;
-	    rpc_stat->stats[i].func_total = totalFunc;
-	    rpc_stat->stats[i].func_index = i;
+	newShard = rxi_Alloc(sizeof(*newShard));
+	MUTEX_INIT(&newShard->lock, "rx_rpc_shard", MUTEX_DEFAULT, 0);
+	opr_queue_Init(&newShard->stats);
+	opr_queue_Init(&newShard->latency);
+#ifdef RX_ENABLE_RPC_SHARDS
+	MUTEX_ENTER(&rx_rpc_stats);
+#endif
+	opr_queue_Append(&rxi_rpcShards, &newShard->entry);
+#ifdef RX_ENABLE_RPC_SHARDS
+	MUTEX_EXIT(&rx_rpc_stats);
+#endif
+	*shardp = newShard;
+    }
+    return *shardp;
+}
+
+/*!
+ * Add the counts in one function's statistics to those in another.
+ */
+static void
+rxi_AddRPCOpStat(rx_function_entry_v1_p total, rx_function_entry_v1_p rpc_stat)
+{
+    total->invocations += rpc_stat->invocations;
+    total->bytes_sent += rpc_stat->bytes_sent;
+    total->bytes_rcvd += rpc_stat->bytes_rcvd;
+    clock_Add(&total->queue_time_sum, &rpc_stat->queue_time_sum);
+    clock_Add(&total->queue_time_sum_sqr, &rpc_stat->queue_time_sum_sqr);
+    if (clock_Lt(&rpc_stat->queue_time_min, &total->queue_time_min))
+	total->queue_time_min = rpc_stat->queue_time_min;
+    if (clock_Gt(&rpc_stat->queue_time_max, &total->queue_time_max))
+	total->queue_time_max = rpc_stat->queue_time_max;
+    clock_Add(&total->execution_time_sum, &rpc_stat->execution_time_sum);
+    clock_Add(&total->execution_time_sum_sqr,
+	      &rpc_stat->execution_time_sum_sqr);
+    if (clock_Lt(&rpc_stat->execution_time_min, &total->execution_time_min))
+	total->execution_time_min = rpc_stat->execution_time_min;
+    if (clock_Gt(&rpc_stat->execution_time_max, &total->execution_time_max))
+	total->execution_time_max = rpc_stat->execution_time_max;
+}
+
+/*!
+ * Total up the process statistics held in every shard into the queue
+ * totals, with one structure for each interface. rx_rpc_stats must be
+ * held.
+ *
+ * @return
+ * 	the number of function entries in totals
+ */
+static unsigned int
+rxi_TotalProcessRpcStats(struct opr_queue *totals)
+{
+    struct opr_queue *scursor, *cursor;
+    unsigned int count = 0;
+    int i;
+
+    for (opr_queue_Scan(&rxi_rpcShards, scursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(scursor, struct rx_rpc_shard, entry);
+
+	MUTEX_ENTER(&shard->lock);
+	for (opr_queue_Scan(&shard->stats, cursor)) {
+	    rx_interface_stat_p rpc_stat, total;
+
+	    rpc_stat = opr_queue_Entry(cursor, struct rx_interface_stat, entry);
+	    total = rxi_FindRpcStat(totals, rpc_stat->stats[0].interfaceId,
+				    rpc_stat->stats[0].func_total,
+				    rpc_stat->stats[0].remote_is_server,
+				    &count, 1);
+	    if (total == NULL)
+		continue;
+	    for (i = 0; i < rpc_stat->stats[0].func_total
+			&& i < total->stats[0].func_total; i++)
+		rxi_AddRPCOpStat(&total->stats[i], &rpc_stat->stats[i]);
 	}
-	opr_queue_Prepend(stats, &rpc_stat->entry);
-	if (addToPeerList) {
-	    opr_queue_Prepend(&peerStats, &rpc_stat->entryPeers);
+	MUTEX_EXIT(&shard->lock);
+    }
+    return count;
+}
+
+/*!
+ * Total up the peer statistics held in every shard into the hash table
+ * totals, with one structure for each peer and interface. rx_rpc_stats
+ * must be held.
+ *
+ * @return
+ * 	the number of function entries in totals
+ */
+static unsigned int
+rxi_TotalPeerRpcStats(struct opr_queue *totals)
+{
+    struct opr_queue *scursor, *cursor;
+    unsigned int count = 0;
+    int b, i;
+
+    for (opr_queue_Scan(&rxi_rpcShards, scursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(scursor, struct rx_rpc_shard, entry);
+
+	MUTEX_ENTER(&shard->lock);
+	for (b = 0; shard->peerStats != NULL && b < RX_RPC_PEER_BUCKETS; b++) {
+	    for (opr_queue_Scan(&shard->peerStats[b], cursor)) {
+		rx_interface_stat_p rpc_stat, total;
+
+		rpc_stat = opr_queue_Entry(cursor, struct rx_interface_stat,
+					   entry);
+		total = rxi_FindPeerRpcStat(totals,
+					    rpc_stat->stats[0].interfaceId,
+					    rpc_stat->stats[0].func_total,
+					    rpc_stat->stats[0].remote_is_server,
+					    rpc_stat->stats[0].remote_peer,
+					    rpc_stat->stats[0].remote_port,
+					    &count, 1);
+		if (total == NULL)
+		    continue;
+		for (i = 0; i < rpc_stat->stats[0].func_total
+			    && i < total->stats[0].func_total; i++)
+		    rxi_AddRPCOpStat(&total->stats[i], &rpc_stat->stats[i]);
+	    }
 	}
+	MUTEX_EXIT(&shard->lock);
     }
-    return rpc_stat;
+    return count;
+}
+
+/*!
+ * Free a queue of stat structures.
+ *
+ * @return
+ * 	the number of function entries freed
+ */
+static unsigned int
+rxi_FreeRpcStats(struct opr_queue *stats)
+{
+    struct opr_queue *cursor, *store;
+    unsigned int count = 0;
+
+    for (opr_queue_ScanSafe(stats, cursor, store)) {
+	rx_interface_stat_p rpc_stat
+	    = opr_queue_Entry(cursor, struct rx_interface_stat, entry);
+
+	opr_queue_Remove(&rpc_stat->entry);
+	count += rpc_stat->stats[0].func_total;
+	rxi_Free(rpc_stat, sizeof(rx_interface_stat_t) +
+		 rpc_stat->stats[0].func_total *
+		 sizeof(rx_function_entry_v1_t));
+    }
+    return count;
+}
+
+/*!
+ * Free the statistics which every shard holds for a peer, or for all
+ * peers if peer is NULL.
+ */
+static void
+rxi_FreePeerRpcStats(struct rx_peer *peer)
+{
+    struct opr_queue *scursor, *cursor, *store;
+    int b;
+
+    MUTEX_ENTER(&rx_rpc_stats);
+    for (opr_queue_Scan(&rxi_rpcShards, scursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(scursor, struct rx_rpc_shard, entry);
+
+	MUTEX_ENTER(&shard->lock);
+	if (shard->peerStatCnt == 0) {
+	    MUTEX_EXIT(&shard->lock);
+	    continue;
+	}
+	if (peer == NULL) {
+	    for (b = 0; b < RX_RPC_PEER_BUCKETS; b++)
+		shard->peerStatCnt -= rxi_FreeRpcStats(&shard->peerStats[b]);
+	} else {
+	    b = RX_RPC_PEER_HASH(peer->host, peer->port);
+	    for (opr_queue_ScanSafe(&shard->peerStats[b], cursor, store)) {
+		rx_interface_stat_p rpc_stat
+		    = opr_queue_Entry(cursor, struct rx_interface_stat, entry);
+
+		if (rpc_stat->stats[0].remote_peer != peer->host
+		    || rpc_stat->stats[0].remote_port != peer->port)
+		    continue;
+		opr_queue_Remove(&rpc_stat->entry);
+		shard->peerStatCnt -= rpc_stat->stats[0].func_total;
+		rxi_Free(rpc_stat, sizeof(rx_interface_stat_t) +
+			 rpc_stat->stats[0].func_total *
+			 sizeof(rx_function_entry_v1_t));
+	    }
+	}
+	MUTEX_EXIT(&shard->lock);
+    }
+    MUTEX_EXIT(&rx_rpc_stats);
 }
 
 void
 rx_ClearProcessRPCStats(afs_int32 rxInterface)
 {
     rx_interface_stat_p rpc_stat;
+    struct opr_queue *cursor;
     int totalFunc, i;
 
     if (rxInterface == -1)
         return;
 
     MUTEX_ENTER(&rx_rpc_stats);
-    rpc_stat = rxi_FindRpcStat(&processStats, rxInterface, 0, 0,
-			       0, 0, 0, 0, 0);
-    if (rpc_stat) {
-	totalFunc = rpc_stat->stats[0].func_total;
-	for (i = 0; i < totalFunc; i++)
-	    rxi_ClearRPCOpStat(&(rpc_stat->stats[i]));
+    for (opr_queue_Scan(&rxi_rpcShards, cursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(cursor, struct rx_rpc_shard, entry);
+
+	MUTEX_ENTER(&shard->lock);
+	rpc_stat = rxi_FindRpcStat(&shard->stats, rxInterface, 0, 0, 0, 0);
+	if (rpc_stat) {
+	    totalFunc = rpc_stat->stats[0].func_total;
+	    for (i = 0; i < totalFunc; i++)
+		rxi_ClearRPCOpStat(&(rpc_stat->stats[i]));
+	}
+	MUTEX_EXIT(&shard->lock);
     }
     MUTEX_EXIT(&rx_rpc_stats);
     return;
@@ -8187,23 +9563,28 @@ void
 rx_ClearPeerRPCStats(afs_int32 rxInterface, afs_uint32 peerHost, afs_uint16 peerPort)
 {
     rx_interface_stat_p rpc_stat;
+    struct opr_queue *cursor;
     int totalFunc, i;
-    struct rx_peer * peer;
 
     if (rxInterface == -1)
         return;
 
-    peer = rxi_FindPeer(peerHost, peerPort, 0);
-    if (!peer)
-        return;
-
     MUTEX_ENTER(&rx_rpc_stats);
-    rpc_stat = rxi_FindRpcStat(&peer->rpcStats, rxInterface, 0, 1,
-			       0, 0, 0, 0, 0);
-    if (rpc_stat) {
-	totalFunc = rpc_stat->stats[0].func_total;
-	for (i = 0; i < totalFunc; i++)
-	    rxi_ClearRPCOpStat(&(rpc_stat->stats[i]));
+    for (opr_queue_Scan(&rxi_rpcShards, cursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(cursor, struct rx_rpc_shard, entry);
+
+	MUTEX_ENTER(&shard->lock);
+	if (shard->peerStats != NULL) {
+	    rpc_stat = rxi_FindPeerRpcStat(shard->peerStats, rxInterface, 0, 1,
+					   peerHost, peerPort, 0, 0);
+	    if (rpc_stat) {
+		totalFunc = rpc_stat->stats[0].func_total;
+		for (i = 0; i < totalFunc; i++)
+		    rxi_ClearRPCOpStat(&(rpc_stat->stats[i]));
+	    }
+	}
+	MUTEX_EXIT(&shard->lock);
     }
     MUTEX_EXIT(&rx_rpc_stats);
     return;
@@ -8217,6 +9598,8 @@ rx_CopyProcessRPCStats(afs_uint64 op)
 	rxi_Alloc(sizeof(rx_function_entry_v1_t));
     int currentFunc = (op & MAX_AFS_UINT32);
     afs_int32 rxInterface = (op >> 32);
+    struct opr_queue *cursor;
+    int found = 0;
 
     if (!rxi_monitor_processStats)
         return NULL;
@@ -8228,13 +9611,24 @@ rx_CopyProcessRPCStats(afs_uint64 op)
         return NULL;
 
     MUTEX_ENTER(&rx_rpc_stats);
-    rpc_stat = rxi_FindRpcStat(&processStats, rxInterface, 0, 0,
-			       0, 0, 0, 0, 0);
-    if (rpc_stat)
-	memcpy(rpcop_stat, &(rpc_stat->stats[currentFunc]),
-	       sizeof(rx_function_entry_v1_t));
+    for (opr_queue_Scan(&rxi_rpcShards, cursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(cursor, struct rx_rpc_shard, entry);
+
+	MUTEX_ENTER(&shard->lock);
+	rpc_stat = rxi_FindRpcStat(&shard->stats, rxInterface, 0, 0, 0, 0);
+	if (rpc_stat && currentFunc < rpc_stat->stats[0].func_total) {
+	    if (!found)
+		memcpy(rpcop_stat, &(rpc_stat->stats[currentFunc]),
+		       sizeof(rx_function_entry_v1_t));
+	    else
+		rxi_AddRPCOpStat(rpcop_stat, &(rpc_stat->stats[currentFunc]));
+	    found = 1;
+	}
+	MUTEX_EXIT(&shard->lock);
+    }
     MUTEX_EXIT(&rx_rpc_stats);
-    if (!rpc_stat) {
+    if (!found) {
 	rxi_Free(rpcop_stat, sizeof(rx_function_entry_v1_t));
 	return NULL;
     }
@@ -8249,7 +9643,8 @@ rx_CopyPeerRPCStats(afs_uint64 op, afs_uint32 peerHost, afs_uint16 peerPort)
 	rxi_Alloc(sizeof(rx_function_entry_v1_t));
     int currentFunc = (op & MAX_AFS_UINT32);
     afs_int32 rxInterface = (op >> 32);
-    struct rx_peer *peer;
+    struct opr_queue *cursor;
+    int found = 0;
 
     if (!rxi_monitor_peerStats)
         return NULL;
@@ -8260,18 +9655,29 @@ rx_CopyPeerRPCStats(afs_uint64 op, afs_uint32 peerHost, afs_uint16 peerPort)
     if (rpcop_stat == NULL)
         return NULL;
 
-    peer = rxi_FindPeer(peerHost, peerPort, 0);
-    if (!peer)
-        return NULL;
-
     MUTEX_ENTER(&rx_rpc_stats);
-    rpc_stat = rxi_FindRpcStat(&peer->rpcStats, rxInterface, 0, 1,
-			       0, 0, 0, 0, 0);
-    if (rpc_stat)
-	memcpy(rpcop_stat, &(rpc_stat->stats[currentFunc]),
-	       sizeof(rx_function_entry_v1_t));
+    for (opr_queue_Scan(&rxi_rpcShards, cursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(cursor, struct rx_rpc_shard, entry);
+
+	MUTEX_ENTER(&shard->lock);
+	if (shard->peerStats != NULL) {
+	    rpc_stat = rxi_FindPeerRpcStat(shard->peerStats, rxInterface, 0, 1,
+					   peerHost, peerPort, 0, 0);
+	    if (rpc_stat && currentFunc < rpc_stat->stats[0].func_total) {
+		if (!found)
+		    memcpy(rpcop_stat, &(rpc_stat->stats[currentFunc]),
+			   sizeof(rx_function_entry_v1_t));
+		else
+		    rxi_AddRPCOpStat(rpcop_stat,
+				     &(rpc_stat->stats[currentFunc]));
+		found = 1;
+	    }
+	}
+	MUTEX_EXIT(&shard->lock);
+    }
     MUTEX_EXIT(&rx_rpc_stats);
-    if (!rpc_stat) {
+    if (!found) {
 	rxi_Free(rpcop_stat, sizeof(rx_function_entry_v1_t));
 	return NULL;
     }
@@ -8286,21 +9692,14 @@ rx_ReleaseRPCStats(void *stats)
 }
 
 /*!
- * Given all of the information for a particular rpc
- * call, create (if needed) and update the stat totals for the rpc.
+ * Update the stat totals for a particular rpc function with one call.
  *
- * @param stats
- * 	the queue of stats that will be updated with the new value
- *
- * @param rxInterface
- * 	a unique number that identifies the rpc interface
+ * @param rpc_stat
+ * 	the stat structure for the rpc interface
  *
  * @param currentFunc
  * 	the index of the function being invoked
  *
- * @param totalFunc
- * 	the total number of functions in this interface
- *
  * @param queueTime
  * 	the amount of time this function waited for a thread
  *
@@ -8312,71 +9711,38 @@ rx_ReleaseRPCStats(void *stats)
  *
  * @param bytesRcvd
  * 	the number bytes received by this invocation
- *
- * @param isServer
- * 	if true, this invocation was made to a server
- *
- * @param remoteHost
- * 	the ip address of the remote host
- *
- * @param remotePort
- * 	the port of the remote host
- *
- * @param addToPeerList
- * 	if != 0, add newly created stat to the global peer list
- *
- * @param counter
- * 	if a new stats structure is allocated, the counter will
- *	be updated with the new number of allocated stat structures
- *
  */
 
-static int
-rxi_AddRpcStat(struct opr_queue *stats, afs_uint32 rxInterface,
-	       afs_uint32 currentFunc, afs_uint32 totalFunc,
-	       struct clock *queueTime, struct clock *execTime,
-	       afs_uint64 bytesSent, afs_uint64 bytesRcvd, int isServer,
-	       afs_uint32 remoteHost, afs_uint32 remotePort,
-	       int addToPeerList, unsigned int *counter)
+static void
+rxi_CountRpcStat(rx_interface_stat_p rpc_stat, afs_uint32 currentFunc,
+		 struct clock *queueTime, struct clock *execTime,
+		 afs_uint64 bytesSent, afs_uint64 bytesRcvd)
 {
-    int rc = 0;
-    rx_interface_stat_p rpc_stat;
+    rx_function_entry_v1_p op_stat;
 
-    rpc_stat = rxi_FindRpcStat(stats, rxInterface, totalFunc, isServer,
-			       remoteHost, remotePort, addToPeerList, counter,
-			       1);
-    if (!rpc_stat) {
-	rc = -1;
-	goto fail;
-    }
-
-    /*
-     * Increment the stats for this function
-     */
+    if (currentFunc >= rpc_stat->stats[0].func_total)
+	return;
+    op_stat = &rpc_stat->stats[currentFunc];
 
-    rpc_stat->stats[currentFunc].invocations++;
-    rpc_stat->stats[currentFunc].bytes_sent += bytesSent;
-    rpc_stat->stats[currentFunc].bytes_rcvd += bytesRcvd;
-    clock_Add(&rpc_stat->stats[currentFunc].queue_time_sum, queueTime);
-    clock_AddSq(&rpc_stat->stats[currentFunc].queue_time_sum_sqr, queueTime);
-    if (clock_Lt(queueTime, &rpc_stat->stats[currentFunc].queue_time_min)) {
-	rpc_stat->stats[currentFunc].queue_time_min = *queueTime;
+    op_stat->invocations++;
+    op_stat->bytes_sent += bytesSent;
+    op_stat->bytes_rcvd += bytesRcvd;
+    clock_Add(&op_stat->queue_time_sum, queueTime);
+    clock_AddSq(&op_stat->queue_time_sum_sqr, queueTime);
+    if (clock_Lt(queueTime, &op_stat->queue_time_min)) {
+	op_stat->queue_time_min = *queueTime;
     }
-    if (clock_Gt(queueTime, &rpc_stat->stats[currentFunc].queue_time_max)) {
-	rpc_stat->stats[currentFunc].queue_time_max = *queueTime;
+    if (clock_Gt(queueTime, &op_stat->queue_time_max)) {
+	op_stat->queue_time_max = *queueTime;
     }
-    clock_Add(&rpc_stat->stats[currentFunc].execution_time_sum, execTime);
-    clock_AddSq(&rpc_stat->stats[currentFunc].execution_time_sum_sqr,
-		execTime);
-    if (clock_Lt(execTime, &rpc_stat->stats[currentFunc].execution_time_min)) {
-	rpc_stat->stats[currentFunc].execution_time_min = *execTime;
+    clock_Add(&op_stat->execution_time_sum, execTime);
+    clock_AddSq(&op_stat->execution_time_sum_sqr, execTime);
+    if (clock_Lt(execTime, &op_stat->execution_time_min)) {
+	op_stat->execution_time_min = *execTime;
     }
-    if (clock_Gt(execTime, &rpc_stat->stats[currentFunc].execution_time_max)) {
-	rpc_stat->stats[currentFunc].execution_time_max = *execTime;
+    if (clock_Gt(execTime, &op_stat->execution_time_max)) {
+	op_stat->execution_time_max = *execTime;
     }
-
-  fail:
-    return rc;
 }
 
 void
@@ -8386,27 +9752,309 @@ rxi_IncrementTimeAndCount(struct rx_peer *peer, afs_uint32 rxInterface,
 			  afs_uint64 bytesSent, afs_uint64 bytesRcvd,
 			  int isServer)
 {
+    struct rx_rpc_shard *shard;
+    rx_interface_stat_p rpc_stat;
+    unsigned int count = 0;
 
     if (!(rxi_monitor_peerStats || rxi_monitor_processStats))
         return;
 
+#ifndef RX_ENABLE_RPC_SHARDS
     MUTEX_ENTER(&rx_rpc_stats);
+#endif
+    /* Only this thread updates its shard, so its lock is uncontended
+     * except while the shard is being read or cleared. */
+    shard = rxi_GetRpcShard();
+    MUTEX_ENTER(&shard->lock);
 
     if (rxi_monitor_peerStats) {
-        MUTEX_ENTER(&peer->peer_lock);
-	rxi_AddRpcStat(&peer->rpcStats, rxInterface, currentFunc, totalFunc,
-		       queueTime, execTime, bytesSent, bytesRcvd, isServer,
-		       peer->host, peer->port, 1, &rxi_rpc_peer_stat_cnt);
-        MUTEX_EXIT(&peer->peer_lock);
+	if (shard->peerStats == NULL)
+	    shard->peerStats = rxi_AllocPeerRpcStats();
+	if (shard->peerStats != NULL) {
+	    rpc_stat = rxi_FindPeerRpcStat(shard->peerStats, rxInterface,
+					   totalFunc, isServer, peer->host,
+					   peer->port, &shard->peerStatCnt, 1);
+	    if (rpc_stat)
+		rxi_CountRpcStat(rpc_stat, currentFunc, queueTime, execTime,
+				 bytesSent, bytesRcvd);
+	}
     }
 
     if (rxi_monitor_processStats) {
-	rxi_AddRpcStat(&processStats, rxInterface, currentFunc, totalFunc,
-		       queueTime, execTime, bytesSent, bytesRcvd, isServer,
-		       0xffffffff, 0xffffffff, 0, &rxi_rpc_process_stat_cnt);
+	rpc_stat = rxi_FindRpcStat(&shard->stats, rxInterface, totalFunc,
+				   isServer, &count, 1);
+	if (rpc_stat)
+	    rxi_CountRpcStat(rpc_stat, currentFunc, queueTime, execTime,
+			     bytesSent, bytesRcvd);
+    }
+
+    MUTEX_EXIT(&shard->lock);
+#ifndef RX_ENABLE_RPC_SHARDS
+    MUTEX_EXIT(&rx_rpc_stats);
+#endif
+}
+
+/*!
+ * Find the latency histogram bucket for an execution time.
+ */
+static int
+rxi_LatencyBucket(struct clock *execTime)
+{
+    afs_uint64 usec;
+    afs_uint32 value;
+    int msb;
+
+    if (execTime->sec < 0 || execTime->usec < 0)
+	return 0;
+    usec = (afs_uint64)execTime->sec * 1000000 + execTime->usec;
+    value = (usec > MAX_AFS_UINT32) ? MAX_AFS_UINT32 : (afs_uint32)usec;
+
+    if (value < RX_LATENCY_SUB)
+	return value;
+    msb = opr_fls(value) - 1;
+    return ((msb - RX_LATENCY_SUBBITS + 1) << RX_LATENCY_SUBBITS)
+	+ ((value >> (msb - RX_LATENCY_SUBBITS)) & (RX_LATENCY_SUB - 1));
+}
+
+/*!
+ * Return the largest execution time, in usec, held by a latency histogram
+ * bucket, as returned by rx_RetrieveProcessRPCLatency.
+ */
+afs_uint32
+rx_RPCLatencyBucketMax(int bucket)
+{
+    int shift;
+
+    if (bucket < RX_LATENCY_SUB)
+	return bucket;
+    shift = (bucket >> RX_LATENCY_SUBBITS) - 1;
+    return (((afs_uint64)(RX_LATENCY_SUB + (bucket & (RX_LATENCY_SUB - 1)))
+	     + 1) << shift) - 1;
+}
+
+/*!
+ * Find the latency histograms for an interface in a queue of them, creating
+ * them if need be.
+ */
+static struct rxi_rpc_latency *
+rxi_FindLatency(struct opr_queue *queue, afs_uint32 rxInterface,
+		afs_uint32 totalFunc)
+{
+    struct rxi_rpc_latency *latency;
+    struct opr_queue *cursor;
+
+    for (opr_queue_Scan(queue, cursor)) {
+	latency = opr_queue_Entry(cursor, struct rxi_rpc_latency, entry);
+	if (latency->rxInterface == rxInterface)
+	    return latency;
+    }
+
+    latency = rxi_Alloc(sizeof(struct rxi_rpc_latency)
+			+ (totalFunc - 1) * sizeof(afs_uint32 *));
+    latency->rxInterface = rxInterface;
+    latency->totalFunc = totalFunc;
+    opr_queue_Prepend(queue, &latency->entry);
+    return latency;
+}
+
+/*!
+ * Free a queue of latency histograms.
+ */
+static void
+rxi_FreeLatency(struct opr_queue *queue)
+{
+    struct opr_queue *cursor, *store;
+    int i;
+
+    for (opr_queue_ScanSafe(queue, cursor, store)) {
+	struct rxi_rpc_latency *latency
+	    = opr_queue_Entry(cursor, struct rxi_rpc_latency, entry);
+
+	opr_queue_Remove(&latency->entry);
+	for (i = 0; i < latency->totalFunc; i++) {
+	    if (latency->counts[i] != NULL)
+		rxi_Free(latency->counts[i],
+			 RX_LATENCY_BUCKETS * sizeof(afs_uint32));
+	}
+	rxi_Free(latency, sizeof(struct rxi_rpc_latency)
+		 + (latency->totalFunc - 1) * sizeof(afs_uint32 *));
+    }
+}
+
+/*!
+ * Total up the latency histograms held in every shard into the queue
+ * totals, with one structure for each interface. Counts which would
+ * overflow stick at MAX_AFS_UINT32. rx_rpc_stats must be held.
+ *
+ * @return
+ * 	the number of function histograms in totals
+ */
+static unsigned int
+rxi_TotalProcessRpcLatency(struct opr_queue *totals)
+{
+    struct opr_queue *scursor, *cursor;
+    unsigned int count = 0;
+    int bucket, i;
+
+    for (opr_queue_Scan(&rxi_rpcShards, scursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(scursor, struct rx_rpc_shard, entry);
+
+	MUTEX_ENTER(&shard->lock);
+	for (opr_queue_Scan(&shard->latency, cursor)) {
+	    struct rxi_rpc_latency *latency, *total;
+
+	    latency = opr_queue_Entry(cursor, struct rxi_rpc_latency, entry);
+	    total = rxi_FindLatency(totals, latency->rxInterface,
+				    latency->totalFunc);
+	    for (i = 0; i < latency->totalFunc && i < total->totalFunc; i++) {
+		afs_uint32 *counts = latency->counts[i];
+
+		if (counts == NULL)
+		    continue;
+		if (total->counts[i] == NULL) {
+		    total->counts[i]
+			= rxi_Alloc(RX_LATENCY_BUCKETS * sizeof(afs_uint32));
+		    count++;
+		}
+		for (bucket = 0; bucket < RX_LATENCY_BUCKETS; bucket++) {
+		    if (total->counts[i][bucket]
+			> MAX_AFS_UINT32 - counts[bucket])
+			total->counts[i][bucket] = MAX_AFS_UINT32;
+		    else
+			total->counts[i][bucket] += counts[bucket];
+		}
+	    }
+	}
+	MUTEX_EXIT(&shard->lock);
+    }
+    return count;
+}
+
+/*!
+ * Count the execution time of a call served by an interface function in
+ * the calling thread's latency histogram for the function.
+ *
+ * @param rxInterface
+ * 	a unique number that identifies the rpc interface
+ *
+ * @param currentFunc
+ * 	the index of the function being invoked
+ *
+ * @param totalFunc
+ * 	the total number of functions in this interface
+ *
+ * @param execTime
+ * 	the amount of time this function invocation took to execute
+ */
+void
+rxi_RecordLatency(afs_uint32 rxInterface, afs_uint32 currentFunc,
+		  afs_uint32 totalFunc, struct clock *execTime)
+{
+    struct rx_rpc_shard *shard;
+    struct rxi_rpc_latency *latency;
+
+    if (currentFunc >= totalFunc)
+	return;
+
+#ifndef RX_ENABLE_RPC_SHARDS
+    MUTEX_ENTER(&rx_rpc_stats);
+#endif
+    shard = rxi_GetRpcShard();
+
+    MUTEX_ENTER(&shard->lock);
+    latency = rxi_FindLatency(&shard->latency, rxInterface, totalFunc);
+    if (currentFunc < latency->totalFunc) {
+	if (latency->counts[currentFunc] == NULL)
+	    latency->counts[currentFunc]
+		= rxi_Alloc(RX_LATENCY_BUCKETS * sizeof(afs_uint32));
+	latency->counts[currentFunc][rxi_LatencyBucket(execTime)]++;
     }
+    MUTEX_EXIT(&shard->lock);
 
+#ifndef RX_ENABLE_RPC_SHARDS
     MUTEX_EXIT(&rx_rpc_stats);
+#endif
+}
+
+/*!
+ * Find percentiles of the execution times of the calls this process has
+ * served for an interface function.
+ *
+ * Each time is found to within 1/8 of its value, and rounded up.
+ *
+ * @param rxInterface
+ * 	a unique number that identifies the rpc interface
+ *
+ * @param currentFunc
+ * 	the index of the function
+ *
+ * @param npoints
+ * 	the number of percentiles wanted
+ *
+ * @param ppm
+ * 	the percentiles wanted, in parts per million; 990000 asks for the
+ * 	99th percentile
+ *
+ * @param usecs
+ * 	returns the execution time at each percentile, in usec
+ *
+ * @return
+ * 	the number of calls counted. If this is 0, usecs is left alone.
+ */
+afs_uint64
+rx_GetProcessRPCLatency(afs_uint32 rxInterface, afs_uint32 currentFunc,
+			int npoints, afs_uint32 *ppm, afs_uint32 *usecs)
+{
+    struct opr_queue *scursor, *cursor;
+    afs_uint64 *totals;
+    afs_uint64 calls = 0, seen;
+    int bucket, i;
+
+    totals = rxi_Alloc(RX_LATENCY_BUCKETS * sizeof(afs_uint64));
+
+    MUTEX_ENTER(&rx_rpc_stats);
+    for (opr_queue_Scan(&rxi_rpcShards, scursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(scursor, struct rx_rpc_shard, entry);
+
+	MUTEX_ENTER(&shard->lock);
+	for (opr_queue_Scan(&shard->latency, cursor)) {
+	    struct rxi_rpc_latency *latency
+		= opr_queue_Entry(cursor, struct rxi_rpc_latency, entry);
+
+	    if (latency->rxInterface != rxInterface)
+		continue;
+	    if (currentFunc < latency->totalFunc
+		&& latency->counts[currentFunc] != NULL) {
+		for (bucket = 0; bucket < RX_LATENCY_BUCKETS; bucket++)
+		    totals[bucket] += latency->counts[currentFunc][bucket];
+	    }
+	    break;
+	}
+	MUTEX_EXIT(&shard->lock);
+    }
+    MUTEX_EXIT(&rx_rpc_stats);
+
+    for (bucket = 0; bucket < RX_LATENCY_BUCKETS; bucket++)
+	calls += totals[bucket];
+
+    if (calls > 0) {
+	for (i = 0; i < npoints; i++) {
+	    /* Find the first bucket by which ppm parts per million of
+	     * the calls have been counted */
+	    seen = 0;
+	    for (bucket = 0; bucket < RX_LATENCY_BUCKETS - 1; bucket++) {
+		seen += totals[bucket];
+		if (seen * 1000000 >= calls * ppm[i])
+		    break;
+	    }
+	    usecs[i] = rx_RPCLatencyBucketMax(bucket);
+	}
+    }
+
+    rxi_Free(totals, RX_LATENCY_BUCKETS * sizeof(afs_uint64));
+    return calls;
 }
 
 /*!
@@ -8558,6 +10206,8 @@ rx_RetrieveProcessRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
     size_t space = 0;
     afs_uint32 *ptr;
     struct clock now;
+    struct opr_queue totals;
+    unsigned int count;
     int rc = 0;
 
     *stats = 0;
@@ -8575,6 +10225,9 @@ rx_RetrieveProcessRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
 	return rc;
     }
 
+    opr_queue_Init(&totals);
+    count = rxi_TotalProcessRpcStats(&totals);
+
     clock_GetTime(&now);
     *clock_sec = now.sec;
     *clock_usec = now.usec;
@@ -8589,8 +10242,8 @@ rx_RetrieveProcessRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
      */
 
     if (callerVersion >= RX_STATS_RETRIEVAL_FIRST_EDITION) {
-	space = rxi_rpc_process_stat_cnt * sizeof(rx_function_entry_v1_t);
-	*statCount = rxi_rpc_process_stat_cnt;
+	space = count * sizeof(rx_function_entry_v1_t);
+	*statCount = count;
     } else {
 	/*
 	 * This can't happen yet, but in the future version changes
@@ -8605,7 +10258,7 @@ rx_RetrieveProcessRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
 	if (ptr != NULL) {
 	    struct opr_queue *cursor;
 
-	    for (opr_queue_Scan(&processStats, cursor)) {
+	    for (opr_queue_Scan(&totals, cursor)) {
 		struct rx_interface_stat *rpc_stat = 
 		    opr_queue_Entry(cursor, struct rx_interface_stat, entry);
 		/*
@@ -8620,6 +10273,7 @@ rx_RetrieveProcessRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
 	}
     }
     MUTEX_EXIT(&rx_rpc_stats);
+    rxi_FreeRpcStats(&totals);
     return rc;
 }
 
@@ -8657,7 +10311,10 @@ rx_RetrievePeerRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
     size_t space = 0;
     afs_uint32 *ptr;
     struct clock now;
+    struct opr_queue *totals;
+    unsigned int count;
     int rc = 0;
+    int b;
 
     *stats = 0;
     *statCount = 0;
@@ -8674,6 +10331,13 @@ rx_RetrievePeerRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
 	return rc;
     }
 
+    totals = rxi_AllocPeerRpcStats();
+    if (totals == NULL) {
+	MUTEX_EXIT(&rx_rpc_stats);
+	return ENOMEM;
+    }
+    count = rxi_TotalPeerRpcStats(totals);
+
     clock_GetTime(&now);
     *clock_sec = now.sec;
     *clock_usec = now.usec;
@@ -8688,8 +10352,8 @@ rx_RetrievePeerRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
      */
 
     if (callerVersion >= RX_STATS_RETRIEVAL_FIRST_EDITION) {
-	space = rxi_rpc_peer_stat_cnt * sizeof(rx_function_entry_v1_t);
-	*statCount = rxi_rpc_peer_stat_cnt;
+	space = count * sizeof(rx_function_entry_v1_t);
+	*statCount = count;
     } else {
 	/*
 	 * This can't happen yet, but in the future version changes
@@ -8704,34 +10368,119 @@ rx_RetrievePeerRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
 	if (ptr != NULL) {
 	    struct opr_queue *cursor;
 
-	    for (opr_queue_Scan(&peerStats, cursor)) {
-		struct rx_interface_stat *rpc_stat
-		    = opr_queue_Entry(cursor, struct rx_interface_stat,
-				     entryPeers);
+	    for (b = 0; b < RX_RPC_PEER_BUCKETS; b++) {
+		for (opr_queue_Scan(&totals[b], cursor)) {
+		    struct rx_interface_stat *rpc_stat
+			= opr_queue_Entry(cursor, struct rx_interface_stat,
+					  entry);
 
-		/*
-		 * Copy the data based upon the caller version
-		 */
-		rx_MarshallProcessRPCStats(callerVersion,
-					   rpc_stat->stats[0].func_total,
-					   rpc_stat->stats, &ptr);
+		    /*
+		     * Copy the data based upon the caller version
+		     */
+		    rx_MarshallProcessRPCStats(callerVersion,
+					       rpc_stat->stats[0].func_total,
+					       rpc_stat->stats, &ptr);
+		}
 	    }
 	} else {
 	    rc = ENOMEM;
 	}
     }
     MUTEX_EXIT(&rx_rpc_stats);
+    for (b = 0; b < RX_RPC_PEER_BUCKETS; b++)
+	rxi_FreeRpcStats(&totals[b]);
+    rxi_Free(totals, RX_RPC_PEER_BUCKETS * sizeof(struct opr_queue));
+    return rc;
+}
+
+/*
+ * rx_RetrieveProcessRPCLatency - retrieve the histograms of the execution
+ * times of the calls served by this process
+ *
+ * PARAMETERS
+ *
+ * IN callerVersion - the rpc stat version of the caller
+ *
+ * OUT myVersion - the rpc stat version of this function
+ *
+ * OUT bucketCount - the number of buckets in each histogram
+ *
+ * OUT allocSize - the number of bytes allocated to contain the histograms
+ *
+ * OUT statCount - the number of histograms retrieved
+ *
+ * OUT stats - the histograms, one for each interface function which has
+ * served calls. Each is the interface id and the function index, followed
+ * by bucketCount counts of calls. rx_RPCLatencyBucketMax gives the longest
+ * execution time counted by each bucket.
+ *
+ * RETURN CODES
+ *
+ * Returns 0 or ENOMEM.  If there are any histograms, stats will != NULL.
+ */
+
+int
+rx_RetrieveProcessRPCLatency(afs_uint32 callerVersion, afs_uint32 * myVersion,
+			     afs_uint32 * bucketCount, size_t * allocSize,
+			     afs_uint32 * statCount, afs_uint32 ** stats)
+{
+    struct opr_queue totals;
+    struct opr_queue *cursor;
+    unsigned int count;
+    size_t space;
+    afs_uint32 *ptr;
+    int rc = 0;
+    int i;
+
+    *stats = 0;
+    *statCount = 0;
+    *allocSize = 0;
+    *myVersion = RX_STATS_RETRIEVAL_VERSION;
+    *bucketCount = RX_LATENCY_BUCKETS;
+
+    opr_queue_Init(&totals);
+    MUTEX_ENTER(&rx_rpc_stats);
+    count = rxi_TotalProcessRpcLatency(&totals);
+    MUTEX_EXIT(&rx_rpc_stats);
+
+    space = count * (2 + RX_LATENCY_BUCKETS) * sizeof(afs_uint32);
+    if (space > (size_t) 0) {
+	ptr = *stats = rxi_Alloc(space);
+
+	if (ptr != NULL) {
+	    *allocSize = space;
+	    *statCount = count;
+	    for (opr_queue_Scan(&totals, cursor)) {
+		struct rxi_rpc_latency *latency
+		    = opr_queue_Entry(cursor, struct rxi_rpc_latency, entry);
+
+		for (i = 0; i < latency->totalFunc; i++) {
+		    if (latency->counts[i] == NULL)
+			continue;
+		    *(ptr++) = latency->rxInterface;
+		    *(ptr++) = i;
+		    memcpy(ptr, latency->counts[i],
+			   RX_LATENCY_BUCKETS * sizeof(afs_uint32));
+		    ptr += RX_LATENCY_BUCKETS;
+		}
+	    }
+	} else {
+	    rc = ENOMEM;
+	}
+    }
+    rxi_FreeLatency(&totals);
     return rc;
 }
 
 /*
  * rx_FreeRPCStats - free memory allocated by
- *                   rx_RetrieveProcessRPCStats and rx_RetrievePeerRPCStats
+ *                   rx_RetrieveProcessRPCStats, rx_RetrievePeerRPCStats
+ *                   and rx_RetrieveProcessRPCLatency
  *
  * PARAMETERS
  *
- * IN stats - stats previously returned by rx_RetrieveProcessRPCStats or
- * rx_RetrievePeerRPCStats
+ * IN stats - stats previously returned by rx_RetrieveProcessRPCStats,
+ * rx_RetrievePeerRPCStats or rx_RetrieveProcessRPCLatency
  *
  * IN allocSize - the number of bytes in stats.
  *
@@ -8838,35 +10587,37 @@ rx_enablePeerRPCStats(void)
 void
 rx_disableProcessRPCStats(void)
 {
-    struct opr_queue *cursor, *store;
-    size_t space;
+    struct opr_queue *scursor, *cursor;
+    int i;
 
     MUTEX_ENTER(&rx_rpc_stats);
 
     /*
      * Turn off process statistics and if peer stats is also off, turn
-     * off everything
+     * off everything. Threads may still be counting in their shards, so
+     * the stats are cleared rather than freed.
      */
 
     rxi_monitor_processStats = 0;
+#ifndef RX_ENABLE_RPC_SHARDS
     if (rxi_monitor_peerStats == 0) {
 	rx_enable_stats = 0;
     }
+#endif
 
-    for (opr_queue_ScanSafe(&processStats, cursor, store)) {
-    	unsigned int num_funcs = 0;
-	struct rx_interface_stat *rpc_stat
-	    = opr_queue_Entry(cursor, struct rx_interface_stat, entry);
-
-	opr_queue_Remove(&rpc_stat->entry);
+    for (opr_queue_Scan(&rxi_rpcShards, scursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(scursor, struct rx_rpc_shard, entry);
 
-	num_funcs = rpc_stat->stats[0].func_total;
-	space =
-	    sizeof(rx_interface_stat_t) +
-	    rpc_stat->stats[0].func_total * sizeof(rx_function_entry_v1_t);
+	MUTEX_ENTER(&shard->lock);
+	for (opr_queue_Scan(&shard->stats, cursor)) {
+	    struct rx_interface_stat *rpc_stat
+		= opr_queue_Entry(cursor, struct rx_interface_stat, entry);
 
-	rxi_Free(rpc_stat, space);
-	rxi_rpc_process_stat_cnt -= num_funcs;
+	    for (i = 0; i < rpc_stat->stats[0].func_total; i++)
+		rxi_ClearRPCOpStat(&rpc_stat->stats[i]);
+	}
+	MUTEX_EXIT(&shard->lock);
     }
     MUTEX_EXIT(&rx_rpc_stats);
 }
@@ -8884,77 +10635,71 @@ rx_disableProcessRPCStats(void)
 void
 rx_disablePeerRPCStats(void)
 {
-    struct rx_peer **peer_ptr, **peer_end;
-    int code;
-
     /*
      * Turn off peer statistics and if process stats is also off, turn
      * off everything
      */
 
+    MUTEX_ENTER(&rx_rpc_stats);
     rxi_monitor_peerStats = 0;
+#ifndef RX_ENABLE_RPC_SHARDS
     if (rxi_monitor_processStats == 0) {
 	rx_enable_stats = 0;
     }
+#endif
+    MUTEX_EXIT(&rx_rpc_stats);
 
-    for (peer_ptr = &rx_peerHashTable[0], peer_end =
-	 &rx_peerHashTable[rx_hashTableSize]; peer_ptr < peer_end;
-	 peer_ptr++) {
-	struct rx_peer *peer, *next, *prev;
-
-        MUTEX_ENTER(&rx_peerHashTable_lock);
-        MUTEX_ENTER(&rx_rpc_stats);
-        for (prev = peer = *peer_ptr; peer; peer = next) {
-	    next = peer->next;
-	    code = MUTEX_TRYENTER(&peer->peer_lock);
-	    if (code) {
-		size_t space;
-		struct opr_queue *cursor, *store;
-
-		if (prev == *peer_ptr) {
-		    *peer_ptr = next;
-		    prev = next;
-		} else
-		    prev->next = next;
-
-                if (next)
-                    next->refCount++;
-                if (prev)
-                    prev->refCount++;
-                peer->refCount++;
-                MUTEX_EXIT(&rx_peerHashTable_lock);
-
-                for (opr_queue_ScanSafe(&peer->rpcStats, cursor, store)) {
-		    unsigned int num_funcs = 0;
-		    struct rx_interface_stat *rpc_stat
-			= opr_queue_Entry(cursor, struct rx_interface_stat,
-					 entry);
-
-		    opr_queue_Remove(&rpc_stat->entry);
-		    opr_queue_Remove(&rpc_stat->entryPeers);
-		    num_funcs = rpc_stat->stats[0].func_total;
-		    space =
-			sizeof(rx_interface_stat_t) +
-			rpc_stat->stats[0].func_total *
-			sizeof(rx_function_entry_v1_t);
-
-		    rxi_Free(rpc_stat, space);
-		    rxi_rpc_peer_stat_cnt -= num_funcs;
-		}
-		MUTEX_EXIT(&peer->peer_lock);
-
-                MUTEX_ENTER(&rx_peerHashTable_lock);
-                if (next)
-                    next->refCount--;
-                if (prev)
-                    prev->refCount--;
-                peer->refCount--;
-	    } else {
-		prev = peer;
-	    }
-	}
-        MUTEX_EXIT(&rx_rpc_stats);
-        MUTEX_EXIT(&rx_peerHashTable_lock);
+    rxi_FreePeerRpcStats(NULL);
+}
+
+/*
+ * rxi_ClearRPCOpStatFields - clear the parts of the stats for one
+ * function chosen by clearFlag
+ */
+
+static void
+rxi_ClearRPCOpStatFields(rx_function_entry_v1_p op_stat, afs_uint32 clearFlag)
+{
+    if (clearFlag & AFS_RX_STATS_CLEAR_INVOCATIONS) {
+	op_stat->invocations = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_SENT) {
+	op_stat->bytes_sent = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_RCVD) {
+	op_stat->bytes_rcvd = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SUM) {
+	op_stat->queue_time_sum.sec = 0;
+	op_stat->queue_time_sum.usec = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SQUARE) {
+	op_stat->queue_time_sum_sqr.sec = 0;
+	op_stat->queue_time_sum_sqr.usec = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MIN) {
+	op_stat->queue_time_min.sec = 9999999;
+	op_stat->queue_time_min.usec = 9999999;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MAX) {
+	op_stat->queue_time_max.sec = 0;
+	op_stat->queue_time_max.usec = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SUM) {
+	op_stat->execution_time_sum.sec = 0;
+	op_stat->execution_time_sum.usec = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SQUARE) {
+	op_stat->execution_time_sum_sqr.sec = 0;
+	op_stat->execution_time_sum_sqr.usec = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MIN) {
+	op_stat->execution_time_min.sec = 9999999;
+	op_stat->execution_time_min.usec = 9999999;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MAX) {
+	op_stat->execution_time_max.sec = 0;
+	op_stat->execution_time_max.usec = 0;
     }
 }
 
@@ -8974,59 +10719,25 @@ rx_disablePeerRPCStats(void)
 void
 rx_clearProcessRPCStats(afs_uint32 clearFlag)
 {
-    struct opr_queue *cursor;
+    struct opr_queue *scursor, *cursor;
 
     MUTEX_ENTER(&rx_rpc_stats);
 
-    for (opr_queue_Scan(&processStats, cursor)) {
-	unsigned int num_funcs = 0, i;
-	struct rx_interface_stat *rpc_stat
-	     = opr_queue_Entry(cursor, struct rx_interface_stat, entry);
+    for (opr_queue_Scan(&rxi_rpcShards, scursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(scursor, struct rx_rpc_shard, entry);
 
-	num_funcs = rpc_stat->stats[0].func_total;
-	for (i = 0; i < num_funcs; i++) {
-	    if (clearFlag & AFS_RX_STATS_CLEAR_INVOCATIONS) {
-		rpc_stat->stats[i].invocations = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_SENT) {
-		rpc_stat->stats[i].bytes_sent = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_RCVD) {
-		rpc_stat->stats[i].bytes_rcvd = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SUM) {
-		rpc_stat->stats[i].queue_time_sum.sec = 0;
-		rpc_stat->stats[i].queue_time_sum.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SQUARE) {
-		rpc_stat->stats[i].queue_time_sum_sqr.sec = 0;
-		rpc_stat->stats[i].queue_time_sum_sqr.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MIN) {
-		rpc_stat->stats[i].queue_time_min.sec = 9999999;
-		rpc_stat->stats[i].queue_time_min.usec = 9999999;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MAX) {
-		rpc_stat->stats[i].queue_time_max.sec = 0;
-		rpc_stat->stats[i].queue_time_max.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SUM) {
-		rpc_stat->stats[i].execution_time_sum.sec = 0;
-		rpc_stat->stats[i].execution_time_sum.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SQUARE) {
-		rpc_stat->stats[i].execution_time_sum_sqr.sec = 0;
-		rpc_stat->stats[i].execution_time_sum_sqr.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MIN) {
-		rpc_stat->stats[i].execution_time_min.sec = 9999999;
-		rpc_stat->stats[i].execution_time_min.usec = 9999999;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MAX) {
-		rpc_stat->stats[i].execution_time_max.sec = 0;
-		rpc_stat->stats[i].execution_time_max.usec = 0;
-	    }
+	MUTEX_ENTER(&shard->lock);
+	for (opr_queue_Scan(&shard->stats, cursor)) {
+	    unsigned int num_funcs = 0, i;
+	    struct rx_interface_stat *rpc_stat
+		 = opr_queue_Entry(cursor, struct rx_interface_stat, entry);
+
+	    num_funcs = rpc_stat->stats[0].func_total;
+	    for (i = 0; i < num_funcs; i++)
+		rxi_ClearRPCOpStatFields(&rpc_stat->stats[i], clearFlag);
 	}
+	MUTEX_EXIT(&shard->lock);
     }
 
     MUTEX_EXIT(&rx_rpc_stats);
@@ -9048,59 +10759,28 @@ rx_clearProcessRPCStats(afs_uint32 clearFlag)
 void
 rx_clearPeerRPCStats(afs_uint32 clearFlag)
 {
-    struct opr_queue *cursor;
+    struct opr_queue *scursor, *cursor;
+    int b;
 
     MUTEX_ENTER(&rx_rpc_stats);
 
-    for (opr_queue_Scan(&peerStats, cursor)) {
-	unsigned int num_funcs, i;
-	struct rx_interface_stat *rpc_stat
-	    = opr_queue_Entry(cursor, struct rx_interface_stat, entryPeers);
+    for (opr_queue_Scan(&rxi_rpcShards, scursor)) {
+	struct rx_rpc_shard *shard
+	    = opr_queue_Entry(scursor, struct rx_rpc_shard, entry);
 
-	num_funcs = rpc_stat->stats[0].func_total;
-	for (i = 0; i < num_funcs; i++) {
-	    if (clearFlag & AFS_RX_STATS_CLEAR_INVOCATIONS) {
-		rpc_stat->stats[i].invocations = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_SENT) {
-		rpc_stat->stats[i].bytes_sent = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_RCVD) {
-		rpc_stat->stats[i].bytes_rcvd = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SUM) {
-		rpc_stat->stats[i].queue_time_sum.sec = 0;
-		rpc_stat->stats[i].queue_time_sum.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SQUARE) {
-		rpc_stat->stats[i].queue_time_sum_sqr.sec = 0;
-		rpc_stat->stats[i].queue_time_sum_sqr.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MIN) {
-		rpc_stat->stats[i].queue_time_min.sec = 9999999;
-		rpc_stat->stats[i].queue_time_min.usec = 9999999;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MAX) {
-		rpc_stat->stats[i].queue_time_max.sec = 0;
-		rpc_stat->stats[i].queue_time_max.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SUM) {
-		rpc_stat->stats[i].execution_time_sum.sec = 0;
-		rpc_stat->stats[i].execution_time_sum.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SQUARE) {
-		rpc_stat->stats[i].execution_time_sum_sqr.sec = 0;
-		rpc_stat->stats[i].execution_time_sum_sqr.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MIN) {
-		rpc_stat->stats[i].execution_time_min.sec = 9999999;
-		rpc_stat->stats[i].execution_time_min.usec = 9999999;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MAX) {
-		rpc_stat->stats[i].execution_time_max.sec = 0;
-		rpc_stat->stats[i].execution_time_max.usec = 0;
+	MUTEX_ENTER(&shard->lock);
+	for (b = 0; shard->peerStats != NULL && b < RX_RPC_PEER_BUCKETS; b++) {
+	    for (opr_queue_Scan(&shard->peerStats[b], cursor)) {
+		unsigned int num_funcs, i;
+		struct rx_interface_stat *rpc_stat
+		    = opr_queue_Entry(cursor, struct rx_interface_stat, entry);
+
+		num_funcs = rpc_stat->stats[0].func_total;
+		for (i = 0; i < num_funcs; i++)
+		    rxi_ClearRPCOpStatFields(&rpc_stat->stats[i], clearFlag);
 	    }
 	}
+	MUTEX_EXIT(&shard->lock);
     }
 
     MUTEX_EXIT(&rx_rpc_stats);
@@ -168,6 +168,7 @@ extern u_short rx_PortOf(struct rx_peer *peer);
 /* 0x20000 was RX_CALL_PEER_BUSY */
 #define RX_CALL_ACKALL_SENT     0x40000 /* ACKALL has been sent on the call */
 #define RX_CALL_FLUSH		0x80000 /* Transmit queue should be flushed to peer */
+#define RX_CALL_PROBE_SENT	0x100000 /* A tail loss probe is outstanding */
 #endif
 
 
@@ -193,6 +194,10 @@ extern u_short rx_PortOf(struct rx_peer *peer);
 #define	RX_CIDMASK  (~RX_CHANNELMASK)
 #endif /* !KDUMP_RX_LOCK */
 
+/* Most channels a wide connection may have.  Channels beyond the first
+ * RX_MAXCALLS are carried by further connections to the same service. */
+#define RX_MAXWIDECALLS 64
+
 #ifndef KERNEL
 typedef void (*rx_destructor_t) (void *);
 int rx_KeyCreate(rx_destructor_t);
@@ -259,6 +264,18 @@ rx_IsLoopbackAddr(afs_uint32 addr)
 /* Enable or disable asymmetric client checking for a service */
 #define rx_SetCheckReach(service, x) ((service)->checkReach = (x))
 
+/* Set the priority class in which a service's calls wait for a server
+ * thread. Calls whose request spans more than one packet (bulk stores, say)
+ * may be given a class of their own. Server threads take waiting calls from
+ * the highest class first, although one thread still serves calls in the
+ * order they arrived, so that no class is starved. */
+#define RX_PRIORITY_HIGH	0
+#define RX_PRIORITY_NORMAL	1
+#define RX_PRIORITY_LOW		2
+#define RX_NPRIORITIES		3
+#define rx_SetServicePriority(service, x) ((service)->priority = (x))
+#define rx_SetServiceBulkPriority(service, x) ((service)->bulkPriority = (x))
+
 /* Set the overload threshold and the overload error */
 #define rx_SetBusyThreshold(threshold, code) (rx_BusyThreshold=(threshold),rx_BusyError=(code))
 
@@ -298,6 +315,22 @@ returned with an error code of RX_CALL_DEAD ( transient error ) */
 #define rx_EnableHotThread()		(rx_enable_hot_thread = 1)
 #define rx_DisableHotThread()		(rx_enable_hot_thread = 0)
 
+/* Macros to turn batched packet I/O on and off. Where the platform supports
+ * it, listener threads then read, and calls send, several datagrams with
+ * each system call.
+ */
+#define rx_EnableBatchIO()		(rx_enable_batch_io = 1)
+#define rx_DisableBatchIO()		(rx_enable_batch_io = 0)
+
+/* Macro to choose where rxgen server stubs allocate the arguments they
+ * decode. RX_ARENA_NONE allocates each one separately, which is slower,
+ * but lets tools such as AddressSanitizer and valgrind track them.
+ */
+#define RX_ARENA_NONE	0	/* osi_alloc each decoded argument */
+#define RX_ARENA_CALL	1	/* bump allocate, freed by rx_EndCall */
+#define RX_ARENA_REUSE	2	/* as above, threads keep a chunk for reuse */
+#define rx_SetCallArenas(mode)		(rx_call_arenas = (mode))
+
 #define rx_PutConnection(conn) rx_DestroyConnection(conn)
 
 /* A service is installed by rx_NewService, and specifies a service type that
@@ -342,6 +375,8 @@ struct rx_service {
     u_char checkReach;		/* Check for asymmetric clients? */
     int nSpecific;		/* number entries in specific data */
     void **specific;		/* pointer to connection specific data */
+    u_char priority;		/* Priority class of calls waiting for a thread */
+    u_char bulkPriority;	/* ... and of those with multi-packet requests */
 #ifdef	RX_ENABLE_LOCKS
     afs_kmutex_t svc_data_lock;	/* protect specific data */
 #endif
@@ -437,6 +472,26 @@ struct rx_ackPacket {
 /* The packet size transmitted for an acknowledge is adjusted to reflect the actual size of the acks array.  This macro defines the size */
 #define rx_AckDataSize(nAcks) (3 + nAcks + offsetof(struct rx_ackPacket, acks[0]))
 
+/* The acks array is followed by a trailer of 32 bit words: the maximum
+ * packet size the receiver will accept, its interface MTU, its receive
+ * window (capped at RX_MAXACKS), the number of packets it will accept in
+ * a jumbogram, and a word of RX_ACKCAP flags.  Older peers send only the
+ * first four words, and ignore any after them.
+ *
+ * Peers which can read extended ACKs say so by setting RX_ACKCAP_EXTACKS
+ * in every ACK they send. ACKs sent to such a peer set RX_ACKCAP_EXTENDED,
+ * and add two words to the trailer: the receive window again, uncapped,
+ * and the number of acknowledgements beyond the first RX_MAXACKS. These
+ * extra acknowledgements follow as a bitmap, one bit per packet starting
+ * from the least significant bit of the first byte, which is set if the
+ * packet has been received. Older peers never see the extended trailer,
+ * and are never offered more than RX_MAXACKS. */
+#define RX_MAXEXTWINDOW	    8192	/* Largest extended receive window */
+#define RX_ACKTRAILER_WORDS 5
+#define RX_EXTACKTRAILER_WORDS 7
+#define RX_ACKCAP_EXTACKS   1	/* The sender reads extended ACKs */
+#define RX_ACKCAP_EXTENDED  2	/* This ACK has the extended trailer */
+
 #define	RX_CHALLENGE_TIMEOUT	2	/* Number of seconds before another authentication request packet is generated */
 #define RX_CHALLENGE_MAXTRIES	50	/* Max # of times we resend challenge */
 #define	RX_CHECKREACH_TIMEOUT	2	/* Number of seconds before another ping is generated */
@@ -667,7 +722,10 @@ struct rx_statistics {		/* General rx statistics */
     int receiveCbufPktAllocFailures;
     int sendCbufPktAllocFailures;
     int nBusies;
-    int spares[4];
+    int recvBatches;		/* Number of batched (recvmmsg) reads */
+    int recvBatchPackets;	/* Number of datagrams read by batched reads */
+    int sendBatches;		/* Number of batched (sendmmsg) sends */
+    int sendBatchPackets;	/* Number of datagrams sent by batched sends */
 };
 
 /* structures for debug input and output packets */
@@ -682,7 +740,7 @@ struct rx_debugIn {
 #define RX_DEBUGI_BADTYPE     (-8)
 
 #define RX_DEBUGI_VERSION_MINIMUM ('L')	/* earliest real version */
-#define RX_DEBUGI_VERSION     ('S')    /* Latest version */
+#define RX_DEBUGI_VERSION     ('V')    /* Latest version */
     /* first version w/ secStats */
 #define RX_DEBUGI_VERSION_W_SECSTATS ('L')
     /* version M is first supporting GETALLCONN and RXSTATS type */
@@ -696,6 +754,9 @@ struct rx_debugIn {
 #define RX_DEBUGI_VERSION_W_GETPEER ('Q')
 #define RX_DEBUGI_VERSION_W_WAITED ('R')
 #define RX_DEBUGI_VERSION_W_PACKETS ('S')
+#define RX_DEBUGI_VERSION_W_CALLCC ('T')
+#define RX_DEBUGI_VERSION_W_CALLQUEUES ('U')
+#define RX_DEBUGI_VERSION_W_WIDECONN ('V')
 
 #define	RX_DEBUGI_GETSTATS	1	/* get basic rx stats */
 #define	RX_DEBUGI_GETCONN	2	/* get connection info */
@@ -715,7 +776,10 @@ struct rx_debugStats {
     afs_int32 idleThreads;	/* Number of server threads that are idle */
     afs_int32 nWaited;
     afs_int32 nPackets;
-    afs_int32 spare2[6];
+    afs_int32 nCallQueues;	/* Number of queues calls wait on for a thread */
+    afs_int32 nQueued[RX_NPRIORITIES];	/* Calls waiting, by priority class */
+    afs_int32 nStolen;		/* Calls taken by a thread from another's queue */
+    afs_int32 spare2[1];
 };
 
 struct rx_debugConn_vL {
@@ -747,7 +811,8 @@ struct rx_debugConn {
     char flags;
     char type;
     char securityIndex;
-    char sparec[3];		/* force correct alignment */
+    u_char wideGroup;		/* which RX_MAXCALLS channels of a wide conn */
+    char sparec[2];		/* force correct alignment */
     char callState[RX_MAXCALLS];
     char callMode[RX_MAXCALLS];
     char callFlags[RX_MAXCALLS];
@@ -756,7 +821,9 @@ struct rx_debugConn {
     struct rx_securityObjectStats secStats;
     afs_int32 epoch;
     afs_int32 natMTU;
-    afs_int32 sparel[9];
+    afs_int32 callCwind[RX_MAXCALLS];	/* congestion window, in packets */
+    afs_int32 callRtt[RX_MAXCALLS];	/* smoothed rtt, in msec/8 */
+    afs_int32 wideCid;		/* cid of the wide conn this is part of, or 0 */
 };
 
 struct rx_debugPeer {
@@ -802,6 +869,9 @@ struct rx_debugPeer {
 #define RX_SERVER_DEBUG_ALL_PEER		0x80
 #define RX_SERVER_DEBUG_WAITED_CNT              0x100
 #define RX_SERVER_DEBUG_PACKETS_CNT              0x200
+#define RX_SERVER_DEBUG_CALL_CC			0x400
+#define RX_SERVER_DEBUG_CALL_QUEUES		0x800
+#define RX_SERVER_DEBUG_WIDE_CONN		0x1000
 
 #define AFS_RX_STATS_CLEAR_ALL			0xffffffff
 #define AFS_RX_STATS_CLEAR_INVOCATIONS		0x1
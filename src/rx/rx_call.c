@@ -68,6 +68,10 @@ rx_RecordCallStatistics(struct rx_call *call, unsigned int rxInterface,
     queue = call->startTime;
     clock_Sub(&queue, &call->queueTime);
 
+    /* Stubs serving a call say that the remote end is not the server */
+    if (!isServer)
+	rxi_RecordLatency(rxInterface, currentFunc, totalFunc, &exec);
+
     rxi_IncrementTimeAndCount(call->conn->peer, rxInterface, currentFunc,
 			     totalFunc, &queue, &exec, call->app.bytesSent,
 			     call->app.bytesRcvd, 1);
@@ -83,14 +83,16 @@ struct rx_call {
     u_short ssthresh;		/* The slow start threshold */
     u_short nDgramPackets;	/* Packets per AFS 3.5 jumbogram */
     u_short nAcks;		/* The number of consecutive acks */
-    u_short nNacks;		/* Number packets acked that follow the
-				 * first negatively acked packet */
     u_short nSoftAcks;		/* The number of delayed soft acks */
     u_short nHardAcks;		/* The number of delayed hard acks */
     u_short congestSeq;		/* Peer's congestion sequence counter */
     int rtt;
     int rtt_dev;
     struct clock rto;		/* The round trip timeout calculated for this call */
+    struct clock rackSent;	/* When the latest packet to be acked was sent */
+    afs_uint32 rackSeq;		/* Sequence number of that packet */
+    struct clock rackRtt;	/* Round trip time measured for that packet */
+    struct clock recoverTime;	/* When the congestion window was last cut */
     struct rxevent *resendEvent;	/* If this is non-Null, there is a retransmission event pending */
     struct rxevent *keepAliveEvent;	/* Scheduled periodically in active calls to keep call alive */
     struct rxevent *growMTUEvent;      /* Scheduled periodically in active calls to discover true maximum MTU */
@@ -139,12 +141,14 @@ struct rx_call {
     int iovNext;		/* next entry in current iovec */
     struct iovec *iov;		/* current iovec */
 
+    struct xdr_arena *arena;	/* decoded server call arguments, or NULL */
+
     struct clock queueTime;	/* time call was queued */
     struct clock startTime;	/* time call was started */
 
     u_short tqWaiters;
 
-    struct rx_packet *xmitList[RX_MAXACKS]; /* Can't xmit more than we ack */
+    struct rx_packet *xmitList[RX_MAXACKS]; /* Packets for one pass of rxi_Start */
                                 /* Protected by setting RX_CALL_TQ_BUSY */
 #ifdef RXDEBUG_PACKET
     u_short tqc;                /* packet count in tq */
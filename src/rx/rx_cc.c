@@ -0,0 +1,225 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/* Congestion control algorithms for Rx calls. See rx_cc.h for the
+ * interface. */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#ifdef KERNEL
+# include "afs/sysincludes.h"
+# include "afsincludes.h"
+#else
+# include <roken.h>
+#endif
+
+#include "rx.h"
+#include "rx_clock.h"
+#include "rx_globals.h"
+#include "rx_atomic.h"
+#include "rx_peer.h"
+#include "rx_call.h"
+#include "rx_cc.h"
+
+/*
+ * NewReno
+ *
+ * The algorithm Rx has always used. The window doubles every round trip
+ * until it reaches the slow start threshold, and then grows by one packet
+ * per round trip. A loss halves it.
+ */
+
+static void
+newreno_OnAck(struct rx_call *call, struct rx_peer *peer, int newAcks)
+{
+    /* If cwind is smaller than ssthresh, then increase
+     * the window one packet for each ack we receive (exponential
+     * growth).
+     * If cwind is greater than or equal to ssthresh then increase
+     * the congestion window by one packet for each cwind acks we
+     * receive (linear growth).  */
+    if (call->cwind < call->ssthresh) {
+	call->cwind =
+	    MIN((int)call->ssthresh, (int)(call->cwind + newAcks));
+	call->nCwindAcks = 0;
+    } else {
+	call->nCwindAcks += newAcks;
+	if (call->nCwindAcks >= call->cwind) {
+	    call->nCwindAcks = 0;
+	    call->cwind = MIN((int)(call->cwind + 1), rx_maxSendWindow);
+	}
+    }
+}
+
+static void
+newreno_OnLoss(struct rx_call *call, struct rx_peer *peer, int timeout)
+{
+    call->ssthresh = MAX(4, MIN((int)call->cwind, (int)call->twind)) >> 1;
+}
+
+static struct rx_ccOps rxi_ccNewReno = {
+    "newreno",
+    newreno_OnAck,
+    newreno_OnLoss,
+};
+
+/*
+ * CUBIC
+ *
+ * After a loss, the window follows a cubic function of the time since
+ * that loss: it climbs quickly back towards the size it was when the loss
+ * happened, levels off around that size, and then probes further above it
+ * at an increasing rate. How quickly the window grows depends on elapsed
+ * time rather than on the round trip time, so paths with a large
+ * bandwidth-delay product get up to speed far more quickly than with
+ * NewReno. See RFC 8312.
+ *
+ * All of the arithmetic is done in integers, so that this can run in the
+ * kernel. Time is measured in milliseconds, and the scaling constant C is
+ * 2^-31 packets/ms^3, about 0.47 packets/s^3, close to the 0.4 of the RFC.
+ * A loss reduces the window to 7/10 of its size.
+ */
+
+#define CUBIC_SHIFT	31	/* C = 2^-CUBIC_SHIFT packets/ms^3 */
+#define CUBIC_MAXTIME	(1 << 20)	/* Keep the cube within 64 bits */
+
+/* Integer cube root, rounded down */
+static afs_uint32
+cubic_Root(afs_uint64 x)
+{
+    afs_uint64 r = 0, b;
+    int bit;
+
+    for (bit = 20; bit >= 0; bit--) {
+	b = r | ((afs_uint64)1 << bit);
+	if (b * b * b <= x)
+	    r = b;
+    }
+    return (afs_uint32)r;
+}
+
+static void
+cubic_OnAck(struct rx_call *call, struct rx_peer *peer, int newAcks)
+{
+    struct clock now;
+    afs_int32 t;
+    afs_uint64 offset;
+    afs_uint32 target, count;
+
+    /* Slow start is the same as for NewReno */
+    if (call->cwind < call->ssthresh) {
+	newreno_OnAck(call, peer, newAcks);
+	return;
+    }
+
+    clock_GetTime(&now);
+
+    /* Start a new epoch of growth if there isn't one running */
+    if (clock_IsZero(&peer->ccEpoch)) {
+	peer->ccEpoch = now;
+	if (call->cwind < peer->ccWmax) {
+	    peer->ccK = cubic_Root((afs_uint64)(peer->ccWmax - call->cwind)
+				   << CUBIC_SHIFT);
+	    peer->ccOrigin = peer->ccWmax;
+	} else {
+	    peer->ccK = 0;
+	    peer->ccOrigin = call->cwind;
+	}
+    }
+
+    /* Work out where the window should be one round trip from now */
+    clock_Sub(&now, &peer->ccEpoch);
+    if (now.sec >= CUBIC_MAXTIME / 1000)
+	t = CUBIC_MAXTIME;
+    else
+	t = now.sec * 1000 + now.usec / 1000;
+    t += (call->rtt >> 3) - (afs_int32)peer->ccK;
+    if (t > CUBIC_MAXTIME)
+	t = CUBIC_MAXTIME;
+    else if (t < -CUBIC_MAXTIME)
+	t = -CUBIC_MAXTIME;
+
+    if (t >= 0) {
+	offset = ((afs_uint64)t * t * t) >> CUBIC_SHIFT;
+	target = peer->ccOrigin + MIN(offset, rx_maxSendWindow);
+    } else {
+	t = -t;
+	offset = ((afs_uint64)t * t * t) >> CUBIC_SHIFT;
+	target = peer->ccOrigin - MIN(offset, peer->ccOrigin);
+    }
+
+    /* Grow by one packet every 'count' acknowledgements, so as to reach the
+     * target within a round trip, but never more slowly than NewReno */
+    if (target > call->cwind)
+	count = MAX(call->cwind / (target - call->cwind), 1);
+    else
+	count = call->cwind;
+    count = MIN(count, call->cwind);
+
+    call->nCwindAcks += newAcks;
+    if (call->nCwindAcks >= count) {
+	call->nCwindAcks = 0;
+	call->cwind = MIN((int)(call->cwind + 1), rx_maxSendWindow);
+    }
+}
+
+static void
+cubic_OnLoss(struct rx_call *call, struct rx_peer *peer, int timeout)
+{
+    int cwind = MIN((int)call->cwind, (int)call->twind);
+
+    /* If we lost packets before getting back to the previous maximum, then
+     * other flows are competing for the path: give up some more room */
+    if (cwind < peer->ccWmax)
+	peer->ccWmax = (cwind * 17) / 20;
+    else
+	peer->ccWmax = cwind;
+    clock_Zero(&peer->ccEpoch);
+
+    call->ssthresh = MAX(2, (cwind * 7) / 10);
+}
+
+static struct rx_ccOps rxi_ccCubic = {
+    "cubic",
+    cubic_OnAck,
+    cubic_OnLoss,
+};
+
+struct rx_ccOps *rxi_ccOps = &rxi_ccNewReno;
+
+static struct rx_ccOps *rxi_ccAlgorithms[] = {
+    &rxi_ccNewReno,
+    &rxi_ccCubic,
+    NULL
+};
+
+/*!
+ * Select the congestion control algorithm used by all calls in this
+ * process.
+ *
+ * @param[in] name
+ *      "newreno" (the default) or "cubic"
+ *
+ * @return
+ *      0 on success, or EINVAL if the algorithm isn't known
+ */
+int
+rx_SetCongestionControl(const char *name)
+{
+    int i;
+
+    for (i = 0; rxi_ccAlgorithms[i] != NULL; i++) {
+	if (strcmp(rxi_ccAlgorithms[i]->name, name) == 0) {
+	    rxi_ccOps = rxi_ccAlgorithms[i];
+	    return 0;
+	}
+    }
+    return EINVAL;
+}
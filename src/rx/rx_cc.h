@@ -0,0 +1,40 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+#ifndef OPENAFS_RX_CC_H
+#define OPENAFS_RX_CC_H 1
+
+/* Congestion control algorithms. The generic parts of slow start and fast
+ * recovery stay in rx.c; an algorithm decides how the congestion window of
+ * a call grows as packets are acknowledged, and where the slow start
+ * threshold is put when a loss is detected.
+ *
+ * Both operations are called with the call lock and the peer lock held.
+ * Any state which an algorithm keeps between calls lives in the peer.
+ */
+
+struct rx_ccOps {
+    char *name;
+    /* newAcks packets have been acknowledged, outside of fast recovery */
+    void (*op_OnAck) (struct rx_call *call, struct rx_peer *peer,
+		      int newAcks);
+    /* Packets have been lost. timeout is set if this was discovered by
+     * the retransmit timer, rather than by negative acknowledgements */
+    void (*op_OnLoss) (struct rx_call *call, struct rx_peer *peer,
+		       int timeout);
+};
+
+extern struct rx_ccOps *rxi_ccOps;
+
+#define RXCC_OnAck(call, peer, newAcks) \
+    (*rxi_ccOps->op_OnAck)(call, peer, newAcks)
+#define RXCC_OnLoss(call, peer, timeout) \
+    (*rxi_ccOps->op_OnLoss)(call, peer, timeout)
+
+#endif
@@ -77,6 +77,14 @@ struct rx_connection {
     afs_int32 msgsizeRetryErr;
     int nSpecific;		/* number entries in specific data */
     void **specific;		/* pointer to connection specific data */
+    /* A wide connection's channels past the first RX_MAXCALLS are carried
+     * by further client connections, made as they're needed */
+    struct rx_connection **wideConns;	/* the further connections */
+    u_short nWideConns;		/* how many are made (conn_data_lock) */
+    u_short maxWideConns;	/* how many may be made; 0 if not wide */
+    u_short wideRotor;		/* next to wait on when all are busy */
+    u_short wideGroup;		/* which RX_MAXCALLS channels this carries */
+    afs_uint32 wideCid;		/* cid of the wide connection, or 0 */
 };
 
 #endif
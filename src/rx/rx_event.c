@@ -22,7 +22,7 @@
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-/* A reimplementation of the rx_event handler using red/black trees
+/* A reimplementation of the rx_event handler using a timing wheel
  *
  * The first rx_event implementation used a simple sorted queue of all
  * events, which lead to O(n^2) performance, where n is the number of
@@ -34,9 +34,21 @@
  * where RTT times are in the millisecond, most connections will have events
  * expiring within the next second, so the problem reoccurs.
  *
- * This new implementation uses Red-Black trees to store a sorted list of
- * events. Red Black trees are guaranteed to have no worse than O(log N)
- * insertion, and are commonly used in timer applications
+ * The third implementation used Red-Black trees to store a sorted list of
+ * events. This gave O(log N) insertion and removal, but a busy server posts
+ * and cancels a retransmit, keepalive or ack event for nearly every packet,
+ * and the time spent rebalancing the tree under the event lock was
+ * significant.
+ *
+ * This implementation uses a hierarchical timing wheel. Each level of the
+ * wheel is an array of RXEVENT_SLOTS queues. A slot at level 0 holds the
+ * events which expire in a single millisecond tick; a slot at level n covers
+ * RXEVENT_SLOTS times the span of a slot at level n-1. When the wheel turns
+ * past the start of a slot above level 0, that slot's events are
+ * redistributed ("cascaded") to the lower levels. Posting and cancelling an
+ * event are O(1), and each event is cascaded at most once per level. Events
+ * fire up to a tick later than the time they were posted for, but never
+ * before it.
  */
 
 #include <afsconfig.h>
@@ -51,20 +63,29 @@
 
 #include <afs/opr.h>
 #include <opr/queue.h>
-#include <opr/rbtree.h>
+#include <opr/ffs.h>
 
 #include "rx.h"
 #include "rx_atomic.h"
 #include "rx_call.h"
 #include "rx_globals.h"
 
+/* Shape of the timing wheel. A tick is one millisecond, so the wheel spans
+ * 2^24ms, about four and a half hours. Events further out than that are
+ * parked in the final slot, and are re-filed when it is cascaded. */
+#define RXEVENT_LEVELS		4
+#define RXEVENT_SLOTBITS	6
+#define RXEVENT_SLOTS		(1 << RXEVENT_SLOTBITS)
+#define RXEVENT_SLOTMASK	(RXEVENT_SLOTS - 1)
+#define RXEVENT_HORIZON \
+    ((afs_uint64)1 << (RXEVENT_SLOTBITS * RXEVENT_LEVELS))
+
 struct rxevent {
     struct opr_queue q;
-    struct opr_rbtree_node node;
     struct clock eventTime;
-    struct rxevent *next;
     rx_atomic_t refcnt;
     int handled;
+    int slot;
     void (*func)(struct rxevent *, void *, void *, int);
     void *arg;
     void *arg1;
@@ -85,9 +106,11 @@ static struct {
 
 static struct {
     afs_kmutex_t lock;
-    struct opr_rbtree head;
-    struct rxevent *first;
-} eventTree;
+    afs_uint64 now;	/* The tick the wheel has turned to */
+    int count;		/* Number of events on the wheel */
+    afs_uint64 occupied[RXEVENT_LEVELS];	/* Bitmap of non-empty slots */
+    struct opr_queue slots[RXEVENT_LEVELS * RXEVENT_SLOTS];
+} eventWheel;
 
 static struct {
     afs_kmutex_t lock;
@@ -172,13 +195,138 @@ rxevent_Get(struct rxevent *ev) {
     return rxevent_get(ev);
 }
 
+static_inline afs_uint64
+clockToTick(struct clock *c)
+{
+    return (afs_uint64)c->sec * 1000 + c->usec / 1000;
+}
+
+/* Rotate a slot bitmap so that bit 'shift' becomes bit 0 */
+static_inline afs_uint64
+rotateSlots(afs_uint64 bits, int shift)
+{
+    if (shift == 0)
+	return bits;
+    return (bits >> shift) | (bits << (RXEVENT_SLOTS - shift));
+}
+
+/* File an event in the slot for its expiry time. Called with the wheel
+ * lock held. */
+static void
+wheelInsert(struct rxevent *ev)
+{
+    afs_uint64 tick, delta;
+    int level, index;
+
+    tick = clockToTick(&ev->eventTime);
+    if (tick < eventWheel.now)
+	tick = eventWheel.now;
+    delta = tick - eventWheel.now;
+    if (delta >= RXEVENT_HORIZON) {
+	delta = RXEVENT_HORIZON - 1;
+	tick = eventWheel.now + delta;
+    }
+
+    for (level = 0; level < RXEVENT_LEVELS - 1; level++) {
+	if (delta < ((afs_uint64)1 << (RXEVENT_SLOTBITS * (level + 1))))
+	    break;
+    }
+    index = (tick >> (RXEVENT_SLOTBITS * level)) & RXEVENT_SLOTMASK;
+
+    ev->slot = level * RXEVENT_SLOTS + index;
+    opr_queue_Append(&eventWheel.slots[ev->slot], &ev->q);
+    eventWheel.occupied[level] |= (afs_uint64)1 << index;
+    eventWheel.count++;
+}
+
+/* Take an event off the wheel. Called with the wheel lock held. */
+static void
+wheelRemove(struct rxevent *ev)
+{
+    opr_queue_Remove(&ev->q);
+    if (opr_queue_IsEmpty(&eventWheel.slots[ev->slot])) {
+	eventWheel.occupied[ev->slot / RXEVENT_SLOTS] &=
+	    ~((afs_uint64)1 << (ev->slot & RXEVENT_SLOTMASK));
+    }
+    eventWheel.count--;
+}
+
+/* Return the first tick, at or after the current one, at which there are
+ * either level 0 events to fire, or a higher level slot to cascade. The
+ * wheel must not be empty. Called with the wheel lock held. */
+static afs_uint64
+wheelNextTick(void)
+{
+    afs_uint64 next = 0, base, tick;
+    int level, shift, index, distance;
+
+    for (level = 0; level < RXEVENT_LEVELS; level++) {
+	if (eventWheel.occupied[level] == 0)
+	    continue;
+
+	shift = RXEVENT_SLOTBITS * level;
+	base = eventWheel.now >> shift;
+	index = base & RXEVENT_SLOTMASK;
+
+	/* Above level 0, the current slot has already been cascaded, so
+	 * anything in it is due a full turn of that level later. */
+	if (level > 0)
+	    index = (index + 1) & RXEVENT_SLOTMASK;
+	distance = opr_ffsll(rotateSlots(eventWheel.occupied[level], index)) - 1;
+	if (level > 0)
+	    distance++;
+
+	tick = (base + distance) << shift;
+	if (next == 0 || tick < next)
+	    next = tick;
+    }
+
+    return next;
+}
+
+/* Move the wheel on to 'tick', cascading the slots which start there.
+ * There must be nothing on the wheel which is due before 'tick'. Called
+ * with the wheel lock held. */
+static void
+wheelAdvance(afs_uint64 tick)
+{
+    struct opr_queue cascade;
+    struct rxevent *ev;
+    int level, index;
+
+    eventWheel.now = tick;
+    if (eventWheel.count == 0)
+	return;
+
+    for (level = 1; level < RXEVENT_LEVELS; level++) {
+	if ((tick & (((afs_uint64)1 << (RXEVENT_SLOTBITS * level)) - 1)) != 0)
+	    break;
+
+	index = (tick >> (RXEVENT_SLOTBITS * level)) & RXEVENT_SLOTMASK;
+	if (!(eventWheel.occupied[level] & ((afs_uint64)1 << index)))
+	    continue;
+
+	opr_queue_Init(&cascade);
+	opr_queue_SpliceAppend(&cascade,
+			       &eventWheel.slots[level * RXEVENT_SLOTS + index]);
+	eventWheel.occupied[level] &= ~((afs_uint64)1 << index);
+
+	while (!opr_queue_IsEmpty(&cascade)) {
+	    ev = opr_queue_First(&cascade, struct rxevent, q);
+	    opr_queue_Remove(&ev->q);
+	    eventWheel.count--;
+	    wheelInsert(ev);
+	}
+    }
+}
+
 /* Called if the time now is older than the last time we recorded running an
  * event. This test catches machines where the system time has been set
  * backwards, and avoids RX completely stalling when timers fail to fire.
  *
  * Take the different between now and the last event time, and subtract that
- * from the timing of every event on the system. This does a relatively slow
- * walk of the completely eventTree, but time-travel will hopefully be a pretty
+ * from the timing of every event on the system. This takes every event off
+ * the wheel and files it again, but time-travel will hopefully be a pretty
  * rare occurrence.
  *
  * This can only safely be called from the event thread, as it plays with the
@@ -188,10 +336,12 @@ rxevent_Get(struct rxevent *ev) {
 static void
 adjustTimes(void)
 {
-    struct opr_rbtree_node *node;
+    struct opr_queue events;
     struct clock adjTime, now;
+    struct rxevent *event;
+    int i;
 
-    MUTEX_ENTER(&eventTree.lock);
+    MUTEX_ENTER(&eventWheel.lock);
     /* Time adjustment is expensive, make absolutely certain that we have
      * to do it, by getting an up to date time to base our decision on
      * once we've acquired the relevant locks.
@@ -205,35 +355,50 @@ adjustTimes(void)
 
     clock_Sub(&adjTime, &now);
 
-    /* If there are no events in the tree, then there's nothing to adjust */
-    if (eventTree.first == NULL)
-	goto out;
-
-    node = opr_rbtree_first(&eventTree.head);
-    while(node) {
-	struct rxevent *event = opr_containerof(node, struct rxevent, node);
-
+    opr_queue_Init(&events);
+    for (i = 0; i < RXEVENT_LEVELS * RXEVENT_SLOTS; i++)
+	opr_queue_SpliceAppend(&events, &eventWheel.slots[i]);
+    for (i = 0; i < RXEVENT_LEVELS; i++)
+	eventWheel.occupied[i] = 0;
+    eventWheel.count = 0;
+    eventWheel.now = clockToTick(&now);
+
+    while (!opr_queue_IsEmpty(&events)) {
+	event = opr_queue_First(&events, struct rxevent, q);
+	opr_queue_Remove(&event->q);
 	clock_Sub(&event->eventTime, &adjTime);
-	node = opr_rbtree_next(node);
+	wheelInsert(event);
     }
-    eventSchedule.next = eventTree.first->eventTime;
+
+    /* The event thread may be asleep until a time that has now moved;
+     * make sure that the next post wakes it. */
+    eventSchedule.raised = 0;
 
 out:
-    MUTEX_EXIT(&eventTree.lock);
+    MUTEX_EXIT(&eventWheel.lock);
 }
 
 static int initialised = 0;
 void
 rxevent_Init(int nEvents, void (*scheduler)(void))
 {
+    struct clock now;
+    int i;
+
     if (initialised)
 	return;
 
     initialised = 1;
 
     clock_Init();
-    MUTEX_INIT(&eventTree.lock, "event tree lock", MUTEX_DEFAULT, 0);
-    opr_rbtree_init(&eventTree.head);
+    MUTEX_INIT(&eventWheel.lock, "event wheel lock", MUTEX_DEFAULT, 0);
+    for (i = 0; i < RXEVENT_LEVELS * RXEVENT_SLOTS; i++)
+	opr_queue_Init(&eventWheel.slots[i]);
+    for (i = 0; i < RXEVENT_LEVELS; i++)
+	eventWheel.occupied[i] = 0;
+    eventWheel.count = 0;
+    clock_GetTime(&now);
+    eventWheel.now = clockToTick(&now);
 
     MUTEX_INIT(&freeEvents.lock, "free events lock", MUTEX_DEFAULT, 0);
     opr_queue_Init(&freeEvents.list);
@@ -253,10 +418,12 @@ rxevent_Post(struct clock *when, struct clock *now,
 	     void (*func) (struct rxevent *, void *, void *, int),
 	     void *arg, void *arg1, int arg2)
 {
-    struct rxevent *ev, *event;
-    struct opr_rbtree_node **childptr, *parent = NULL;
+    struct rxevent *ev;
+    afs_uint64 nowTick;
 
-    ev = rxevent_alloc();
+    /* Take the caller's reference before the event goes on the wheel, as
+     * the event thread may fire and release it as soon as it is there. */
+    ev = rxevent_get(rxevent_alloc());
     ev->eventTime = *when;
     ev->func = func;
     ev->arg = arg;
@@ -266,53 +433,29 @@ rxevent_Post(struct clock *when, struct clock *now,
     if (clock_Lt(now, &eventSchedule.last))
 	adjustTimes();
 
-    MUTEX_ENTER(&eventTree.lock);
+    MUTEX_ENTER(&eventWheel.lock);
 
-    /* Work out where in the tree we'll be storing this */
-    childptr = &eventTree.head.root;
+    /* If the wheel is empty, it may not have been turned for a while. Catch
+     * it up, so the event is filed relative to the present. */
+    nowTick = clockToTick(now);
+    if (eventWheel.count == 0 && eventWheel.now < nowTick)
+	wheelAdvance(nowTick);
 
-    while(*childptr) {
-	event = opr_containerof((*childptr), struct rxevent, node);
+    wheelInsert(ev);
 
-	parent = *childptr;
-	if (clock_Lt(when, &event->eventTime))
-	    childptr = &(*childptr)->left;
-	else if (clock_Gt(when, &event->eventTime))
-	    childptr = &(*childptr)->right;
-	else {
-	    opr_queue_Append(&event->q, &ev->q);
-	    goto out;
-	}
-    }
-    opr_queue_Init(&ev->q);
-    opr_rbtree_insert(&eventTree.head, parent, childptr, &ev->node);
-
-    if (eventTree.first == NULL ||
-	clock_Lt(when, &(eventTree.first->eventTime))) {
-	eventTree.first = ev;
+    /* If the event thread won't wake up before this event is due, then
+     * reschedule it */
+    if (!eventSchedule.raised || clock_Lt(when, &eventSchedule.next)) {
 	eventSchedule.raised = 1;
-	clock_Zero(&eventSchedule.next);
-	MUTEX_EXIT(&eventTree.lock);
+	eventSchedule.next = *when;
+	MUTEX_EXIT(&eventWheel.lock);
 	if (eventSchedule.func != NULL)
 	    (*eventSchedule.func)();
-	return rxevent_get(ev);
+	return ev;
     }
 
-out:
-    MUTEX_EXIT(&eventTree.lock);
-    return rxevent_get(ev);
-}
-
-/* We're going to remove ev from the tree, so set the first pointer to the
- * next event after it */
-static_inline void
-resetFirst(struct rxevent *ev)
-{
-    struct opr_rbtree_node *next = opr_rbtree_next(&ev->node);
-    if (next)
-	eventTree.first = opr_containerof(next, struct rxevent, node);
-    else
-	eventTree.first = NULL;
+    MUTEX_EXIT(&eventWheel.lock);
+    return ev;
 }
 
 /*!
@@ -333,49 +476,16 @@ rxevent_Cancel(struct rxevent **evp)
 
     event = *evp;
 
-    MUTEX_ENTER(&eventTree.lock);
+    MUTEX_ENTER(&eventWheel.lock);
 
     if (!event->handled) {
-	/* We're a node on the red/black tree. If our list is non-empty,
-	 * then swap the first element in the list in in our place,
-	 * promoting it to the list head */
-	if (event->node.parent == NULL
-	    && eventTree.head.root != &event->node) {
-	    /* Not in the rbtree, therefore must be a list element */
-	    opr_queue_Remove(&event->q);
-	} else {
-	    if (!opr_queue_IsEmpty(&event->q)) {
-	        struct rxevent *next;
-
-		next = opr_queue_First(&event->q, struct rxevent, q);
-		opr_queue_Remove(&next->q); /* Remove ourselves from list */
-		if (event->q.prev == &event->q) {
-		    next->q.prev = next->q.next = &next->q;
-		} else {
-		    next->q = event->q;
-		    next->q.prev->next = &next->q;
-		    next->q.next->prev = &next->q;
-		}
-
-		opr_rbtree_replace(&eventTree.head, &event->node,
-				   &next->node);
-
-		if (eventTree.first == event)
-		    eventTree.first = next;
-
-	    } else {
-		if (eventTree.first == event)
-		    resetFirst(event);
-
-		opr_rbtree_remove(&eventTree.head, &event->node);
-	    }
-	}
+	wheelRemove(event);
 	event->handled = 1;
-	rxevent_put(event); /* Dispose of eventTree reference */
+	rxevent_put(event); /* Dispose of eventWheel reference */
 	cancelled = 1;
     }
 
-    MUTEX_EXIT(&eventTree.lock);
+    MUTEX_EXIT(&eventWheel.lock);
 
     *evp = NULL;
     rxevent_put(event); /* Dispose of caller's reference */
@@ -396,8 +506,11 @@ rxevent_Cancel(struct rxevent **evp)
 int
 rxevent_RaiseEvents(struct clock *wait)
 {
-    struct clock now;
+    struct clock now, frac;
     struct rxevent *event;
+    struct opr_queue *slot;
+    afs_uint64 nowTick, next, due;
+    afs_uint32 msec;
     int ret;
 
     clock_GetTime(&now);
@@ -407,41 +520,58 @@ rxevent_RaiseEvents(struct clock *wait)
 	  adjustTimes();
     eventSchedule.last = now;
 
-    MUTEX_ENTER(&eventTree.lock);
-    /* Lock our event tree */
-    while (eventTree.first != NULL
-	   && clock_Lt(&eventTree.first->eventTime, &now)) {
-
-	/* Grab the next node, either in the event's list, or in the tree node
-	 * itself, and remove it from the event tree */
-	event = eventTree.first;
-	if (!opr_queue_IsEmpty(&event->q)) {
-	    event = opr_queue_Last(&event->q, struct rxevent, q);
-	    opr_queue_Remove(&event->q);
-	} else {
-	    resetFirst(event);
-	    opr_rbtree_remove(&eventTree.head, &event->node);
+    /* Everything in a tick is due once the clock has moved past it */
+    nowTick = clockToTick(&now);
+
+    MUTEX_ENTER(&eventWheel.lock);
+    while (eventWheel.now < nowTick) {
+	/* Fire the events in the current tick, one at a time, as the wheel
+	 * may move whilst we have dropped the lock. Events which are posted
+	 * for the current tick or earlier in the meantime land in the same
+	 * slot, and are fired here too. */
+	slot = &eventWheel.slots[eventWheel.now & RXEVENT_SLOTMASK];
+	if (!opr_queue_IsEmpty(slot)) {
+	    event = opr_queue_First(slot, struct rxevent, q);
+	    wheelRemove(event);
+	    event->handled = 1;
+	    MUTEX_EXIT(&eventWheel.lock);
+
+	    /* Fire the event, then free the structure */
+	    event->func(event, event->arg, event->arg1, event->arg2);
+	    rxevent_put(event);
+
+	    MUTEX_ENTER(&eventWheel.lock);
+	    continue;
 	}
-	event->handled = 1;
-        MUTEX_EXIT(&eventTree.lock);
-
-        /* Fire the event, then free the structure */
-	event->func(event, event->arg, event->arg1, event->arg2);
-	rxevent_put(event);
 
-	MUTEX_ENTER(&eventTree.lock);
+	/* Turn the wheel straight on to the next tick with work to do */
+	next = nowTick;
+	if (eventWheel.count != 0) {
+	    due = wheelNextTick();
+	    if (due < next)
+		next = due;
+	}
+	wheelAdvance(next);
     }
 
     /* Figure out when we next need to be scheduled */
-    if (eventTree.first != NULL) {
-	*wait = eventSchedule.next = eventTree.first->eventTime;
+    if (eventWheel.count != 0) {
+	/* Wake up once the clock has moved past the next tick with work */
+	msec = wheelNextTick() + 1 - nowTick;
+	wait->sec = msec / 1000;
+	wait->usec = (msec % 1000) * 1000;
+	frac.sec = 0;
+	frac.usec = now.usec % 1000;
+	clock_Sub(wait, &frac);
+
+	eventSchedule.next = now;
+	clock_Add(&eventSchedule.next, wait);
 	ret = eventSchedule.raised = 1;
-	clock_Sub(wait, &now);
     } else {
 	ret = eventSchedule.raised = 0;
     }
 
-    MUTEX_EXIT(&eventTree.lock);
+    MUTEX_EXIT(&eventWheel.lock);
 
     return ret;
 }
@@ -454,7 +584,7 @@ shutdown_rxevent(void)
     if (!initialised) {
 	return;
     }
-    MUTEX_DESTROY(&eventTree.lock);
+    MUTEX_DESTROY(&eventWheel.lock);
 
 #if !defined(AFS_AIX32_ENV) || !defined(KERNEL)
     MUTEX_DESTROY(&freeEvents.lock);
@@ -39,10 +39,6 @@ EXT osi_socket rx_socket;
 
 /* The array of installed services.  Null terminated. */
 EXT struct rx_service *rx_services[RX_MAX_SERVICES + 1];
-#ifdef RX_ENABLE_LOCKS
-/* Protects nRequestsRunning as well as pool allocation variables. */
-EXT afs_kmutex_t rx_serverPool_lock;
-#endif /* RX_ENABLE_LOCKS */
 
 /* Constant delay time before sending a hard ack if the receiver consumes
  * a packet while no delayed ack event is scheduled. Ensures that the
@@ -91,6 +87,11 @@ void  rx_SetUdpBufSize(int x);
 #define rx_GetMinUdpBufSize()   (64*1024)
 #define rx_SetUdpBufSize(x)     (((x)>rx_GetMinUdpBufSize()) ? (rx_UdpBufSize = (x)):0)
 #endif
+/* Number of sockets, each with its own listener thread, opened on each
+ * server port. See rx_SetNumListeners. */
+#define RX_MAX_LISTENERS 64
+EXT int rx_nListeners GLOBALSINIT(1);
+
 /*
  * Variables to control RX overload management. When the number of calls
  * waiting for a thread exceed the threshold, new calls are aborted
@@ -113,12 +114,12 @@ EXT int rx_BusyError GLOBALSINIT(-1);
 
 EXT int rx_minPeerTimeout GLOBALSINIT(20);      /* in milliseconds */
 EXT int rx_minWindow GLOBALSINIT(1);
-EXT int rx_maxWindow GLOBALSINIT(RX_MAXACKS);   /* must ack what we receive */
+EXT int rx_maxWindow GLOBALSINIT(RX_MAXEXTWINDOW);   /* must ack what we receive */
 EXT int rx_initReceiveWindow GLOBALSINIT(16);	/* how much to accept */
 EXT int rx_maxReceiveWindow GLOBALSINIT(32);	/* how much to accept */
 EXT int rx_initSendWindow GLOBALSINIT(16);
 EXT int rx_maxSendWindow GLOBALSINIT(32);
-EXT int rx_nackThreshold GLOBALSINIT(3);	/* Number NACKS to trigger congestion recovery */
+EXT int rx_nackThreshold GLOBALSINIT(3);	/* Window inflation on entering fast recovery */
 EXT int rx_nDgramThreshold GLOBALSINIT(4);	/* Number of packets before increasing
                                                  * packets per datagram */
 #define RX_MAX_FRAGS 4
@@ -144,8 +145,14 @@ EXT int rx_nPackets GLOBALSINIT(0);	/* preallocate packets with rx_extraPackets
  * thread-specific rx data:
  *
  *  _FPQ member contains a thread-specific free packet queue
+ *  rpc_shard member holds the RPC statistics recorded by the thread
+ *  arena_spare member holds an XDR arena chunk kept between calls
+ *  trace_ring member holds the call events recorded by the thread
  */
 #ifdef AFS_PTHREAD_ENV
+struct rx_rpc_shard;
+struct xdr_arena_chunk;
+struct rx_traceRing;
 EXT pthread_key_t rx_ts_info_key;
 typedef struct rx_ts_info_t {
     struct {
@@ -168,8 +175,14 @@ typedef struct rx_ts_info_t {
         int galloc_xfer;
     } _FPQ;
     struct rx_packet * local_special_packet;
+    struct rx_rpc_shard *rpc_shard;	/* this thread's RPC statistics */
+    struct xdr_arena_chunk *arena_spare;	/* for the next call's arguments */
+    struct rx_traceRing *trace_ring;	/* this thread's call events */
+    char *gro_buf;			/* for coalesced reads, as listener */
+    int gro_headroom;			/* space before each read in gro_buf */
 } rx_ts_info_t;
 EXT struct rx_ts_info_t * rx_ts_info_init(void);   /* init function for thread-specific data struct */
+EXT void rx_ts_info_destroy(void *);	/* ... and its destructor */
 #define RX_TS_INFO_GET(ts_info_p) \
     do { \
         ts_info_p = (struct rx_ts_info_t*)pthread_getspecific(rx_ts_info_key); \
@@ -525,18 +538,34 @@ EXT afs_kcondvar_t rx_waitingForPackets_cv;
 #endif
 EXT char rx_waitingForPackets;	/* Processes set and wait on this variable when waiting for packet buffers */
 
+/* The connection and peer hash tables are each split into RX_HASH_SHARDS
+ * shards, with a lock apiece.  The tables grow as they fill, but their
+ * sizes are always powers of two no smaller than RX_HASH_SHARDS, and
+ * bucket b is in shard b % RX_HASH_SHARDS, so an entry never changes
+ * shard.  Growing a table takes all of its shard locks, in order, so
+ * holding any one of them is enough to read the table and its size. */
+#define RX_HASH_SHARDS 64
+
 EXT struct rx_peer **rx_peerHashTable;
 EXT struct rx_connection **rx_connHashTable;
-EXT struct rx_connection *rx_connCleanup_list GLOBALSINIT(0);
-EXT afs_uint32 rx_hashTableSize GLOBALSINIT(257);	/* Prime number */
+EXT afs_uint32 rx_hashTableSize GLOBALSINIT(256);	/* Initial size */
+EXT afs_uint32 rx_peerHashTableSize;
+EXT afs_uint32 rx_connHashTableSize;
 #ifdef RX_ENABLE_LOCKS
-EXT afs_kmutex_t rx_peerHashTable_lock;
-EXT afs_kmutex_t rx_connHashTable_lock;
+EXT afs_kmutex_t rx_peerHashTable_lock[RX_HASH_SHARDS];
+EXT afs_kmutex_t rx_connHashTable_lock[RX_HASH_SHARDS];
 #endif /* RX_ENABLE_LOCKS */
 
-#define CONN_HASH(host, port, cid, epoch, type) ((((cid)>>RX_CIDSHIFT)%rx_hashTableSize))
+#define RX_HASH_MIX(x) \
+    ((((afs_uint32)(x) * 0x9e3779b1) >> 16) ^ ((afs_uint32)(x) * 0x9e3779b1))
+
+#define CONN_HASH(host, port, cid, epoch, type) RX_HASH_MIX((cid)>>RX_CIDSHIFT)
+#define CONN_BUCKET(hash) ((hash) & (rx_connHashTableSize - 1))
+#define CONN_HASH_LOCK(hash) (&rx_connHashTable_lock[(hash) % RX_HASH_SHARDS])
 
-#define PEER_HASH(host, port)  ((host ^ port) % rx_hashTableSize)
+#define PEER_HASH(host, port)  RX_HASH_MIX((host) ^ (port))
+#define PEER_BUCKET(hash) ((hash) & (rx_peerHashTableSize - 1))
+#define PEER_HASH_LOCK(hash) (&rx_peerHashTable_lock[(hash) % RX_HASH_SHARDS])
 
 /* Forward definitions of internal procedures */
 #define	rxi_ChallengeOff(conn)	\
@@ -558,6 +587,7 @@ do { \
 #define rxi_FreeConnection(conn) (rxi_Free(conn, sizeof(struct rx_connection)))
 
 EXT afs_int32 rx_stats_active GLOBALSINIT(1);	/* boolean - rx statistics gathering */
+EXT int rx_traceEnabled GLOBALSINIT(0);	/* boolean - see rx_TraceEnable */
 
 #ifndef KERNEL
 /* Some debugging stuff */
@@ -629,7 +659,17 @@ EXT afs_kmutex_t rx_packets_mutex POSTAMBLE;	/* used to protect packet counters
 EXT afs_kmutex_t rx_refcnt_mutex POSTAMBLE;       /* used to protect conn/call ref counts */
 #endif
 
+/*
+ * Userspace pthreaded Rx keeps RPC statistics per thread, cheaply enough
+ * that the stubs always record the time taken by each call served, for
+ * rx_RetrieveProcessRPCLatency. The per process and per peer statistics are
+ * still only counted once turned on.
+ */
+#if defined(AFS_PTHREAD_ENV) && !defined(KERNEL)
+EXT int rx_enable_stats GLOBALSINIT(1);
+#else
 EXT int rx_enable_stats GLOBALSINIT(0);
+#endif
 
 /*
  * Set this flag to enable the listener thread to trade places with an idle
@@ -638,5 +678,22 @@ EXT int rx_enable_stats GLOBALSINIT(0);
  */
 EXT int rx_enable_hot_thread GLOBALSINIT(0);
 
+/*
+ * Set this flag to read and send several datagrams per system call, on
+ * platforms which can do so.
+ */
+EXT int rx_enable_batch_io GLOBALSINIT(1);
+
+/*
+ * Where rxgen server stubs get the storage for the arguments they decode;
+ * see rx_SetCallArenas.  Arenas are off by default in the kernel, and
+ * when building with AddressSanitizer, which can't see into them.
+ */
+#if defined(KERNEL) || defined(__SANITIZE_ADDRESS__)
+EXT int rx_call_arenas GLOBALSINIT(RX_ARENA_NONE);
+#else
+EXT int rx_call_arenas GLOBALSINIT(RX_ARENA_REUSE);
+#endif
+
 EXT int RX_IPUDP_SIZE GLOBALSINIT(_RX_IPUDP_SIZE);
 #endif /* AFS_RX_GLOBALS_H */
@@ -0,0 +1,393 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * A simulated link for the datagrams sent by userspace Rx; see
+ * rx_impair.h.
+ *
+ * Each datagram offered to the link is dropped, or sent once or twice.
+ * A copy which is due to leave later than now is copied out of the
+ * caller's iovecs, and sent by an event posted for the time it is due.
+ * The link is only impaired on the way out, so that when both ends of a
+ * test share a process, every datagram in either direction crosses it
+ * once.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+#include <afs/opr.h>
+
+#include "rx.h"
+#include "rx_atomic.h"
+#include "rx_clock.h"
+#include "rx_event.h"
+#include "rx_globals.h"
+#include "rx_internal.h"
+#include "rx_impair.h"
+
+#define RXI_IMPAIR_LIMIT 1000	/* datagrams held by default */
+
+/* A datagram held by the link until it is due to leave */
+struct rxi_impairDatagram {
+    osi_socket socket;
+    struct sockaddr_in addr;
+    int length;
+    char data[1];
+};
+
+int rxi_impairEnabled = 0;
+
+/* Protects everything below */
+afs_kmutex_t rxi_impairMutex;
+static struct rx_impairment rxi_impairment;
+static struct rx_impairmentStats rxi_impairStats;
+static afs_uint64 rxi_impairState;	/* of the random number generator */
+static afs_uint64 rxi_impairLinkFree;	/* usec at which the link is next idle */
+static afs_uint32 rxi_impairHeld;	/* datagrams waiting to leave */
+
+/* xorshift64*, which is quite good enough to decide what befalls a
+ * datagram, and gives the same sequence on every platform. */
+static afs_uint32
+rxi_ImpairRandom(void)
+{
+    rxi_impairState ^= rxi_impairState >> 12;
+    rxi_impairState ^= rxi_impairState << 25;
+    rxi_impairState ^= rxi_impairState >> 27;
+    return (afs_uint32)((rxi_impairState * 2685821657736338717ULL) >> 32);
+}
+
+/* Returns true perMillion times in a million */
+static int
+rxi_ImpairChance(afs_uint32 perMillion)
+{
+    return perMillion > 0 && rxi_ImpairRandom() % 1000000 < perMillion;
+}
+
+/*
+ * Work out when a copy of a datagram of length bytes, offered to the link
+ * at now, is to leave it.  Times are in usec.  Called with rxi_impairMutex
+ * held.
+ */
+static afs_uint64
+rxi_ImpairDepartTime(afs_uint64 now, int length)
+{
+    afs_uint64 when = now;
+    afs_int64 delay;
+
+    /* The link sends one datagram at a time, at its rate */
+    if (rxi_impairment.rate > 0) {
+	if (rxi_impairLinkFree > when)
+	    when = rxi_impairLinkFree;
+	when += (afs_uint64)length * 1000000 / rxi_impairment.rate;
+	rxi_impairLinkFree = when;
+    }
+
+    /* A reordered datagram jumps ahead of those being delayed */
+    if (rxi_ImpairChance(rxi_impairment.reorder)) {
+	rxi_impairStats.reordered++;
+	return when;
+    }
+
+    delay = rxi_impairment.delay;
+    if (rxi_impairment.jitter > 0)
+	delay += (afs_int64)(rxi_ImpairRandom()
+			     % (2 * (afs_uint64)rxi_impairment.jitter + 1))
+		 - rxi_impairment.jitter;
+    if (delay > 0)
+	when += delay;
+    return when;
+}
+
+static int
+rxi_ImpairDeliver(osi_socket socket, struct sockaddr_in *addr,
+		  struct iovec *iov, int niov)
+{
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = addr;
+    msg.msg_namelen = sizeof(struct sockaddr_in);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = niov;
+    return rxi_Sendmsg(socket, &msg, 0);
+}
+
+static void
+rxi_ImpairRelease(struct rxevent *event, void *arg, void *arg1, int arg2)
+{
+    struct rxi_impairDatagram *dgram = arg;
+    struct iovec iov;
+
+    iov.iov_base = dgram->data;
+    iov.iov_len = dgram->length;
+    (void)rxi_ImpairDeliver(dgram->socket, &dgram->addr, &iov, 1);
+    free(dgram);
+
+    MUTEX_ENTER(&rxi_impairMutex);
+    rxi_impairHeld--;
+    MUTEX_EXIT(&rxi_impairMutex);
+}
+
+/*
+ * Offer a datagram to the link.  Returns as rxi_Sendmsg does for a
+ * datagram sent at once; one which is dropped or held counts as sent.
+ */
+int
+rxi_ImpairSend(osi_socket socket, struct sockaddr_in *addr,
+	       struct iovec *iov, int niov)
+{
+    struct rxi_impairDatagram *dgram;
+    struct clock now, when;
+    struct rxevent *event;
+    afs_uint64 usec, due[2];
+    int i, v, copies, nheld, length, offset;
+    int sendNow = 0, code = 0;
+
+    for (i = 0, length = 0; i < niov; i++)
+	length += iov[i].iov_len;
+
+    clock_GetTime(&now);
+    usec = (afs_uint64)now.sec * 1000000 + now.usec;
+
+    /* Decide what becomes of each copy */
+    MUTEX_ENTER(&rxi_impairMutex);
+    rxi_impairStats.datagrams++;
+    if (rxi_ImpairChance(rxi_impairment.loss)) {
+	rxi_impairStats.dropped++;
+	MUTEX_EXIT(&rxi_impairMutex);
+	return 0;
+    }
+    copies = 1;
+    if (rxi_ImpairChance(rxi_impairment.duplicate)) {
+	rxi_impairStats.duplicated++;
+	copies = 2;
+    }
+    for (i = 0, nheld = 0; i < copies; i++) {
+	due[nheld] = rxi_ImpairDepartTime(usec, length);
+	if (due[nheld] <= usec) {
+	    sendNow++;
+	} else if (rxi_impairHeld >= rxi_impairment.limit) {
+	    rxi_impairStats.overflowed++;
+	} else {
+	    rxi_impairHeld++;
+	    rxi_impairStats.delayed++;
+	    nheld++;
+	}
+    }
+    MUTEX_EXIT(&rxi_impairMutex);
+
+    for (i = 0; i < nheld; i++) {
+	dgram = malloc(sizeof(*dgram) + length);
+	if (dgram == NULL) {
+	    MUTEX_ENTER(&rxi_impairMutex);
+	    rxi_impairHeld--;
+	    MUTEX_EXIT(&rxi_impairMutex);
+	    sendNow++;
+	    continue;
+	}
+	dgram->socket = socket;
+	dgram->addr = *addr;
+	dgram->length = length;
+	for (v = 0, offset = 0; v < niov; v++) {
+	    memcpy(dgram->data + offset, iov[v].iov_base, iov[v].iov_len);
+	    offset += iov[v].iov_len;
+	}
+	when.sec = (afs_int32)(due[i] / 1000000);
+	when.usec = (afs_int32)(due[i] % 1000000);
+	event = rxevent_Post(&when, &now, rxi_ImpairRelease, dgram, NULL, 0);
+	rxevent_Put(&event);
+    }
+
+    for (i = 0; i < sendNow; i++) {
+	int ret = rxi_ImpairDeliver(socket, addr, iov, niov);
+
+	if (i == 0)
+	    code = ret;
+    }
+    return code;
+}
+
+/*
+ * Impair the link as described by imp, or stop impairing it if imp is
+ * NULL.  The random number generator is reseeded, and the statistics are
+ * cleared.  Datagrams already held still leave when they are due.
+ */
+void
+rx_SetImpairment(const struct rx_impairment *imp)
+{
+    MUTEX_ENTER(&rxi_impairMutex);
+    if (imp != NULL) {
+	rxi_impairment = *imp;
+	if (rxi_impairment.limit == 0)
+	    rxi_impairment.limit = RXI_IMPAIR_LIMIT;
+	rxi_impairState = ((afs_uint64)imp->seed << 32)
+			  ^ 0x9e3779b97f4a7c15ULL;
+	rxi_impairLinkFree = 0;
+	memset(&rxi_impairStats, 0, sizeof(rxi_impairStats));
+    }
+    rxi_impairEnabled = (imp != NULL);
+    MUTEX_EXIT(&rxi_impairMutex);
+}
+
+void
+rx_GetImpairmentStats(struct rx_impairmentStats *stats)
+{
+    MUTEX_ENTER(&rxi_impairMutex);
+    *stats = rxi_impairStats;
+    MUTEX_EXIT(&rxi_impairMutex);
+}
+
+/* A percentage, stored in millionths */
+static int
+rxi_ImpairPercent(double number, const char *units, afs_uint32 *value)
+{
+    if (number > 100 || (*units != '\0' && strcmp(units, "%") != 0))
+	return EINVAL;
+    *value = (afs_uint32)(number * 10000 + 0.5);
+    return 0;
+}
+
+/* A time, stored in usec */
+static int
+rxi_ImpairTime(double number, const char *units, afs_uint32 *value)
+{
+    if (*units == '\0' || strcmp(units, "ms") == 0)
+	number *= 1000;
+    else if (strcmp(units, "s") == 0)
+	number *= 1000000;
+    else if (strcmp(units, "us") != 0)
+	return EINVAL;
+    if (number >= 0xffffffff)
+	return EINVAL;
+    *value = (afs_uint32)number;
+    return 0;
+}
+
+/* A rate in bits per second, stored in bytes per second */
+static int
+rxi_ImpairRate(double number, const char *units, afs_uint32 *value)
+{
+    switch (*units) {
+    case 'k':
+    case 'K':
+	number *= 1000;
+	units++;
+	break;
+    case 'm':
+    case 'M':
+	number *= 1000000;
+	units++;
+	break;
+    case 'g':
+    case 'G':
+	number *= 1000000000;
+	units++;
+	break;
+    }
+    if (*units != '\0' && strcmp(units, "bit") != 0)
+	return EINVAL;
+    number /= 8;
+    if (number >= 0xffffffff)
+	return EINVAL;
+    *value = (afs_uint32)number;
+    return 0;
+}
+
+/* A plain count */
+static int
+rxi_ImpairCount(double number, const char *units, afs_uint32 *value)
+{
+    if (*units != '\0' || number >= 4294967296.0
+	|| number != (afs_uint32)number)
+	return EINVAL;
+    *value = (afs_uint32)number;
+    return 0;
+}
+
+/*
+ * Parse an impairment from spec, a list of key=value settings separated
+ * by commas or spaces, into imp.  Anything not mentioned is zero.
+ * Returns 0, or EINVAL if spec can't be understood.
+ */
+int
+rx_ParseImpairment(const char *spec, struct rx_impairment *imp)
+{
+    char key[16], *end;
+    const char *value;
+    char units[16];
+    double number;
+    size_t len;
+    int code = 0;
+
+    memset(imp, 0, sizeof(*imp));
+    while (code == 0) {
+	spec += strspn(spec, ", ");
+	if (*spec == '\0')
+	    break;
+
+	len = strcspn(spec, "=, ");
+	if (spec[len] != '=' || len == 0 || len >= sizeof(key))
+	    return EINVAL;
+	memcpy(key, spec, len);
+	key[len] = '\0';
+	value = spec + len + 1;
+
+	number = strtod(value, &end);
+	if (end == value || number < 0)
+	    return EINVAL;
+	len = strcspn(end, ", ");
+	if (len >= sizeof(units))
+	    return EINVAL;
+	memcpy(units, end, len);
+	units[len] = '\0';
+	spec = end + len;
+
+	if (strcmp(key, "loss") == 0)
+	    code = rxi_ImpairPercent(number, units, &imp->loss);
+	else if (strcmp(key, "dup") == 0)
+	    code = rxi_ImpairPercent(number, units, &imp->duplicate);
+	else if (strcmp(key, "reorder") == 0)
+	    code = rxi_ImpairPercent(number, units, &imp->reorder);
+	else if (strcmp(key, "delay") == 0)
+	    code = rxi_ImpairTime(number, units, &imp->delay);
+	else if (strcmp(key, "jitter") == 0)
+	    code = rxi_ImpairTime(number, units, &imp->jitter);
+	else if (strcmp(key, "rate") == 0)
+	    code = rxi_ImpairRate(number, units, &imp->rate);
+	else if (strcmp(key, "limit") == 0)
+	    code = rxi_ImpairCount(number, units, &imp->limit);
+	else if (strcmp(key, "seed") == 0)
+	    code = rxi_ImpairCount(number, units, &imp->seed);
+	else
+	    code = EINVAL;
+    }
+    return code;
+}
+
+/*
+ * Take up any impairment given in the environment.  Called as Rx is
+ * initialised.
+ */
+void
+rxi_ImpairInit(void)
+{
+    struct rx_impairment imp;
+    char *spec;
+
+    spec = getenv("RX_IMPAIR");
+    if (spec == NULL || *spec == '\0')
+	return;
+    if (rx_ParseImpairment(spec, &imp) != 0) {
+	(osi_Msg "rx: ignoring unparseable RX_IMPAIR \"%s\"\n", spec);
+	return;
+    }
+    rx_SetImpairment(&imp);
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * Network impairment for testing userspace Rx.
+ *
+ * While an impairment is set, every datagram this process sends is passed
+ * through a simulated link which may drop, duplicate, delay or reorder it,
+ * and which may limit the rate at which datagrams leave.  Decisions are
+ * drawn from a generator seeded from the impairment, so a run may be
+ * repeated.  The impairment may be given to rx_SetImpairment once Rx has
+ * been initialised, or in the RX_IMPAIR environment variable, in the form
+ * accepted by rx_ParseImpairment, as Rx is initialised.  Something like
+ *
+ *	RX_IMPAIR="delay=20ms,jitter=5ms,loss=1,rate=10mbit,seed=7"
+ *
+ * Keys are loss, dup and reorder (percentages, which may be fractional),
+ * delay and jitter (times, in msec unless followed by us, ms or s), rate
+ * (bits per second, with an optional k, m or g, and optionally "bit"),
+ * limit (the number of datagrams the link may hold) and seed.
+ */
+
+#ifndef OPENAFS_RX_IMPAIR_H
+#define OPENAFS_RX_IMPAIR_H
+
+struct rx_impairment {
+    afs_uint32 loss;		/* datagrams dropped, per million */
+    afs_uint32 duplicate;	/* datagrams sent twice, per million */
+    afs_uint32 reorder;		/* datagrams sent ahead of the delay,
+				 * per million */
+    afs_uint32 delay;		/* usec each datagram is held for */
+    afs_uint32 jitter;		/* usec the delay varies by, either way */
+    afs_uint32 rate;		/* bytes per second; 0 for no limit */
+    afs_uint32 limit;		/* datagrams held at once; 0 for 1000 */
+    afs_uint32 seed;
+};
+
+struct rx_impairmentStats {
+    afs_uint32 datagrams;	/* offered to the link */
+    afs_uint32 dropped;		/* lost on purpose */
+    afs_uint32 overflowed;	/* dropped because the link was full */
+    afs_uint32 duplicated;
+    afs_uint32 reordered;
+    afs_uint32 delayed;		/* held before being sent */
+};
+
+extern int rx_ParseImpairment(const char *spec, struct rx_impairment *imp);
+extern void rx_SetImpairment(const struct rx_impairment *imp);
+extern void rx_GetImpairmentStats(struct rx_impairmentStats *stats);
+
+#endif /* OPENAFS_RX_IMPAIR_H */
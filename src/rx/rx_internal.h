@@ -13,9 +13,71 @@
 # endif
 #endif
 
+/* Userspace pthreaded Rx can move several datagrams per system call with
+ * recvmmsg/sendmmsg. RX_MAXMMSG is the largest batch handed to the kernel
+ * in one go. */
+#if !defined(KERNEL) && defined(AFS_PTHREAD_ENV) && defined(HAVE_RECVMMSG) \
+    && defined(HAVE_SENDMMSG)
+# define RX_ENABLE_MMSG
+# define RX_MAXMMSG 16
+#endif
+
+/* Userspace pthreaded Rx keeps the RPC statistics of each thread apart, so
+ * that threads don't contend for a lock as each call completes. */
+#if !defined(KERNEL) && defined(AFS_PTHREAD_ENV)
+# define RX_ENABLE_RPC_SHARDS
+#endif
+
+/* Userspace pthreaded Rx lets each thread keep a chunk of XDR arena between
+ * the calls it serves, so that decoding arguments needn't allocate. */
+#if !defined(KERNEL) && defined(AFS_PTHREAD_ENV)
+# define RX_ENABLE_ARENA_REUSE
+#endif
+
+/* Userspace Rx can send file data straight from a read-only mapping of the
+ * file, rather than reading it into packet buffers first. */
+#if !defined(KERNEL) && !defined(AFS_NT40_ENV)
+# define RX_ENABLE_FILEMAP
+#endif
+
+/* Userspace Rx can record call events in a binary trace ring per thread,
+ * which pthreaded Rx reaches through the thread's rx_ts_info_t. */
+#ifndef KERNEL
+# define RX_ENABLE_TRACE
+# ifdef AFS_PTHREAD_ENV
+#  define RX_ENABLE_TRACE_RINGS
+# endif
+#endif
+
+/* Userspace Rx can pass the datagrams it sends through a simulated link,
+ * which drops, duplicates, delays and reorders them, for testing. */
+#ifndef KERNEL
+# define RX_ENABLE_IMPAIR
+#endif
+
+/* On Linux, a batch of equally sized datagrams for one peer can be handed
+ * to the kernel as a single buffer to be cut up (UDP_SEGMENT), and the
+ * kernel can hand us several datagrams from one peer coalesced into a
+ * single buffer (UDP_GRO). Whether the running kernel supports this is
+ * discovered as each socket is created. A coalesced buffer may be up to
+ * RX_MAXGROSIZE bytes long; listeners read RX_MAXGROMSG of them at once. */
+#ifdef RX_ENABLE_MMSG
+# include <netinet/udp.h>
+# if defined(UDP_SEGMENT) && defined(UDP_GRO) && defined(SOL_UDP)
+#  define RX_ENABLE_UDP_OFFLOAD
+#  define RX_MAXGROSIZE 65536
+#  define RX_MAXGROMSG 8
+# endif
+#endif
+
 /* Globals that we don't want the world to know about */
 extern rx_atomic_t rx_nWaiting;
 extern rx_atomic_t rx_nWaited;
+#ifdef RX_ENABLE_UDP_OFFLOAD
+# define RXI_SOCKET_GSO 1	/* The kernel segments datagrams we send */
+# define RXI_SOCKET_GRO 2	/* The kernel may coalesce datagrams we read */
+extern int rxi_SocketOffload(osi_socket socket);
+#endif
 
 /* Prototypes for internal functions */
 
@@ -45,6 +107,8 @@ extern struct rx_packet *rxi_SendAck(struct rx_call *call,
 extern struct rx_packet *rxi_SendConnectionAbort(struct rx_connection *conn,
 						 struct rx_packet *packet,
 						 int istack, int force);
+extern void rxi_RecordLatency(afs_uint32 rxInterface, afs_uint32 currentFunc,
+			      afs_uint32 totalFunc, struct clock *execTime);
 extern void rxi_IncrementTimeAndCount(struct rx_peer *peer,
 				      afs_uint32 rxInterface,
 				      afs_uint32 currentFunc,
@@ -54,15 +118,106 @@ extern void rxi_IncrementTimeAndCount(struct rx_peer *peer,
 				      afs_uint64 bytesSent,
 				      afs_uint64 bytesRcvd,
 				      int isServer);
+extern void rxi_CallQueueStats(afs_int32 *idleThreads, afs_int32 *nQueues,
+			       afs_int32 *nQueued, afs_int32 *nStolen);
 #ifdef RX_ENABLE_LOCKS
 extern void rxi_WaitforTQBusy(struct rx_call *call);
 #else
 # define rxi_WaitforTQBusy(call)
 #endif
 
+/* xdr_rx.c */
+extern void rxi_ReleaseCallArena(struct rx_call *call);
+extern void rxi_FreeCallArena(struct rx_call *call);
+
+/* rx_tracering.c */
+#ifdef RX_ENABLE_TRACE
+extern afs_kmutex_t rxi_traceMutex;
+extern void rxi_TraceEvent(int event, afs_uint32 cid, afs_uint32 callNumber,
+			   afs_uint32 seq, afs_uint32 serial,
+			   afs_uint32 value, int type);
+
+# define RXI_TRACE_SIDE(conn) \
+    ((conn)->type == RX_SERVER_CONNECTION ? RX_TRACE_SERVER : 0)
+# define RXI_TRACE_CALL(event, call, value) do { \
+    if (rx_traceEnabled) \
+	rxi_TraceEvent((event) | RXI_TRACE_SIDE((call)->conn), \
+		       (call)->conn->cid | (call)->channel, \
+		       *(call)->callNumber, 0, 0, (value), 0); \
+} while (0)
+# define RXI_TRACE_PACKET(event, conn, p) do { \
+    if (rx_traceEnabled) \
+	rxi_TraceEvent((event) | RXI_TRACE_SIDE(conn), (p)->header.cid, \
+		       (p)->header.callNumber, (p)->header.seq, \
+		       (p)->header.serial, \
+		       (p)->length | ((afs_uint32)(p)->header.flags << 24), \
+		       (p)->header.type); \
+} while (0)
+# define RXI_TRACE_ACK(event, call, first, serial, reason) do { \
+    if (rx_traceEnabled) \
+	rxi_TraceEvent((event) | RXI_TRACE_SIDE((call)->conn), \
+		       (call)->conn->cid | (call)->channel, \
+		       *(call)->callNumber, (first), (serial), (reason), \
+		       RX_PACKET_TYPE_ACK); \
+} while (0)
+# define RXI_TRACE_WINDOW(call) do { \
+    if (rx_traceEnabled) \
+	rxi_TraceEvent(RX_TRACE_WINDOW | RXI_TRACE_SIDE((call)->conn), \
+		       (call)->conn->cid | (call)->channel, \
+		       *(call)->callNumber, (call)->nextCwind, 0, \
+		       (call)->cwind, 0); \
+} while (0)
+#else
+# define RXI_TRACE_CALL(event, call, value) do { } while (0)
+# define RXI_TRACE_PACKET(event, conn, p) do { } while (0)
+# define RXI_TRACE_ACK(event, call, first, serial, reason) do { } while (0)
+# define RXI_TRACE_WINDOW(call) do { } while (0)
+#endif
+
+/* rx_impair.c */
+#ifdef RX_ENABLE_IMPAIR
+extern int rxi_impairEnabled;
+extern afs_kmutex_t rxi_impairMutex;
+extern int rxi_ImpairSend(osi_socket socket, struct sockaddr_in *addr,
+			  struct iovec *iov, int niov);
+extern void rxi_ImpairInit(void);
+#endif
+
+/* rx_rdwr.c */
+#ifdef RX_ENABLE_FILEMAP
+struct rxi_filemap;
+extern afs_kmutex_t rxi_fileMapMutex;
+extern afs_kcondvar_t rxi_fileMapCond;
+extern void rxi_ReleaseFileMap(struct rxi_filemap *map);
+#endif
+
 /* rx_packet.h */
 
 extern int rxi_SendIovecs(struct rx_connection *conn, struct iovec *iov,
 			  int iovcnt, size_t length, int istack);
 extern void rxi_SendRaw(struct rx_call *call, struct rx_connection *conn,
 			int type, char *data, int bytes, int istack);
+#ifdef RX_ENABLE_MMSG
+extern int rxi_ReadPackets(osi_socket socket, struct rx_packet **list,
+			   int npackets, afs_uint32 *hosts, u_short *ports,
+			   int *valid);
+extern void rxi_SendPacketLists(struct rx_call *call,
+				struct rx_connection *conn,
+				struct rx_packet **lists[], int lens[],
+				int nlists, int istack);
+#ifdef RX_ENABLE_UDP_OFFLOAD
+extern int rxi_ReadCoalesced(osi_socket socket, struct rx_packet **list,
+			     int npackets, char **bufs, int headroom,
+			     int *valid, char **rest, int *restlen,
+			     int *segsizes, afs_uint32 *hosts,
+			     u_short *ports);
+extern int rxi_CopyReadPacket(struct rx_packet *p, char *buf, int nbytes,
+			      afs_uint32 *host, u_short *port);
+#endif
+
+/* rx_pthread.c */
+extern int rxi_Recvmmsg(osi_socket socket, struct msghdr *msgs, int *nbytes,
+			int nmsgs);
+extern int rxi_Sendmmsg(osi_socket socket, struct msghdr *msgs, int nmsgs,
+			int *errorp);
+#endif
@@ -67,6 +67,7 @@
 #include "rx_globals.h"
 #include "rx_internal.h"
 #include "rx_stats.h"
+#include "rx_tracering.h"
 
 #include "rx_peer.h"
 #include "rx_conn.h"
@@ -115,8 +116,6 @@ static int rxi_FreeDataBufsToQueue(struct rx_packet *p, afs_uint32 first,
 				   struct opr_queue * q);
 #endif
 
-extern struct opr_queue rx_idleServerQueue;
-
 /* some rules about packets:
  * 1.  When a packet is allocated, the final iov_buf contains room for
  * a security trailer, but iov_len masks that fact.  If the security
@@ -904,6 +903,24 @@ rxi_FreePacketTSFPQ(struct rx_packet *p, int flush_global)
 }
 #endif /* RX_ENABLE_TSFPQ */
 
+#ifdef RX_ENABLE_FILEMAP
+/* The data past the first buffer of a packet built by rx_WritevFromFd lies
+ * in a mapping of the file being sent, so there are no continuation
+ * buffers to free; only the packet's hold on the mapping. */
+static_inline void
+rxi_ForgetFileData(struct rx_packet *p)
+{
+    if (p->flags & RX_PKTFLAG_FILEDATA) {
+	p->flags &= ~RX_PKTFLAG_FILEDATA;
+	p->niovecs = 2;
+	rxi_ReleaseFileMap(p->filemap);
+	p->filemap = NULL;
+    }
+}
+#else
+# define rxi_ForgetFileData(p)
+#endif
+
 /*
  * free continuation buffers off a packet into a queue
  *
@@ -922,6 +939,7 @@ rxi_FreeDataBufsToQueue(struct rx_packet *p, afs_uint32 first, struct opr_queue
     struct rx_packet * cb;
     int count = 0;
 
+    rxi_ForgetFileData(p);
     for (first = MAX(2, first); first < p->niovecs; first++, count++) {
 	iov = &p->wirevec[first];
 	if (!iov->iov_base)
@@ -950,6 +968,7 @@ rxi_FreeDataBufsNoLock(struct rx_packet *p, afs_uint32 first)
 {
     struct iovec *iov;
 
+    rxi_ForgetFileData(p);
     for (first = MAX(2, first); first < p->niovecs; first++) {
 	iov = &p->wirevec[first];
 	if (!iov->iov_base)
@@ -984,6 +1003,7 @@ rxi_FreeDataBufsTSFPQ(struct rx_packet *p, afs_uint32 first, int flush_global)
     struct rx_ts_info_t * rx_ts_info;
 
     RX_TS_INFO_GET(rx_ts_info);
+    rxi_ForgetFileData(p);
 
     for (first = MAX(2, first); first < p->niovecs; first++) {
 	iov = &p->wirevec[first];
@@ -1432,20 +1452,17 @@ CountFDs(int amax)
 
 #if !defined(KERNEL) || defined(UKERNEL)
 
-/* This function reads a single packet from the interface into the
- * supplied packet buffer (*p).  Return 0 if the packet is bogus.  The
- * (host,port) of the sender are stored in the supplied variables, and
- * the data length of the packet is stored in the packet structure.
- * The header is decoded. */
-int
-rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
-	       u_short * port)
+/* Prepare the supplied packet buffer to receive a datagram of up to
+ * rx_maxJumboRecvSize bytes. The size of the receive area is stored in
+ * *tlenp, and the original length of the last iovec (which is extended
+ * to detect overlong datagrams) in *savelenp. */
+static void
+rxi_PrepareReadPacket(struct rx_packet *p, afs_uint32 *tlenp,
+		      afs_uint32 *savelenp)
 {
-    struct sockaddr_in from;
-    int nbytes;
     afs_int32 rlen;
-    afs_uint32 tlen, savelen;
-    struct msghdr msg;
+    afs_uint32 tlen;
+
     rx_computelen(p, tlen);
     rx_SetDataSize(p, tlen);	/* this is the size of the user data area */
 
@@ -1467,16 +1484,21 @@ rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
      * our problems caused by the lack of a length field in the rx header.
      * Use the extra buffer that follows the localdata in each packet
      * structure. */
-    savelen = p->wirevec[p->niovecs - 1].iov_len;
+    *savelenp = p->wirevec[p->niovecs - 1].iov_len;
     p->wirevec[p->niovecs - 1].iov_len += RX_EXTRABUFFERSIZE;
 
-    memset(&msg, 0, sizeof(msg));
-    msg.msg_name = (char *)&from;
-    msg.msg_namelen = sizeof(struct sockaddr_in);
-    msg.msg_iov = p->wirevec;
-    msg.msg_iovlen = p->niovecs;
-    nbytes = rxi_Recvmsg(socket, &msg, 0);
+    *tlenp = tlen;
+}
 
+/* Complete the receipt of a datagram of nbytes bytes into the packet
+ * buffer *p, which was set up by rxi_PrepareReadPacket. Return 0 if the
+ * packet is bogus, otherwise decode the header and store the (host,port)
+ * of the sender in the supplied variables. */
+static int
+rxi_FinishReadPacket(struct rx_packet *p, int nbytes, afs_uint32 tlen,
+		     afs_uint32 savelen, struct sockaddr_in *from,
+		     afs_uint32 * host, u_short * port)
+{
     /* restore the vec to its correct state */
     p->wirevec[p->niovecs - 1].iov_len = savelen;
 
@@ -1488,10 +1510,10 @@ rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
 	} else if (nbytes <= 0) {
             if (rx_stats_active) {
                 rx_atomic_inc(&rx_stats.bogusPacketOnRead);
-                rx_stats.bogusHost = from.sin_addr.s_addr;
+                rx_stats.bogusHost = from->sin_addr.s_addr;
             }
-	    dpf(("B: bogus packet from [%x,%d] nb=%d\n", ntohl(from.sin_addr.s_addr),
-		 ntohs(from.sin_port), nbytes));
+	    dpf(("B: bogus packet from [%x,%d] nb=%d\n", ntohl(from->sin_addr.s_addr),
+		 ntohs(from->sin_port), nbytes));
 	}
 	return 0;
     }
@@ -1500,8 +1522,8 @@ rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
 		&& (random() % 100 < rx_intentionallyDroppedOnReadPer100)) {
 	rxi_DecodePacketHeader(p);
 
-	*host = from.sin_addr.s_addr;
-	*port = from.sin_port;
+	*host = from->sin_addr.s_addr;
+	*port = from->sin_port;
 
 	dpf(("Dropped %d %s: %x.%u.%u.%u.%u.%u.%u flags %d len %d\n",
 	      p->header.serial, rx_packetTypes[p->header.type - 1], ntohl(*host), ntohs(*port), p->header.serial,
@@ -1517,8 +1539,8 @@ rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
 	/* Extract packet header. */
 	rxi_DecodePacketHeader(p);
 
-	*host = from.sin_addr.s_addr;
-	*port = from.sin_port;
+	*host = from->sin_addr.s_addr;
+	*port = from->sin_port;
 	if (rx_stats_active
 	    && p->header.type > 0 && p->header.type < RX_N_PACKET_TYPES) {
 
@@ -1533,6 +1555,258 @@ rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
     }
 }
 
+/* This function reads a single packet from the interface into the
+ * supplied packet buffer (*p).  Return 0 if the packet is bogus.  The
+ * (host,port) of the sender are stored in the supplied variables, and
+ * the data length of the packet is stored in the packet structure.
+ * The header is decoded. */
+int
+rxi_ReadPacket(osi_socket socket, struct rx_packet *p, afs_uint32 * host,
+	       u_short * port)
+{
+    struct sockaddr_in from;
+    int nbytes;
+    afs_uint32 tlen, savelen;
+    struct msghdr msg;
+
+    rxi_PrepareReadPacket(p, &tlen, &savelen);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = (char *)&from;
+    msg.msg_namelen = sizeof(struct sockaddr_in);
+    msg.msg_iov = p->wirevec;
+    msg.msg_iovlen = p->niovecs;
+    nbytes = rxi_Recvmsg(socket, &msg, 0);
+
+    return rxi_FinishReadPacket(p, nbytes, tlen, savelen, &from, host, port);
+}
+
+#ifdef RX_ENABLE_MMSG
+/* This function reads up to npackets datagrams from the interface into
+ * the supplied packet buffers with a single system call, blocking until
+ * at least one is available. It returns the number of buffers that were
+ * filled, which is zero if the read failed. For each filled buffer
+ * valid[i] is set as rxi_ReadPacket's return value would be, and for the
+ * valid ones the sender is stored in hosts[i] and ports[i]. */
+int
+rxi_ReadPackets(osi_socket socket, struct rx_packet **list, int npackets,
+		afs_uint32 *hosts, u_short *ports, int *valid)
+{
+    struct sockaddr_in from[RX_MAXMMSG];
+    struct msghdr msgs[RX_MAXMMSG];
+    afs_uint32 tlen[RX_MAXMMSG], savelen[RX_MAXMMSG];
+    int nbytes[RX_MAXMMSG];
+    int i, nread;
+
+    if (npackets > RX_MAXMMSG)
+	npackets = RX_MAXMMSG;
+
+    memset(msgs, 0, npackets * sizeof(msgs[0]));
+    for (i = 0; i < npackets; i++) {
+	rxi_PrepareReadPacket(list[i], &tlen[i], &savelen[i]);
+	msgs[i].msg_name = (char *)&from[i];
+	msgs[i].msg_namelen = sizeof(struct sockaddr_in);
+	msgs[i].msg_iov = list[i]->wirevec;
+	msgs[i].msg_iovlen = list[i]->niovecs;
+    }
+
+    nread = rxi_Recvmmsg(socket, msgs, nbytes, npackets);
+
+    if (rx_stats_active && nread > 0) {
+	rx_atomic_inc(&rx_stats.recvBatches);
+	rx_atomic_add(&rx_stats.recvBatchPackets, nread);
+    }
+
+    if (nread <= 0) {
+	/* Let the first buffer account for the failure; the rest were never
+	 * touched, but their iovecs still need to be put back. */
+	valid[0] = rxi_FinishReadPacket(list[0], nread, tlen[0], savelen[0],
+					&from[0], &hosts[0], &ports[0]);
+	for (i = 1; i < npackets; i++)
+	    list[i]->wirevec[list[i]->niovecs - 1].iov_len = savelen[i];
+	return 0;
+    }
+
+    for (i = 0; i < npackets; i++) {
+	if (i < nread) {
+	    valid[i] = rxi_FinishReadPacket(list[i], nbytes[i], tlen[i],
+					    savelen[i], &from[i], &hosts[i],
+					    &ports[i]);
+	} else {
+	    list[i]->wirevec[list[i]->niovecs - 1].iov_len = savelen[i];
+	}
+    }
+    return nread;
+}
+#endif /* RX_ENABLE_MMSG */
+
+#ifdef RX_ENABLE_UDP_OFFLOAD
+/* Copy length bytes, starting offset bytes in, out of the iovecs iov */
+static void
+rxi_CopyFromIovecs(struct iovec *iov, int niov, int offset, int length,
+		   char *out)
+{
+    int i, n;
+
+    for (i = 0; i < niov && length > 0; i++) {
+	if (offset >= iov[i].iov_len) {
+	    offset -= iov[i].iov_len;
+	    continue;
+	}
+	n = MIN(iov[i].iov_len - offset, length);
+	memcpy(out, (char *)iov[i].iov_base + offset, n);
+	out += n;
+	length -= n;
+	offset = 0;
+    }
+}
+
+/* This function reads up to npackets datagrams from the interface with a
+ * single system call, blocking until at least one is available. Each read
+ * goes into the packet list[i], as far as the first headroom bytes of it,
+ * and carries on into the buffer bufs[i], RX_MAXGROSIZE bytes long, which
+ * must have headroom bytes of space before it.
+ *
+ * The kernel may have coalesced several datagrams from one sender into one
+ * read; all of them but the last are then segsizes[i] bytes long. The
+ * first is left in list[i], and valid[i] set as rxi_ReadPacket's return
+ * value would be. Any others are gathered together, restlen[i] bytes of
+ * them starting at rest[i], for rxi_CopyReadPacket to split into packets
+ * of their own. The sender of every buffer is stored in hosts[i] and
+ * ports[i]. The number of buffers filled is returned. */
+int
+rxi_ReadCoalesced(osi_socket socket, struct rx_packet **list, int npackets,
+		  char **bufs, int headroom, int *valid, char **rest,
+		  int *restlen, int *segsizes, afs_uint32 *hosts,
+		  u_short *ports)
+{
+    struct sockaddr_in from[RX_MAXGROMSG];
+    struct msghdr msgs[RX_MAXGROMSG];
+    struct iovec iov[RX_MAXGROMSG][RX_MAXIOVECS + 1];
+    afs_uint32 tlen[RX_MAXGROMSG], savelen[RX_MAXGROMSG];
+    int nbytes[RX_MAXGROMSG], room[RX_MAXGROMSG];
+    union {
+	char buf[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr align;
+    } control[RX_MAXGROMSG];
+    struct cmsghdr *cmsg;
+    struct rx_packet *p;
+    int i, n, nread, first, stitch;
+
+    if (npackets > RX_MAXGROMSG)
+	npackets = RX_MAXGROMSG;
+
+    memset(msgs, 0, npackets * sizeof(msgs[0]));
+    for (i = 0; i < npackets; i++) {
+	p = list[i];
+	rxi_PrepareReadPacket(p, &tlen[i], &savelen[i]);
+	room[i] = 0;
+	for (n = 0; n < p->niovecs && room[i] < headroom; n++) {
+	    iov[i][n] = p->wirevec[n];
+	    if (iov[i][n].iov_len > headroom - room[i])
+		iov[i][n].iov_len = headroom - room[i];
+	    room[i] += iov[i][n].iov_len;
+	}
+	iov[i][n].iov_base = bufs[i];
+	iov[i][n].iov_len = RX_MAXGROSIZE;
+	msgs[i].msg_name = (char *)&from[i];
+	msgs[i].msg_namelen = sizeof(struct sockaddr_in);
+	msgs[i].msg_iov = iov[i];
+	msgs[i].msg_iovlen = n + 1;
+	msgs[i].msg_control = control[i].buf;
+	msgs[i].msg_controllen = sizeof(control[i].buf);
+    }
+
+    nread = rxi_Recvmmsg(socket, msgs, nbytes, npackets);
+
+    if (rx_stats_active && nread > 0) {
+	rx_atomic_inc(&rx_stats.recvBatches);
+	rx_atomic_add(&rx_stats.recvBatchPackets, nread);
+    }
+
+    if (nread <= 0) {
+	/* As in rxi_ReadPackets */
+	valid[0] = rxi_FinishReadPacket(list[0], nread, tlen[0], savelen[0],
+					&from[0], &hosts[0], &ports[0]);
+	for (i = 1; i < npackets; i++)
+	    list[i]->wirevec[list[i]->niovecs - 1].iov_len = savelen[i];
+	return 0;
+    }
+
+    for (i = nread; i < npackets; i++)
+	list[i]->wirevec[list[i]->niovecs - 1].iov_len = savelen[i];
+
+    for (i = 0; i < nread; i++) {
+	p = list[i];
+	segsizes[i] = nbytes[i];
+	for (cmsg = CMSG_FIRSTHDR(&msgs[i]); cmsg != NULL;
+	     cmsg = CMSG_NXTHDR(&msgs[i], cmsg)) {
+	    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+		memcpy(&segsizes[i], CMSG_DATA(cmsg), sizeof(int));
+		break;
+	    }
+	}
+	if (segsizes[i] <= 0 || segsizes[i] > nbytes[i])
+	    segsizes[i] = nbytes[i];
+	hosts[i] = from[i].sin_addr.s_addr;
+	ports[i] = from[i].sin_port;
+
+	/* Normally the first datagram fits in the packet. Everything after
+	 * it that also landed in the packet is copied back in front of the
+	 * buffer, so that the rest are all in one piece. */
+	first = segsizes[i];
+	if (first > room[i] || first < RX_HEADER_SIZE)
+	    first = 0;
+	stitch = MIN(nbytes[i], room[i]) - first;
+	if (stitch > 0)
+	    rxi_CopyFromIovecs(iov[i], msgs[i].msg_iovlen - 1, first, stitch,
+			       bufs[i] - stitch);
+	rest[i] = bufs[i] - MAX(stitch, 0);
+	restlen[i] = nbytes[i] - first;
+
+	if (first) {
+	    valid[i] = rxi_FinishReadPacket(p, first, tlen[i], savelen[i],
+					    &from[i], &hosts[i], &ports[i]);
+	} else {
+	    /* Leave it to rxi_CopyReadPacket like the others */
+	    p->wirevec[p->niovecs - 1].iov_len = savelen[i];
+	    valid[i] = 0;
+	}
+    }
+    return nread;
+}
+
+/* This function copies a datagram of nbytes bytes, which was read by
+ * rxi_ReadCoalesced from the sender *host, *port, into the supplied packet
+ * buffer (*p). The return value and the state of the packet are just as
+ * they would be had rxi_ReadPacket read the datagram itself. */
+int
+rxi_CopyReadPacket(struct rx_packet *p, char *buf, int nbytes,
+		   afs_uint32 *host, u_short *port)
+{
+    struct sockaddr_in from;
+    afs_uint32 tlen, savelen;
+    int i, offset, length;
+
+    rxi_PrepareReadPacket(p, &tlen, &savelen);
+
+    /* Anything longer than tlen is bogus, and is only copied in as far as
+     * rxi_FinishReadPacket needs to see that. */
+    for (i = 0, offset = 0; i < p->niovecs && offset < nbytes; i++) {
+	length = MIN(p->wirevec[i].iov_len, nbytes - offset);
+	memcpy(p->wirevec[i].iov_base, buf + offset, length);
+	offset += length;
+    }
+
+    memset(&from, 0, sizeof(from));
+    from.sin_family = AF_INET;
+    from.sin_addr.s_addr = *host;
+    from.sin_port = *port;
+
+    return rxi_FinishReadPacket(p, nbytes, tlen, savelen, &from, host, port);
+}
+#endif /* RX_ENABLE_UDP_OFFLOAD */
+
 #endif /* !KERNEL || UKERNEL */
 
 /* This function splits off the first packet in a jumbo packet.
@@ -1613,6 +1887,11 @@ osi_NetSend(osi_socket socket, void *addr, struct iovec *dvec, int nvecs,
     struct msghdr msg;
 	int ret;
 
+#ifdef RX_ENABLE_IMPAIR
+    if (rxi_impairEnabled)
+	return rxi_ImpairSend(socket, addr, dvec, nvecs);
+#endif
+
     memset(&msg, 0, sizeof(msg));
     msg.msg_iov = dvec;
     msg.msg_iovlen = nvecs;
@@ -1806,6 +2085,7 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
     switch (tin.type) {
     case RX_DEBUGI_GETSTATS:{
 	    struct rx_debugStats tstat;
+	    int i;
 
 	    /* get basic stats */
 	    memset(&tstat, 0, sizeof(tstat));	/* make sure spares are zero */
@@ -1813,7 +2093,6 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 #ifndef	RX_ENABLE_LOCKS
 	    tstat.waitingForPackets = rx_waitingForPackets;
 #endif
-	    MUTEX_ENTER(&rx_serverPool_lock);
 	    tstat.nFreePackets = htonl(rx_nFreePackets);
 	    tstat.nPackets = htonl(rx_nPackets);
 	    tstat.callsExecuted = htonl(rxi_nCalls);
@@ -1821,9 +2100,13 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 	    tstat.usedFDs = CountFDs(64);
 	    tstat.nWaiting = htonl(rx_atomic_read(&rx_nWaiting));
 	    tstat.nWaited = htonl(rx_atomic_read(&rx_nWaited));
-	    tstat.idleThreads = opr_queue_Count(&rx_idleServerQueue);
-	    MUTEX_EXIT(&rx_serverPool_lock);
+	    rxi_CallQueueStats(&tstat.idleThreads, &tstat.nCallQueues,
+			       tstat.nQueued, &tstat.nStolen);
 	    tstat.idleThreads = htonl(tstat.idleThreads);
+	    tstat.nCallQueues = htonl(tstat.nCallQueues);
+	    for (i = 0; i < RX_NPRIORITIES; i++)
+		tstat.nQueued[i] = htonl(tstat.nQueued[i]);
+	    tstat.nStolen = htonl(tstat.nStolen);
 	    tl = sizeof(struct rx_debugStats) - ap->length;
 	    if (tl > 0)
 		tl = rxi_AllocDataBuf(ap, tl, RX_PACKET_CLASS_SEND_CBUF);
@@ -1840,7 +2123,7 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 
     case RX_DEBUGI_GETALLCONN:
     case RX_DEBUGI_GETCONN:{
-            unsigned int i, j;
+            unsigned int b, i, j;
 	    struct rx_connection *tc;
 	    struct rx_call *tcall;
 	    struct rx_debugConn tconn;
@@ -1855,7 +2138,7 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 
 	    memset(&tconn, 0, sizeof(tconn));	/* make sure spares are zero */
 	    /* get N'th (maybe) "interesting" connection info */
-	    for (i = 0; i < rx_hashTableSize; i++) {
+	    for (b = 0; b < rx_connHashTableSize; b++) {
 #if !defined(KERNEL)
 		/* the time complexity of the algorithm used here
 		 * exponentially increses with the number of connections.
@@ -1866,11 +2149,11 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 		(void)IOMGR_Poll();
 #endif
 #endif
-		MUTEX_ENTER(&rx_connHashTable_lock);
+		MUTEX_ENTER(CONN_HASH_LOCK(b));
 		/* We might be slightly out of step since we are not
 		 * locking each call, but this is only debugging output.
 		 */
-		for (tc = rx_connHashTable[i]; tc; tc = tc->next) {
+		for (tc = rx_connHashTable[b]; tc; tc = tc->next) {
 		    if ((all || rxi_IsConnInteresting(tc))
 			&& tin.index-- <= 0) {
 			tconn.host = tc->peer->host;
@@ -1884,6 +2167,8 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 				tconn.callState[j] = tcall->state;
 				tconn.callMode[j] = tcall->app.mode;
 				tconn.callFlags[j] = tcall->flags;
+				tconn.callCwind[j] = htonl(tcall->cwind);
+				tconn.callRtt[j] = htonl(tcall->rtt);
 				if (!opr_queue_IsEmpty(&tcall->rq))
 				    tconn.callOther[j] |= RX_OTHER_IN;
 				if (!opr_queue_IsEmpty(&tcall->tq))
@@ -1893,6 +2178,8 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 			}
 
 			tconn.natMTU = htonl(tc->peer->natMTU);
+			tconn.wideCid = htonl(tc->wideCid);
+			tconn.wideGroup = tc->wideGroup;
 			tconn.error = htonl(tc->error);
 			tconn.flags = tc->flags;
 			tconn.type = tc->type;
@@ -1920,7 +2207,7 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 				DOHTONL(sparel[i]);
 			}
 
-			MUTEX_EXIT(&rx_connHashTable_lock);
+			MUTEX_EXIT(CONN_HASH_LOCK(b));
 			rx_packetwrite(ap, 0, sizeof(struct rx_debugConn),
 				       (char *)&tconn);
 			tl = ap->length;
@@ -1931,7 +2218,7 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 			return ap;
 		    }
 		}
-		MUTEX_EXIT(&rx_connHashTable_lock);
+		MUTEX_EXIT(CONN_HASH_LOCK(b));
 	    }
 	    /* if we make it here, there are no interesting packets */
 	    tconn.cid = htonl(0xffffffff);	/* means end */
@@ -1961,13 +2248,13 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 		return ap;
 
 	    memset(&tpeer, 0, sizeof(tpeer));
-	    for (i = 0; i < rx_hashTableSize; i++) {
+	    for (i = 0; i < rx_peerHashTableSize; i++) {
 #if !defined(KERNEL)
 		/* the time complexity of the algorithm used here
 		 * exponentially increses with the number of peers.
 		 *
 		 * Yielding after processing each hash table entry
-		 * and dropping rx_peerHashTable_lock.
+		 * and dropping its rx_peerHashTable_lock shard
 		 * also increases the risk that we will miss a new
 		 * entry - but we are willing to live with this
 		 * limitation since this is meant for debugging only
@@ -1978,11 +2265,11 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 		(void)IOMGR_Poll();
 #endif
 #endif
-		MUTEX_ENTER(&rx_peerHashTable_lock);
+		MUTEX_ENTER(PEER_HASH_LOCK(i));
 		for (tp = rx_peerHashTable[i]; tp; tp = tp->next) {
 		    if (tin.index-- <= 0) {
                         tp->refCount++;
-                        MUTEX_EXIT(&rx_peerHashTable_lock);
+                        MUTEX_EXIT(PEER_HASH_LOCK(i));
 
                         MUTEX_ENTER(&tp->peer_lock);
 			tpeer.host = tp->host;
@@ -2016,9 +2303,9 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 			    htonl(tp->bytesReceived & MAX_AFS_UINT32);
                         MUTEX_EXIT(&tp->peer_lock);
 
-                        MUTEX_ENTER(&rx_peerHashTable_lock);
+                        MUTEX_ENTER(PEER_HASH_LOCK(i));
                         tp->refCount--;
-			MUTEX_EXIT(&rx_peerHashTable_lock);
+			MUTEX_EXIT(PEER_HASH_LOCK(i));
 
 			rx_packetwrite(ap, 0, sizeof(struct rx_debugPeer),
 				       (char *)&tpeer);
@@ -2030,7 +2317,7 @@ rxi_ReceiveDebugPacket(struct rx_packet *ap, osi_socket asocket,
 			return ap;
 		    }
 		}
-		MUTEX_EXIT(&rx_peerHashTable_lock);
+		MUTEX_EXIT(PEER_HASH_LOCK(i));
 	    }
 	    /* if we make it here, there are no interesting packets */
 	    tpeer.host = htonl(0xffffffff);	/* means end */
@@ -2259,6 +2546,9 @@ rxi_SendPacket(struct rx_call *call, struct rx_connection *conn,
     if (p->firstSerial == 0) {
 	p->firstSerial = p->header.serial;
     }
+    if (p->header.type != RX_PACKET_TYPE_ACK)
+	RXI_TRACE_PACKET(p->firstSerial == p->header.serial
+			 ? RX_TRACE_SEND : RX_TRACE_RESEND, conn, p);
 #ifdef RXDEBUG
     /* If an output tracer function is defined, call it with the packet and
      * network address.  Note this function may modify its arguments. */
@@ -2355,35 +2645,30 @@ rxi_SendPacket(struct rx_call *call, struct rx_connection *conn,
     }
 }
 
-/* Send a list of packets to appropriate destination for the specified
- * connection.  The headers are first encoded and placed in the packets.
+/* Stamp the packets in a list with consecutive serial numbers, encode
+ * their headers, and describe them in wirevec as a single datagram. If
+ * there is more than one packet, they are chained into a jumbogram. The
+ * number of iovecs used is stored in *nvecsp, and the length of the
+ * datagram is returned. *dropp is set if a tracer asked for the datagram
+ * to be dropped.
  */
-void
-rxi_SendPacketList(struct rx_call *call, struct rx_connection *conn,
-		   struct rx_packet **list, int len, int istack)
+static int
+rxi_PrepareSendList(struct rx_connection *conn, struct sockaddr_in *addr,
+		    struct rx_packet **list, int len, struct iovec *wirevec,
+		    int *nvecsp, int *dropp)
 {
-#if     defined(AFS_SUN5_ENV) && defined(KERNEL)
-    int waslocked;
-#endif
-    struct sockaddr_in addr;
-    struct rx_peer *peer = conn->peer;
-    osi_socket socket;
     struct rx_packet *p = NULL;
-    struct iovec wirevec[RX_MAXIOVECS];
-    int i, length, code;
+    int i, length, nvecs;
     afs_uint32 serial;
     afs_uint32 temp;
     struct rx_jumboHeader *jp;
-#ifdef RXDEBUG
-    char deliveryType = 'S';
-#endif
-    /* The address we're sending the packet to */
-    addr.sin_family = AF_INET;
-    addr.sin_port = peer->port;
-    addr.sin_addr.s_addr = peer->host;
-    memset(&addr.sin_zero, 0, sizeof(addr.sin_zero));
 
-    if (len + 1 > RX_MAXIOVECS) {
+    *dropp = 0;
+
+    /* A packet whose data lies in a file mapping takes two iovecs */
+    for (i = 0, nvecs = 1; i < len; i++)
+	nvecs += (list[i]->flags & RX_PKTFLAG_FILEDATA) ? 2 : 1;
+    if (nvecs > RX_MAXIOVECS) {
 	osi_Panic("rxi_SendPacketList, len > RX_MAXIOVECS\n");
     }
 
@@ -2420,37 +2705,59 @@ rxi_SendPacketList(struct rx_call *call, struct rx_connection *conn,
     length = RX_HEADER_SIZE;
     wirevec[0].iov_base = (char *)(&list[0]->wirehead[0]);
     wirevec[0].iov_len = RX_HEADER_SIZE;
+    nvecs = 1;
     for (i = 0; i < len; i++) {
 	p = list[i];
 
-	/* The whole 3.5 jumbogram scheme relies on packets fitting
-	 * in a single packet buffer. */
-	if (p->niovecs > 2) {
-	    osi_Panic("rxi_SendPacketList, niovecs > 2\n");
-	}
+	if (len == 1) {
+	    /* A lone packet is sent as is, and may span several buffers */
+	    memcpy(wirevec, p->wirevec, p->niovecs * sizeof(struct iovec));
+	    nvecs = p->niovecs;
+	    length += p->length;
+	} else {
+	    /* The whole 3.5 jumbogram scheme relies on packets fitting
+	     * in a single packet buffer, or in their first buffer and a
+	     * file mapping. */
+	    if (p->niovecs > 2 && !(p->flags & RX_PKTFLAG_FILEDATA)) {
+		osi_Panic("rxi_SendPacketList, niovecs > 2\n");
+	    }
 
-	/* Set the RX_JUMBO_PACKET flags in all but the last packets
-	 * in this chunk.  */
-	if (i < len - 1) {
-	    if (p->length != RX_JUMBOBUFFERSIZE) {
-		osi_Panic("rxi_SendPacketList, length != jumbo size\n");
+	    /* Set the RX_JUMBO_PACKET flags in all but the last packets
+	     * in this chunk.  */
+	    if (i < len - 1) {
+		if (p->length != RX_JUMBOBUFFERSIZE) {
+		    osi_Panic("rxi_SendPacketList, length != jumbo size\n");
+		}
+		p->header.flags |= RX_JUMBO_PACKET;
+		length += RX_JUMBOBUFFERSIZE + RX_JUMBOHEADERSIZE;
+	    } else {
+		length += p->length;
 	    }
-	    p->header.flags |= RX_JUMBO_PACKET;
-	    length += RX_JUMBOBUFFERSIZE + RX_JUMBOHEADERSIZE;
-	    wirevec[i + 1].iov_len = RX_JUMBOBUFFERSIZE + RX_JUMBOHEADERSIZE;
-	} else {
-	    wirevec[i + 1].iov_len = p->length;
-	    length += p->length;
-	}
-	wirevec[i + 1].iov_base = (char *)(&p->localdata[0]);
-	if (jp != NULL) {
-	    /* Convert jumbo packet header to network byte order */
-	    temp = (afs_uint32) (p->header.flags) << 24;
-	    temp |= (afs_uint32) (p->header.spare);
-	    *(afs_uint32 *) jp = htonl(temp);
+
+	    /* The jumbo header in front of this packet goes at the end of
+	     * the buffer before it. A file mapping can't be written to, so
+	     * after one the header goes instead in the tail of this
+	     * packet's wire header, which no one else sends, and which lies
+	     * just before its data. */
+	    wirevec[nvecs].iov_base = (char *)(&p->localdata[0]);
+	    wirevec[nvecs].iov_len = 0;
+	    if (i > 0 && (list[i - 1]->flags & RX_PKTFLAG_FILEDATA)) {
+		jp = (struct rx_jumboHeader *)
+		    ((char *)(&p->localdata[0]) - RX_JUMBOHEADERSIZE);
+		wirevec[nvecs].iov_base = (char *)jp;
+		wirevec[nvecs].iov_len = RX_JUMBOHEADERSIZE;
+	    }
+	    if (p->flags & RX_PKTFLAG_FILEDATA) {
+		wirevec[nvecs].iov_len += p->wirevec[1].iov_len;
+		wirevec[++nvecs] = p->wirevec[2];
+	    } else if (i < len - 1) {
+		wirevec[nvecs].iov_len += RX_JUMBOBUFFERSIZE
+		    + RX_JUMBOHEADERSIZE;
+	    } else {
+		wirevec[nvecs].iov_len += p->length;
+	    }
+	    nvecs++;
 	}
-	jp = (struct rx_jumboHeader *)
-	    ((char *)(&p->localdata[0]) + RX_JUMBOBUFFERSIZE);
 
 	/* Stamp each packet with a unique serial number.  The serial
 	 * number is maintained on a connection basis because some types
@@ -2466,21 +2773,113 @@ rxi_SendPacketList(struct rx_call *call, struct rx_connection *conn,
 	if (p->firstSerial == 0) {
 	    p->firstSerial = p->header.serial;
 	}
+	RXI_TRACE_PACKET(p->firstSerial == p->header.serial
+			 ? RX_TRACE_SEND : RX_TRACE_RESEND, conn, p);
 #ifdef RXDEBUG
 	/* If an output tracer function is defined, call it with the packet and
 	 * network address.  Note this function may modify its arguments. */
 	if (rx_almostSent) {
-	    int drop = (*rx_almostSent) (p, &addr);
+	    int drop = (*rx_almostSent) (p, addr);
 	    /* drop packet if return value is non-zero? */
 	    if (drop)
-		deliveryType = 'D';	/* Drop the packet */
+		*dropp = 1;	/* Drop the packet */
 	}
 #endif
 
 	/* Get network byte order header */
 	rxi_EncodePacketHeader(p);	/* XXX in the event of rexmit, etc, don't need to
 					 * touch ALL the fields */
+
+	if (jp != NULL) {
+	    /* Convert jumbo packet header to network byte order */
+	    temp = (afs_uint32) (p->header.flags) << 24;
+	    temp |= (afs_uint32) (p->header.spare);
+	    *(afs_uint32 *) jp = htonl(temp);
+	}
+	if (len > 1)
+	    jp = (struct rx_jumboHeader *)
+		((char *)(&p->localdata[0]) + RX_JUMBOBUFFERSIZE);
     }
+    *nvecsp = nvecs;
+
+#ifdef RXDEBUG
+    /* Possibly drop this packet,  for testing purposes */
+    if ((rx_intentionallyDroppedPacketsPer100 > 0)
+	&& (random() % 100 < rx_intentionallyDroppedPacketsPer100)) {
+	*dropp = 1;
+    }
+#endif
+
+    return length;
+}
+
+/* Account for a datagram which could not be sent */
+static void
+rxi_SendListFailed(struct rx_call *call, struct rx_packet **list, int len,
+		   int code)
+{
+    int i;
+
+    /* send failed, so let's hurry up the resend, eh? */
+    if (rx_stats_active)
+	rx_atomic_inc(&rx_stats.netSendFailures);
+    for (i = 0; i < len; i++) {
+	list[i]->flags &= ~RX_PKTFLAG_SENT;  /* resend it very soon */
+    }
+    /* Some systems are nice and tell us right away that we cannot
+     * reach this recipient by returning an error code.
+     * So, when this happens let's "down" the host NOW so
+     * we don't sit around waiting for this host to timeout later.
+     */
+    if (call) {
+	rxi_NetSendError(call, code);
+    }
+}
+
+/* Update the statistics for a datagram which has been sent */
+static void
+rxi_SendListDone(struct rx_peer *peer, struct rx_packet **list, int len,
+		 int drop)
+{
+    struct rx_packet *p = list[len - 1];
+
+    dpf(("%c %d %s: %x.%u.%u.%u.%u.%u.%u flags %d, packet %"AFS_PTR_FMT" len %d\n",
+          drop ? 'D' : 'S', p->header.serial, rx_packetTypes[p->header.type - 1], ntohl(peer->host),
+          ntohs(peer->port), p->header.serial, p->header.epoch, p->header.cid, p->header.callNumber,
+          p->header.seq, p->header.flags, p, p->length));
+
+    if (rx_stats_active) {
+        rx_atomic_inc(&rx_stats.packetsSent[p->header.type - 1]);
+        MUTEX_ENTER(&peer->peer_lock);
+        peer->bytesSent += p->length;
+        MUTEX_EXIT(&peer->peer_lock);
+    }
+}
+
+/* Send a list of packets to appropriate destination for the specified
+ * connection.  The headers are first encoded and placed in the packets.
+ */
+void
+rxi_SendPacketList(struct rx_call *call, struct rx_connection *conn,
+		   struct rx_packet **list, int len, int istack)
+{
+#if     defined(AFS_SUN5_ENV) && defined(KERNEL)
+    int waslocked;
+#endif
+    struct sockaddr_in addr;
+    struct rx_peer *peer = conn->peer;
+    osi_socket socket;
+    struct iovec wirevec[RX_MAXIOVECS];
+    int nvecs, length, code, drop;
+
+    /* The address we're sending the packet to */
+    addr.sin_family = AF_INET;
+    addr.sin_port = peer->port;
+    addr.sin_addr.s_addr = peer->host;
+    memset(&addr.sin_zero, 0, sizeof(addr.sin_zero));
+
+    length = rxi_PrepareSendList(conn, &addr, list, len, wirevec, &nvecs,
+				 &drop);
 
     /* Send the packet out on the same socket that related packets are being
      * received on */
@@ -2488,16 +2887,7 @@ rxi_SendPacketList(struct rx_call *call, struct rx_connection *conn,
 	(conn->type ==
 	 RX_CLIENT_CONNECTION ? rx_socket : conn->service->socket);
 
-#ifdef RXDEBUG
-    /* Possibly drop this packet,  for testing purposes */
-    if ((deliveryType == 'D')
-	|| ((rx_intentionallyDroppedPacketsPer100 > 0)
-	    && (random() % 100 < rx_intentionallyDroppedPacketsPer100))) {
-	deliveryType = 'D';	/* Drop the packet */
-    } else {
-	deliveryType = 'S';	/* Send the packet */
-#endif /* RXDEBUG */
-
+    if (!drop) {
 	/* Loop until the packet is sent.  We'd prefer just to use a
 	 * blocking socket, but unfortunately the interface doesn't
 	 * allow us to have the socket block in send mode, and not
@@ -2508,46 +2898,209 @@ rxi_SendPacketList(struct rx_call *call, struct rx_connection *conn,
 	    AFS_GUNLOCK();
 #endif
 	if ((code =
-	     osi_NetSend(socket, &addr, &wirevec[0], len + 1, length,
+	     osi_NetSend(socket, &addr, &wirevec[0], nvecs, length,
 			 istack)) != 0) {
-	    /* send failed, so let's hurry up the resend, eh? */
-            if (rx_stats_active)
-                rx_atomic_inc(&rx_stats.netSendFailures);
-	    for (i = 0; i < len; i++) {
-		p = list[i];
-		p->flags &= ~RX_PKTFLAG_SENT;  /* resend it very soon */
-	    }
-	    /* Some systems are nice and tell us right away that we cannot
-	     * reach this recipient by returning an error code.
-	     * So, when this happens let's "down" the host NOW so
-	     * we don't sit around waiting for this host to timeout later.
-	     */
-	    if (call) {
-		rxi_NetSendError(call, code);
-	    }
+	    rxi_SendListFailed(call, list, len, code);
 	}
 #if	defined(AFS_SUN5_ENV) && defined(KERNEL)
 	if (!istack && waslocked)
 	    AFS_GLOCK();
 #endif
-#ifdef RXDEBUG
     }
 
-    osi_Assert(p != NULL);
+    rxi_SendListDone(peer, list, len, drop);
+}
 
-    dpf(("%c %d %s: %x.%u.%u.%u.%u.%u.%u flags %d, packet %"AFS_PTR_FMT" len %d\n",
-          deliveryType, p->header.serial, rx_packetTypes[p->header.type - 1], ntohl(peer->host),
-          ntohs(peer->port), p->header.serial, p->header.epoch, p->header.cid, p->header.callNumber,
-          p->header.seq, p->header.flags, p, p->length));
+#ifdef RX_ENABLE_MMSG
+#ifdef RX_ENABLE_UDP_OFFLOAD
+/* Send the datagrams which make up a message the kernel would not segment
+ * for us one at a time. If they all go, the fault lay with segmentation,
+ * so stop using it for this peer. */
+static void
+rxi_SendSegments(struct rx_call *call, struct rx_peer *peer,
+		 osi_socket socket, struct msghdr *gso,
+		 struct rx_packet **lists[], int lens[], int first,
+		 int nsegs, int *nvecs, int *drop)
+{
+    struct msghdr msgs[RX_MAXMMSG];
+    int index[RX_MAXMMSG];
+    struct iovec *iov = gso->msg_iov;
+    int i, n, sent, code;
+    int failed = 0;
+
+    for (i = first, n = 0; n < nsegs; i++) {
+	if (drop[i])
+	    continue;
+	memset(&msgs[n], 0, sizeof(msgs[n]));
+	msgs[n].msg_name = gso->msg_name;
+	msgs[n].msg_namelen = gso->msg_namelen;
+	msgs[n].msg_iov = iov;
+	msgs[n].msg_iovlen = nvecs[i];
+	iov += nvecs[i];
+	index[n++] = i;
+    }
+
+    for (i = 0; i < nsegs; i += sent) {
+	sent = rxi_Sendmmsg(socket, &msgs[i], nsegs - i, &code);
+	if (sent == 0) {
+	    rxi_SendListFailed(call, lists[index[i]], lens[index[i]], code);
+	    failed = 1;
+	    sent = 1;
+	}
+    }
+
+    if (!failed) {
+	dpf(("rxi_SendSegments: UDP_SEGMENT failed for [%x,%d]\n",
+	     ntohl(peer->host), ntohs(peer->port)));
+	MUTEX_ENTER(&peer->peer_lock);
+	peer->noGSO = 1;
+	MUTEX_EXIT(&peer->peer_lock);
+    }
+}
+#endif /* RX_ENABLE_UDP_OFFLOAD */
+
+/* Send several lists of packets to the peer of the specified connection
+ * with as few system calls as possible. Each list becomes one datagram,
+ * built just as rxi_SendPacketList would build it. Where the kernel can
+ * segment them for us, runs of datagrams of the same size are handed over
+ * as a single buffer.
+ */
+void
+rxi_SendPacketLists(struct rx_call *call, struct rx_connection *conn,
+		    struct rx_packet **lists[], int lens[], int nlists,
+		    int istack)
+{
+    struct sockaddr_in addr;
+    struct rx_peer *peer = conn->peer;
+    osi_socket socket;
+    struct iovec wirevecs[RX_MAXMMSG * RX_MAXIOVECS];
+    struct msghdr msgs[RX_MAXMMSG];
+    int index[RX_MAXMMSG];
+    int nsegs[RX_MAXMMSG];
+    int nvecs[RX_MAXMMSG];
+    int drop[RX_MAXMMSG];
+    int i, nmsgs, nvec, sent, code;
+#ifdef RX_ENABLE_UDP_OFFLOAD
+    union {
+	char buf[CMSG_SPACE(sizeof(afs_uint16))];
+	struct cmsghdr align;
+    } control[RX_MAXMMSG];
+    struct cmsghdr *cmsg;
+    int segsize[RX_MAXMMSG];
+    int lastsize[RX_MAXMMSG];
+    int msgsize[RX_MAXMMSG];
+    int gso;
+#endif
+
+    socket =
+	(conn->type ==
+	 RX_CLIENT_CONNECTION ? rx_socket : conn->service->socket);
 
+#ifdef RX_ENABLE_UDP_OFFLOAD
+    gso = (rxi_SocketOffload(socket) & RXI_SOCKET_GSO) && !peer->noGSO;
 #endif
-    if (rx_stats_active) {
-        rx_atomic_inc(&rx_stats.packetsSent[p->header.type - 1]);
-        MUTEX_ENTER(&peer->peer_lock);
-        peer->bytesSent += p->length;
-        MUTEX_EXIT(&peer->peer_lock);
+#if defined(RX_ENABLE_UDP_OFFLOAD) && defined(RX_ENABLE_IMPAIR)
+    /* The simulated link must see each datagram on its own */
+    if (rxi_impairEnabled)
+	gso = 0;
+#endif
+
+    if (nlists > RX_MAXMMSG) {
+	osi_Panic("rxi_SendPacketLists, nlists > RX_MAXMMSG\n");
+    }
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = peer->port;
+    addr.sin_addr.s_addr = peer->host;
+    memset(&addr.sin_zero, 0, sizeof(addr.sin_zero));
+
+    /* Build one message per list, leaving out any that are to be dropped.
+     * The iovecs for each datagram follow straight on from those of the
+     * one before, so that a message may describe several of them. */
+    nmsgs = 0;
+    nvec = 0;
+    for (i = 0; i < nlists; i++) {
+	int length;
+
+	length = rxi_PrepareSendList(conn, &addr, lists[i], lens[i],
+				     &wirevecs[nvec], &nvecs[i], &drop[i]);
+	if (drop[i])
+	    continue;
+#ifdef RX_ENABLE_UDP_OFFLOAD
+	/* The kernel cuts a buffer into segments of the size of the first,
+	 * with only the last allowed to be shorter. No segment may need
+	 * fragmenting, and together they must fit in one IP datagram. */
+	if (gso && nmsgs > 0 && length <= segsize[nmsgs - 1]
+	    && lastsize[nmsgs - 1] == segsize[nmsgs - 1]
+	    && msgsize[nmsgs - 1] + length <= 0xffff - RX_IPUDP_SIZE
+	    && segsize[nmsgs - 1] <= peer->ifMTU) {
+	    msgs[nmsgs - 1].msg_iovlen += nvecs[i];
+	    nsegs[nmsgs - 1]++;
+	    lastsize[nmsgs - 1] = length;
+	    msgsize[nmsgs - 1] += length;
+	    nvec += nvecs[i];
+	    continue;
+	}
+	segsize[nmsgs] = lastsize[nmsgs] = msgsize[nmsgs] = length;
+#endif
+	memset(&msgs[nmsgs], 0, sizeof(msgs[nmsgs]));
+	msgs[nmsgs].msg_name = &addr;
+	msgs[nmsgs].msg_namelen = sizeof(struct sockaddr_in);
+	msgs[nmsgs].msg_iov = &wirevecs[nvec];
+	msgs[nmsgs].msg_iovlen = nvecs[i];
+	index[nmsgs] = i;
+	nsegs[nmsgs] = 1;
+	nmsgs++;
+	nvec += nvecs[i];
+    }
+
+#ifdef RX_ENABLE_UDP_OFFLOAD
+    /* Tell the kernel how to cut up the messages holding several datagrams */
+    for (i = 0; i < nmsgs; i++) {
+	afs_uint16 size = segsize[i];
+
+	if (nsegs[i] == 1)
+	    continue;
+	msgs[i].msg_control = control[i].buf;
+	msgs[i].msg_controllen = sizeof(control[i].buf);
+	cmsg = CMSG_FIRSTHDR(&msgs[i]);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(size));
+	memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
     }
+#endif
+
+    /* A failed datagram only fails itself; carry on with the ones behind
+     * it, as we would have done had they been sent one at a time. */
+    for (i = 0; i < nmsgs; i += sent) {
+	sent = rxi_Sendmmsg(socket, &msgs[i], nmsgs - i, &code);
+	if (rx_stats_active) {
+	    int n, npackets = 0;
+
+	    for (n = 0; n < sent; n++)
+		npackets += nsegs[i + n];
+	    rx_atomic_inc(&rx_stats.sendBatches);
+	    rx_atomic_add(&rx_stats.sendBatchPackets, npackets);
+	}
+	if (sent == 0) {
+#ifdef RX_ENABLE_UDP_OFFLOAD
+	    if (nsegs[i] > 1) {
+		rxi_SendSegments(call, peer, socket, &msgs[i], lists, lens,
+				 index[i], nsegs[i], nvecs, drop);
+		sent = 1;
+		continue;
+	    }
+#endif
+	    rxi_SendListFailed(call, lists[index[i]], lens[index[i]], code);
+	    sent = 1;
+	}
+    }
+
+    for (i = 0; i < nlists; i++)
+	rxi_SendListDone(peer, lists[i], lens[i], drop[i]);
 }
+#endif /* RX_ENABLE_MMSG */
 
 /* Send a raw abort packet, without any call or connection structures */
 void
@@ -168,6 +168,8 @@
 #define RX_PKTFLAG_CP           0x20
 #endif
 #define RX_PKTFLAG_SENT		0x40
+#define RX_PKTFLAG_FILEDATA	0x80	/* data past wirevec[1] lies in a file
+					 * mapping, not in continuation buffers */
 
 /* The rx part of the header of a packet, in host form */
 struct rx_header {
@@ -251,6 +253,10 @@ struct rx_packet {
     unsigned int niovecs;       /* # of iovecs that potentially have data */
     unsigned int aiovecs;       /* # of allocated iovecs */
     struct iovec wirevec[RX_MAXWVECS + 1];	/* the new form of the packet */
+#ifndef KERNEL
+    struct rxi_filemap *filemap;	/* mapping holding the data past
+					 * wirevec[1], if RX_PKTFLAG_FILEDATA */
+#endif
 
     u_char flags;		/* Flags for local state of this packet */
     u_char unused;		/* was backoff, now just here for alignment */
@@ -31,7 +31,7 @@ struct rx_peer {
 
     /* For garbage collection */
     afs_uint32 idleWhen;	/* When the refcountwent to zero */
-    afs_int32 refCount;	        /* Reference count for this structure (rx_peerHashTable_lock) */
+    afs_int32 refCount;	        /* Reference count for this structure (its rx_peerHashTable_lock shard) */
 
     int rtt;			/* Smoothed round trip time, measured in milliseconds/8 */
     int rtt_dev;		/* Smoothed rtt mean difference, in milliseconds/4 */
@@ -58,11 +58,18 @@ struct rx_peer {
     u_short cwind;		/* congestion window */
     u_short nDgramPackets;	/* number packets per AFS 3.5 jumbogram */
     u_short congestSeq;		/* Changed when a call retransmits */
+    /* State kept between calls by the congestion control algorithm; see
+     * rx_cc.c */
+    u_short ccWmax;		/* cwind when a loss was last seen */
+    u_short ccOrigin;		/* cwind the current epoch is heading for */
+    afs_uint32 ccK;		/* msec from the epoch start to ccOrigin */
+    struct clock ccEpoch;	/* Start of the current epoch of growth */
     afs_uint64 bytesSent;	/* Number of bytes sent to this peer */
     afs_uint64 bytesReceived;	/* Number of bytes received from this peer */
-    struct opr_queue rpcStats;	/* rpc statistic list */
     int lastReachTime;		/* Last time we verified reachability */
     afs_int32 maxPacketSize;    /* Max size we sent that got acked (w/o hdrs) */
+    int noGSO;			/* The kernel won't segment datagrams to here */
+    rx_atomic_t extAcks;	/* Its last ACK said it reads extended ACKs */
 #ifdef AFS_RXERRQ_ENV
     rx_atomic_t neterrs;
 
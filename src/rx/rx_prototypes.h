@@ -35,6 +35,13 @@ extern struct rx_connection *rx_NewConnection(afs_uint32 shost,
 					      struct rx_securityClass
 					      *securityObject,
 					      int serviceSecurityIndex);
+extern struct rx_connection *rx_NewWideConnection(afs_uint32 shost,
+						  u_short sport,
+						  u_short sservice,
+						  struct rx_securityClass
+						  *securityObject,
+						  int serviceSecurityIndex,
+						  int nchannels);
 extern void rx_SetConnDeadTime(struct rx_connection *conn,
 			       int seconds);
 extern void rx_SetConnHardDeadTime(struct rx_connection *conn, int seconds);
@@ -76,6 +83,7 @@ extern void rx_SetArrivalProc(struct rx_call *call,
 						    int index),
 			      void * handle, int arg);
 extern afs_int32 rx_EndCall(struct rx_call *call, afs_int32 rc);
+extern struct xdr_arena *rx_CallArena(struct rx_call *call);
 extern void rx_InterruptCall(struct rx_call *call, afs_int32 error);
 extern void rx_Finalize(void);
 extern void *rxi_Alloc(size_t size);
@@ -149,7 +157,18 @@ extern int rx_RetrievePeerRPCStats(afs_uint32 callerVersion,
 				   afs_uint32 * clock_usec,
 				   size_t * allocSize, afs_uint32 * statCount,
 				   afs_uint32 ** stats);
+extern int rx_RetrieveProcessRPCLatency(afs_uint32 callerVersion,
+					afs_uint32 * myVersion,
+					afs_uint32 * bucketCount,
+					size_t * allocSize,
+					afs_uint32 * statCount,
+					afs_uint32 ** stats);
+extern afs_uint32 rx_RPCLatencyBucketMax(int bucket);
 extern void rx_FreeRPCStats(afs_uint32 * stats, size_t allocSize);
+extern afs_uint64 rx_GetProcessRPCLatency(afs_uint32 rxInterface,
+					  afs_uint32 currentFunc,
+					  int npoints, afs_uint32 *ppm,
+					  afs_uint32 *usecs);
 extern int rx_queryProcessRPCStats(void);
 extern int rx_queryPeerRPCStats(void);
 extern void rx_enableProcessRPCStats(void);
@@ -178,6 +197,9 @@ void rxi_DebugPrint(char *format, ...)
 extern int rx_GetNetworkError(struct rx_connection *conn, int *err_origin,
                               int *err_type, int *err_code, const char **msg);
 
+/* rx_cc.c */
+extern int rx_SetCongestionControl(const char *name);
+
 /* rx_clock.c */
 #if !defined(clock_Init)
 extern void clock_Init(void);
@@ -464,6 +486,7 @@ extern int rxi_ReadProc(struct rx_call *call, char *buf,
 			int nbytes);
 extern int rx_ReadProc(struct rx_call *call, char *buf, int nbytes);
 extern int rx_ReadProc32(struct rx_call *call, afs_int32 * value);
+extern afs_int32 *rx_ReadInline(struct rx_call *call, int nbytes);
 extern int rxi_FillReadVec(struct rx_call *call, afs_uint32 serial);
 extern int rxi_ReadvProc(struct rx_call *call, struct iovec *iov, int *nio,
 			 int maxio, int nbytes);
@@ -474,12 +497,18 @@ extern int rxi_WriteProc(struct rx_call *call, char *buf,
 extern int rx_WriteProc(struct rx_call *call, char *buf, int nbytes);
 extern int rx_WriteProc32(struct rx_call *call,
 			  afs_int32 * value);
+extern afs_int32 *rx_WriteInline(struct rx_call *call, int nbytes);
 extern int rx_WritevAlloc(struct rx_call *call, struct iovec *iov, int *nio,
 			  int maxio, int nbytes);
 extern int rxi_WritevProc(struct rx_call *call, struct iovec *iov, int nio,
 			  int nbytes);
 extern int rx_WritevProc(struct rx_call *call, struct iovec *iov, int nio,
 			 int nbytes);
+#if !defined(KERNEL) && !defined(AFS_NT40_ENV)
+extern int rx_WritevFromFd(struct rx_call *call, int fd, afs_foff_t offset,
+			   int nbytes);
+extern void rx_WaitForFileData(int fd);
+#endif
 extern void rxi_FlushWrite(struct rx_call *call);
 extern void rxi_FlushWriteLocked(struct rx_call *call);
 extern void rx_FlushWrite(struct rx_call *call);
@@ -492,6 +521,12 @@ extern void rx_FreeStatistics(struct rx_statistics **);
 
 /* rx_trace.c */
 
+/* rx_tracering.c */
+#ifndef KERNEL
+extern void rx_TraceEnable(int on);
+extern int rx_TraceEnabled(void);
+extern int rx_TraceDump(const char *path);
+#endif
 
 /* rx_user.c */
 #ifdef AFS_PTHREAD_ENV
@@ -499,6 +534,7 @@ extern afs_kmutex_t rx_if_init_mutex;
 extern afs_kmutex_t rx_if_mutex;
 #endif
 extern osi_socket rxi_GetUDPSocket(u_short port);
+extern osi_socket rxi_SharedSocket(osi_socket socket);
 extern void rxi_InitPeerParams(struct rx_peer *pp);
 extern int rxi_HandleSocketError(int socket);
 
@@ -517,6 +553,7 @@ extern void osi_Panic(char *fmt, ...) AFS_NORETURN;
 extern void rx_GetIFInfo(void);
 extern void rx_SetNoJumbo(void);
 extern int rx_SetMaxMTU(int mtu);
+extern int rx_SetNumListeners(int n);
 
 /* rx_xmit_nt.c */
 
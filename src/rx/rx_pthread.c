@@ -16,6 +16,9 @@
  */
 
 #include <afsconfig.h>
+#if defined(HAVE_RECVMMSG) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE	/* for recvmmsg, sendmmsg and struct mmsghdr */
+#endif
 #include <afs/param.h>
 
 #include <roken.h>
@@ -30,8 +33,10 @@
 #include "rx_pthread.h"
 #include "rx_clock.h"
 #include "rx_atomic.h"
+#include "rx_packet.h"
 #include "rx_internal.h"
 #include "rx_pthread.h"
+#include "xdr.h"
 #ifdef AFS_NT40_ENV
 #include "rx_xmit_nt.h"
 #endif
@@ -199,6 +204,192 @@ rxi_ReScheduleEvents(void)
 }
 
 
+#ifdef RX_ENABLE_MMSG
+/* Loop to listen on a socket, reading up to RX_MAXMMSG datagrams with each
+ * system call. Return setting *newcallp if this thread should become a
+ * server thread.  */
+static void
+rxi_ListenerProcMulti(osi_socket sock, int *tnop, struct rx_call **newcallp)
+{
+    struct rx_packet *list[RX_MAXMMSG];
+    afs_uint32 hosts[RX_MAXMMSG];
+    u_short ports[RX_MAXMMSG];
+    int valid[RX_MAXMMSG];
+    int i, n, npackets, nread;
+
+    memset(list, 0, sizeof(list));
+    nread = 0;
+    for (;;) {
+        /* See if a check for additional packets was issued */
+        rx_CheckPackets();
+
+	/*
+	 * Reuse the packets filled by the last read, and top up the list
+	 * with new ones. If packets are short, make do with what we have.
+	 */
+	for (i = 0; i < nread; i++) {
+	    if (list[i])
+		rxi_RestoreDataBufs(list[i]);
+	}
+	for (npackets = 0; npackets < RX_MAXMMSG; npackets++) {
+	    if (list[npackets])
+		continue;
+	    list[npackets] = rxi_AllocPacket(RX_PACKET_CLASS_RECEIVE);
+	    if (!list[npackets])
+		break;
+	}
+	if (npackets == 0) {
+	    /* Could this happen with multiple socket listeners? */
+	    osi_Panic("rxi_Listener: no packets!");	/* Shouldn't happen */
+	}
+
+	nread = rxi_ReadPackets(sock, list, npackets, hosts, ports, valid);
+	if (nread > 0)
+	    clock_NewTime();
+
+	for (i = 0; i < nread; i++) {
+	    if (!valid[i])
+		continue;
+	    list[i] = rxi_ReceivePacket(list[i], sock, hosts[i], ports[i],
+					tnop, newcallp);
+	    if (newcallp && *newcallp) {
+		/* This thread is about to become a server thread, so deal
+		 * with the rest of the batch without handing over calls. */
+		for (n = i + 1; n < nread; n++) {
+		    if (valid[n])
+			list[n] = rxi_ReceivePacket(list[n], sock, hosts[n],
+						    ports[n], NULL, NULL);
+		}
+		for (n = 0; n < RX_MAXMMSG; n++) {
+		    if (list[n])
+			rxi_FreePacket(list[n]);
+		}
+		return;
+	    }
+	}
+    }
+    /* NOTREACHED */
+}
+#endif /* RX_ENABLE_MMSG */
+
+#ifdef RX_ENABLE_UDP_OFFLOAD
+/* Loop to listen on a socket from which the kernel may hand us several
+ * coalesced datagrams at a time. The first datagram of each read lands in
+ * a packet, as it would without coalescing; the rest spill over into a
+ * buffer kept by this thread, and are copied out into packets of their
+ * own. Return setting *newcallp if this thread should become a server
+ * thread.  */
+static void
+rxi_ListenerProcGRO(osi_socket sock, int *tnop, struct rx_call **newcallp)
+{
+    struct rx_ts_info_t *rx_ts_info;
+    struct rx_packet *list[RX_MAXGROMSG];
+    char *bufs[RX_MAXGROMSG], *rest[RX_MAXGROMSG];
+    int valid[RX_MAXGROMSG], restlen[RX_MAXGROMSG], segsizes[RX_MAXGROMSG];
+    afs_uint32 hosts[RX_MAXGROMSG];
+    u_short ports[RX_MAXGROMSG];
+    struct rx_packet *p = NULL;
+    int i, n, npackets, nread, offset, length;
+    int handedOver = 0;
+
+    /* Each read may fill up a packet before spilling into the buffer, so
+     * leave room in front of it to gather what follows the first datagram
+     * back together */
+    RX_TS_INFO_GET(rx_ts_info);
+    if (rx_ts_info->gro_buf == NULL) {
+	rx_ts_info->gro_headroom = rx_maxJumboRecvSize + RX_EXTRABUFFERSIZE;
+	rx_ts_info->gro_buf = malloc(RX_MAXGROMSG *
+				     (rx_ts_info->gro_headroom
+				      + RX_MAXGROSIZE));
+	if (rx_ts_info->gro_buf == NULL) {
+	    rxi_ListenerProcMulti(sock, tnop, newcallp);
+	    return;
+	}
+    }
+    for (i = 0; i < RX_MAXGROMSG; i++)
+	bufs[i] = rx_ts_info->gro_buf + rx_ts_info->gro_headroom
+	    + i * (rx_ts_info->gro_headroom + RX_MAXGROSIZE);
+
+    memset(list, 0, sizeof(list));
+    nread = 0;
+    for (;;) {
+        /* See if a check for additional packets was issued */
+        rx_CheckPackets();
+
+	/* As in rxi_ListenerProcMulti */
+	for (i = 0; i < nread; i++) {
+	    if (list[i])
+		rxi_RestoreDataBufs(list[i]);
+	}
+	for (npackets = 0; npackets < RX_MAXGROMSG; npackets++) {
+	    if (list[npackets])
+		continue;
+	    list[npackets] = rxi_AllocPacket(RX_PACKET_CLASS_RECEIVE);
+	    if (!list[npackets])
+		break;
+	}
+	if (npackets == 0)
+	    osi_Panic("rxi_Listener: no packets!");
+
+	nread = rxi_ReadCoalesced(sock, list, npackets, bufs,
+				  rx_ts_info->gro_headroom, valid, rest,
+				  restlen, segsizes, hosts, ports);
+	if (nread > 0)
+	    clock_NewTime();
+
+	for (i = 0; i < nread; i++) {
+	    /* Once this thread is to become a server thread, deal with the
+	     * rest of what was read without handing over calls. */
+	    if (valid[i]) {
+		if (handedOver)
+		    list[i] = rxi_ReceivePacket(list[i], sock, hosts[i],
+						ports[i], NULL, NULL);
+		else
+		    list[i] = rxi_ReceivePacket(list[i], sock, hosts[i],
+						ports[i], tnop, newcallp);
+		if (newcallp && *newcallp)
+		    handedOver = 1;
+	    }
+
+	    for (offset = 0; offset < restlen[i]; offset += length) {
+		length = MIN(segsizes[i], restlen[i] - offset);
+
+		/* Grab a new packet only if necessary */
+		if (p) {
+		    rxi_RestoreDataBufs(p);
+		} else if (!(p = rxi_AllocPacket(RX_PACKET_CLASS_RECEIVE))) {
+		    osi_Panic("rxi_Listener: no packets!");
+		}
+
+		if (!rxi_CopyReadPacket(p, rest[i] + offset, length,
+					&hosts[i], &ports[i]))
+		    continue;
+
+		if (handedOver)
+		    p = rxi_ReceivePacket(p, sock, hosts[i], ports[i], NULL,
+					  NULL);
+		else
+		    p = rxi_ReceivePacket(p, sock, hosts[i], ports[i], tnop,
+					  newcallp);
+		if (newcallp && *newcallp)
+		    handedOver = 1;
+	    }
+	}
+
+	if (handedOver) {
+	    if (p)
+		rxi_FreePacket(p);
+	    for (n = 0; n < RX_MAXGROMSG; n++) {
+		if (list[n])
+		    rxi_FreePacket(list[n]);
+	    }
+	    return;
+	}
+    }
+    /* NOTREACHED */
+}
+#endif /* RX_ENABLE_UDP_OFFLOAD */
+
 /* Loop to listen on a socket. Return setting *newcallp if this
  * thread should become a server thread.  */
 static void
@@ -214,6 +405,19 @@ rxi_ListenerProc(osi_socket sock, int *tnop, struct rx_call **newcallp)
     }
     MUTEX_EXIT(&listener_mutex);
 
+#ifdef RX_ENABLE_UDP_OFFLOAD
+    if (rxi_SocketOffload(sock) & RXI_SOCKET_GRO) {
+	rxi_ListenerProcGRO(sock, tnop, newcallp);
+	return;
+    }
+#endif
+#ifdef RX_ENABLE_MMSG
+    if (rx_enable_batch_io) {
+	rxi_ListenerProcMulti(sock, tnop, newcallp);
+	return;
+    }
+#endif
+
     for (;;) {
         /* See if a check for additional packets was issued */
         rx_CheckPackets();
@@ -405,6 +609,81 @@ rxi_Recvmsg(osi_socket socket, struct msghdr *msg_p, int flags)
     return ret;
 }
 
+#ifdef RX_ENABLE_MMSG
+/*
+ * Recvmmsg. Blocks until at least one message is available, and returns
+ * the number of messages received, or -1 on error. The length of each
+ * message is stored in nbytes.
+ */
+int
+rxi_Recvmmsg(osi_socket socket, struct msghdr *msgs, int *nbytes, int nmsgs)
+{
+    struct mmsghdr mmsgs[RX_MAXMMSG];
+    int i, ret;
+
+    if (nmsgs > RX_MAXMMSG)
+	nmsgs = RX_MAXMMSG;
+
+    for (i = 0; i < nmsgs; i++) {
+	mmsgs[i].msg_hdr = msgs[i];
+	mmsgs[i].msg_len = 0;
+    }
+    ret = recvmmsg(socket, mmsgs, nmsgs, MSG_WAITFORONE, NULL);
+
+#ifdef AFS_RXERRQ_ENV
+    if (ret < 0) {
+	while (rxi_HandleSocketError(socket) > 0)
+	    ;
+    }
+#endif
+
+    for (i = 0; i < ret; i++) {
+	msgs[i].msg_namelen = mmsgs[i].msg_hdr.msg_namelen;
+	msgs[i].msg_controllen = mmsgs[i].msg_hdr.msg_controllen;
+	msgs[i].msg_flags = mmsgs[i].msg_hdr.msg_flags;
+	nbytes[i] = mmsgs[i].msg_len;
+    }
+
+    return ret;
+}
+
+/*
+ * Sendmmsg. Returns the number of messages sent, or 0 if the first message
+ * could not be sent, in which case the error which rxi_Sendmsg returned for
+ * it is stored in *errorp.
+ */
+int
+rxi_Sendmmsg(osi_socket socket, struct msghdr *msgs, int nmsgs, int *errorp)
+{
+    struct mmsghdr mmsgs[RX_MAXMMSG];
+    int i, ret;
+
+    if (nmsgs > RX_MAXMMSG)
+	nmsgs = RX_MAXMMSG;
+
+#ifdef RX_ENABLE_IMPAIR
+    if (rxi_impairEnabled) {
+	*errorp = rxi_ImpairSend(socket, msgs[0].msg_name, msgs[0].msg_iov,
+				 msgs[0].msg_iovlen);
+	return (*errorp == 0) ? 1 : 0;
+    }
+#endif
+
+    for (i = 0; i < nmsgs; i++) {
+	mmsgs[i].msg_hdr = msgs[i];
+	mmsgs[i].msg_len = 0;
+    }
+    ret = sendmmsg(socket, mmsgs, nmsgs, 0);
+    if (ret > 0)
+	return ret;
+
+    /* Nothing was sent. Send the first message on its own, so that the
+     * error is dealt with exactly as it would have been without batching. */
+    *errorp = rxi_Sendmsg(socket, &msgs[0], 0);
+    return (*errorp == 0) ? 1 : 0;
+}
+#endif /* RX_ENABLE_MMSG */
+
 /*
  * Sendmsg.
  */
@@ -459,6 +738,23 @@ struct rx_ts_info_t * rx_ts_info_init(void) {
     return rx_ts_info;
 }
 
+/* Free what a thread has kept for itself when it exits. The structure
+ * itself is not freed, since the packet and statistics code may still
+ * hold pointers into it. */
+void
+rx_ts_info_destroy(void *arg)
+{
+    struct rx_ts_info_t *rx_ts_info = arg;
+
+    free(rx_ts_info->gro_buf);
+    rx_ts_info->gro_buf = NULL;
+    if (rx_ts_info->arena_spare != NULL) {
+	osi_free((char *)rx_ts_info->arena_spare,
+		 rx_ts_info->arena_spare->size);
+	rx_ts_info->arena_spare = NULL;
+    }
+}
+
 int
 rx_GetThreadNum(void) {
     return (intptr_t)pthread_getspecific(rx_thread_id_key);
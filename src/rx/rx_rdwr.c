@@ -65,6 +65,10 @@
 #include "rx_call.h"
 #include "rx_packet.h"
 
+#ifdef RX_ENABLE_FILEMAP
+# include <sys/mman.h>
+#endif
+
 #ifdef RX_LOCKS_DB
 /* rxdb_fileID is used to identify the lock location, along with line#. */
 static int rxdb_fileID = RXDB_FILE_RX_RDWR;
@@ -382,6 +386,28 @@ rx_ReadProc32(struct rx_call *call, afs_int32 * value)
     return bytes;
 }
 
+/* Return a pointer to the next nbytes of data for the caller to decode in
+ * place, and consume them, if they are all in the current iovec and are
+ * aligned to be read as 32 bit words. Otherwise return NULL, in which case
+ * the caller must fall back to rx_Read. The data remains valid until the
+ * next read on the call. */
+afs_int32 *
+rx_ReadInline(struct rx_call *call, int nbytes)
+{
+    afs_int32 *buf;
+
+    if (call->error || nbytes < 0 || !opr_queue_IsEmpty(&call->app.iovq)
+	|| call->app.curlen < nbytes || call->app.nLeft < nbytes
+	|| ((size_t)call->app.curpos & (sizeof(afs_int32) - 1)))
+	return NULL;
+
+    buf = (afs_int32 *)call->app.curpos;
+    call->app.curpos += nbytes;
+    call->app.curlen -= nbytes;
+    call->app.nLeft -= nbytes;
+    return buf;
+}
+
 /* rxi_FillReadVec
  *
  * Uses packets in the receive queue to fill in as much of the
@@ -861,6 +887,28 @@ rx_WriteProc32(struct rx_call *call, afs_int32 * value)
     return bytes;
 }
 
+/* Return a pointer to space for the next nbytes of data, for the caller to
+ * encode into in place, if there is that much room in the current iovec and
+ * it is aligned to be written as 32 bit words. Otherwise return NULL, in
+ * which case the caller must fall back to rx_Write. The caller must fill
+ * the space before the next write on the call. */
+afs_int32 *
+rx_WriteInline(struct rx_call *call, int nbytes)
+{
+    afs_int32 *buf;
+
+    if (call->error || nbytes < 0 || !opr_queue_IsEmpty(&call->app.iovq)
+	|| call->app.curlen < nbytes || call->app.nFree < nbytes
+	|| ((size_t)call->app.curpos & (sizeof(afs_int32) - 1)))
+	return NULL;
+
+    buf = (afs_int32 *)call->app.curpos;
+    call->app.curpos += nbytes;
+    call->app.curlen -= nbytes;
+    call->app.nFree -= nbytes;
+    return buf;
+}
+
 /* rxi_WritevAlloc -- internal version.
  *
  * Fill in an iovec to point to data in packet buffers. The application
@@ -1220,6 +1268,400 @@ rx_WritevProc(struct rx_call *call, struct iovec *iov, int nio, int nbytes)
     return bytes;
 }
 
+#ifdef RX_ENABLE_FILEMAP
+
+# ifdef O_LARGEFILE
+#  define rxi_pread	pread64
+#  define rxi_mmap	mmap64
+#  define rxi_fstat	fstat64
+#  define rxi_stat	stat64
+# else
+#  define rxi_pread	pread
+#  define rxi_mmap	mmap
+#  define rxi_fstat	fstat
+#  define rxi_stat	stat
+# endif
+
+/* Writes shorter than RX_FILEMAP_MIN are copied, as mapping the file would
+ * cost more than the copy. Longer ones are mapped whole. */
+#define RX_FILEMAP_MIN		(64 * 1024)
+
+/* Security classes may rewrite the start of a packet's data in place
+ * (rxkad's auth level encrypts its first eight bytes), so this much of each
+ * packet is always copied into the packet's own buffer. */
+#define RX_FILEMAP_COPY		8
+
+/* How many packets to build before handing them to the transmit queue */
+#define RX_FILEMAP_BATCH	16
+
+/* A read-only mapping of the range of a file being sent by
+ * rx_WritevFromFd. Each packet whose data lies in it holds a reference, so
+ * it stays mapped until the last of them has been acknowledged and freed.
+ * Mappings are kept on rxi_fileMaps until then, so that rx_WaitForFileData
+ * can tell whether any of a file's data is still to be sent. */
+struct rxi_filemap {
+    struct opr_queue entry;	/* on rxi_fileMaps */
+    rx_atomic_t refCount;
+    char *base;
+    size_t len;
+    dev_t dev;			/* the file mapped */
+    ino_t ino;
+};
+
+afs_kmutex_t rxi_fileMapMutex;
+afs_kcondvar_t rxi_fileMapCond;
+static struct opr_queue rxi_fileMaps = { &rxi_fileMaps, &rxi_fileMaps };
+
+/* Map nbytes of the file open on fd, starting at offset, and return the
+ * mapping with one reference held, or NULL if the file can't be mapped.
+ * *datap is set to where the data starts. */
+static struct rxi_filemap *
+rxi_MapFile(int fd, struct rxi_stat *st, afs_foff_t offset, int nbytes,
+	    char **datap)
+{
+    long pagesize = sysconf(_SC_PAGESIZE);
+    struct rxi_filemap *map;
+    afs_foff_t start;
+    size_t len;
+    char *base;
+
+    start = offset & ~(afs_foff_t)(pagesize - 1);
+    len = offset - start + nbytes;
+    base = rxi_mmap(NULL, len, PROT_READ, MAP_SHARED, fd, start);
+    if (base == MAP_FAILED)
+	return NULL;
+    map = rxi_Alloc(sizeof(*map));
+    if (map == NULL) {
+	munmap(base, len);
+	return NULL;
+    }
+    rx_atomic_set(&map->refCount, 1);
+    map->base = base;
+    map->len = len;
+    map->dev = st->st_dev;
+    map->ino = st->st_ino;
+
+    MUTEX_ENTER(&rxi_fileMapMutex);
+    opr_queue_Append(&rxi_fileMaps, &map->entry);
+    MUTEX_EXIT(&rxi_fileMapMutex);
+
+    *datap = base + (offset - start);
+    return map;
+}
+
+/* Drop a reference to a file mapping, removing the mapping with the last
+ * one. Called by rx_packet.c as each packet holding one is freed. */
+void
+rxi_ReleaseFileMap(struct rxi_filemap *map)
+{
+    if (rx_atomic_dec_and_read(&map->refCount) > 0)
+	return;
+
+    MUTEX_ENTER(&rxi_fileMapMutex);
+    opr_queue_Remove(&map->entry);
+#ifdef RX_ENABLE_LOCKS
+    CV_BROADCAST(&rxi_fileMapCond);
+#else
+    osi_rxWakeup(&rxi_fileMaps);
+#endif
+    MUTEX_EXIT(&rxi_fileMapMutex);
+
+    munmap(map->base, map->len);
+    rxi_Free(map, sizeof(*map));
+}
+
+/* rxi_WriteFromFd -- copy data from a file into packet buffers, just as
+ * rx_WritevAlloc, a read, and rx_Writev would.
+ *
+ * LOCKS USED -- called at netpri.
+ */
+static int
+rxi_WriteFromFd(struct rx_call *call, int fd, afs_foff_t offset, int nbytes)
+{
+    struct iovec iov[RX_MAXIOVECS];
+    int requestCount = nbytes;
+    int nio, i, n;
+
+    /* rxi_WritevProc expects a current packet, as there always is once
+     * something has been written; rxi_WriteMapped may have queued it. A
+     * write of no bytes switches mode and allocates one. */
+    if (nbytes > 0 && !call->app.currentPacket)
+	rxi_WriteProc(call, NULL, 0);
+
+    while (nbytes > 0) {
+	n = rxi_WritevAlloc(call, iov, &nio, RX_MAXIOVECS, nbytes);
+	if (n <= 0)
+	    break;
+	for (i = 0; i < nio; i++) {
+	    if (rxi_pread(fd, iov[i].iov_base, iov[i].iov_len, offset)
+		!= (ssize_t)iov[i].iov_len)
+		return requestCount - nbytes;
+	    offset += iov[i].iov_len;
+	}
+	if (rxi_WritevProc(call, iov, nio, n) != n)
+	    return 0;
+	nbytes -= n;
+    }
+    return requestCount - nbytes;
+}
+
+/* Move packets built by rxi_WriteMapped onto the transmit queue, and wait
+ * for room for more. Called with the call locked. */
+static void
+rxi_QueueMapped(struct rx_call *call, struct opr_queue *q)
+{
+    opr_queue_SpliceAppend(&call->tq, q);
+
+    /* If the call is in recovery, let it exhaust its current retransmit
+     * queue before forcing it to send new packets
+     */
+    if (!(call->flags & RX_CALL_FAST_RECOVER)) {
+	rxi_Start(call, 0);
+    }
+
+    while (!call->error && call->tnext + 1 > call->tfirst + (2 * call->twind)) {
+	clock_NewTime();
+	call->startWait = clock_Sec();
+#ifdef	RX_ENABLE_LOCKS
+	CV_WAIT(&call->cv_twind, &call->lock);
+#else
+	call->flags |= RX_CALL_WAIT_WINDOW_ALLOC;
+	osi_rxSleep(&call->twind);
+#endif
+	call->startWait = 0;
+    }
+}
+
+/* rxi_WriteMapped -- send whole packets of data which lies in a mapping
+ * of a file.
+ *
+ * Each packet holds the first RX_FILEMAP_COPY bytes of its data itself,
+ * and points into the mapping for the rest, taking a reference to the
+ * mapping which is dropped when the packet is freed. Returns the number of
+ * bytes sent, which is short of nbytes by less than a packet unless the
+ * call fails.
+ *
+ * LOCKS USED -- called at netpri.
+ */
+static int
+rxi_WriteMapped(struct rx_call *call, struct rxi_filemap *map, char *data,
+		int nbytes)
+{
+    struct rx_connection *conn = call->conn;
+    struct rx_packet *cp;
+    struct opr_queue tmpq;
+    int requestCount = nbytes;
+    int npackets = 0;
+    int mud;
+
+    /* Free any packets from the last call to ReadvProc/WritevProc */
+    if (!opr_queue_IsEmpty(&call->app.iovq)) {
+#ifdef RXDEBUG_PACKET
+        call->iovqc -=
+#endif /* RXDEBUG_PACKET */
+            rxi_FreePackets(0, &call->app.iovq);
+    }
+
+    if (call->app.mode != RX_MODE_SENDING) {
+	if ((conn->type == RX_SERVER_CONNECTION)
+	    && (call->app.mode == RX_MODE_RECEIVING)) {
+	    call->app.mode = RX_MODE_SENDING;
+	    if (call->app.currentPacket) {
+#ifdef RX_TRACK_PACKETS
+		call->app.currentPacket->flags &= ~RX_PKTFLAG_CP;
+#endif
+		rxi_FreePacket(call->app.currentPacket);
+		call->app.currentPacket = NULL;
+		call->app.nLeft = 0;
+		call->app.nFree = 0;
+	    }
+	} else {
+	    return 0;
+	}
+    }
+
+    /* Our packets must follow any data already written */
+    if (call->app.currentPacket && call->app.nFree > 0)
+	return 0;
+
+    opr_queue_Init(&tmpq);
+    MUTEX_ENTER(&call->lock);
+    if (call->error)
+	goto out;
+    clock_NewTime();
+    rxi_WaitforTQBusy(call);
+
+    if (call->app.currentPacket) {
+#ifdef RX_TRACK_PACKETS
+	call->app.currentPacket->flags &= ~RX_PKTFLAG_CP;
+	call->app.currentPacket->flags |= RX_PKTFLAG_TQ;
+#endif
+	call->app.bytesSent += call->app.currentPacket->length;
+	rxi_PrepareSendPacket(call, call->app.currentPacket, 0);
+	/* PrepareSendPacket drops the call lock */
+	rxi_WaitforTQBusy(call);
+	opr_queue_Append(&tmpq, &call->app.currentPacket->entry);
+	call->app.currentPacket = NULL;
+    }
+
+    while (!call->error) {
+	mud = rx_MaxUserDataSize(call);
+	if (nbytes < mud || mud <= RX_FILEMAP_COPY)
+	    break;
+	cp = rxi_AllocSendPacket(call, 0);
+	if (cp == NULL)
+	    break;
+
+	memcpy((char *)cp->wirevec[1].iov_base + conn->securityHeaderSize,
+	       data, RX_FILEMAP_COPY);
+	cp->wirevec[1].iov_len = conn->securityHeaderSize + RX_FILEMAP_COPY;
+	cp->wirevec[2].iov_base = data + RX_FILEMAP_COPY;
+	cp->wirevec[2].iov_len = mud - RX_FILEMAP_COPY;
+	cp->niovecs = 3;
+	cp->length = mud;
+	cp->flags |= RX_PKTFLAG_FILEDATA;
+	cp->filemap = map;
+	rx_atomic_inc(&map->refCount);
+	data += mud;
+	nbytes -= mud;
+
+	call->app.bytesSent += cp->length;
+	rxi_PrepareSendPacket(call, cp, 0);
+	/* PrepareSendPacket drops the call lock */
+	rxi_WaitforTQBusy(call);
+#ifdef RX_TRACK_PACKETS
+	cp->flags |= RX_PKTFLAG_TQ;
+#endif
+	opr_queue_Append(&tmpq, &cp->entry);
+
+	if (++npackets == RX_FILEMAP_BATCH) {
+	    rxi_QueueMapped(call, &tmpq);
+	    npackets = 0;
+	}
+    }
+    rxi_WaitforTQBusy(call);
+    rxi_QueueMapped(call, &tmpq);
+
+  out:
+    if (call->error) {
+	call->app.mode = RX_MODE_ERROR;
+	MUTEX_EXIT(&call->lock);
+	return 0;
+    }
+    MUTEX_EXIT(&call->lock);
+
+    return requestCount - nbytes;
+}
+
+/*!
+ * Send data from a file on a call
+ *
+ * Writes nbytes of the file open on fd, starting at offset, to the call.
+ * Where it can, Rx sends the data straight from a read-only mapping of the
+ * file, rather than reading it into packet buffers first. The call's
+ * security class must leave all but the first few bytes of each packet's
+ * data as it finds them: rxnull, and rxkad at the clear and auth levels do.
+ *
+ * The range to be sent must lie within the file. Packets go on referring
+ * to the file after rx_WritevFromFd has returned, until they have been
+ * acknowledged, so anyone about to change or truncate it must first call
+ * rx_WaitForFileData.
+ *
+ * @param[in] call	the call to write to
+ * @param[in] fd	the file to send data from
+ * @param[in] offset	where in the file the data starts
+ * @param[in] nbytes	how many bytes to send
+ *
+ * @return the number of bytes written, which is less than nbytes if the
+ * 	call has failed or the file could not be read.
+ */
+int
+rx_WritevFromFd(struct rx_call *call, int fd, afs_foff_t offset, int nbytes)
+{
+    int requestCount = nbytes;
+    struct rxi_filemap *map;
+    struct rxi_stat st;
+    char *data;
+    int n;
+    SPLVAR;
+
+    NETPRI;
+
+    /* Fill the packet being written first, so that packets stay full */
+    if (call->app.mode == RX_MODE_SENDING && call->app.currentPacket
+	&& call->app.nFree > 0) {
+	n = MIN(call->app.nFree, nbytes);
+	if (rxi_WriteFromFd(call, fd, offset, n) != n)
+	    goto out;
+	offset += n;
+	nbytes -= n;
+    }
+
+    /* Touching a mapping beyond the end of the file would fault, so the
+     * copy below is left to find a file shorter than we were told */
+    if (nbytes >= RX_FILEMAP_MIN && rxi_fstat(fd, &st) == 0
+	&& offset + nbytes <= st.st_size
+	&& (map = rxi_MapFile(fd, &st, offset, nbytes, &data)) != NULL) {
+	n = rxi_WriteMapped(call, map, data, nbytes);
+	rxi_ReleaseFileMap(map);
+	offset += n;
+	nbytes -= n;
+    }
+
+    /* Copy whatever is left: less than a packet, unless the file couldn't
+     * be mapped. A short read stops the copy short of nbytes. */
+    if (nbytes > 0)
+	nbytes -= rxi_WriteFromFd(call, fd, offset, nbytes);
+
+  out:
+    USERPRI;
+    return requestCount - nbytes;
+}
+
+/*!
+ * Wait until no packet refers to data sent from a file
+ *
+ * Packets built by rx_WritevFromFd refer to the file they were sent from
+ * until they have been acknowledged, or their call has failed. Their
+ * retransmissions would carry any change made to the file meanwhile, and
+ * would fault if it were truncated, so this must be called before it is
+ * changed.
+ *
+ * @param[in] fd	the file about to be changed
+ */
+void
+rx_WaitForFileData(int fd)
+{
+    struct rxi_filemap *map;
+    struct opr_queue *cursor;
+    struct rxi_stat st;
+    int busy;
+
+    if (rxi_fstat(fd, &st) < 0)
+	return;
+
+    MUTEX_ENTER(&rxi_fileMapMutex);
+    do {
+	busy = 0;
+	for (opr_queue_Scan(&rxi_fileMaps, cursor)) {
+	    map = opr_queue_Entry(cursor, struct rxi_filemap, entry);
+	    if (map->dev == st.st_dev && map->ino == st.st_ino) {
+		busy = 1;
+		break;
+	    }
+	}
+	if (busy) {
+#ifdef RX_ENABLE_LOCKS
+	    CV_WAIT(&rxi_fileMapCond, &rxi_fileMapMutex);
+#else
+	    osi_rxSleep(&rxi_fileMaps);
+#endif
+	}
+    } while (busy);
+    MUTEX_EXIT(&rxi_fileMapMutex);
+}
+#endif /* RX_ENABLE_FILEMAP */
+
 /* Flush any buffered data to the stream, switch to read mode
  * (clients) or to EOF mode (servers). If 'locked' is nonzero, call->lock must
  * be already held.
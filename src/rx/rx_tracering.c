@@ -0,0 +1,209 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * Rings of binary call event records, one per thread.  See
+ * rx_tracering.h for the format of the records and of a dump.
+ *
+ * A ring is only ever written by the thread it belongs to, which fills in
+ * the next record and then advances the ring's head, so recording takes
+ * no lock.  The rings are found for dumping through a list which is only
+ * locked as a thread adds its ring, the first time it records something.
+ * Rings are never freed, since the thread which owns one may be recording
+ * into it at any time.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+#include <afs/opr.h>
+
+#include "rx.h"
+#include "rx_atomic.h"
+#include "rx_clock.h"
+#include "rx_globals.h"
+#include "rx_internal.h"
+#include "rx_tracering.h"
+
+struct rx_traceRing {
+    struct opr_queue entry;
+    rx_atomic_t head;		/* records ever written; the next goes at
+				 * head % RX_TRACE_RINGSIZE */
+    u_short thread;
+    struct rx_traceRecord records[RX_TRACE_RINGSIZE];
+};
+
+/* Protects rxi_traceRings and rxi_traceThreads */
+afs_kmutex_t rxi_traceMutex;
+static struct opr_queue rxi_traceRings = { &rxi_traceRings, &rxi_traceRings };
+static u_short rxi_traceThreads;
+
+/*
+ * Find the calling thread's ring, making it if need be.
+ */
+static struct rx_traceRing *
+rxi_GetTraceRing(void)
+{
+#ifdef RX_ENABLE_TRACE_RINGS
+    struct rx_ts_info_t *rx_ts_info;
+    struct rx_traceRing **ringp;
+
+    RX_TS_INFO_GET(rx_ts_info);
+    ringp = &rx_ts_info->trace_ring;
+#else
+    static struct rx_traceRing *ring = NULL;
+    struct rx_traceRing **ringp = &ring;
+#endif
+
+    if (*ringp == NULL) {
+	struct rx_traceRing *newRing;
+
+	newRing = calloc(1, sizeof(*newRing));
+	if (newRing == NULL)
+	    return NULL;
+	MUTEX_ENTER(&rxi_traceMutex);
+	newRing->thread = rxi_traceThreads++;
+	opr_queue_Append(&rxi_traceRings, &newRing->entry);
+	MUTEX_EXIT(&rxi_traceMutex);
+	*ringp = newRing;
+    }
+    return *ringp;
+}
+
+/*
+ * Record an event in the calling thread's ring.  Callers go through the
+ * RXI_TRACE macros, which only get here while tracing is enabled.
+ */
+void
+rxi_TraceEvent(int event, afs_uint32 cid, afs_uint32 callNumber,
+	       afs_uint32 seq, afs_uint32 serial, afs_uint32 value, int type)
+{
+    struct rx_traceRing *ring;
+    struct rx_traceRecord *rec;
+    struct clock now;
+
+    ring = rxi_GetTraceRing();
+    if (ring == NULL)
+	return;
+
+    clock_GetTime(&now);
+    rec = &ring->records[rx_atomic_read(&ring->head)
+			 & (RX_TRACE_RINGSIZE - 1)];
+    rec->sec = now.sec;
+    rec->usec = now.usec;
+    rec->cid = cid;
+    rec->callNumber = callNumber;
+    rec->seq = seq;
+    rec->serial = serial;
+    rec->value = value;
+    rec->event = event;
+    rec->type = type;
+    rec->thread = ring->thread;
+    /* The record must be complete before the head moves past it */
+    rx_atomic_inc(&ring->head);
+}
+
+/*
+ * Turn the recording of call events on or off.  Turning it off leaves
+ * what has been recorded in place to be dumped.
+ */
+void
+rx_TraceEnable(int on)
+{
+    rx_traceEnabled = on ? 1 : 0;
+}
+
+int
+rx_TraceEnabled(void)
+{
+    return rx_traceEnabled;
+}
+
+/*
+ * Copy out the records in a ring, oldest first, to recs, which has room
+ * for RX_TRACE_RINGSIZE.  The ring's thread may be recording as we copy;
+ * any record it could have begun to overwrite is left out.
+ */
+static int
+rxi_CopyTraceRing(struct rx_traceRing *ring, struct rx_traceRecord *recs)
+{
+    afs_uint32 first, last, i, n;
+
+    last = rx_atomic_read(&ring->head);
+    first = last > RX_TRACE_RINGSIZE ? last - RX_TRACE_RINGSIZE : 0;
+    for (i = first; i < last; i++)
+	recs[i - first] = ring->records[i & (RX_TRACE_RINGSIZE - 1)];
+
+    /* Anything at or below the slot now being written may be torn */
+    n = rx_atomic_read(&ring->head);
+    if (n + 1 > first + RX_TRACE_RINGSIZE) {
+	i = n + 1 - RX_TRACE_RINGSIZE - first;
+	if (i >= last - first)
+	    return 0;
+	memmove(recs, recs + i, (last - first - i) * sizeof(*recs));
+	return last - first - i;
+    }
+    return last - first;
+}
+
+/*
+ * Write everything in the rings to the file at path.  Returns 0, or an
+ * errno value.
+ */
+int
+rx_TraceDump(const char *path)
+{
+    struct rx_traceFileHeader header;
+    struct rx_traceRecord *recs;
+    struct opr_queue *cursor;
+    FILE *fp;
+    int n, code = 0;
+
+    recs = malloc(RX_TRACE_RINGSIZE * sizeof(*recs));
+    if (recs == NULL)
+	return ENOMEM;
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+	code = errno;
+	free(recs);
+	return code;
+    }
+
+    /* Leave room for the header, which needs the count of records */
+    memset(&header, 0, sizeof(header));
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
+	code = errno;
+
+    MUTEX_ENTER(&rxi_traceMutex);
+    for (opr_queue_Scan(&rxi_traceRings, cursor)) {
+	struct rx_traceRing *ring
+	    = opr_queue_Entry(cursor, struct rx_traceRing, entry);
+
+	if (code)
+	    break;
+	n = rxi_CopyTraceRing(ring, recs);
+	if (n > 0 && fwrite(recs, sizeof(*recs), n, fp) != n)
+	    code = errno;
+	header.nRecords += n;
+    }
+    MUTEX_EXIT(&rxi_traceMutex);
+
+    header.magic = RX_TRACE_MAGIC;
+    header.version = RX_TRACE_VERSION;
+    header.recordSize = sizeof(struct rx_traceRecord);
+    if (code == 0
+	&& (fseek(fp, 0, SEEK_SET) != 0
+	    || fwrite(&header, sizeof(header), 1, fp) != 1))
+	code = errno;
+    if (fclose(fp) != 0 && code == 0)
+	code = errno;
+    free(recs);
+    return code;
+}
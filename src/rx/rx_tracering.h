@@ -0,0 +1,69 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * Binary trace of Rx call events.
+ *
+ * While tracing is enabled (rx_TraceEnable), each thread records the call
+ * events it sees in a ring of RX_TRACE_RINGSIZE records of its own, so
+ * that recording takes no locks, and the oldest records are overwritten
+ * by the newest.  rx_TraceDump writes the records from all of the rings
+ * to a file: an rx_traceFileHeader, followed by nRecords rx_traceRecords,
+ * all in the byte order of the host which wrote them.  rxtracedecode
+ * turns such a file back into a timeline for each call.
+ */
+
+#ifndef OPENAFS_RX_TRACERING_H
+#define OPENAFS_RX_TRACERING_H
+
+#define RX_TRACE_MAGIC		0x52785472	/* "RxTr" */
+#define RX_TRACE_VERSION	1
+
+#define RX_TRACE_RINGSIZE	4096	/* records per thread; a power of 2 */
+
+/* Events.  seq, serial and value are as noted; otherwise they're zero. */
+#define RX_TRACE_CALL_START	1	/* value: service id */
+#define RX_TRACE_CALL_END	2	/* value: the call's error */
+#define RX_TRACE_SEND		3	/* a packet other than an ACK was sent;
+					 * seq, serial, value: length | flags << 24 */
+#define RX_TRACE_RECV		4	/* a packet other than an ACK arrived;
+					 * as for RX_TRACE_SEND */
+#define RX_TRACE_RESEND		5	/* a data packet was sent again;
+					 * as for RX_TRACE_SEND */
+#define RX_TRACE_ACK_SEND	6	/* seq: first packet, serial: packet
+					 * acknowledged, value: reason */
+#define RX_TRACE_ACK_RECV	7	/* as for RX_TRACE_ACK_SEND */
+#define RX_TRACE_WINDOW		8	/* congestion window changed;
+					 * value: new cwind, seq: nextCwind */
+#define RX_TRACE_NEVENTS	9
+
+/* Or'd into an event recorded for the server's end of a call */
+#define RX_TRACE_SERVER		0x80
+
+struct rx_traceRecord {
+    afs_uint32 sec;		/* time of the event */
+    afs_uint32 usec;
+    afs_uint32 cid;		/* connection id, including the channel */
+    afs_uint32 callNumber;	/* zero for connection-wide packets */
+    afs_uint32 seq;
+    afs_uint32 serial;
+    afs_uint32 value;
+    u_char event;		/* RX_TRACE_xxx, possibly | RX_TRACE_SERVER */
+    u_char type;		/* RX_PACKET_TYPE_xxx for packet events */
+    u_short thread;		/* which thread's ring the record came from */
+};
+
+struct rx_traceFileHeader {
+    afs_uint32 magic;		/* RX_TRACE_MAGIC */
+    afs_uint32 version;		/* RX_TRACE_VERSION */
+    afs_uint32 recordSize;	/* sizeof(struct rx_traceRecord) */
+    afs_uint32 nRecords;
+};
+
+#endif /* OPENAFS_RX_TRACERING_H */
@@ -68,6 +68,8 @@ afs_kmutex_t rx_if_init_mutex;
  * myNetFlags
  * myNetMTUs
  * myNetMasks
+ * rxi_sharedSockets
+ * rxi_nSharedSockets
  */
 
 afs_kmutex_t rx_if_mutex;
@@ -80,6 +82,59 @@ afs_kmutex_t rx_if_mutex;
 #define UNLOCK_IF
 #endif /* AFS_PTHREAD_ENV */
 
+/* Extra listener sockets, and the socket whose port each one shares */
+#define RX_MAX_SHARED_SOCKETS (RX_MAX_SERVICES * (RX_MAX_LISTENERS - 1))
+static struct {
+    osi_socket socket;
+    osi_socket primary;
+} rxi_sharedSockets[RX_MAX_SHARED_SOCKETS];
+static int rxi_nSharedSockets = 0;
+
+#ifdef RX_ENABLE_UDP_OFFLOAD
+/* Sockets on which the kernel will segment datagrams for us, or coalesce
+ * them, and which of those it does (RXI_SOCKET_GSO, RXI_SOCKET_GRO).
+ * Entries are filled in before they are counted, and are never removed,
+ * so rxi_SocketOffload can read them without holding rx_if_mutex. */
+#define RX_MAX_OFFLOAD_SOCKETS (RX_MAX_SERVICES * RX_MAX_LISTENERS + 1)
+static struct {
+    osi_socket socket;
+    int flags;
+} rxi_offloadSockets[RX_MAX_OFFLOAD_SOCKETS];
+static int rxi_nOffloadSockets = 0;
+
+static void
+rxi_SetSocketOffload(osi_socket socket, int flags)
+{
+    int i;
+
+    LOCK_IF;
+    for (i = 0; i < rxi_nOffloadSockets; i++) {
+	if (rxi_offloadSockets[i].socket == socket)
+	    break;
+    }
+    if (i < rxi_nOffloadSockets) {
+	rxi_offloadSockets[i].flags = flags;
+    } else if (flags && i < RX_MAX_OFFLOAD_SOCKETS) {
+	rxi_offloadSockets[i].socket = socket;
+	rxi_offloadSockets[i].flags = flags;
+	rxi_nOffloadSockets++;
+    }
+    UNLOCK_IF;
+}
+
+/* Return the offloads which are on for the given socket */
+int
+rxi_SocketOffload(osi_socket socket)
+{
+    int i, n = rxi_nOffloadSockets;
+
+    for (i = 0; i < n; i++) {
+	if (rxi_offloadSockets[i].socket == socket)
+	    return rxi_offloadSockets[i].flags;
+    }
+    return 0;
+}
+#endif
 
 /*
  * Make a socket for receiving/sending IP packets.  Set it into non-blocking
@@ -87,8 +142,8 @@ afs_kmutex_t rx_if_mutex;
  * one.  Returns the socket (>= 0) on success.  Returns OSI_NULLSOCKET on
  * failure. Port must be in network byte order.
  */
-osi_socket
-rxi_GetHostUDPSocket(u_int ahost, u_short port)
+static osi_socket
+rxi_NewUDPSocket(u_int ahost, u_short port, int reuseport)
 {
     int binds, code = 0;
     osi_socket socketFd = OSI_NULLSOCKET;
@@ -129,6 +184,18 @@ rxi_GetHostUDPSocket(u_int ahost, u_short port)
     rxi_xmit_init(socketFd);
 #endif /* AFS_NT40_ENV */
 
+#ifdef SO_REUSEPORT
+    if (reuseport) {
+	int on = 1;
+
+	if (setsockopt(socketFd, SOL_SOCKET, SO_REUSEPORT, (char *)&on,
+		       sizeof(on)) < 0) {
+	    (osi_Msg "%s*WARNING* Unable to share port %d between listeners\n",
+	     name, ntohs(port));
+	}
+    }
+#endif
+
     taddr.sin_addr.s_addr = ahost;
     taddr.sin_family = AF_INET;
     taddr.sin_port = (u_short) port;
@@ -205,6 +272,25 @@ rxi_GetHostUDPSocket(u_int ahost, u_short port)
 	int recverr = 1;
 	setsockopt(socketFd, SOL_IP, IP_RECVERR, &recverr, sizeof(recverr));
     }
+#endif
+#ifdef RX_ENABLE_UDP_OFFLOAD
+    /* Segmentation and coalescing are only used along with batched I/O.
+     * Once GRO is on, every read from this socket must be prepared for a
+     * coalesced buffer, so the flag must be set before the listener
+     * starts. */
+    {
+	int zero = 0, on = 1, offload = 0;
+
+	if (rx_enable_batch_io) {
+	    if (setsockopt(socketFd, SOL_UDP, UDP_SEGMENT, &zero,
+			   sizeof(zero)) == 0)
+		offload |= RXI_SOCKET_GSO;
+	    if (setsockopt(socketFd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0)
+		offload |= RXI_SOCKET_GRO;
+	}
+	/* The descriptor may be one we've had before */
+	rxi_SetSocketOffload(socketFd, offload);
+    }
 #endif
     if (rxi_Listen(socketFd) < 0) {
 	goto error;
@@ -224,6 +310,81 @@ rxi_GetHostUDPSocket(u_int ahost, u_short port)
     return OSI_NULLSOCKET;
 }
 
+/*
+ * Get a socket bound to the given host and port, with a listener thread
+ * reading from it. If more than one listener has been asked for with
+ * rx_SetNumListeners, further sockets are bound to the same port, each with
+ * a listener of its own. The kernel hashes each peer address onto one of
+ * these sockets, so every packet for a given call is read by the same
+ * listener. Only the first socket is returned; packets are sent from it.
+ */
+osi_socket
+rxi_GetHostUDPSocket(u_int ahost, u_short port)
+{
+    osi_socket socketFd;
+    int i, shared;
+
+    shared = (rx_nListeners > 1 && port != 0);
+
+    socketFd = rxi_NewUDPSocket(ahost, port, shared);
+    if (socketFd == OSI_NULLSOCKET || !shared)
+	return socketFd;
+
+    for (i = 1; i < rx_nListeners; i++) {
+	osi_socket extraFd;
+	int slot = -1;
+
+	/* Only a socket which was made takes a slot, so that no slot is
+	 * ever left holding OSI_NULLSOCKET */
+	extraFd = rxi_NewUDPSocket(ahost, port, 1);
+	if (extraFd != OSI_NULLSOCKET) {
+	    LOCK_IF;
+	    if (rxi_nSharedSockets < RX_MAX_SHARED_SOCKETS) {
+		slot = rxi_nSharedSockets++;
+		rxi_sharedSockets[slot].socket = extraFd;
+		rxi_sharedSockets[slot].primary = socketFd;
+	    }
+	    UNLOCK_IF;
+	    if (slot < 0) {
+#ifdef AFS_NT40_ENV
+		closesocket(extraFd);
+#else
+		close(extraFd);
+#endif
+	    }
+	}
+	if (slot < 0) {
+	    (osi_Msg "rxi_GetUDPSocket: *WARNING* only %d of %d listeners "
+	     "started on port %d\n", i, rx_nListeners, ntohs(port));
+	    break;
+	}
+    }
+
+    return socketFd;
+}
+
+/*
+ * Return the socket returned by rxi_GetHostUDPSocket whose port the given
+ * extra listener socket shares, or OSI_NULLSOCKET if it is not one of them.
+ */
+osi_socket
+rxi_SharedSocket(osi_socket socket)
+{
+    osi_socket primary = OSI_NULLSOCKET;
+    int i;
+
+    LOCK_IF;
+    for (i = 0; i < rxi_nSharedSockets; i++) {
+	if (rxi_sharedSockets[i].socket == socket) {
+	    primary = rxi_sharedSockets[i].primary;
+	    break;
+	}
+    }
+    UNLOCK_IF;
+
+    return primary;
+}
+
 osi_socket
 rxi_GetUDPSocket(u_short port)
 {
@@ -660,10 +821,9 @@ rx_GetIFInfo(void)
 #endif /* AFS_NT40_ENV */
 
 /* Called from rxi_FindPeer, when initializing a clear rx_peer structure,
- * to get interesting information.
- * Curiously enough, the rx_peerHashTable_lock currently protects the
- * Inited variable (and hence rx_GetIFInfo). When the fs suite uses
- * pthreads, this issue will need to be revisited.
+ * to get interesting information.  It is called with a shard of the
+ * rx_peerHashTable_lock held, so peers in other shards may be initialised
+ * at the same time; rx_if_init_mutex guards Inited.
  */
 
 void
@@ -778,6 +938,23 @@ rx_SetMaxMTU(int mtu)
     return 0;
 }
 
+/* Set the number of sockets, each with its own listener thread, that
+ * servers open on each port. Must be called before rx_Init. */
+int
+rx_SetNumListeners(int n)
+{
+    if (n < 1 || n > RX_MAX_LISTENERS)
+	return EINVAL;
+#if !defined(SO_REUSEPORT) || !defined(AFS_PTHREAD_ENV)
+    if (n > 1)
+	return EOPNOTSUPP;
+#endif
+
+    rx_nListeners = n;
+
+    return 0;
+}
+
 #ifdef AFS_RXERRQ_ENV
 int
 rxi_HandleSocketError(int socket)
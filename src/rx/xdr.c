@@ -422,7 +422,7 @@ xdr_bytes(XDR * xdrs, char **cpp, u_int * sizep,
 
     case XDR_DECODE:
 	if (sp == NULL) {
-	    *cpp = sp = (char *)osi_alloc(nodesize);
+	    *cpp = sp = xdr_decode_alloc(xdrs, nodesize);
 	}
 	if (sp == NULL) {
 	    return (FALSE);
@@ -434,7 +434,7 @@ xdr_bytes(XDR * xdrs, char **cpp, u_int * sizep,
 
     case XDR_FREE:
 	if (sp != NULL) {
-	    osi_free(sp, nodesize);
+	    xdr_decode_free(xdrs, sp, nodesize);
 	    *cpp = NULL;
 	}
 	return (TRUE);
@@ -545,7 +545,7 @@ xdr_string(XDR * xdrs, char **cpp, u_int maxsize)
 
     case XDR_DECODE:
 	if (sp == NULL)
-	    *cpp = sp = (char *)osi_alloc(nodesize);
+	    *cpp = sp = xdr_decode_alloc(xdrs, nodesize);
 	if (sp == NULL) {
 	    return (FALSE);
 	}
@@ -557,7 +557,7 @@ xdr_string(XDR * xdrs, char **cpp, u_int maxsize)
 
     case XDR_FREE:
 	if (sp != NULL) {
-	    osi_free(sp, nodesize);
+	    xdr_decode_free(xdrs, sp, nodesize);
 	    *cpp = NULL;
 	}
 	return (TRUE);
@@ -592,6 +592,7 @@ xdr_free(xdrproc_t proc, void *obj)
     XDR x;
 
     x.x_op = XDR_FREE;
+    x.x_arena = NULL;
 
     /* See note in xdr.h for the method behind this madness */
 #if defined(AFS_I386_LINUX26_ENV) && defined(KERNEL) && !defined(UKERNEL)
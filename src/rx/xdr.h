@@ -86,6 +86,14 @@ typedef char * caddr_t;
 #define xdr_enum afs_xdr_enum
 #define xdr_array afs_xdr_array
 #define xdr_arrayN afs_xdr_arrayN
+#define xdr_arena_alloc afs_xdr_arena_alloc
+#define xdr_arena_release afs_xdr_arena_release
+#define xdr_decode_alloc afs_xdr_decode_alloc
+#define xdr_decode_free afs_xdr_decode_free
+#define xdr_arraystream_create afs_xdr_arraystream_create
+#define xdr_arraystream_begin afs_xdr_arraystream_begin
+#define xdr_arraystream_next afs_xdr_arraystream_next
+#define xdr_arraystream_finish afs_xdr_arraystream_finish
 #define xdr_bytes afs_xdr_bytes
 #define xdr_opaque afs_xdr_opaque
 #define xdr_string afs_xdr_string
@@ -214,6 +222,7 @@ typedef struct __afs_xdr {
     caddr_t x_private;		/* pointer to private data */
     caddr_t x_base;		/* private used for position info */
     int x_handy;		/* extra private word */
+    struct xdr_arena *x_arena;	/* if set, XDR_DECODE allocates from here */
 } XDR;
 
 /*
@@ -283,6 +292,46 @@ struct xdr_discrim {
     xdrproc_t proc;
 };
 
+/*
+ * State for encoding or decoding the elements of a variable-length array
+ * one at a time, instead of all at once with xdr_array.  The encoding on
+ * the wire is the same.  rxgen's "stream" procedures pass one of these to
+ * the server routine in place of the array itself.
+ */
+struct xdr_arraystream {
+    XDR *xdrs;
+    enum xdr_op op;		/* XDR_ENCODE or XDR_DECODE */
+    xdrproc_t elproc;		/* xdr routine to handle each element */
+    u_int elsize;		/* size in bytes of each element */
+    u_int maxsize;		/* max number of elements */
+    u_int count;		/* number of elements in the array */
+    u_int done;			/* elements handled so far */
+    int started;		/* element count has been handled */
+    bool_t (*head) (XDR *, void *);	/* encodes what precedes the array */
+    void *rock;			/* passed to head */
+    struct xdr_arraystream *input;	/* finished before this is begun */
+};
+
+/*
+ * A bump allocator for the storage which XDR_DECODE hands out.  An rxgen
+ * server stub decodes its arguments into one of these, so that they cost
+ * a pointer increment each rather than an osi_alloc, and are all
+ * released together when the call ends.  xdr_decode_free frees nothing
+ * on a stream which has an arena.
+ */
+#define XDR_ARENA_CHUNK	8192	/* bytes per chunk, including its header */
+
+struct xdr_arena_chunk {
+    struct xdr_arena_chunk *next;
+    u_int size;			/* bytes in the chunk, including this header */
+    u_int used;			/* bytes handed out, including this header */
+};
+
+struct xdr_arena {
+    struct xdr_arena_chunk *chunks;	/* allocations come from the first */
+    struct xdr_arena_chunk **spare;	/* a chunk kept between uses, or NULL */
+};
+
 /*
  * In-line routines for fast encode/decode of primitve data types.
  * Caveat emptor: these use single memory cycles to get the
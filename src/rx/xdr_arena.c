@@ -0,0 +1,138 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * xdr_arena.c.  Storage for decoded XDR data.
+ *
+ * The XDR primitives get the storage for what they decode through
+ * xdr_decode_alloc, and give it back through xdr_decode_free.  Without
+ * an arena on the stream, these are just osi_alloc and osi_free.  With
+ * one, storage is carved from chunks of XDR_ARENA_CHUNK bytes, and
+ * nothing is given back until xdr_arena_release frees the lot.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#ifdef KERNEL
+# include "afs/sysincludes.h"
+#else
+# include <roken.h>
+#endif
+
+#include "xdr.h"
+
+/* Everything handed out is aligned for any of the types XDR decodes */
+#define ARENA_ALIGN(x)	(((x) + 7) & ~7)
+#define ARENA_HEADER	ARENA_ALIGN(sizeof(struct xdr_arena_chunk))
+
+static struct xdr_arena_chunk *
+arena_newchunk(struct xdr_arena *arena, u_int size)
+{
+    struct xdr_arena_chunk *chunk;
+
+    if (size == XDR_ARENA_CHUNK && arena->spare != NULL
+	&& *arena->spare != NULL) {
+	chunk = *arena->spare;
+	*arena->spare = NULL;
+    } else {
+	chunk = (struct xdr_arena_chunk *)osi_alloc(size);
+	if (chunk == NULL)
+	    return NULL;
+	chunk->size = size;
+    }
+    chunk->used = ARENA_HEADER;
+    return chunk;
+}
+
+/*
+ * Allocate size bytes from the arena.  Anything too big to share a chunk
+ * gets one to itself, behind the chunk being carved up, so the rest of
+ * that chunk isn't wasted.
+ */
+void *
+xdr_arena_alloc(struct xdr_arena *arena, u_int size)
+{
+    struct xdr_arena_chunk *chunk = arena->chunks;
+    char *p;
+
+    if (size > (u_int)-1 - ARENA_HEADER - 7)
+	return NULL;
+    size = ARENA_ALIGN(size);
+    if (size > XDR_ARENA_CHUNK / 4) {
+	chunk = arena_newchunk(arena, size + ARENA_HEADER);
+	if (chunk == NULL)
+	    return NULL;
+	chunk->used = chunk->size;
+	if (arena->chunks != NULL) {
+	    chunk->next = arena->chunks->next;
+	    arena->chunks->next = chunk;
+	} else {
+	    chunk->next = NULL;
+	    arena->chunks = chunk;
+	}
+	return (char *)chunk + ARENA_HEADER;
+    }
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+	chunk = arena_newchunk(arena, XDR_ARENA_CHUNK);
+	if (chunk == NULL)
+	    return NULL;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+    }
+    p = (char *)chunk + chunk->used;
+    chunk->used += size;
+    return p;
+}
+
+/*
+ * Free everything allocated from the arena.  If the arena has somewhere
+ * to keep a spare chunk, and it's empty, one chunk is kept there to be
+ * used again.
+ */
+void
+xdr_arena_release(struct xdr_arena *arena)
+{
+    struct xdr_arena_chunk *chunk, *next;
+
+    for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+	next = chunk->next;
+	if (chunk->size == XDR_ARENA_CHUNK && arena->spare != NULL
+	    && *arena->spare == NULL)
+	    *arena->spare = chunk;
+	else
+	    osi_free((char *)chunk, chunk->size);
+    }
+    arena->chunks = NULL;
+}
+
+/*
+ * Allocate storage for the XDR_DECODE of something on xdrs
+ */
+void *
+xdr_decode_alloc(XDR *xdrs, u_int size)
+{
+    if (xdrs->x_arena != NULL)
+	return xdr_arena_alloc(xdrs->x_arena, size);
+    return osi_alloc(size);
+}
+
+/*
+ * Give back storage for the XDR_FREE of something on xdrs.  On a stream
+ * with an arena, everything is taken to have come from it, and goes when
+ * the arena is released; callers clear x_arena before freeing anything
+ * which was allocated elsewhere.
+ */
+void
+xdr_decode_free(XDR *xdrs, void *ptr, u_int size)
+{
+    if (xdrs->x_arena != NULL)
+	return;
+    osi_free(ptr, size);
+}
@@ -111,7 +111,7 @@ xdr_array(XDR * xdrs, caddr_t * addrp, u_int * sizep, u_int maxsize,
 	case XDR_DECODE:
 	    if (c == 0)
 		return (TRUE);
-	    *addrp = target = (caddr_t)osi_alloc(nodesize);
+	    *addrp = target = xdr_decode_alloc(xdrs, nodesize);
 	    if (target == NULL) {
 		return (FALSE);
 	    }
@@ -137,9 +137,138 @@ xdr_array(XDR * xdrs, caddr_t * addrp, u_int * sizep, u_int maxsize,
      * the array may need freeing
      */
     if (xdrs->x_op == XDR_FREE) {
-	osi_free(*addrp, nodesize);
+	xdr_decode_free(xdrs, *addrp, nodesize);
 	*addrp = NULL;
     }
     return (stat);
 }
+
+/*
+ * Streamed arrays.  These put the same bytes on the wire as xdr_array, but
+ * let the caller produce or consume the elements one at a time, so that a
+ * large array never has to be held in memory all at once.
+ *
+ * When encoding, the caller announces the number of elements with
+ * xdr_arraystream_begin and then hands each one to xdr_arraystream_next.
+ * Anything which must be encoded ahead of the array (such as earlier
+ * output parameters of an RPC) is written by the head routine when the
+ * array is begun.
+ *
+ * When decoding, xdr_arraystream_begin reads the number of elements into
+ * stream->count, and each call to xdr_arraystream_next decodes the next
+ * one into the caller's buffer.  Anything the element routine allocates
+ * belongs to the caller, to be released with xdr_free.
+ *
+ * xdr_arraystream_finish completes the array: an encoder which was never
+ * begun sends an empty array, and a decoder skips whatever elements the
+ * caller didn't read.
+ *
+ * An Rx call can't be read from once the reply has started, so an encoder
+ * may be given an input stream, which is finished when it is begun.
+ */
+void
+xdr_arraystream_create(struct xdr_arraystream *stream, XDR * xdrs,
+		       enum xdr_op op, u_int maxsize, u_int elsize,
+		       xdrproc_t elproc,
+		       bool_t (*head) (XDR *, void *), void *rock)
+{
+    u_int i;
+
+    i = ((~0u) >> 1) / elsize;
+    if (maxsize > i)
+	maxsize = i;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->xdrs = xdrs;
+    stream->op = op;
+    stream->elproc = elproc;
+    stream->elsize = elsize;
+    stream->maxsize = maxsize;
+    stream->head = head;
+    stream->rock = rock;
+}
+
+/*
+ * Encode or decode the element count; count is ignored when decoding
+ */
+bool_t
+xdr_arraystream_begin(struct xdr_arraystream *stream, u_int count)
+{
+    XDR *xdrs = stream->xdrs;
+
+    if (stream->started)
+	return (FALSE);
+    stream->started = 1;
+
+    if (stream->op == XDR_ENCODE) {
+	if (count > stream->maxsize)
+	    return (FALSE);
+	if (stream->input != NULL && !xdr_arraystream_finish(stream->input))
+	    return (FALSE);
+	xdrs->x_op = XDR_ENCODE;
+	if (stream->head != NULL && !(*stream->head) (xdrs, stream->rock))
+	    return (FALSE);
+	stream->count = count;
+    } else {
+	xdrs->x_op = XDR_DECODE;
+    }
+    if (!xdr_u_int(xdrs, &stream->count))
+	return (FALSE);
+    if (stream->count > stream->maxsize)
+	return (FALSE);
+    return (TRUE);
+}
+
+/*
+ * Encode or decode the next element of the array
+ */
+bool_t
+xdr_arraystream_next(struct xdr_arraystream *stream, void *elem)
+{
+    XDR *xdrs = stream->xdrs;
+    struct xdr_arena *arena = xdrs->x_arena;
+    bool_t stat;
+
+    if (!stream->started || stream->done >= stream->count)
+	return (FALSE);
+    xdrs->x_op = stream->op;
+    if (stream->op == XDR_DECODE)
+	memset(elem, 0, stream->elsize);
+    /* The caller frees what the element holds with xdr_free, so that
+     * mustn't come from the stream's arena */
+    xdrs->x_arena = NULL;
+    stat = (*stream->elproc) (xdrs, elem, LASTUNSIGNED);
+    xdrs->x_arena = arena;
+    if (!stat)
+	return (FALSE);
+    stream->done++;
+    return (TRUE);
+}
+
+bool_t
+xdr_arraystream_finish(struct xdr_arraystream *stream)
+{
+    caddr_t elem;
+    bool_t stat = TRUE;
+
+    if (stream->op == XDR_ENCODE) {
+	if (!stream->started && !xdr_arraystream_begin(stream, 0))
+	    return (FALSE);
+	return (stream->done == stream->count);
+    }
+
+    if (!stream->started)
+	return (FALSE);
+    if (stream->done == stream->count)
+	return (TRUE);
+    elem = (caddr_t)osi_alloc(stream->elsize);
+    if (elem == NULL)
+	return (FALSE);
+    while (stat && stream->done < stream->count) {
+	stat = xdr_arraystream_next(stream, elem);
+	xdr_free(stream->elproc, elem);
+    }
+    osi_free(elem, stream->elsize);
+    return (stat);
+}
 #endif /* NeXT */
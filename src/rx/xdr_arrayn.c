@@ -111,7 +111,7 @@ xdr_arrayN(XDR * xdrs, caddr_t * addrp, u_int * sizep, u_int maxsize,
 	case XDR_DECODE:
 	    if (c == 0)
 		return (TRUE);
-	    *addrp = target = (caddr_t) osi_alloc(nodesize);
+	    *addrp = target = xdr_decode_alloc(xdrs, nodesize);
 	    if (target == NULL) {
 		return (FALSE);
 	    }
@@ -137,7 +137,7 @@ xdr_arrayN(XDR * xdrs, caddr_t * addrp, u_int * sizep, u_int maxsize,
      * the array may need freeing
      */
     if (xdrs->x_op == XDR_FREE) {
-	osi_free(*addrp, nodesize);
+	xdr_decode_free(xdrs, *addrp, nodesize);
 	*addrp = NULL;
     }
     return (stat);
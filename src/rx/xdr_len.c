@@ -123,4 +123,5 @@ xdrlen_create(XDR * xdrs)
     xdrs->x_op = XDR_ENCODE;
     xdrs->x_ops = &xdrlen_ops;
     xdrs->x_handy = 0;
+    xdrs->x_arena = NULL;
 }
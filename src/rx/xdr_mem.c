@@ -92,6 +92,7 @@ xdrmem_create(XDR * xdrs, caddr_t addr, u_int size, enum xdr_op op)
     xdrs->x_ops = &xdrmem_ops;
     xdrs->x_private = xdrs->x_base = addr;
     xdrs->x_handy = (size > INT_MAX) ? INT_MAX : size;	/* XXX */
+    xdrs->x_arena = NULL;
 }
 
 static void
@@ -171,7 +172,9 @@ xdrmem_inline(XDR *xdrs, u_int len)
 {
     afs_int32 *buf = 0;
 
-    if (xdrs->x_handy >= len) {
+    /* The inline macros read and write whole words */
+    if (xdrs->x_handy >= len
+	&& !((size_t)xdrs->x_private & (sizeof(afs_int32) - 1))) {
 	xdrs->x_handy -= len;
 	buf = (afs_int32 *) xdrs->x_private;
 	xdrs->x_private += len;
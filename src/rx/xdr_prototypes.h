@@ -31,9 +31,26 @@ extern void xdrrx_create(XDR * xdrs, struct rx_call *call,
 
 #ifndef XDR_AFS_DECLS_ONLY
 
+/* xdr_arena.c */
+extern void *xdr_arena_alloc(struct xdr_arena *arena, u_int size);
+extern void xdr_arena_release(struct xdr_arena *arena);
+extern void *xdr_decode_alloc(XDR *xdrs, u_int size);
+extern void xdr_decode_free(XDR *xdrs, void *ptr, u_int size);
+
 /* xdr_array.c */
 extern bool_t xdr_array(XDR * xdrs, caddr_t * addrp, u_int * sizep,
 			u_int maxsize, u_int elsize, xdrproc_t elproc);
+extern void xdr_arraystream_create(struct xdr_arraystream *stream,
+				   XDR * xdrs, enum xdr_op op,
+				   u_int maxsize, u_int elsize,
+				   xdrproc_t elproc,
+				   bool_t (*head) (XDR *, void *),
+				   void *rock);
+extern bool_t xdr_arraystream_begin(struct xdr_arraystream *stream,
+				    u_int count);
+extern bool_t xdr_arraystream_next(struct xdr_arraystream *stream,
+				   void *elem);
+extern bool_t xdr_arraystream_finish(struct xdr_arraystream *stream);
 
 /* xdr_arrayn.c */
 extern bool_t xdr_arrayN(XDR * xdrs, caddr_t * addrp, u_int * sizep,
@@ -164,6 +164,7 @@ xdrrec_create(XDR * xdrs, u_int sendsize, u_int recvsize,
     }
     xdrs->x_ops = &xdrrec_ops;
     xdrs->x_private = (caddr_t) rstrm;
+    xdrs->x_arena = NULL;
     rstrm->tcp_handle = tcp_handle;
     rstrm->readit = readit;
     rstrm->writeit = writeit;
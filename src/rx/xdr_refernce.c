@@ -72,7 +72,7 @@ xdr_reference(XDR *xdrs,
 	    return (TRUE);
 
 	case XDR_DECODE:
-	    *pp = loc = osi_alloc(size);
+	    *pp = loc = xdr_decode_alloc(xdrs, size);
 	    if (loc == NULL) {
 		return (FALSE);
 	    }
@@ -85,7 +85,7 @@ xdr_reference(XDR *xdrs,
     stat = (*proc) (xdrs, loc, LASTUNSIGNED);
 
     if (xdrs->x_op == XDR_FREE) {
-	osi_free(loc, size);
+	xdr_decode_free(xdrs, loc, size);
 	*pp = NULL;
     }
     return (stat);
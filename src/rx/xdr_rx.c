@@ -37,6 +37,10 @@
 #endif /* KERNEL */
 
 #include "rx.h"
+#include "rx_atomic.h"
+#include "rx_globals.h"
+#include "rx_internal.h"
+#include "rx_call.h"
 #include "xdr.h"
 
 /* Static prototypes */
@@ -86,6 +90,50 @@ xdrrx_create(XDR * xdrs, struct rx_call *call,
     xdrs->x_op = op;
     xdrs->x_ops = &xdrrx_ops;
     xdrs->x_private = (caddr_t) call;
+    xdrs->x_arena = NULL;
+}
+
+/*
+ * The arena which a server stub should decode the call's arguments into,
+ * or NULL if they should be allocated separately.  Everything in it is
+ * released by rx_EndCall.  Only the thread serving the call may use it.
+ */
+struct xdr_arena *
+rx_CallArena(struct rx_call *call)
+{
+    struct xdr_arena *arena;
+#ifdef RX_ENABLE_ARENA_REUSE
+    struct rx_ts_info_t *rx_ts_info;
+#endif
+
+    if (rx_call_arenas == RX_ARENA_NONE)
+	return NULL;
+    if (call->arena == NULL)
+	call->arena = rxi_Alloc(sizeof(struct xdr_arena));
+    arena = call->arena;
+#ifdef RX_ENABLE_ARENA_REUSE
+    if (rx_call_arenas == RX_ARENA_REUSE) {
+	RX_TS_INFO_GET(rx_ts_info);
+	arena->spare = &rx_ts_info->arena_spare;
+    }
+#endif
+    return arena;
+}
+
+void
+rxi_ReleaseCallArena(struct rx_call *call)
+{
+    xdr_arena_release(call->arena);
+    call->arena->spare = NULL;
+}
+
+void
+rxi_FreeCallArena(struct rx_call *call)
+{
+    call->arena->spare = NULL;
+    xdr_arena_release(call->arena);
+    rxi_Free(call->arena, sizeof(struct xdr_arena));
+    call->arena = NULL;
 }
 
 #if	defined(KERNEL) && defined(AFS_AIX32_ENV)
@@ -243,9 +291,17 @@ xdrrx_setpos(XDR * xdrs, u_int pos)
 }
 #endif
 
+/* Let the caller encode or decode straight into or out of the current
+ * packet, if the next len bytes are all in one contiguous piece of it. */
 static afs_int32 *
 xdrrx_inline(XDR *axdrs, u_int len)
 {
-    /* I don't know what this routine is supposed to do, but the stdio module returns null, so we will, too */
-    return (0);
+    XDR * xdrs = (XDR *)axdrs;
+    struct rx_call *call = ((struct rx_call *)(xdrs)->x_private);
+
+    if (xdrs->x_op == XDR_DECODE)
+	return rx_ReadInline(call, len);
+    if (xdrs->x_op == XDR_ENCODE)
+	return rx_WriteInline(call, len);
+    return NULL;
 }
@@ -104,6 +104,7 @@ xdrstdio_create(xdrs, file, op)
     xdrs->x_private = (caddr_t) file;
     xdrs->x_handy = 0;
     xdrs->x_base = 0;
+    xdrs->x_arena = NULL;
 }
 
 /*
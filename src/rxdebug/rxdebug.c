@@ -80,6 +80,9 @@ MainCommand(struct cmd_syndesc *as, void *arock)
     int withWaited;
     int withPeers;
     int withPackets;
+    int withCallCC;
+    int withWideConn;
+    int withCallQueues;
     struct rx_debugStats tstats;
     char *portName, *hostName;
     char hoststr[20];
@@ -242,6 +245,9 @@ MainCommand(struct cmd_syndesc *as, void *arock)
     withWaited = (supportedDebugValues & RX_SERVER_DEBUG_WAITED_CNT);
     withPeers = (supportedDebugValues & RX_SERVER_DEBUG_ALL_PEER);
     withPackets = (supportedDebugValues & RX_SERVER_DEBUG_PACKETS_CNT);
+    withCallCC = (supportedDebugValues & RX_SERVER_DEBUG_CALL_CC);
+    withWideConn = (supportedDebugValues & RX_SERVER_DEBUG_WIDE_CONN);
+    withCallQueues = (supportedDebugValues & RX_SERVER_DEBUG_CALL_QUEUES);
 
     if (withPackets)
         printf("Free packets: %d/%d, packet reclaims: %d, calls: %d, used FDs: %d\n",
@@ -260,6 +266,15 @@ MainCommand(struct cmd_syndesc *as, void *arock)
 	printf("%d threads are idle\n", tstats.idleThreads);
     if (withWaited)
 	printf("%d calls have waited for a thread\n", tstats.nWaited);
+    if (withCallQueues) {
+	printf("%d call queues, calls waiting by priority: "
+	       "%d high, %d normal, %d low\n", tstats.nCallQueues,
+	       tstats.nQueued[RX_PRIORITY_HIGH],
+	       tstats.nQueued[RX_PRIORITY_NORMAL],
+	       tstats.nQueued[RX_PRIORITY_LOW]);
+	printf("%d calls were taken from another thread's queue\n",
+	       tstats.nStolen);
+    }
 
     if (rxstats) {
 	if (!withRxStats) {
@@ -407,9 +422,15 @@ MainCommand(struct cmd_syndesc *as, void *arock)
 	    }
 	    printf("security index %d, ", tconn.securityIndex);
 	    if (tconn.type == RX_CLIENT_CONNECTION)
-		printf("client conn\n");
+		printf("client conn");
 	    else
-		printf("server conn\n");
+		printf("server conn");
+	    if (withWideConn && tconn.wideCid)
+		printf(", channels %d-%d of wide conn %x",
+		       tconn.wideGroup * RX_MAXCALLS,
+		       tconn.wideGroup * RX_MAXCALLS + RX_MAXCALLS - 1,
+		       tconn.wideCid);
+	    printf("\n");
 
 	    if (withSecStats) {
 		switch ((int)tconn.secStats.type) {
@@ -474,7 +495,12 @@ MainCommand(struct cmd_syndesc *as, void *arock)
 	    }
 
 	    for (j = 0; j < RX_MAXCALLS; j++) {
-		printf("    call %d: # %d, state ", j, tconn.callNumber[j]);
+		if (withWideConn && tconn.wideCid)
+		    printf("    call %d: # %d, state ",
+			   tconn.wideGroup * RX_MAXCALLS + j,
+			   tconn.callNumber[j]);
+		else
+		    printf("    call %d: # %d, state ", j, tconn.callNumber[j]);
 		if (tconn.callState[j] == RX_STATE_NOTINIT) {
 		    printf("not initialized\n");
 		    continue;
@@ -520,6 +546,9 @@ MainCommand(struct cmd_syndesc *as, void *arock)
 		    printf(", has_input_packets");
 		if (tconn.callOther[j] & RX_OTHER_OUT)
 		    printf(", has_output_packets");
+		if (withCallCC)
+		    printf(", cwind %d, rtt %u msec", tconn.callCwind[j],
+			   tconn.callRtt[j] >> 3);
 		printf("\n");
 	    }
 	}
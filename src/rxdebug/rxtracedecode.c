@@ -0,0 +1,323 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * Decode a dump of the Rx call trace rings (see rx_TraceDump) into a
+ * timeline for each call, marking where a call went quiet for longer
+ * than the stall threshold.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+#include <afs/stds.h>
+
+#include <roken.h>
+
+#include <afs/cmd.h>
+
+#include <rx/rx.h>
+#include <rx/rx_packet.h>
+#include <rx/rx_tracering.h>
+
+static char *packetTypes[] = RX_PACKET_TYPES;
+
+static char *ackReasons[] = {
+    "unknown", "requested", "duplicate", "sequence", "window", "nospace",
+    "ping", "response", "delay", "idle"
+};
+
+static char *eventNames[RX_TRACE_NEVENTS] = {
+    "unknown", "start", "end", "send", "recv", "resend", "ack out",
+    "ack in", "window"
+};
+
+/* What is known of a call once all of its records have been seen */
+struct callSummary {
+    int nEvents;
+    int nSent;
+    int nResent;
+    int nReceived;
+    int nAcksOut;
+    int nAcksIn;
+    int nWindow;
+    afs_uint32 minWindow;
+    double duration;		/* msec from first to last event */
+    double longestGap;		/* msec */
+    double gapAt;		/* msec into the call that the gap ended */
+};
+
+static afs_uint32
+swap32(afs_uint32 x)
+{
+    return ((x & 0xff) << 24) | ((x & 0xff00) << 8) | ((x >> 8) & 0xff00)
+	| (x >> 24);
+}
+
+static void
+swapRecord(struct rx_traceRecord *rec)
+{
+    rec->sec = swap32(rec->sec);
+    rec->usec = swap32(rec->usec);
+    rec->cid = swap32(rec->cid);
+    rec->callNumber = swap32(rec->callNumber);
+    rec->seq = swap32(rec->seq);
+    rec->serial = swap32(rec->serial);
+    rec->value = swap32(rec->value);
+    rec->thread = ((rec->thread & 0xff) << 8) | (rec->thread >> 8);
+}
+
+/* Records sort by call, and then by time */
+static int
+compareRecords(const void *a, const void *b)
+{
+    const struct rx_traceRecord *ra = a, *rb = b;
+
+    if ((ra->event & RX_TRACE_SERVER) != (rb->event & RX_TRACE_SERVER))
+	return (ra->event & RX_TRACE_SERVER) ? 1 : -1;
+    if (ra->cid != rb->cid)
+	return ra->cid < rb->cid ? -1 : 1;
+    if (ra->callNumber != rb->callNumber)
+	return ra->callNumber < rb->callNumber ? -1 : 1;
+    if (ra->sec != rb->sec)
+	return ra->sec < rb->sec ? -1 : 1;
+    if (ra->usec != rb->usec)
+	return ra->usec < rb->usec ? -1 : 1;
+    return 0;
+}
+
+static int
+sameCall(struct rx_traceRecord *a, struct rx_traceRecord *b)
+{
+    return (a->event & RX_TRACE_SERVER) == (b->event & RX_TRACE_SERVER)
+	&& a->cid == b->cid && a->callNumber == b->callNumber;
+}
+
+/* Milliseconds from one record to another */
+static double
+elapsed(struct rx_traceRecord *from, struct rx_traceRecord *to)
+{
+    return ((double)to->sec - from->sec) * 1000.0
+	+ ((double)to->usec - from->usec) / 1000.0;
+}
+
+static void
+printEvent(struct rx_traceRecord *rec, double when)
+{
+    int event = rec->event & ~RX_TRACE_SERVER;
+    char *type;
+
+    printf("  %10.3f  T%-3d %-7s", when, rec->thread,
+	   event < RX_TRACE_NEVENTS ? eventNames[event] : eventNames[0]);
+    switch (event) {
+    case RX_TRACE_CALL_START:
+	printf(" service %u", rec->value);
+	break;
+    case RX_TRACE_CALL_END:
+	printf(" error %d", (afs_int32)rec->value);
+	break;
+    case RX_TRACE_SEND:
+    case RX_TRACE_RECV:
+    case RX_TRACE_RESEND:
+	if (rec->type > 0 && rec->type <= sizeof(packetTypes) / sizeof(char *))
+	    type = packetTypes[rec->type - 1];
+	else
+	    type = "unknown";
+	printf(" %-9s seq %u ser %u len %u flags 0x%x", type, rec->seq,
+	       rec->serial, rec->value & 0xffffff, rec->value >> 24);
+	break;
+    case RX_TRACE_ACK_SEND:
+    case RX_TRACE_ACK_RECV:
+	printf(" %-9s first %u ser %u",
+	       rec->value < sizeof(ackReasons) / sizeof(char *)
+	       ? ackReasons[rec->value] : ackReasons[0],
+	       rec->seq, rec->serial);
+	break;
+    case RX_TRACE_WINDOW:
+	printf(" cwind %u", rec->value);
+	break;
+    }
+    printf("\n");
+}
+
+static void
+summarise(struct rx_traceRecord *recs, int n, struct callSummary *sum)
+{
+    int i;
+    double gap;
+
+    memset(sum, 0, sizeof(*sum));
+    sum->nEvents = n;
+    sum->duration = elapsed(&recs[0], &recs[n - 1]);
+    for (i = 0; i < n; i++) {
+	switch (recs[i].event & ~RX_TRACE_SERVER) {
+	case RX_TRACE_SEND:
+	    sum->nSent++;
+	    break;
+	case RX_TRACE_RESEND:
+	    sum->nResent++;
+	    break;
+	case RX_TRACE_RECV:
+	    sum->nReceived++;
+	    break;
+	case RX_TRACE_ACK_SEND:
+	    sum->nAcksOut++;
+	    break;
+	case RX_TRACE_ACK_RECV:
+	    sum->nAcksIn++;
+	    break;
+	case RX_TRACE_WINDOW:
+	    if (sum->nWindow == 0 || recs[i].value < sum->minWindow)
+		sum->minWindow = recs[i].value;
+	    sum->nWindow++;
+	    break;
+	}
+	if (i > 0) {
+	    gap = elapsed(&recs[i - 1], &recs[i]);
+	    if (gap > sum->longestGap) {
+		sum->longestGap = gap;
+		sum->gapAt = elapsed(&recs[0], &recs[i]);
+	    }
+	}
+    }
+}
+
+/*
+ * Print one call's records, which are in time order.  Any gap of more
+ * than stall msec is shown as a stall, ahead of the event which ended it.
+ */
+static void
+printCall(struct rx_traceRecord *recs, int n, double stall, int brief)
+{
+    struct callSummary sum;
+    int i;
+    double gap;
+
+    summarise(recs, n, &sum);
+    printf("Call %x.%u (%s): %d events over %.3f msec; sent %d, resent %d,"
+	   " received %d, acks %d out %d in",
+	   recs[0].cid, recs[0].callNumber,
+	   (recs[0].event & RX_TRACE_SERVER) ? "server" : "client",
+	   sum.nEvents, sum.duration, sum.nSent, sum.nResent, sum.nReceived,
+	   sum.nAcksOut, sum.nAcksIn);
+    if (sum.nWindow)
+	printf("; window changed %d times, down to %u", sum.nWindow,
+	       sum.minWindow);
+    if (sum.longestGap > stall)
+	printf("; stalled up to %.3f msec at %.3f", sum.longestGap,
+	       sum.gapAt);
+    printf("\n");
+    if (brief)
+	return;
+
+    for (i = 0; i < n; i++) {
+	if (i > 0) {
+	    gap = elapsed(&recs[i - 1], &recs[i]);
+	    if (gap > stall)
+		printf("  ** stalled for %.3f msec\n", gap);
+	}
+	printEvent(&recs[i], elapsed(&recs[0], &recs[i]));
+    }
+    printf("\n");
+}
+
+static int
+DecodeCommand(struct cmd_syndesc *as, void *arock)
+{
+    struct rx_traceFileHeader header;
+    struct rx_traceRecord *recs;
+    char *path = as->parms[0].items->data;
+    double stall = 50.0;
+    afs_uint32 cid = 0;
+    int onlyCid = 0, brief = 0, swapped = 0;
+    int i, first, n;
+    FILE *fp;
+
+    if (as->parms[1].items)
+	stall = atof(as->parms[1].items->data);
+    if (as->parms[2].items) {
+	cid = strtoul(as->parms[2].items->data, NULL, 16);
+	onlyCid = 1;
+    }
+    if (as->parms[3].items)
+	brief = 1;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+	fprintf(stderr, "rxtracedecode: can't open %s: %s\n", path,
+		strerror(errno));
+	return 1;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1) {
+	fprintf(stderr, "rxtracedecode: %s is too short\n", path);
+	return 1;
+    }
+    if (header.magic == swap32(RX_TRACE_MAGIC)) {
+	swapped = 1;
+	header.version = swap32(header.version);
+	header.recordSize = swap32(header.recordSize);
+	header.nRecords = swap32(header.nRecords);
+    } else if (header.magic != RX_TRACE_MAGIC) {
+	fprintf(stderr, "rxtracedecode: %s is not an Rx trace\n", path);
+	return 1;
+    }
+    if (header.version != RX_TRACE_VERSION
+	|| header.recordSize != sizeof(struct rx_traceRecord)) {
+	fprintf(stderr, "rxtracedecode: %s is an unsupported trace version\n",
+		path);
+	return 1;
+    }
+    if (header.nRecords == 0) {
+	printf("No events recorded\n");
+	return 0;
+    }
+
+    recs = malloc(header.nRecords * sizeof(*recs));
+    if (recs == NULL) {
+	fprintf(stderr, "rxtracedecode: out of memory\n");
+	return 1;
+    }
+    n = fread(recs, sizeof(*recs), header.nRecords, fp);
+    fclose(fp);
+    if (n != header.nRecords)
+	fprintf(stderr, "rxtracedecode: %s is truncated; %d of %u records\n",
+		path, n, header.nRecords);
+    if (swapped) {
+	for (i = 0; i < n; i++)
+	    swapRecord(&recs[i]);
+    }
+
+    qsort(recs, n, sizeof(*recs), compareRecords);
+    for (first = 0; first < n; first = i) {
+	for (i = first + 1; i < n && sameCall(&recs[first], &recs[i]); i++)
+	    ;
+	if (onlyCid && (recs[first].cid & RX_CIDMASK) != (cid & RX_CIDMASK))
+	    continue;
+	printCall(&recs[first], i - first, stall, brief);
+    }
+    free(recs);
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct cmd_syndesc *ts;
+
+    ts = cmd_CreateSyntax(NULL, DecodeCommand, NULL, 0,
+			  "decode a dump of Rx call traces");
+    cmd_AddParm(ts, "-file", CMD_SINGLE, CMD_REQUIRED, "trace dump file");
+    cmd_AddParm(ts, "-stall", CMD_SINGLE, CMD_OPTIONAL,
+		"msec without an event to report as a stall (default 50)");
+    cmd_AddParm(ts, "-cid", CMD_SINGLE, CMD_OPTIONAL,
+		"only show calls on this connection id (hex)");
+    cmd_AddParm(ts, "-brief", CMD_FLAG, CMD_OPTIONAL,
+		"only summarise each call");
+
+    return cmd_Dispatch(argc, argv);
+}
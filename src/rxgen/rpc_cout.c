@@ -57,6 +57,11 @@ static void print_ifstat(int indent, char *prefix, char *type, relation rel,
 static void emit_enum(definition * def);
 static void emit_union(definition * def);
 static void emit_struct(definition * def);
+static definition *find_def(char *type);
+static int inline_words(char *type, char *words);
+static int inline_struct_words(definition * def, char *words);
+static void print_inline(definition * def, char *objname, int encode);
+static void emit_inline_struct(definition * def);
 static void emit_typedef(definition * def);
 static void print_stat(declaration * dec);
 static void print_hout(declaration * dec);
@@ -390,11 +395,154 @@ emit_union(definition * def)
 
 
 
+/*
+ * Structures made up only of 32 bit integers, and of fixed size arrays and
+ * structures of them, have a fixed layout on the wire. Where the stream can
+ * give us a contiguous buffer for the whole structure, we encode or decode
+ * it there a word at a time, rather than calling through the stream's ops
+ * for each field.
+ */
+
+static definition *
+find_def(char *type)
+{
+    return (definition *) FINDVAL(defined, type, findtype);
+}
+
+/*
+ * Is type a single 32 bit word on the wire? If so, the suffix of the
+ * IXDR macros to get and put it with is copied to words.
+ */
+static int
+inline_words(char *type, char *words)
+{
+    definition *def;
+
+    if (streq(type, "afs_int32") || streq(type, "int")) {
+	strcpy(words, "INT32");
+	return 1;
+    }
+    if (streq(type, "afs_uint32") || streq(type, "u_int")) {
+	strcpy(words, "U_INT32");
+	return 1;
+    }
+    if (streq(type, "bool")) {
+	strcpy(words, "BOOL");
+	return 1;
+    }
+    def = find_def(type);
+    if (def == NULL)
+	return 0;
+    if (def->def_kind == DEF_ENUM) {
+	strcpy(words, "ENUM");
+	return 1;
+    }
+    if (def->def_kind == DEF_TYPEDEF && def->def.ty.rel == REL_ALIAS)
+	return inline_words(def->def.ty.old_type, words);
+    return 0;
+}
+
+/*
+ * Does the structure have a fixed layout? If so, an expression for the
+ * number of words it takes on the wire is appended to words.
+ */
+static int
+inline_struct_words(definition * def, char *words)
+{
+    decl_list *dl;
+    declaration *dec;
+    char suffix[16];
+    int count = 0;
+
+    if (def == NULL || def->def_kind != DEF_STRUCT)
+	return 0;
+    for (dl = def->def.st.decls; dl != NULL; dl = dl->next) {
+	dec = &dl->decl;
+	if (dec->rel == REL_ALIAS && inline_words(dec->type, suffix)) {
+	    count++;
+	} else if (dec->rel == REL_VECTOR && inline_words(dec->type, suffix)) {
+	    s_print(words + strlen(words), "(%s) + ", dec->array_max);
+	} else if (dec->rel == REL_ALIAS) {
+	    if (!inline_struct_words(find_def(dec->type), words))
+		return 0;
+	    strcat(words, " + ");
+	} else {
+	    return 0;
+	}
+    }
+    s_print(words + strlen(words), "%d", count);
+    return 1;
+}
+
+/*
+ * Print the statements to encode or decode, at buf, each word of a fixed
+ * layout structure.
+ */
+static void
+print_inline(definition * def, char *objname, int encode)
+{
+    decl_list *dl;
+    declaration *dec;
+    char suffix[16];
+    char name[256];
+
+    for (dl = def->def.st.decls; dl != NULL; dl = dl->next) {
+	dec = &dl->decl;
+	s_print(name, "%s%s", objname, dec->name);
+	if (!inline_words(dec->type, suffix)) {
+	    strcat(name, ".");
+	    print_inline(find_def(dec->type), name, encode);
+	    continue;
+	}
+	if (dec->rel == REL_VECTOR) {
+	    f_print(fout, "\t\t\tfor (i = 0; i < %s; i++)\n\t",
+		    dec->array_max);
+	    strcat(name, "[i]");
+	}
+	if (encode) {
+	    f_print(fout, "\t\t\tIXDR_PUT_%s(buf, %s);\n", suffix, name);
+	} else if (streq(suffix, "ENUM")) {
+	    f_print(fout, "\t\t\t%s = IXDR_GET_ENUM(buf, %s);\n", name,
+		    dec->type);
+	} else {
+	    f_print(fout, "\t\t\t%s = IXDR_GET_%s(buf);\n", name, suffix);
+	}
+    }
+}
+
+static void
+emit_inline_struct(definition * def)
+{
+    char words[1024];
+
+    words[0] = '\0';
+    if (!inline_struct_words(def, words))
+	return;
+
+    f_print(fout, "\tif (xdrs->x_op == XDR_ENCODE "
+	    "|| xdrs->x_op == XDR_DECODE) {\n");
+    f_print(fout, "\t\tafs_int32 *buf = XDR_INLINE(xdrs, "
+	    "(%s) * BYTES_PER_XDR_UNIT);\n", words);
+    if (strchr(words, '(') != NULL) {
+	/* there are arrays to loop over */
+	f_print(fout, "\t\tu_int i;\n");
+    }
+    f_print(fout, "\n\t\tif (buf != NULL && xdrs->x_op == XDR_ENCODE) {\n");
+    print_inline(def, "objp->", 1);
+    f_print(fout, "\t\t\treturn (TRUE);\n");
+    f_print(fout, "\t\t} else if (buf != NULL) {\n");
+    print_inline(def, "objp->", 0);
+    f_print(fout, "\t\t\treturn (TRUE);\n");
+    f_print(fout, "\t\t}\n");
+    f_print(fout, "\t}\n");
+}
+
 static void
 emit_struct(definition * def)
 {
     decl_list *dl;
 
+    emit_inline_struct(def);
     for (dl = def->def.st.decls; dl != NULL; dl = dl->next) {
 	print_stat(&dl->decl);
     }
@@ -552,6 +700,7 @@ print_param(declaration * dec)
     objname = Proc_list->pl.param_name;
     switch (rel) {
     case REL_POINTER:
+	Proc_list->pl.param_xdrtype = type;
 	print_rxifopen(type);
 	print_rxifarg(amp, objname, 0);
 /*
@@ -642,6 +791,7 @@ print_param(declaration * dec)
 */
 	break;
     case REL_ALIAS:
+	Proc_list->pl.param_xdrtype = type;
 	print_rxifopen(type);
 	print_rxifarg(amp, objname, 0);
 	break;
@@ -195,7 +195,10 @@ psproc1(definition * defp, int callTconnF, char *type, char *prefix,
 	    default:
 		break;
 	    }
-	    if (plist->pl.param_flag & OUT_STRING) {
+	    if ((plist->pl.param_flag & STREAM_PARAM) && callTconnF == 3) {
+		f_print(fout, "struct xdr_arraystream *%s",
+			plist->pl.param_name);
+	    } else if (plist->pl.param_flag & OUT_STRING) {
 		f_print(fout, "%s *%s", plist->pl.param_type,
 			plist->pl.param_name);
 	    } else {
@@ -101,6 +101,8 @@ static void check_proc(definition * defp, token * tokp, int noname);
 static int InvalidConstant(char *name);
 static int opcodenum_is_defined(int opcode_num);
 static void analyze_ProcParams(definition * defp, token * tokp);
+static definition *stream_array_def(proc1_list * plist);
+static void find_stream_params(definition * defp);
 static void generate_code(definition * defp, int proc_split_flag,
 			  int multi_flag);
 static void handle_split_proc(definition * defp, int multi_flag);
@@ -130,9 +132,14 @@ static void ucs_ProcName_setup(definition * defp, char *procheader,
 static void ucs_ProcParams_setup(definition * defp, int split_flag);
 static void ucs_ProcTail_setup(definition * defp, int split_flag);
 static void ss_Proc_CodeGeneration(definition * defp);
+static proc1_list *ss_StreamParam(definition * defp, defkind param_kind);
+static int ss_StreamHeadParams(definition * defp);
+static void ss_ProcStreamHead_setup(definition * defp);
 static void ss_ProcName_setup(definition * defp);
 static void ss_ProcParams_setup(definition * defp);
 static void ss_ProcSpecial_setup(definition * defp);
+static void ss_ProcStream_setup(definition * defp);
+static int ss_UsesArena(definition * defp);
 static void ss_ProcUnmarshallInParams_setup(definition * defp);
 static void ss_ProcCallRealProc_setup(definition * defp);
 static void ss_ProcMarshallOutParams_setup(definition * defp);
@@ -724,6 +731,10 @@ check_proc(definition * defp, token * tokp, int noname)
     }
     analyze_ProcParams(defp, &tok);
     defp->pc.proc_opcodenum = -1;
+    if (peekscan(TOK_STREAM, &tok))
+	defp->pc.stream_flag = 1;
+    else
+	defp->pc.stream_flag = 0;
     scan4(TOK_SPLIT, TOK_MULTI, TOK_EQUAL, TOK_SEMICOLON, &tok);
     if (tok.kind == TOK_MULTI) {
 	proc_multi = 1;
@@ -771,6 +782,8 @@ check_proc(definition * defp, token * tokp, int noname)
 	opcodesnotallowed[PackageIndex] = 1;	/* force it */
     }
     no_of_opcodes[PackageIndex]++, master_no_of_opcodes++;
+    if (defp->pc.stream_flag)
+	find_stream_params(defp);
     if (proc_multi) {
 	generate_code(defp, 0, 1);
 	if (Cflag || cflag) {
@@ -867,6 +880,68 @@ analyze_ProcParams(definition * defp, token * tokp)
 }
 
 
+/*
+ * If the parameter is a typedef'd variable-length array, which can be
+ * streamed an element at a time, return its typedef.
+ */
+static definition *
+stream_array_def(proc1_list * plist)
+{
+    list *listp;
+    definition *def;
+
+    if (strchr(plist->pl.param_type, '*') == NULL)
+	return NULL;
+    for (listp = defined; listp != NULL; listp = listp->next) {
+	def = (definition *) listp->val;
+	if (def->def_kind == DEF_TYPEDEF
+	    && streq(def->def_name, structname(plist->pl.param_type))) {
+	    if (def->def.ty.rel != REL_ARRAY
+		|| streq(def->def.ty.old_type, "opaque")
+		|| streq(def->def.ty.old_type, "string"))
+		return NULL;
+	    return def;
+	}
+    }
+    return NULL;
+}
+
+
+/*
+ * The server routine of a "stream" procedure is given its last IN
+ * parameter, and its last OUT parameter, as a struct xdr_arraystream if
+ * they are variable-length arrays. It can then consume or produce their
+ * elements one at a time over the call, rather than have them all held
+ * in memory.
+ */
+static void
+find_stream_params(definition * defp)
+{
+    proc1_list *plist, *lastin = NULL, *lastout = NULL;
+
+    for (plist = defp->pc.plists; plist; plist = plist->next) {
+	if (plist->component_kind != DEF_PARAM)
+	    continue;
+	if (plist->pl.param_kind != DEF_OUTPARAM)
+	    lastin = plist;
+	if (plist->pl.param_kind != DEF_INPARAM)
+	    lastout = plist;
+    }
+    if (lastin && lastin->pl.param_kind == DEF_INPARAM
+	&& stream_array_def(lastin))
+	lastin->pl.param_flag |= STREAM_PARAM;
+    else
+	lastin = NULL;
+    if (lastout && lastout->pl.param_kind == DEF_OUTPARAM
+	&& stream_array_def(lastout))
+	lastout->pl.param_flag |= STREAM_PARAM;
+    else
+	lastout = NULL;
+    if (!lastin && !lastout)
+	error("stream procedure has no IN or OUT array to stream");
+}
+
+
 static void
 generate_code(definition * defp, int proc_split_flag, int multi_flag)
 {
@@ -956,6 +1031,10 @@ hdle_param_tok(definition * defp, declaration * dec, token * tokp,
     get_declaration(dec, DEF_PARAM);
     Proc_list->pl.param_name = dec->name;
     get1_param_type(defp, dec, &Proc_list->pl.param_type);
+    /* A pointer parameter is decoded into the stub's own variable */
+    Proc_list->pl.param_allocs =
+	allocatingtype(dec->type,
+		       dec->rel == REL_POINTER ? REL_ALIAS : dec->rel);
     print_param(dec);
     scan2(TOK_COMMA, TOK_RPAREN, tokp);
     if (tokp->kind == TOK_COMMA)
@@ -1299,10 +1378,13 @@ static void
 ss_Proc_CodeGeneration(definition * defp)
 {
     defp->can_fail = 0;
+    if (!cflag)
+	ss_ProcStreamHead_setup(defp);
     ss_ProcName_setup(defp);
     if (!cflag) {
 	ss_ProcParams_setup(defp);
 	ss_ProcSpecial_setup(defp);
+	ss_ProcStream_setup(defp);
 	ss_ProcUnmarshallInParams_setup(defp);
 	ss_ProcCallRealProc_setup(defp);
 	ss_ProcMarshallOutParams_setup(defp);
@@ -1311,6 +1393,87 @@ ss_Proc_CodeGeneration(definition * defp)
 }
 
 
+/* The streamed IN or OUT parameter of a procedure, if it has one */
+static proc1_list *
+ss_StreamParam(definition * defp, defkind param_kind)
+{
+    proc1_list *plist;
+
+    for (plist = defp->pc.plists; plist; plist = plist->next) {
+	if (plist->component_kind == DEF_PARAM
+	    && plist->pl.param_kind == param_kind
+	    && (plist->pl.param_flag & STREAM_PARAM))
+	    return plist;
+    }
+    return NULL;
+}
+
+/*
+ * The number of OUT parameters ahead of a streamed OUT array, which have
+ * to be encoded when the server routine begins the array
+ */
+static int
+ss_StreamHeadParams(definition * defp)
+{
+    proc1_list *plist;
+    int heads = 0;
+
+    if (!ss_StreamParam(defp, DEF_OUTPARAM))
+	return 0;
+    for (plist = defp->pc.plists; plist; plist = plist->next) {
+	if (plist->component_kind == DEF_PARAM
+	    && plist->pl.param_kind != DEF_INPARAM
+	    && !(plist->pl.param_flag & STREAM_PARAM))
+	    heads++;
+    }
+    return heads;
+}
+
+
+/*
+ * Emit the head routine for a streamed OUT array, which encodes the OUT
+ * parameters in front of it through a structure holding their addresses.
+ */
+static void
+ss_ProcStreamHead_setup(definition * defp)
+{
+    proc1_list *plist;
+    int i;
+
+    if (!ss_StreamHeadParams(defp))
+	return;
+
+    f_print(fout, "struct _%s%s%s_StreamOut {\n", prefix,
+	    PackagePrefix[PackageIndex], defp->pc.proc_name);
+    for (plist = defp->pc.plists; plist; plist = plist->next) {
+	if (plist->component_kind == DEF_PARAM
+	    && plist->pl.param_kind != DEF_INPARAM
+	    && !(plist->pl.param_flag & STREAM_PARAM))
+	    f_print(fout, "\tvoid *%s;\n", plist->pl.param_name);
+    }
+    f_print(fout, "};\n\n");
+
+    f_print(fout, "static bool_t\n_%s%s%s_StreamHead(XDR *z_xdrs, void *z_rock)\n",
+	    prefix, PackagePrefix[PackageIndex], defp->pc.proc_name);
+    f_print(fout, "{\n\tstruct _%s%s%s_StreamOut *z_out = z_rock;\n\n",
+	    prefix, PackagePrefix[PackageIndex], defp->pc.proc_name);
+    for (plist = defp->pc.plists, i = 0; plist; plist = plist->next) {
+	if (plist->component_kind != DEF_PARAM
+	    || plist->pl.param_kind == DEF_INPARAM
+	    || (plist->pl.param_flag & STREAM_PARAM))
+	    continue;
+	/* The structure holds the address of each stub variable, which is
+	 * all a simply coded parameter's xdr routine needs */
+	if (plist->pl.param_xdrtype == NULL)
+	    error("can't stream an array after this OUT parameter");
+	f_print(fout, i++ ? "\n\t    && " : "\treturn (");
+	f_print(fout, "xdr_%s(z_xdrs, z_out->%s)", plist->pl.param_xdrtype,
+		plist->pl.param_name);
+    }
+    f_print(fout, ");\n}\n\n");
+}
+
+
 static void
 ss_ProcName_setup(definition * defp)
 {
@@ -1345,6 +1508,12 @@ ss_ProcParams_setup(definition * defp)
 
     for (plist = defp->pc.plists; plist; plist = plist->next) {
 	if ((plist->component_kind == DEF_PARAM)
+	    && !(plist->pl.param_flag & PROCESSED_PARAM)
+	    && (plist->pl.param_flag & STREAM_PARAM)) {
+	    f_print(fout, "\tstruct xdr_arraystream %s;\n",
+		    plist->pl.param_name);
+	    plist->pl.param_flag |= PROCESSED_PARAM;
+	} else if ((plist->component_kind == DEF_PARAM)
 	    && !(plist->pl.param_flag & PROCESSED_PARAM)) {
 	    if (plist->pl.param_flag & INDIRECT_PARAM) {
 		char pres = '\0', *pntr = strchr(plist->pl.param_type, '*');
@@ -1369,6 +1538,7 @@ ss_ProcParams_setup(definition * defp)
 	    for (plist1 = defp->pc.plists; plist1; plist1 = plist1->next) {
 		if ((plist1->component_kind == DEF_PARAM)
 		    && streq(plist->pl.param_type, plist1->pl.param_type)
+		    && !(plist1->pl.param_flag & STREAM_PARAM)
 		    && !(plist1->pl.param_flag & PROCESSED_PARAM)) {
 		    if (plist1->pl.param_flag & INDIRECT_PARAM) {
 			f_print(fout, ", %s", plist1->pl.param_name);
@@ -1403,6 +1573,9 @@ ss_ProcParams_setup(definition * defp)
 	    }
 	}
     }
+    if (ss_StreamHeadParams(defp))
+	f_print(fout, "\tstruct _%s%s%s_StreamOut z_out;\n", prefix,
+		PackagePrefix[PackageIndex], defp->pc.proc_name);
     fprintf(fout, "\n");
 }
 
@@ -1419,6 +1592,7 @@ ss_ProcSpecial_setup(definition * defp)
 
 	for (plist = defp->pc.plists; plist; plist = plist->next) {
 	    if (plist->component_kind == DEF_PARAM
+		&& !(plist->pl.param_flag & STREAM_PARAM)
 		&& (plist->pl.param_kind == DEF_INPARAM
 		    || plist->pl.param_kind == DEF_INOUTPARAM)) {
 		spec_list *spec = defp1->def.sd.specs;
@@ -1436,7 +1610,8 @@ ss_ProcSpecial_setup(definition * defp)
     for (listp = typedef_defined; listp != NULL; listp = listp->next) {
 	defp1 = (definition *) listp->val;
 	for (plist = defp->pc.plists; plist; plist = plist->next) {
-	    if (plist->component_kind == DEF_PARAM) {
+	    if (plist->component_kind == DEF_PARAM
+		&& !(plist->pl.param_flag & STREAM_PARAM)) {
 		if (streq(defp1->def_name, structname(plist->pl.param_type))) {
 		    plist->pl.param_flag |= FREETHIS_PARAM;
 		    switch (defp1->pc.rel) {
@@ -1471,7 +1646,8 @@ ss_ProcSpecial_setup(definition * defp)
     for (listp = complex_defined; listp != NULL; listp = listp->next) {
 	defp1 = (definition *) listp->val;
 	for (plist = defp->pc.plists; plist; plist = plist->next) {
-	    if (plist->component_kind == DEF_PARAM) {
+	    if (plist->component_kind == DEF_PARAM
+		&& !(plist->pl.param_flag & STREAM_PARAM)) {
 		if (streq(defp1->def_name, structname(plist->pl.param_type))) {
 		    plist->pl.param_flag |= FREETHIS_PARAM;
 		    fprintf(fout, "\n\tmemset(&%s, 0, sizeof(%s));",
@@ -1485,6 +1661,75 @@ ss_ProcSpecial_setup(definition * defp)
 }
 
 
+static void
+ss_ProcStream_setup(definition * defp)
+{
+    proc1_list *plist, *in;
+    definition *defp1;
+    int heads;
+
+    heads = ss_StreamHeadParams(defp);
+    in = ss_StreamParam(defp, DEF_INPARAM);
+    for (plist = defp->pc.plists; plist; plist = plist->next) {
+	if (plist->component_kind != DEF_PARAM)
+	    continue;
+	if (plist->pl.param_flag & STREAM_PARAM) {
+	    defp1 = stream_array_def(plist);
+	    f_print(fout, "\txdr_arraystream_create(&%s, z_xdrs, %s, %s,\n",
+		    plist->pl.param_name,
+		    plist->pl.param_kind == DEF_INPARAM ?
+			"XDR_DECODE" : "XDR_ENCODE",
+		    defp1->def.ty.array_max);
+	    if (streq(defp1->def.ty.old_type, "bool")) {
+		f_print(fout, "\t    sizeof(bool_t), (xdrproc_t) xdr_bool");
+	    } else {
+		f_print(fout, "\t    sizeof(%s%s%s), (xdrproc_t) xdr_%s",
+			defp1->def.ty.old_prefix ? defp1->def.ty.old_prefix : "",
+			defp1->def.ty.old_prefix ? " " : "",
+			defp1->def.ty.old_type, defp1->def.ty.old_type);
+	    }
+	    if (plist->pl.param_kind == DEF_OUTPARAM && heads) {
+		f_print(fout, ",\n\t    _%s%s%s_StreamHead, &z_out);\n", prefix,
+			PackagePrefix[PackageIndex], defp->pc.proc_name);
+	    } else {
+		f_print(fout, ", NULL, NULL);\n");
+	    }
+	    if (plist->pl.param_kind == DEF_OUTPARAM && in) {
+		f_print(fout, "\t%s.input = &%s;\n", plist->pl.param_name,
+			in->pl.param_name);
+	    }
+	} else if (heads && plist->pl.param_kind != DEF_INPARAM) {
+	    f_print(fout, "\tz_out.%s = &%s;\n", plist->pl.param_name,
+		    plist->pl.param_name);
+	}
+    }
+}
+
+
+/*
+ * IN parameters are decoded into the call's arena, if it has one, and only
+ * live until the call ends.  The arena is only worth fetching if decoding
+ * some of them allocates storage, and isn't used at all if there are INOUT
+ * parameters, as the server routine may replace what they point to.
+ */
+static int
+ss_UsesArena(definition * defp)
+{
+    proc1_list *plist;
+
+    if (defp->pc.paramtypes[INOUT])
+	return 0;
+    for (plist = defp->pc.plists; plist; plist = plist->next) {
+	if (plist->component_kind == DEF_PARAM
+	    && plist->pl.param_kind == DEF_INPARAM
+	    && !(plist->pl.param_flag & STREAM_PARAM)
+	    && plist->pl.param_allocs)
+	    return 1;
+    }
+    return 0;
+}
+
+
 static void
 ss_ProcUnmarshallInParams_setup(definition * defp)
 {
@@ -1493,8 +1738,22 @@ ss_ProcUnmarshallInParams_setup(definition * defp)
 
     noofparams = defp->pc.paramtypes[IN] + defp->pc.paramtypes[INOUT];
     noofoutparams = defp->pc.paramtypes[INOUT] + defp->pc.paramtypes[OUT];
+    if (ss_UsesArena(defp))
+	f_print(fout, "\tz_xdrs->x_arena = rx_CallArena(z_call);");
     for (plist = defp->pc.plists, i = 0; plist; plist = plist->next) {
 	if (plist->component_kind == DEF_PARAM
+	    && (plist->pl.param_flag & STREAM_PARAM)
+	    && plist->pl.param_kind == DEF_INPARAM) {
+	    f_print(fout, i ? "\n\t     || " : "\n\tif (");
+	    f_print(fout, "(!xdr_arraystream_begin(&%s, 0))",
+		    plist->pl.param_name);
+	    if (++i == noofparams) {
+		f_print(fout, ") {\n");
+		f_print(fout,
+			"\t\tz_result = RXGEN_SS_UNMARSHAL;\n\t\tgoto fail;\n\t}\n\n");
+		defp->can_fail = 1;
+	    }
+	} else if (plist->component_kind == DEF_PARAM
 	    && (plist->pl.param_kind == DEF_INPARAM
 		|| plist->pl.param_kind == DEF_INOUTPARAM)) {
 	    if (!i) {
@@ -1529,7 +1788,7 @@ ss_ProcCallRealProc_setup(definition * defp)
 	    PackagePrefix[PackageIndex], defp->pc.proc_name);
     for (plist = defp->pc.plists; plist; plist = plist->next) {
 	if (plist->component_kind == DEF_PARAM) {
-	    if (plist->pl.param_flag & INDIRECT_PARAM) {
+	    if (plist->pl.param_flag & (INDIRECT_PARAM | STREAM_PARAM)) {
 		f_print(fout, ", &%s", plist->pl.param_name);
 	    } else {
 		if (plist->pl.param_flag & OUT_STRING) {
@@ -1544,6 +1803,12 @@ ss_ProcCallRealProc_setup(definition * defp)
     if (zflag) {
 	f_print(fout, "\tif (z_result)\n\t\treturn z_result;\n");
     }
+    plist = ss_StreamParam(defp, DEF_INPARAM);
+    if (plist) {
+	f_print(fout, "\tif (z_result == 0 && !xdr_arraystream_finish(&%s))\n",
+		plist->pl.param_name);
+	f_print(fout, "\t\tz_result = RXGEN_SS_UNMARSHAL;\n");
+    }
 }
 
 
@@ -1556,6 +1821,14 @@ ss_ProcMarshallOutParams_setup(definition * defp)
     noofparams = defp->pc.paramtypes[INOUT] + defp->pc.paramtypes[OUT];
     if (noofparams)
 	f_print(fout, "\tz_xdrs->x_op = XDR_ENCODE;\n");
+    plist = ss_StreamParam(defp, DEF_OUTPARAM);
+    if (plist) {
+	/* Everything else was encoded when the array was begun */
+	f_print(fout, "\tif (z_result == 0 && !xdr_arraystream_finish(&%s))\n",
+		plist->pl.param_name);
+	f_print(fout, "\t\tz_result = RXGEN_SS_MARSHAL;\n");
+	return;
+    }
     if (noofparams) {
 	for (plist = defp->pc.plists, i = 0; plist; plist = plist->next) {
 	    if (plist->component_kind == DEF_PARAM
@@ -1595,14 +1868,41 @@ ss_ProcTail_setup(definition * defp)
     definition *defp1;
     list *listp;
     int somefrees = 0;
+    int arena = ss_UsesArena(defp);
 
     if (defp->can_fail) {
 	f_print(fout, "fail:\n");
     }
 
+    if (arena) {
+	/* IN parameters decoded into the arena go when it is released */
+	for (plist = defp->pc.plists; plist; plist = plist->next) {
+	    if (plist->component_kind != DEF_PARAM
+		|| plist->pl.param_kind != DEF_INPARAM
+		|| !(plist->pl.param_flag & FREETHIS_PARAM))
+		continue;
+	    if (!somefrees) {
+		f_print(fout, "\tz_xdrs->x_op = XDR_FREE;\n");
+		f_print(fout, "\tif (z_xdrs->x_arena == NULL\n\t    && ((!%s)",
+			plist->scode);
+		somefrees = 1;
+	    } else {
+		f_print(fout, "\n\t\t|| (!%s)", plist->scode);
+	    }
+	}
+	if (somefrees) {
+	    f_print(fout, "))\n");
+	    f_print(fout, "\t\tz_result = RXGEN_SS_XDRFREE;\n\n");
+	    somefrees = 0;
+	}
+	/* Anything else was allocated by the server routine */
+	f_print(fout, "\tz_xdrs->x_arena = NULL;\n");
+    }
+
     for (plist = defp->pc.plists; plist; plist = plist->next) {
 	if (plist->component_kind == DEF_PARAM
-		&& (plist->pl.param_flag & FREETHIS_PARAM))
+		&& (plist->pl.param_flag & FREETHIS_PARAM)
+		&& !(arena && plist->pl.param_kind == DEF_INPARAM))
 	    ss_ProcTail_frees(plist->scode, &somefrees);
     }
 
@@ -1612,6 +1912,7 @@ ss_ProcTail_setup(definition * defp)
 	    if (plist->component_kind == DEF_PARAM
 		&& (plist->pl.param_kind == DEF_OUTPARAM
 		    || plist->pl.param_kind == DEF_INOUTPARAM)
+		&& !(plist->pl.param_flag & STREAM_PARAM)
 		&& !(plist->pl.param_flag & FREETHIS_PARAM)) {
 		if (streq(defp1->def_name, structname(plist->pl.param_type))) {
 		    switch (defp1->pc.rel) {
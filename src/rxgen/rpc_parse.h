@@ -127,12 +127,15 @@ struct param_list {
     char *param_name;
     char *param_type;
     char *string_name;
+    char *param_xdrtype;	/* if set, xdr_<type>(xdrs, &param) codes it */
+    int param_allocs;		/* decoding it allocates storage */
 #define	INDIRECT_PARAM	1
 #define	PROCESSED_PARAM	2
 #define	ARRAYNAME_PARAM	4
 #define	ARRAYSIZE_PARAM	8
 #define	FREETHIS_PARAM	16
 #define	OUT_STRING	32
+#define	STREAM_PARAM	64
     char param_flag;
 };
 typedef struct param_list param_list;
@@ -160,6 +163,7 @@ struct procedure_def {
     short paramtypes[3];
     char split_flag;
     char multi_flag;
+    char stream_flag;
     relation rel;
     proc1_list *plists;
 };
@@ -413,6 +413,7 @@ static token symbols[] = {
     {TOK_SPLITPREFIX, "splitprefix"},
     {TOK_SPLIT, "split"},
     {TOK_MULTI, "multi"},
+    {TOK_STREAM, "stream"},
     {TOK_IN, "IN"},
     {TOK_OUT, "OUT"},
     {TOK_INOUT, "INOUT"},
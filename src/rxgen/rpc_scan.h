@@ -81,6 +81,7 @@ enum tok_kind {
     TOK_SPLITPREFIX,
     TOK_SPLIT,
     TOK_MULTI,
+    TOK_STREAM,
     TOK_IN,
     TOK_OUT,
     TOK_INOUT,
@@ -158,6 +158,65 @@ fixtype(char *type)
     return (fixit(type, type));
 }
 
+/* Types with xdr routines of their own which decode in place */
+static char *inplacetypes[] = {
+    "int", "u_int", "long", "u_long", "short", "u_short", "char", "u_char",
+    "bool", "bool_t", "float", "double", "enum", "int64", "uint64",
+    "afs_int32", "afs_uint32", "afs_int64", "afs_uint64", "afsUUID", "void",
+    NULL
+};
+
+/*
+ * Does decoding an object of this type allocate storage? Types which
+ * aren't defined here, or known to decode in place, are assumed to.
+ */
+int
+allocatingtype(char *type, relation rel)
+{
+    definition *def;
+    decl_list *dl;
+    case_list *cl;
+    int i;
+
+    if (rel == REL_ARRAY || rel == REL_POINTER || streq(type, "string"))
+	return (1);
+    if (streq(type, "opaque"))
+	return (0);
+    for (i = 0; inplacetypes[i] != NULL; i++) {
+	if (streq(type, inplacetypes[i]))
+	    return (0);
+    }
+    def = (definition *) FINDVAL(defined, type, findit);
+    if (def == NULL)
+	return (1);
+    switch (def->def_kind) {
+    case DEF_CONST:
+    case DEF_ENUM:
+	return (0);
+    case DEF_TYPEDEF:
+	return (allocatingtype(def->def.ty.old_type, def->def.ty.rel));
+    case DEF_STRUCT:
+	for (dl = def->def.st.decls; dl != NULL; dl = dl->next) {
+	    if (allocatingtype(dl->decl.type, dl->decl.rel))
+		return (1);
+	}
+	return (0);
+    case DEF_UNION:
+	for (cl = def->def.un.cases; cl != NULL; cl = cl->next) {
+	    if (cl->case_decl.type != NULL
+		&& allocatingtype(cl->case_decl.type, cl->case_decl.rel))
+		return (1);
+	}
+	if (def->def.un.default_decl != NULL
+	    && def->def.un.default_decl->type != NULL)
+	    return (allocatingtype(def->def.un.default_decl->type,
+				   def->def.un.default_decl->rel));
+	return (0);
+    default:
+	return (1);
+    }
+}
+
 char *
 stringfix(char *type)
 {
@@ -365,6 +424,7 @@ static token tokstrings[] = {
     {TOK_SPLITPREFIX, "splitprefix"},
     {TOK_SPLIT, "split"},
     {TOK_MULTI, "multi"},
+    {TOK_STREAM, "stream"},
     {TOK_IN, "IN"},
     {TOK_OUT, "OUT"},
     {TOK_INOUT, "INOUT"},
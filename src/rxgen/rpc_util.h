@@ -82,6 +82,7 @@ extern char *findval(list * lst, char *val,
 		     int (*cmp) (definition * def, char *type));
 extern void storeval(list ** lstp, char *val);
 extern char *fixtype(char *type);
+extern int allocatingtype(char *type, relation rel);
 extern char *stringfix(char *type);
 extern void ptype(char *prefix, char *type, int follow);
 extern int isvectordef(char *type, relation rel);
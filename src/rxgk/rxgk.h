@@ -58,4 +58,17 @@ struct rx_securityClass *rxgk_NewClientSecurityObject(RXGK_Level level,
 						      RXGK_Data *token,
 						      afsUUID *uuid);
 
+/* rxgk_crypto_rfc3961.c */
+afs_int32 rxgk_make_key(rxgk_key *key_out, void *raw_key, afs_uint32 length,
+			afs_int32 enctype);
+void rxgk_release_key(rxgk_key *key);
+afs_int32 rxgk_encrypt_in_key(rxgk_key key, afs_int32 usage, RXGK_Data *in,
+			      RXGK_Data *out);
+afs_int32 rxgk_decrypt_in_key(rxgk_key key, afs_int32 usage, RXGK_Data *in,
+			      RXGK_Data *out);
+afs_int32 rxgk_encrypt_batch(rxgk_key key, afs_int32 usage, RXGK_Data *in,
+			     RXGK_Data *out, int count);
+afs_int32 rxgk_decrypt_batch(rxgk_key key, afs_int32 usage, RXGK_Data *in,
+			     RXGK_Data *out, int count);
+
 #endif /* OPENAFS_RXGK_H */
@@ -0,0 +1,204 @@
+/* rxgk/rxgk_crypto_rfc3961.c - Wrappers for RFC3961 crypto used in RXGK */
+/*
+ * Copyright (C) 2013, 2014 by the Massachusetts Institute of Technology.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * * Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in
+ *   the documentation and/or other materials provided with the
+ *   distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Wrappers for RFC3961 crypto used in RXGK.
+ *
+ * An rxgk_key carries the RFC3961 crypto context for its key along with
+ * the key itself.  Setting up that context, and deriving the keys for each
+ * usage from it, costs far more than encrypting a packet, so it is done
+ * once per key rather than once per operation; a connection's transport
+ * key is made once, and every packet sent on it then reuses the context.
+ *
+ * The context keeps state between operations, so it is only used under
+ * the key's lock.  The batch routines take that lock once for a whole
+ * set of buffers, such as all of the packets a call has queued to send.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+#include <afs/stds.h>
+
+#include <roken.h>
+
+#include <afs/opr.h>
+#include <opr/lock.h>
+#include <rx/rx.h>
+#include <rx/rx_opaque.h>
+#include <rx/rxgk.h>
+#include <afs/rfc3961.h>
+
+#include "rxgk_private.h"
+
+struct rxgk_keyblock {
+    opr_mutex_t lock;
+    krb5_keyblock key;
+    krb5_crypto crypto;		/* under lock */
+};
+
+/*
+ * Make an rxgk_key from length bytes of raw key data for enctype.
+ */
+afs_int32
+rxgk_make_key(rxgk_key *key_out, void *raw_key, afs_uint32 length,
+	      afs_int32 enctype)
+{
+    struct rxgk_keyblock *kb;
+    krb5_error_code ret;
+
+    *key_out = NULL;
+    if (krb5_enctype_valid(NULL, enctype) != 0)
+	return RXGK_BADETYPE;
+
+    kb = calloc(1, sizeof(*kb));
+    if (kb == NULL)
+	return RXGK_INCONSISTENCY;
+    ret = krb5_keyblock_init(NULL, enctype, raw_key, length, &kb->key);
+    if (ret != 0) {
+	free(kb);
+	return RXGK_BADETYPE;
+    }
+    ret = krb5_crypto_init(NULL, &kb->key, enctype, &kb->crypto);
+    if (ret != 0) {
+	krb5_free_keyblock_contents(NULL, &kb->key);
+	free(kb);
+	return RXGK_BADETYPE;
+    }
+    opr_mutex_init(&kb->lock);
+    *key_out = kb;
+    return 0;
+}
+
+/*
+ * Destroy the key and its crypto context, and clear the caller's
+ * reference to it.
+ */
+void
+rxgk_release_key(rxgk_key *key)
+{
+    struct rxgk_keyblock *kb = *key;
+
+    if (kb == NULL)
+	return;
+    krb5_crypto_destroy(NULL, kb->crypto);
+    krb5_free_keyblock_contents(NULL, &kb->key);
+    opr_mutex_destroy(&kb->lock);
+    free(kb);
+    *key = NULL;
+}
+
+/* Encrypt or decrypt one buffer.  Called with the key's lock held. */
+static afs_int32
+crypt_locked(struct rxgk_keyblock *kb, afs_int32 usage, RXGK_Data *in,
+	     RXGK_Data *out, int encrypt)
+{
+    krb5_data result;
+    krb5_error_code ret;
+
+    memset(&result, 0, sizeof(result));
+    if (encrypt)
+	ret = krb5_encrypt(NULL, kb->crypto, usage, in->val, in->len, &result);
+    else
+	ret = krb5_decrypt(NULL, kb->crypto, usage, in->val, in->len, &result);
+    if (ret != 0)
+	return encrypt ? RXGK_INCONSISTENCY : RXGK_SEALED_INCON;
+
+    ret = rx_opaque_populate(out, result.data, result.length);
+    krb5_data_free(&result);
+    return ret != 0 ? RXGK_INCONSISTENCY : 0;
+}
+
+static afs_int32
+crypt_batch(rxgk_key key, afs_int32 usage, RXGK_Data *in, RXGK_Data *out,
+	    int count, int encrypt)
+{
+    struct rxgk_keyblock *kb = key;
+    afs_int32 code = 0;
+    int i;
+
+    opr_mutex_enter(&kb->lock);
+    for (i = 0; i < count; i++) {
+	code = crypt_locked(kb, usage, &in[i], &out[i], encrypt);
+	if (code != 0)
+	    break;
+    }
+    opr_mutex_exit(&kb->lock);
+
+    if (code != 0) {
+	while (--i >= 0)
+	    rx_opaque_freeContents(&out[i]);
+    }
+    return code;
+}
+
+/*
+ * Encrypt in with key for usage, putting the result in out, which the
+ * caller must free with rx_opaque_freeContents.
+ */
+afs_int32
+rxgk_encrypt_in_key(rxgk_key key, afs_int32 usage, RXGK_Data *in,
+		    RXGK_Data *out)
+{
+    return crypt_batch(key, usage, in, out, 1, 1);
+}
+
+/*
+ * Decrypt in with key for usage, putting the result in out, which the
+ * caller must free with rx_opaque_freeContents.
+ */
+afs_int32
+rxgk_decrypt_in_key(rxgk_key key, afs_int32 usage, RXGK_Data *in,
+		    RXGK_Data *out)
+{
+    return crypt_batch(key, usage, in, out, 1, 0);
+}
+
+/*
+ * Encrypt count buffers from in[] with key for usage, into out[].  Either
+ * all of them are encrypted, or none are and nothing is left to free.
+ */
+afs_int32
+rxgk_encrypt_batch(rxgk_key key, afs_int32 usage, RXGK_Data *in,
+		   RXGK_Data *out, int count)
+{
+    return crypt_batch(key, usage, in, out, count, 1);
+}
+
+/*
+ * Decrypt count buffers from in[] with key for usage, into out[].  Either
+ * all of them are decrypted, or none are and nothing is left to free.
+ */
+afs_int32
+rxgk_decrypt_batch(rxgk_key key, afs_int32 usage, RXGK_Data *in,
+		   RXGK_Data *out, int count)
+{
+    return crypt_batch(key, usage, in, out, count, 0);
+}
@@ -94,82 +94,97 @@ fc_keysched(struct ktc_encryptionKey *key, fc_KeySchedule schedule)
     return 0;
 }
 
+/*
+ * One round of the Feistel network: run R (xor'd with the round's key
+ * bits) through the S-boxes, and fold the result into L.  The S-box
+ * tables include the permutation of their outputs, so there's nothing
+ * else to do.
+ */
+#define FC_ROUND(L, R, K) do { \
+    afs_uint32 S_ = (afs_uint32)(K) ^ (R); \
+    (L) ^= sbox0[S_ >> 24] ^ sbox1[(S_ >> 16) & 0xff] \
+	^ sbox2[(S_ >> 8) & 0xff] ^ sbox3[S_ & 0xff]; \
+} while (0)
+
+static_inline void
+fc_encrypt_block(afs_uint32 *Lp, afs_uint32 *Rp, const afs_int32 *schedule)
+{
+    afs_uint32 L = *Lp, R = *Rp;
+    int i;
+
+    for (i = 0; i < ROUNDS; i += 2) {
+	FC_ROUND(L, R, schedule[i]);
+	FC_ROUND(R, L, schedule[i + 1]);
+    }
+    *Lp = L;
+    *Rp = R;
+}
+
+static_inline void
+fc_decrypt_block(afs_uint32 *Lp, afs_uint32 *Rp, const afs_int32 *schedule)
+{
+    afs_uint32 L = *Lp, R = *Rp;
+    int i;
+
+    for (i = ROUNDS - 1; i > 0; i -= 2) {
+	FC_ROUND(R, L, schedule[i]);
+	FC_ROUND(L, R, schedule[i - 1]);
+    }
+    *Lp = L;
+    *Rp = R;
+}
+
+/*
+ * Decrypt FC_INTERLEAVE blocks at once.  No block depends on another, so
+ * working through their rounds side by side lets the table lookups for
+ * one block overlap with those of the others, instead of each round
+ * waiting on the last.
+ */
+#define FC_INTERLEAVE 4
+
+static_inline void
+fc_decrypt_blocks(afs_uint32 *L, afs_uint32 *R, const afs_int32 *schedule)
+{
+    afs_uint32 L0 = L[0], L1 = L[1], L2 = L[2], L3 = L[3];
+    afs_uint32 R0 = R[0], R1 = R[1], R2 = R[2], R3 = R[3];
+    afs_int32 K;
+    int i;
+
+    for (i = ROUNDS - 1; i > 0; i -= 2) {
+	K = schedule[i];
+	FC_ROUND(R0, L0, K);
+	FC_ROUND(R1, L1, K);
+	FC_ROUND(R2, L2, K);
+	FC_ROUND(R3, L3, K);
+	K = schedule[i - 1];
+	FC_ROUND(L0, R0, K);
+	FC_ROUND(L1, R1, K);
+	FC_ROUND(L2, R2, K);
+	FC_ROUND(L3, R3, K);
+    }
+    L[0] = L0; L[1] = L1; L[2] = L2; L[3] = L3;
+    R[0] = R0; R[1] = R1; R[2] = R2; R[3] = R3;
+}
+
 /* IN int encrypt; * 0 ==> decrypt, else encrypt */
 afs_int32
 fc_ecb_encrypt(void * clear, void * cipher,
 	       const fc_KeySchedule schedule, int encrypt)
 {
     afs_uint32 L, R;
-    volatile afs_uint32 S, P;
-    volatile unsigned char *Pchar = (unsigned char *)&P;
-    volatile unsigned char *Schar = (unsigned char *)&S;
-    int i;
 
-#ifndef WORDS_BIGENDIAN
-#define Byte0 3
-#define Byte1 2
-#define Byte2 1
-#define Byte3 0
-#else
-#define Byte0 0
-#define Byte1 1
-#define Byte2 2
-#define Byte3 3
-#endif
-
-#if 0
-    memcpy(&L, clear, sizeof(afs_int32));
-    memcpy(&R, clear + 1, sizeof(afs_int32));
-#else
     L = ntohl(*((afs_uint32 *)clear));
     R = ntohl(*((afs_uint32 *)clear + 1));
-#endif
 
     if (encrypt) {
 	INC_RXKAD_STATS(fc_encrypts[ENCRYPT]);
-	for (i = 0; i < (ROUNDS / 2); i++) {
-	    S = *schedule++ ^ R;	/* xor R with key bits from schedule */
-	    Pchar[Byte2] = sbox0[Schar[Byte0]];	/* do 8-bit S Box subst. */
-	    Pchar[Byte3] = sbox1[Schar[Byte1]];	/* and permute the result */
-	    Pchar[Byte1] = sbox2[Schar[Byte2]];
-	    Pchar[Byte0] = sbox3[Schar[Byte3]];
-	    P = (P >> 5) | ((P & ((1 << 5) - 1)) << (32 - 5));	/* right rot 5 bits */
-	    L ^= P;		/* we're done with L, so save there */
-	    S = *schedule++ ^ L;	/* this time xor with L */
-	    Pchar[Byte2] = sbox0[Schar[Byte0]];
-	    Pchar[Byte3] = sbox1[Schar[Byte1]];
-	    Pchar[Byte1] = sbox2[Schar[Byte2]];
-	    Pchar[Byte0] = sbox3[Schar[Byte3]];
-	    P = (P >> 5) | ((P & ((1 << 5) - 1)) << (32 - 5));	/* right rot 5 bits */
-	    R ^= P;
-	}
+	fc_encrypt_block(&L, &R, schedule);
     } else {
 	INC_RXKAD_STATS(fc_encrypts[DECRYPT]);
-	schedule = &schedule[ROUNDS - 1];	/* start at end of key schedule */
-	for (i = 0; i < (ROUNDS / 2); i++) {
-	    S = *schedule-- ^ L;	/* xor R with key bits from schedule */
-	    Pchar[Byte2] = sbox0[Schar[Byte0]];	/* do 8-bit S Box subst. and */
-	    Pchar[Byte3] = sbox1[Schar[Byte1]];	/* permute the result */
-	    Pchar[Byte1] = sbox2[Schar[Byte2]];
-	    Pchar[Byte0] = sbox3[Schar[Byte3]];
-	    P = (P >> 5) | ((P & ((1 << 5) - 1)) << (32 - 5));	/* right rot 5 bits */
-	    R ^= P;		/* we're done with L, so save there */
-	    S = *schedule-- ^ R;	/* this time xor with L */
-	    Pchar[Byte2] = sbox0[Schar[Byte0]];
-	    Pchar[Byte3] = sbox1[Schar[Byte1]];
-	    Pchar[Byte1] = sbox2[Schar[Byte2]];
-	    Pchar[Byte0] = sbox3[Schar[Byte3]];
-	    P = (P >> 5) | ((P & ((1 << 5) - 1)) << (32 - 5));	/* right rot 5 bits */
-	    L ^= P;
-	}
+	fc_decrypt_block(&L, &R, schedule);
     }
-#if 0
-    memcpy(cipher, &L, sizeof(afs_int32));
-    memcpy(cipher + 1, &R, sizeof(afs_int32));
-#else
     *((afs_int32 *)cipher) = htonl(L);
     *((afs_int32 *)cipher + 1) = htonl(R);
-#endif
     return 0;
 }
 
@@ -192,6 +207,7 @@ fc_cbc_encrypt(void *input, void *output, afs_int32 length,
     afs_uint32 t_input[2];
     afs_uint32 t_output[2];
     unsigned char *t_in_p = (unsigned char *)t_input;
+    afs_uint32 L, R;
 
     if (encrypt) {
 	for (i = 0; length > 0; i++, length -= 8) {
@@ -203,11 +219,12 @@ fc_cbc_encrypt(void *input, void *output, afs_int32 length,
 	    for (j = length; j <= 7; j++)
 		*(t_in_p + j) = 0;
 
-	    /* do the xor for cbc into the temp */
-	    xor[0] ^= t_input[0];
-	    xor[1] ^= t_input[1];
-	    /* encrypt */
-	    fc_ecb_encrypt(xor, t_output, key, encrypt);
+	    /* do the xor for cbc, and encrypt */
+	    L = ntohl(xor[0] ^ t_input[0]);
+	    R = ntohl(xor[1] ^ t_input[1]);
+	    fc_encrypt_block(&L, &R, key);
+	    t_output[0] = htonl(L);
+	    t_output[1] = htonl(R);
 
 	    /* copy temp output and save it for cbc */
 	    memcpy(output, t_output, sizeof(t_output));
@@ -216,24 +233,51 @@ fc_cbc_encrypt(void *input, void *output, afs_int32 length,
 	    /* calculate xor value for next round from plain & cipher text */
 	    xor[0] = t_input[0] ^ t_output[0];
 	    xor[1] = t_input[1] ^ t_output[1];
-
-
 	}
+	ADD_RXKAD_STATS(fc_encrypts[ENCRYPT], i);
 	t_output[0] = 0;
 	t_output[1] = 0;
     } else {
-	/* decrypt */
-	for (i = 0; length > 0; i++, length -= 8) {
+	afs_uint32 c_input[2 * FC_INTERLEAVE];
+	afs_uint32 Ls[FC_INTERLEAVE], Rs[FC_INTERLEAVE];
+
+	/* decrypt.  Only the xor chains one block to the next, so take
+	 * the blocks FC_INTERLEAVE at a time while there are that many.
+	 * The input is all read before any output is written, since the
+	 * two may be the same buffer. */
+	for (i = 0; length >= 8 * FC_INTERLEAVE;
+	     i += FC_INTERLEAVE, length -= 8 * FC_INTERLEAVE) {
+	    memcpy(c_input, input, sizeof(c_input));
+	    input=((char *)input) + sizeof(c_input);
+
+	    for (j = 0; j < FC_INTERLEAVE; j++) {
+		Ls[j] = ntohl(c_input[2 * j]);
+		Rs[j] = ntohl(c_input[2 * j + 1]);
+	    }
+	    fc_decrypt_blocks(Ls, Rs, key);
+
+	    for (j = 0; j < FC_INTERLEAVE; j++) {
+		t_output[0] = htonl(Ls[j]) ^ xor[0];
+		t_output[1] = htonl(Rs[j]) ^ xor[1];
+		memcpy(output, t_output, sizeof(t_output));
+		output=((char *)output) + sizeof(t_output);
+		xor[0] = c_input[2 * j] ^ t_output[0];
+		xor[1] = c_input[2 * j + 1] ^ t_output[1];
+	    }
+	}
+	for (; length > 0; i++, length -= 8) {
 	    /* get input */
 	    memcpy(t_input, input, sizeof(t_input));
 	    input=((char *)input) + sizeof(t_input);
 
 	    /* no padding for decrypt */
-	    fc_ecb_encrypt(t_input, t_output, key, encrypt);
+	    L = ntohl(t_input[0]);
+	    R = ntohl(t_input[1]);
+	    fc_decrypt_block(&L, &R, key);
 
 	    /* do the xor for cbc into the output */
-	    t_output[0] ^= xor[0];
-	    t_output[1] ^= xor[1];
+	    t_output[0] = htonl(L) ^ xor[0];
+	    t_output[1] = htonl(R) ^ xor[1];
 
 	    /* copy temp output */
 	    memcpy(output, t_output, sizeof(t_output));
@@ -243,6 +287,7 @@ fc_cbc_encrypt(void *input, void *output, afs_int32 length,
 	    xor[0] = t_input[0] ^ t_output[0];
 	    xor[1] = t_input[1] ^ t_output[1];
 	}
+	ADD_RXKAD_STATS(fc_encrypts[DECRYPT], i);
     }
     return 0;
 }
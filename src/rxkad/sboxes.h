@@ -15,107 +15,235 @@
  * Initial revision
  *  */
 
-static const unsigned char sbox0[256] = {
-    0xea, 0x7f, 0xb2, 0x64, 0x9d, 0xb0, 0xd9, 0x11, 0xcd, 0x86, 0x86,
-    0x91, 0x0a, 0xb2, 0x93, 0x06, 0x0e, 0x06, 0xd2, 0x65, 0x73, 0xc5,
-    0x28, 0x60, 0xf2, 0x20, 0xb5, 0x38, 0x7e, 0xda, 0x9f, 0xe3, 0xd2,
-    0xcf, 0xc4, 0x3c, 0x61, 0xff, 0x4a, 0x4a, 0x35, 0xac, 0xaa, 0x5f,
-    0x2b, 0xbb, 0xbc, 0x53, 0x4e, 0x9d, 0x78, 0xa3, 0xdc, 0x09, 0x32,
-    0x10, 0xc6, 0x6f, 0x66, 0xd6, 0xab, 0xa9, 0xaf, 0xfd, 0x3b, 0x95,
-    0xe8, 0x34, 0x9a, 0x81, 0x72, 0x80, 0x9c, 0xf3, 0xec, 0xda, 0x9f,
-    0x26, 0x76, 0x15, 0x3e, 0x55, 0x4d, 0xde, 0x84, 0xee, 0xad, 0xc7,
-    0xf1, 0x6b, 0x3d, 0xd3, 0x04, 0x49, 0xaa, 0x24, 0x0b, 0x8a, 0x83,
-    0xba, 0xfa, 0x85, 0xa0, 0xa8, 0xb1, 0xd4, 0x01, 0xd8, 0x70, 0x64,
-    0xf0, 0x51, 0xd2, 0xc3, 0xa7, 0x75, 0x8c, 0xa5, 0x64, 0xef, 0x10,
-    0x4e, 0xb7, 0xc6, 0x61, 0x03, 0xeb, 0x44, 0x3d, 0xe5, 0xb3, 0x5b,
-    0xae, 0xd5, 0xad, 0x1d, 0xfa, 0x5a, 0x1e, 0x33, 0xab, 0x93, 0xa2,
-    0xb7, 0xe7, 0xa8, 0x45, 0xa4, 0xcd, 0x29, 0x63, 0x44, 0xb6, 0x69,
-    0x7e, 0x2e, 0x62, 0x03, 0xc8, 0xe0, 0x17, 0xbb, 0xc7, 0xf3, 0x3f,
-    0x36, 0xba, 0x71, 0x8e, 0x97, 0x65, 0x60, 0x69, 0xb6, 0xf6, 0xe6,
-    0x6e, 0xe0, 0x81, 0x59, 0xe8, 0xaf, 0xdd, 0x95, 0x22, 0x99, 0xfd,
-    0x63, 0x19, 0x74, 0x61, 0xb1, 0xb6, 0x5b, 0xae, 0x54, 0xb3, 0x70,
-    0xff, 0xc6, 0x3b, 0x3e, 0xc1, 0xd7, 0xe1, 0x0e, 0x76, 0xe5, 0x36,
-    0x4f, 0x59, 0xc7, 0x08, 0x6e, 0x82, 0xa6, 0x93, 0xc4, 0xaa, 0x26,
-    0x49, 0xe0, 0x21, 0x64, 0x07, 0x9f, 0x64, 0x81, 0x9c, 0xbf, 0xf9,
-    0xd1, 0x43, 0xf8, 0xb6, 0xb9, 0xf1, 0x24, 0x75, 0x03, 0xe4, 0xb0,
-    0x99, 0x46, 0x3d, 0xf5, 0xd1, 0x39, 0x72, 0x12, 0xf6, 0xba, 0x0c,
-    0x0d, 0x42, 0x2e
+/*
+ * The S-boxes are stored as the round function uses them: each byte is
+ * already shifted to the position its output takes in the 32-bit P word,
+ * and P's final right rotation by 5 bits is applied, so that a round is
+ * just four lookups XORed together.  sbox0 feeds byte 1 of P, sbox1
+ * byte 0, sbox2 byte 2 and sbox3 byte 3.
+ */
+#define FC_ROR5(x)	((((x) >> 5) | ((x) << 27)) & 0xffffffff)
+#define SBOX0(x)	FC_ROR5((afs_uint32)(x) << 8)
+#define SBOX1(x)	FC_ROR5((afs_uint32)(x))
+#define SBOX2(x)	FC_ROR5((afs_uint32)(x) << 16)
+#define SBOX3(x)	FC_ROR5((afs_uint32)(x) << 24)
+
+static const afs_uint32 sbox0[256] = {
+    SBOX0(0xea), SBOX0(0x7f), SBOX0(0xb2), SBOX0(0x64), SBOX0(0x9d),
+    SBOX0(0xb0), SBOX0(0xd9), SBOX0(0x11), SBOX0(0xcd), SBOX0(0x86),
+    SBOX0(0x86), SBOX0(0x91), SBOX0(0x0a), SBOX0(0xb2), SBOX0(0x93),
+    SBOX0(0x06), SBOX0(0x0e), SBOX0(0x06), SBOX0(0xd2), SBOX0(0x65),
+    SBOX0(0x73), SBOX0(0xc5), SBOX0(0x28), SBOX0(0x60), SBOX0(0xf2),
+    SBOX0(0x20), SBOX0(0xb5), SBOX0(0x38), SBOX0(0x7e), SBOX0(0xda),
+    SBOX0(0x9f), SBOX0(0xe3), SBOX0(0xd2), SBOX0(0xcf), SBOX0(0xc4),
+    SBOX0(0x3c), SBOX0(0x61), SBOX0(0xff), SBOX0(0x4a), SBOX0(0x4a),
+    SBOX0(0x35), SBOX0(0xac), SBOX0(0xaa), SBOX0(0x5f), SBOX0(0x2b),
+    SBOX0(0xbb), SBOX0(0xbc), SBOX0(0x53), SBOX0(0x4e), SBOX0(0x9d),
+    SBOX0(0x78), SBOX0(0xa3), SBOX0(0xdc), SBOX0(0x09), SBOX0(0x32),
+    SBOX0(0x10), SBOX0(0xc6), SBOX0(0x6f), SBOX0(0x66), SBOX0(0xd6),
+    SBOX0(0xab), SBOX0(0xa9), SBOX0(0xaf), SBOX0(0xfd), SBOX0(0x3b),
+    SBOX0(0x95), SBOX0(0xe8), SBOX0(0x34), SBOX0(0x9a), SBOX0(0x81),
+    SBOX0(0x72), SBOX0(0x80), SBOX0(0x9c), SBOX0(0xf3), SBOX0(0xec),
+    SBOX0(0xda), SBOX0(0x9f), SBOX0(0x26), SBOX0(0x76), SBOX0(0x15),
+    SBOX0(0x3e), SBOX0(0x55), SBOX0(0x4d), SBOX0(0xde), SBOX0(0x84),
+    SBOX0(0xee), SBOX0(0xad), SBOX0(0xc7), SBOX0(0xf1), SBOX0(0x6b),
+    SBOX0(0x3d), SBOX0(0xd3), SBOX0(0x04), SBOX0(0x49), SBOX0(0xaa),
+    SBOX0(0x24), SBOX0(0x0b), SBOX0(0x8a), SBOX0(0x83), SBOX0(0xba),
+    SBOX0(0xfa), SBOX0(0x85), SBOX0(0xa0), SBOX0(0xa8), SBOX0(0xb1),
+    SBOX0(0xd4), SBOX0(0x01), SBOX0(0xd8), SBOX0(0x70), SBOX0(0x64),
+    SBOX0(0xf0), SBOX0(0x51), SBOX0(0xd2), SBOX0(0xc3), SBOX0(0xa7),
+    SBOX0(0x75), SBOX0(0x8c), SBOX0(0xa5), SBOX0(0x64), SBOX0(0xef),
+    SBOX0(0x10), SBOX0(0x4e), SBOX0(0xb7), SBOX0(0xc6), SBOX0(0x61),
+    SBOX0(0x03), SBOX0(0xeb), SBOX0(0x44), SBOX0(0x3d), SBOX0(0xe5),
+    SBOX0(0xb3), SBOX0(0x5b), SBOX0(0xae), SBOX0(0xd5), SBOX0(0xad),
+    SBOX0(0x1d), SBOX0(0xfa), SBOX0(0x5a), SBOX0(0x1e), SBOX0(0x33),
+    SBOX0(0xab), SBOX0(0x93), SBOX0(0xa2), SBOX0(0xb7), SBOX0(0xe7),
+    SBOX0(0xa8), SBOX0(0x45), SBOX0(0xa4), SBOX0(0xcd), SBOX0(0x29),
+    SBOX0(0x63), SBOX0(0x44), SBOX0(0xb6), SBOX0(0x69), SBOX0(0x7e),
+    SBOX0(0x2e), SBOX0(0x62), SBOX0(0x03), SBOX0(0xc8), SBOX0(0xe0),
+    SBOX0(0x17), SBOX0(0xbb), SBOX0(0xc7), SBOX0(0xf3), SBOX0(0x3f),
+    SBOX0(0x36), SBOX0(0xba), SBOX0(0x71), SBOX0(0x8e), SBOX0(0x97),
+    SBOX0(0x65), SBOX0(0x60), SBOX0(0x69), SBOX0(0xb6), SBOX0(0xf6),
+    SBOX0(0xe6), SBOX0(0x6e), SBOX0(0xe0), SBOX0(0x81), SBOX0(0x59),
+    SBOX0(0xe8), SBOX0(0xaf), SBOX0(0xdd), SBOX0(0x95), SBOX0(0x22),
+    SBOX0(0x99), SBOX0(0xfd), SBOX0(0x63), SBOX0(0x19), SBOX0(0x74),
+    SBOX0(0x61), SBOX0(0xb1), SBOX0(0xb6), SBOX0(0x5b), SBOX0(0xae),
+    SBOX0(0x54), SBOX0(0xb3), SBOX0(0x70), SBOX0(0xff), SBOX0(0xc6),
+    SBOX0(0x3b), SBOX0(0x3e), SBOX0(0xc1), SBOX0(0xd7), SBOX0(0xe1),
+    SBOX0(0x0e), SBOX0(0x76), SBOX0(0xe5), SBOX0(0x36), SBOX0(0x4f),
+    SBOX0(0x59), SBOX0(0xc7), SBOX0(0x08), SBOX0(0x6e), SBOX0(0x82),
+    SBOX0(0xa6), SBOX0(0x93), SBOX0(0xc4), SBOX0(0xaa), SBOX0(0x26),
+    SBOX0(0x49), SBOX0(0xe0), SBOX0(0x21), SBOX0(0x64), SBOX0(0x07),
+    SBOX0(0x9f), SBOX0(0x64), SBOX0(0x81), SBOX0(0x9c), SBOX0(0xbf),
+    SBOX0(0xf9), SBOX0(0xd1), SBOX0(0x43), SBOX0(0xf8), SBOX0(0xb6),
+    SBOX0(0xb9), SBOX0(0xf1), SBOX0(0x24), SBOX0(0x75), SBOX0(0x03),
+    SBOX0(0xe4), SBOX0(0xb0), SBOX0(0x99), SBOX0(0x46), SBOX0(0x3d),
+    SBOX0(0xf5), SBOX0(0xd1), SBOX0(0x39), SBOX0(0x72), SBOX0(0x12),
+    SBOX0(0xf6), SBOX0(0xba), SBOX0(0x0c), SBOX0(0x0d), SBOX0(0x42),
+    SBOX0(0x2e)
 };
-static const unsigned char sbox1[256] = {
-    0x77, 0x14, 0xa6, 0xfe, 0xb2, 0x5e, 0x8c, 0x3e, 0x67, 0x6c, 0xa1,
-    0x0d, 0xc2, 0xa2, 0xc1, 0x85, 0x6c, 0x7b, 0x67, 0xc6, 0x23, 0xe3,
-    0xf2, 0x89, 0x50, 0x9c, 0x03, 0xb7, 0x73, 0xe6, 0xe1, 0x39, 0x31,
-    0x2c, 0x27, 0x9f, 0xa5, 0x69, 0x44, 0xd6, 0x23, 0x83, 0x98, 0x7d,
-    0x3c, 0xb4, 0x2d, 0x99, 0x1c, 0x1f, 0x8c, 0x20, 0x03, 0x7c, 0x5f,
-    0xad, 0xf4, 0xfa, 0x95, 0xca, 0x76, 0x44, 0xcd, 0xb6, 0xb8, 0xa1,
-    0xa1, 0xbe, 0x9e, 0x54, 0x8f, 0x0b, 0x16, 0x74, 0x31, 0x8a, 0x23,
-    0x17, 0x04, 0xfa, 0x79, 0x84, 0xb1, 0xf5, 0x13, 0xab, 0xb5, 0x2e,
-    0xaa, 0x0c, 0x60, 0x6b, 0x5b, 0xc4, 0x4b, 0xbc, 0xe2, 0xaf, 0x45,
-    0x73, 0xfa, 0xc9, 0x49, 0xcd, 0000, 0x92, 0x7d, 0x97, 0x7a, 0x18,
-    0x60, 0x3d, 0xcf, 0x5b, 0xde, 0xc6, 0xe2, 0xe6, 0xbb, 0x8b, 0x06,
-    0xda, 0x08, 0x15, 0x1b, 0x88, 0x6a, 0x17, 0x89, 0xd0, 0xa9, 0xc1,
-    0xc9, 0x70, 0x6b, 0xe5, 0x43, 0xf4, 0x68, 0xc8, 0xd3, 0x84, 0x28,
-    0x0a, 0x52, 0x66, 0xa3, 0xca, 0xf2, 0xe3, 0x7f, 0x7a, 0x31, 0xf7,
-    0x88, 0x94, 0x5e, 0x9c, 0x63, 0xd5, 0x24, 0x66, 0xfc, 0xb3, 0x57,
-    0x25, 0xbe, 0x89, 0x44, 0xc4, 0xe0, 0x8f, 0x23, 0x3c, 0x12, 0x52,
-    0xf5, 0x1e, 0xf4, 0xcb, 0x18, 0x33, 0x1f, 0xf8, 0x69, 0x10, 0x9d,
-    0xd3, 0xf7, 0x28, 0xf8, 0x30, 0x05, 0x5e, 0x32, 0xc0, 0xd5, 0x19,
-    0xbd, 0x45, 0x8b, 0x5b, 0xfd, 0xbc, 0xe2, 0x5c, 0xa9, 0x96, 0xef,
-    0x70, 0xcf, 0xc2, 0x2a, 0xb3, 0x61, 0xad, 0x80, 0x48, 0x81, 0xb7,
-    0x1d, 0x43, 0xd9, 0xd7, 0x45, 0xf0, 0xd8, 0x8a, 0x59, 0x7c, 0x57,
-    0xc1, 0x79, 0xc7, 0x34, 0xd6, 0x43, 0xdf, 0xe4, 0x78, 0x16, 0x06,
-    0xda, 0x92, 0x76, 0x51, 0xe1, 0xd4, 0x70, 0x03, 0xe0, 0x2f, 0x96,
-    0x91, 0x82, 0x80
+
+static const afs_uint32 sbox1[256] = {
+    SBOX1(0x77), SBOX1(0x14), SBOX1(0xa6), SBOX1(0xfe), SBOX1(0xb2),
+    SBOX1(0x5e), SBOX1(0x8c), SBOX1(0x3e), SBOX1(0x67), SBOX1(0x6c),
+    SBOX1(0xa1), SBOX1(0x0d), SBOX1(0xc2), SBOX1(0xa2), SBOX1(0xc1),
+    SBOX1(0x85), SBOX1(0x6c), SBOX1(0x7b), SBOX1(0x67), SBOX1(0xc6),
+    SBOX1(0x23), SBOX1(0xe3), SBOX1(0xf2), SBOX1(0x89), SBOX1(0x50),
+    SBOX1(0x9c), SBOX1(0x03), SBOX1(0xb7), SBOX1(0x73), SBOX1(0xe6),
+    SBOX1(0xe1), SBOX1(0x39), SBOX1(0x31), SBOX1(0x2c), SBOX1(0x27),
+    SBOX1(0x9f), SBOX1(0xa5), SBOX1(0x69), SBOX1(0x44), SBOX1(0xd6),
+    SBOX1(0x23), SBOX1(0x83), SBOX1(0x98), SBOX1(0x7d), SBOX1(0x3c),
+    SBOX1(0xb4), SBOX1(0x2d), SBOX1(0x99), SBOX1(0x1c), SBOX1(0x1f),
+    SBOX1(0x8c), SBOX1(0x20), SBOX1(0x03), SBOX1(0x7c), SBOX1(0x5f),
+    SBOX1(0xad), SBOX1(0xf4), SBOX1(0xfa), SBOX1(0x95), SBOX1(0xca),
+    SBOX1(0x76), SBOX1(0x44), SBOX1(0xcd), SBOX1(0xb6), SBOX1(0xb8),
+    SBOX1(0xa1), SBOX1(0xa1), SBOX1(0xbe), SBOX1(0x9e), SBOX1(0x54),
+    SBOX1(0x8f), SBOX1(0x0b), SBOX1(0x16), SBOX1(0x74), SBOX1(0x31),
+    SBOX1(0x8a), SBOX1(0x23), SBOX1(0x17), SBOX1(0x04), SBOX1(0xfa),
+    SBOX1(0x79), SBOX1(0x84), SBOX1(0xb1), SBOX1(0xf5), SBOX1(0x13),
+    SBOX1(0xab), SBOX1(0xb5), SBOX1(0x2e), SBOX1(0xaa), SBOX1(0x0c),
+    SBOX1(0x60), SBOX1(0x6b), SBOX1(0x5b), SBOX1(0xc4), SBOX1(0x4b),
+    SBOX1(0xbc), SBOX1(0xe2), SBOX1(0xaf), SBOX1(0x45), SBOX1(0x73),
+    SBOX1(0xfa), SBOX1(0xc9), SBOX1(0x49), SBOX1(0xcd), SBOX1(0x00),
+    SBOX1(0x92), SBOX1(0x7d), SBOX1(0x97), SBOX1(0x7a), SBOX1(0x18),
+    SBOX1(0x60), SBOX1(0x3d), SBOX1(0xcf), SBOX1(0x5b), SBOX1(0xde),
+    SBOX1(0xc6), SBOX1(0xe2), SBOX1(0xe6), SBOX1(0xbb), SBOX1(0x8b),
+    SBOX1(0x06), SBOX1(0xda), SBOX1(0x08), SBOX1(0x15), SBOX1(0x1b),
+    SBOX1(0x88), SBOX1(0x6a), SBOX1(0x17), SBOX1(0x89), SBOX1(0xd0),
+    SBOX1(0xa9), SBOX1(0xc1), SBOX1(0xc9), SBOX1(0x70), SBOX1(0x6b),
+    SBOX1(0xe5), SBOX1(0x43), SBOX1(0xf4), SBOX1(0x68), SBOX1(0xc8),
+    SBOX1(0xd3), SBOX1(0x84), SBOX1(0x28), SBOX1(0x0a), SBOX1(0x52),
+    SBOX1(0x66), SBOX1(0xa3), SBOX1(0xca), SBOX1(0xf2), SBOX1(0xe3),
+    SBOX1(0x7f), SBOX1(0x7a), SBOX1(0x31), SBOX1(0xf7), SBOX1(0x88),
+    SBOX1(0x94), SBOX1(0x5e), SBOX1(0x9c), SBOX1(0x63), SBOX1(0xd5),
+    SBOX1(0x24), SBOX1(0x66), SBOX1(0xfc), SBOX1(0xb3), SBOX1(0x57),
+    SBOX1(0x25), SBOX1(0xbe), SBOX1(0x89), SBOX1(0x44), SBOX1(0xc4),
+    SBOX1(0xe0), SBOX1(0x8f), SBOX1(0x23), SBOX1(0x3c), SBOX1(0x12),
+    SBOX1(0x52), SBOX1(0xf5), SBOX1(0x1e), SBOX1(0xf4), SBOX1(0xcb),
+    SBOX1(0x18), SBOX1(0x33), SBOX1(0x1f), SBOX1(0xf8), SBOX1(0x69),
+    SBOX1(0x10), SBOX1(0x9d), SBOX1(0xd3), SBOX1(0xf7), SBOX1(0x28),
+    SBOX1(0xf8), SBOX1(0x30), SBOX1(0x05), SBOX1(0x5e), SBOX1(0x32),
+    SBOX1(0xc0), SBOX1(0xd5), SBOX1(0x19), SBOX1(0xbd), SBOX1(0x45),
+    SBOX1(0x8b), SBOX1(0x5b), SBOX1(0xfd), SBOX1(0xbc), SBOX1(0xe2),
+    SBOX1(0x5c), SBOX1(0xa9), SBOX1(0x96), SBOX1(0xef), SBOX1(0x70),
+    SBOX1(0xcf), SBOX1(0xc2), SBOX1(0x2a), SBOX1(0xb3), SBOX1(0x61),
+    SBOX1(0xad), SBOX1(0x80), SBOX1(0x48), SBOX1(0x81), SBOX1(0xb7),
+    SBOX1(0x1d), SBOX1(0x43), SBOX1(0xd9), SBOX1(0xd7), SBOX1(0x45),
+    SBOX1(0xf0), SBOX1(0xd8), SBOX1(0x8a), SBOX1(0x59), SBOX1(0x7c),
+    SBOX1(0x57), SBOX1(0xc1), SBOX1(0x79), SBOX1(0xc7), SBOX1(0x34),
+    SBOX1(0xd6), SBOX1(0x43), SBOX1(0xdf), SBOX1(0xe4), SBOX1(0x78),
+    SBOX1(0x16), SBOX1(0x06), SBOX1(0xda), SBOX1(0x92), SBOX1(0x76),
+    SBOX1(0x51), SBOX1(0xe1), SBOX1(0xd4), SBOX1(0x70), SBOX1(0x03),
+    SBOX1(0xe0), SBOX1(0x2f), SBOX1(0x96), SBOX1(0x91), SBOX1(0x82),
+    SBOX1(0x80)
 };
-static const unsigned char sbox2[256] = {
-    0xf0, 0x37, 0x24, 0x53, 0x2a, 0x03, 0x83, 0x86, 0xd1, 0xec, 0x50,
-    0xf0, 0x42, 0x78, 0x2f, 0x6d, 0xbf, 0x80, 0x87, 0x27, 0x95, 0xe2,
-    0xc5, 0x5d, 0xf9, 0x6f, 0xdb, 0xb4, 0x65, 0x6e, 0xe7, 0x24, 0xc8,
-    0x1a, 0xbb, 0x49, 0xb5, 0x0a, 0x7d, 0xb9, 0xe8, 0xdc, 0xb7, 0xd9,
-    0x45, 0x20, 0x1b, 0xce, 0x59, 0x9d, 0x6b, 0xbd, 0x0e, 0x8f, 0xa3,
-    0xa9, 0xbc, 0x74, 0xa6, 0xf6, 0x7f, 0x5f, 0xb1, 0x68, 0x84, 0xbc,
-    0xa9, 0xfd, 0x55, 0x50, 0xe9, 0xb6, 0x13, 0x5e, 0x07, 0xb8, 0x95,
-    0x02, 0xc0, 0xd0, 0x6a, 0x1a, 0x85, 0xbd, 0xb6, 0xfd, 0xfe, 0x17,
-    0x3f, 0x09, 0xa3, 0x8d, 0xfb, 0xed, 0xda, 0x1d, 0x6d, 0x1c, 0x6c,
-    0x01, 0x5a, 0xe5, 0x71, 0x3e, 0x8b, 0x6b, 0xbe, 0x29, 0xeb, 0x12,
-    0x19, 0x34, 0xcd, 0xb3, 0xbd, 0x35, 0xea, 0x4b, 0xd5, 0xae, 0x2a,
-    0x79, 0x5a, 0xa5, 0x32, 0x12, 0x7b, 0xdc, 0x2c, 0xd0, 0x22, 0x4b,
-    0xb1, 0x85, 0x59, 0x80, 0xc0, 0x30, 0x9f, 0x73, 0xd3, 0x14, 0x48,
-    0x40, 0x07, 0x2d, 0x8f, 0x80, 0x0f, 0xce, 0x0b, 0x5e, 0xb7, 0x5e,
-    0xac, 0x24, 0x94, 0x4a, 0x18, 0x15, 0x05, 0xe8, 0x02, 0x77, 0xa9,
-    0xc7, 0x40, 0x45, 0x89, 0xd1, 0xea, 0xde, 0x0c, 0x79, 0x2a, 0x99,
-    0x6c, 0x3e, 0x95, 0xdd, 0x8c, 0x7d, 0xad, 0x6f, 0xdc, 0xff, 0xfd,
-    0x62, 0x47, 0xb3, 0x21, 0x8a, 0xec, 0x8e, 0x19, 0x18, 0xb4, 0x6e,
-    0x3d, 0xfd, 0x74, 0x54, 0x1e, 0x04, 0x85, 0xd8, 0xbc, 0x1f, 0x56,
-    0xe7, 0x3a, 0x56, 0x67, 0xd6, 0xc8, 0xa5, 0xf3, 0x8e, 0xde, 0xae,
-    0x37, 0x49, 0xb7, 0xfa, 0xc8, 0xf4, 0x1f, 0xe0, 0x2a, 0x9b, 0x15,
-    0xd1, 0x34, 0x0e, 0xb5, 0xe0, 0x44, 0x78, 0x84, 0x59, 0x56, 0x68,
-    0x77, 0xa5, 0x14, 0x06, 0xf5, 0x2f, 0x8c, 0x8a, 0x73, 0x80, 0x76,
-    0xb4, 0x10, 0x86
+
+static const afs_uint32 sbox2[256] = {
+    SBOX2(0xf0), SBOX2(0x37), SBOX2(0x24), SBOX2(0x53), SBOX2(0x2a),
+    SBOX2(0x03), SBOX2(0x83), SBOX2(0x86), SBOX2(0xd1), SBOX2(0xec),
+    SBOX2(0x50), SBOX2(0xf0), SBOX2(0x42), SBOX2(0x78), SBOX2(0x2f),
+    SBOX2(0x6d), SBOX2(0xbf), SBOX2(0x80), SBOX2(0x87), SBOX2(0x27),
+    SBOX2(0x95), SBOX2(0xe2), SBOX2(0xc5), SBOX2(0x5d), SBOX2(0xf9),
+    SBOX2(0x6f), SBOX2(0xdb), SBOX2(0xb4), SBOX2(0x65), SBOX2(0x6e),
+    SBOX2(0xe7), SBOX2(0x24), SBOX2(0xc8), SBOX2(0x1a), SBOX2(0xbb),
+    SBOX2(0x49), SBOX2(0xb5), SBOX2(0x0a), SBOX2(0x7d), SBOX2(0xb9),
+    SBOX2(0xe8), SBOX2(0xdc), SBOX2(0xb7), SBOX2(0xd9), SBOX2(0x45),
+    SBOX2(0x20), SBOX2(0x1b), SBOX2(0xce), SBOX2(0x59), SBOX2(0x9d),
+    SBOX2(0x6b), SBOX2(0xbd), SBOX2(0x0e), SBOX2(0x8f), SBOX2(0xa3),
+    SBOX2(0xa9), SBOX2(0xbc), SBOX2(0x74), SBOX2(0xa6), SBOX2(0xf6),
+    SBOX2(0x7f), SBOX2(0x5f), SBOX2(0xb1), SBOX2(0x68), SBOX2(0x84),
+    SBOX2(0xbc), SBOX2(0xa9), SBOX2(0xfd), SBOX2(0x55), SBOX2(0x50),
+    SBOX2(0xe9), SBOX2(0xb6), SBOX2(0x13), SBOX2(0x5e), SBOX2(0x07),
+    SBOX2(0xb8), SBOX2(0x95), SBOX2(0x02), SBOX2(0xc0), SBOX2(0xd0),
+    SBOX2(0x6a), SBOX2(0x1a), SBOX2(0x85), SBOX2(0xbd), SBOX2(0xb6),
+    SBOX2(0xfd), SBOX2(0xfe), SBOX2(0x17), SBOX2(0x3f), SBOX2(0x09),
+    SBOX2(0xa3), SBOX2(0x8d), SBOX2(0xfb), SBOX2(0xed), SBOX2(0xda),
+    SBOX2(0x1d), SBOX2(0x6d), SBOX2(0x1c), SBOX2(0x6c), SBOX2(0x01),
+    SBOX2(0x5a), SBOX2(0xe5), SBOX2(0x71), SBOX2(0x3e), SBOX2(0x8b),
+    SBOX2(0x6b), SBOX2(0xbe), SBOX2(0x29), SBOX2(0xeb), SBOX2(0x12),
+    SBOX2(0x19), SBOX2(0x34), SBOX2(0xcd), SBOX2(0xb3), SBOX2(0xbd),
+    SBOX2(0x35), SBOX2(0xea), SBOX2(0x4b), SBOX2(0xd5), SBOX2(0xae),
+    SBOX2(0x2a), SBOX2(0x79), SBOX2(0x5a), SBOX2(0xa5), SBOX2(0x32),
+    SBOX2(0x12), SBOX2(0x7b), SBOX2(0xdc), SBOX2(0x2c), SBOX2(0xd0),
+    SBOX2(0x22), SBOX2(0x4b), SBOX2(0xb1), SBOX2(0x85), SBOX2(0x59),
+    SBOX2(0x80), SBOX2(0xc0), SBOX2(0x30), SBOX2(0x9f), SBOX2(0x73),
+    SBOX2(0xd3), SBOX2(0x14), SBOX2(0x48), SBOX2(0x40), SBOX2(0x07),
+    SBOX2(0x2d), SBOX2(0x8f), SBOX2(0x80), SBOX2(0x0f), SBOX2(0xce),
+    SBOX2(0x0b), SBOX2(0x5e), SBOX2(0xb7), SBOX2(0x5e), SBOX2(0xac),
+    SBOX2(0x24), SBOX2(0x94), SBOX2(0x4a), SBOX2(0x18), SBOX2(0x15),
+    SBOX2(0x05), SBOX2(0xe8), SBOX2(0x02), SBOX2(0x77), SBOX2(0xa9),
+    SBOX2(0xc7), SBOX2(0x40), SBOX2(0x45), SBOX2(0x89), SBOX2(0xd1),
+    SBOX2(0xea), SBOX2(0xde), SBOX2(0x0c), SBOX2(0x79), SBOX2(0x2a),
+    SBOX2(0x99), SBOX2(0x6c), SBOX2(0x3e), SBOX2(0x95), SBOX2(0xdd),
+    SBOX2(0x8c), SBOX2(0x7d), SBOX2(0xad), SBOX2(0x6f), SBOX2(0xdc),
+    SBOX2(0xff), SBOX2(0xfd), SBOX2(0x62), SBOX2(0x47), SBOX2(0xb3),
+    SBOX2(0x21), SBOX2(0x8a), SBOX2(0xec), SBOX2(0x8e), SBOX2(0x19),
+    SBOX2(0x18), SBOX2(0xb4), SBOX2(0x6e), SBOX2(0x3d), SBOX2(0xfd),
+    SBOX2(0x74), SBOX2(0x54), SBOX2(0x1e), SBOX2(0x04), SBOX2(0x85),
+    SBOX2(0xd8), SBOX2(0xbc), SBOX2(0x1f), SBOX2(0x56), SBOX2(0xe7),
+    SBOX2(0x3a), SBOX2(0x56), SBOX2(0x67), SBOX2(0xd6), SBOX2(0xc8),
+    SBOX2(0xa5), SBOX2(0xf3), SBOX2(0x8e), SBOX2(0xde), SBOX2(0xae),
+    SBOX2(0x37), SBOX2(0x49), SBOX2(0xb7), SBOX2(0xfa), SBOX2(0xc8),
+    SBOX2(0xf4), SBOX2(0x1f), SBOX2(0xe0), SBOX2(0x2a), SBOX2(0x9b),
+    SBOX2(0x15), SBOX2(0xd1), SBOX2(0x34), SBOX2(0x0e), SBOX2(0xb5),
+    SBOX2(0xe0), SBOX2(0x44), SBOX2(0x78), SBOX2(0x84), SBOX2(0x59),
+    SBOX2(0x56), SBOX2(0x68), SBOX2(0x77), SBOX2(0xa5), SBOX2(0x14),
+    SBOX2(0x06), SBOX2(0xf5), SBOX2(0x2f), SBOX2(0x8c), SBOX2(0x8a),
+    SBOX2(0x73), SBOX2(0x80), SBOX2(0x76), SBOX2(0xb4), SBOX2(0x10),
+    SBOX2(0x86)
 };
-static const unsigned char sbox3[256] = {
-    0xa9, 0x2a, 0x48, 0x51, 0x84, 0x7e, 0x49, 0xe2, 0xb5, 0xb7, 0x42,
-    0x33, 0x7d, 0x5d, 0xa6, 0x12, 0x44, 0x48, 0x6d, 0x28, 0xaa, 0x20,
-    0x6d, 0x57, 0xd6, 0x6b, 0x5d, 0x72, 0xf0, 0x92, 0x5a, 0x1b, 0x53,
-    0x80, 0x24, 0x70, 0x9a, 0xcc, 0xa7, 0x66, 0xa1, 0x01, 0xa5, 0x41,
-    0x97, 0x41, 0x31, 0x82, 0xf1, 0x14, 0xcf, 0x53, 0x0d, 0xa0, 0x10,
-    0xcc, 0x2a, 0x7d, 0xd2, 0xbf, 0x4b, 0x1a, 0xdb, 0x16, 0x47, 0xf6,
-    0x51, 0x36, 0xed, 0xf3, 0xb9, 0x1a, 0xa7, 0xdf, 0x29, 0x43, 0x01,
-    0x54, 0x70, 0xa4, 0xbf, 0xd4, 0x0b, 0x53, 0x44, 0x60, 0x9e, 0x23,
-    0xa1, 0x18, 0x68, 0x4f, 0xf0, 0x2f, 0x82, 0xc2, 0x2a, 0x41, 0xb2,
-    0x42, 0x0c, 0xed, 0x0c, 0x1d, 0x13, 0x3a, 0x3c, 0x6e, 0x35, 0xdc,
-    0x60, 0x65, 0x85, 0xe9, 0x64, 0x02, 0x9a, 0x3f, 0x9f, 0x87, 0x96,
-    0xdf, 0xbe, 0xf2, 0xcb, 0xe5, 0x6c, 0xd4, 0x5a, 0x83, 0xbf, 0x92,
-    0x1b, 0x94, 0000, 0x42, 0xcf, 0x4b, 0000, 0x75, 0xba, 0x8f, 0x76,
-    0x5f, 0x5d, 0x3a, 0x4d, 0x09, 0x12, 0x08, 0x38, 0x95, 0x17, 0xe4,
-    0x01, 0x1d, 0x4c, 0xa9, 0xcc, 0x85, 0x82, 0x4c, 0x9d, 0x2f, 0x3b,
-    0x66, 0xa1, 0x34, 0x10, 0xcd, 0x59, 0x89, 0xa5, 0x31, 0xcf, 0x05,
-    0xc8, 0x84, 0xfa, 0xc7, 0xba, 0x4e, 0x8b, 0x1a, 0x19, 0xf1, 0xa1,
-    0x3b, 0x18, 0x12, 0x17, 0xb0, 0x98, 0x8d, 0x0b, 0x23, 0xc3, 0x3a,
-    0x2d, 0x20, 0xdf, 0x13, 0xa0, 0xa8, 0x4c, 0x0d, 0x6c, 0x2f, 0x47,
-    0x13, 0x13, 0x52, 0x1f, 0x2d, 0xf5, 0x79, 0x3d, 0xa2, 0x54, 0xbd,
-    0x69, 0xc8, 0x6b, 0xf3, 0x05, 0x28, 0xf1, 0x16, 0x46, 0x40, 0xb0,
-    0x11, 0xd3, 0xb7, 0x95, 0x49, 0xcf, 0xc3, 0x1d, 0x8f, 0xd8, 0xe1,
-    0x73, 0xdb, 0xad, 0xc8, 0xc9, 0xa9, 0xa1, 0xc2, 0xc5, 0xe3, 0xba,
-    0xfc, 0x0e, 0x25
+
+static const afs_uint32 sbox3[256] = {
+    SBOX3(0xa9), SBOX3(0x2a), SBOX3(0x48), SBOX3(0x51), SBOX3(0x84),
+    SBOX3(0x7e), SBOX3(0x49), SBOX3(0xe2), SBOX3(0xb5), SBOX3(0xb7),
+    SBOX3(0x42), SBOX3(0x33), SBOX3(0x7d), SBOX3(0x5d), SBOX3(0xa6),
+    SBOX3(0x12), SBOX3(0x44), SBOX3(0x48), SBOX3(0x6d), SBOX3(0x28),
+    SBOX3(0xaa), SBOX3(0x20), SBOX3(0x6d), SBOX3(0x57), SBOX3(0xd6),
+    SBOX3(0x6b), SBOX3(0x5d), SBOX3(0x72), SBOX3(0xf0), SBOX3(0x92),
+    SBOX3(0x5a), SBOX3(0x1b), SBOX3(0x53), SBOX3(0x80), SBOX3(0x24),
+    SBOX3(0x70), SBOX3(0x9a), SBOX3(0xcc), SBOX3(0xa7), SBOX3(0x66),
+    SBOX3(0xa1), SBOX3(0x01), SBOX3(0xa5), SBOX3(0x41), SBOX3(0x97),
+    SBOX3(0x41), SBOX3(0x31), SBOX3(0x82), SBOX3(0xf1), SBOX3(0x14),
+    SBOX3(0xcf), SBOX3(0x53), SBOX3(0x0d), SBOX3(0xa0), SBOX3(0x10),
+    SBOX3(0xcc), SBOX3(0x2a), SBOX3(0x7d), SBOX3(0xd2), SBOX3(0xbf),
+    SBOX3(0x4b), SBOX3(0x1a), SBOX3(0xdb), SBOX3(0x16), SBOX3(0x47),
+    SBOX3(0xf6), SBOX3(0x51), SBOX3(0x36), SBOX3(0xed), SBOX3(0xf3),
+    SBOX3(0xb9), SBOX3(0x1a), SBOX3(0xa7), SBOX3(0xdf), SBOX3(0x29),
+    SBOX3(0x43), SBOX3(0x01), SBOX3(0x54), SBOX3(0x70), SBOX3(0xa4),
+    SBOX3(0xbf), SBOX3(0xd4), SBOX3(0x0b), SBOX3(0x53), SBOX3(0x44),
+    SBOX3(0x60), SBOX3(0x9e), SBOX3(0x23), SBOX3(0xa1), SBOX3(0x18),
+    SBOX3(0x68), SBOX3(0x4f), SBOX3(0xf0), SBOX3(0x2f), SBOX3(0x82),
+    SBOX3(0xc2), SBOX3(0x2a), SBOX3(0x41), SBOX3(0xb2), SBOX3(0x42),
+    SBOX3(0x0c), SBOX3(0xed), SBOX3(0x0c), SBOX3(0x1d), SBOX3(0x13),
+    SBOX3(0x3a), SBOX3(0x3c), SBOX3(0x6e), SBOX3(0x35), SBOX3(0xdc),
+    SBOX3(0x60), SBOX3(0x65), SBOX3(0x85), SBOX3(0xe9), SBOX3(0x64),
+    SBOX3(0x02), SBOX3(0x9a), SBOX3(0x3f), SBOX3(0x9f), SBOX3(0x87),
+    SBOX3(0x96), SBOX3(0xdf), SBOX3(0xbe), SBOX3(0xf2), SBOX3(0xcb),
+    SBOX3(0xe5), SBOX3(0x6c), SBOX3(0xd4), SBOX3(0x5a), SBOX3(0x83),
+    SBOX3(0xbf), SBOX3(0x92), SBOX3(0x1b), SBOX3(0x94), SBOX3(0x00),
+    SBOX3(0x42), SBOX3(0xcf), SBOX3(0x4b), SBOX3(0x00), SBOX3(0x75),
+    SBOX3(0xba), SBOX3(0x8f), SBOX3(0x76), SBOX3(0x5f), SBOX3(0x5d),
+    SBOX3(0x3a), SBOX3(0x4d), SBOX3(0x09), SBOX3(0x12), SBOX3(0x08),
+    SBOX3(0x38), SBOX3(0x95), SBOX3(0x17), SBOX3(0xe4), SBOX3(0x01),
+    SBOX3(0x1d), SBOX3(0x4c), SBOX3(0xa9), SBOX3(0xcc), SBOX3(0x85),
+    SBOX3(0x82), SBOX3(0x4c), SBOX3(0x9d), SBOX3(0x2f), SBOX3(0x3b),
+    SBOX3(0x66), SBOX3(0xa1), SBOX3(0x34), SBOX3(0x10), SBOX3(0xcd),
+    SBOX3(0x59), SBOX3(0x89), SBOX3(0xa5), SBOX3(0x31), SBOX3(0xcf),
+    SBOX3(0x05), SBOX3(0xc8), SBOX3(0x84), SBOX3(0xfa), SBOX3(0xc7),
+    SBOX3(0xba), SBOX3(0x4e), SBOX3(0x8b), SBOX3(0x1a), SBOX3(0x19),
+    SBOX3(0xf1), SBOX3(0xa1), SBOX3(0x3b), SBOX3(0x18), SBOX3(0x12),
+    SBOX3(0x17), SBOX3(0xb0), SBOX3(0x98), SBOX3(0x8d), SBOX3(0x0b),
+    SBOX3(0x23), SBOX3(0xc3), SBOX3(0x3a), SBOX3(0x2d), SBOX3(0x20),
+    SBOX3(0xdf), SBOX3(0x13), SBOX3(0xa0), SBOX3(0xa8), SBOX3(0x4c),
+    SBOX3(0x0d), SBOX3(0x6c), SBOX3(0x2f), SBOX3(0x47), SBOX3(0x13),
+    SBOX3(0x13), SBOX3(0x52), SBOX3(0x1f), SBOX3(0x2d), SBOX3(0xf5),
+    SBOX3(0x79), SBOX3(0x3d), SBOX3(0xa2), SBOX3(0x54), SBOX3(0xbd),
+    SBOX3(0x69), SBOX3(0xc8), SBOX3(0x6b), SBOX3(0xf3), SBOX3(0x05),
+    SBOX3(0x28), SBOX3(0xf1), SBOX3(0x16), SBOX3(0x46), SBOX3(0x40),
+    SBOX3(0xb0), SBOX3(0x11), SBOX3(0xd3), SBOX3(0xb7), SBOX3(0x95),
+    SBOX3(0x49), SBOX3(0xcf), SBOX3(0xc3), SBOX3(0x1d), SBOX3(0x8f),
+    SBOX3(0xd8), SBOX3(0xe1), SBOX3(0x73), SBOX3(0xdb), SBOX3(0xad),
+    SBOX3(0xc8), SBOX3(0xc9), SBOX3(0xa9), SBOX3(0xa1), SBOX3(0xc2),
+    SBOX3(0xc5), SBOX3(0xe3), SBOX3(0xba), SBOX3(0xfc), SBOX3(0x0e),
+    SBOX3(0x25)
 };
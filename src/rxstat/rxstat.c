@@ -66,6 +66,25 @@ MRXSTATS_RetrievePeerRPCStats(struct rx_call * call,
 }
 
 
+afs_int32
+MRXSTATS_RetrieveProcessRPCLatency(struct rx_call * call,
+				   IN afs_uint32 clientVersion,
+				   OUT afs_uint32 * serverVersion,
+				   OUT afs_uint32 * bucket_count,
+				   OUT afs_uint32 * stat_count,
+				   OUT rpcStats * stats)
+{
+    afs_int32 rc;
+    size_t allocSize;
+
+    rc = rx_RetrieveProcessRPCLatency(clientVersion, serverVersion,
+				      bucket_count, &allocSize, stat_count,
+				      &stats->rpcStats_val);
+    stats->rpcStats_len = (u_int)(allocSize / sizeof(afs_uint32));
+    return rc;
+}
+
+
 afs_int32
 MRXSTATS_QueryProcessRPCStats(struct rx_call * call, OUT afs_int32 * on)
 {
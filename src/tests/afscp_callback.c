@@ -165,3 +165,11 @@ SRXAFSCB_TellMeAboutYourself(struct rx_call *rxcall,
 {
      return RXGEN_OPCODE;
 }
+
+afs_int32
+SRXAFSCB_CallBackDirDelta(struct rx_call *rxcall, struct AFSFid *dirFid,
+			  struct AFSDirDeltaStatus *dirStatus,
+			  AFSDirDeltas *deltas)
+{
+     return RXGEN_OPCODE;
+}
@@ -46,6 +46,9 @@ nn * We are using getopt since we want it to be possible to link to
 #ifdef HAVE_SYS_FILE_H
 #include <sys/file.h>
 #endif
+#ifdef HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
 
 #include <assert.h>
 
@@ -53,10 +56,15 @@ nn * We are using getopt since we want it to be possible to link to
 #include <rx/rx_null.h>
 #include <rx/rx_globals.h>
 #include <rx/rx_packet.h>
+#include <rx/rx_impair.h>
+#include <rx/rxkad.h>
+
+#include <hcrypto/des.h>
+#include <hcrypto/rand.h>
 
 #ifdef AFS_PTHREAD_ENV
 #include <pthread.h>
-#define MAX_THREADS 128
+#define MAX_THREADS 512
 #endif
 
 #define DEFAULT_PORT 7009	/* To match tcpdump */
@@ -117,20 +125,41 @@ start_timer(void)
  *
  */
 
-static void
-end_and_print_timer(char *str, long long bytes)
+static long long
+end_timer(void)
 {
     long long start_l, stop_l;
-    double kbps;
 
     timer_check--;
     assert(timer_check == 0);
     gettimeofday(&timer_stop, NULL);
     start_l = timer_start.tv_sec * 1000000 + timer_start.tv_usec;
     stop_l = timer_stop.tv_sec * 1000000 + timer_stop.tv_usec;
-    printf("%s:\t%8llu msec", str, (stop_l - start_l) / 1000);
+    return stop_l - start_l;
+}
+
+/*
+ * usec since the timer was started
+ */
+
+static long long
+timer_now(void)
+{
+    struct timeval now;
 
-    kbps = bytes * 8000.0 / (stop_l - start_l);
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - timer_start.tv_sec) * 1000000LL
+	+ (now.tv_usec - timer_start.tv_usec);
+}
+
+static void
+print_timer(char *str, long long bytes, long long usec)
+{
+    double kbps;
+
+    printf("%s:\t%8llu msec", str, usec / 1000);
+
+    kbps = bytes * 8000.0 / usec;
     if (kbps > 1000000.0)
         printf("\t[%.4g Gbit/s]\n", kbps/1000000.0);
     else if (kbps > 1000.0)
@@ -139,6 +168,103 @@ end_and_print_timer(char *str, long long bytes)
         printf("\t[%.4g kbit/s]\n", kbps);
 }
 
+/*
+ * Latency histogram, in usec.  Values below HIST_SUB have a bucket each;
+ * above that every power of two is split into HIST_SUB buckets, so that a
+ * value is never more than 1/HIST_SUB out.  Each thread keeps its own,
+ * and they are summed once the threads are done.
+ */
+
+#define HIST_SUBBITS 4
+#define HIST_SUB (1 << HIST_SUBBITS)
+#define HIST_BUCKETS ((64 - HIST_SUBBITS + 1) * HIST_SUB)
+
+struct histogram {
+    afs_uint64 count;
+    afs_uint64 sum;
+    afs_uint64 min;
+    afs_uint64 max;
+    afs_uint64 buckets[HIST_BUCKETS];
+};
+
+static int
+hist_bucket(afs_uint64 value)
+{
+    int msb;
+
+    if (value < HIST_SUB)
+	return value;
+    for (msb = HIST_SUBBITS; (value >> msb) > 1; msb++)
+	;
+    return (msb - HIST_SUBBITS + 1) * HIST_SUB
+	+ ((value >> (msb - HIST_SUBBITS)) & (HIST_SUB - 1));
+}
+
+/* The largest value which falls in a bucket */
+static afs_uint64
+hist_value(int bucket)
+{
+    int shift;
+
+    if (bucket < HIST_SUB)
+	return bucket;
+    shift = bucket / HIST_SUB - 1;
+    return (((afs_uint64)HIST_SUB + bucket % HIST_SUB + 1) << shift) - 1;
+}
+
+static void
+hist_add(struct histogram *hist, afs_uint64 value)
+{
+    if (hist->count == 0 || value < hist->min)
+	hist->min = value;
+    if (value > hist->max)
+	hist->max = value;
+    hist->count++;
+    hist->sum += value;
+    hist->buckets[hist_bucket(value)]++;
+}
+
+static void
+hist_merge(struct histogram *to, struct histogram *from)
+{
+    int i;
+
+    if (from->count == 0)
+	return;
+    if (to->count == 0 || from->min < to->min)
+	to->min = from->min;
+    if (from->max > to->max)
+	to->max = from->max;
+    to->count += from->count;
+    to->sum += from->sum;
+    for (i = 0; i < HIST_BUCKETS; i++)
+	to->buckets[i] += from->buckets[i];
+}
+
+/* The value below which the given fraction of the values fall */
+static afs_uint64
+hist_percentile(struct histogram *hist, double fraction)
+{
+    afs_uint64 rank, seen = 0;
+    int i;
+
+    if (hist->count == 0)
+	return 0;
+    rank = fraction * hist->count + 0.5;
+    if (rank < 1)
+	rank = 1;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	seen += hist->buckets[i];
+	if (seen >= rank)
+	    break;
+    }
+    if (i == HIST_BUCKETS || hist_value(i) > hist->max)
+	return hist->max;
+    if (hist_value(i) < hist->min)
+	return hist->min;
+    return hist_value(i);
+}
+
 /*
  *
  */
@@ -167,16 +293,78 @@ str2addr(const char *s)
  *
  */
 
+/*
+ * The server offers both rxnull and rxkad, and the client picks one.  An
+ * rxkad client presents a ticket it has sealed itself, in a key made from
+ * a string both ends know, so that the cost of rxkad can be measured
+ * without a KDC or a KeyFile.
+ */
+
+#define RXPERF_KEY_STRING "rxperf"
+#define RXPERF_KVNO 1
+
+static int seclevel = -1;	/* rxkad level, or -1 for rxnull */
+
+static int
+get_key(void *rock, int kvno, struct ktc_encryptionKey *key)
+{
+    if (kvno != RXPERF_KVNO)
+	return RXKADUNKNOWNKEY;
+    DES_string_to_key(RXPERF_KEY_STRING, (DES_cblock *)key);
+    return 0;
+}
+
+static const char *
+sec_name(void)
+{
+    switch (seclevel) {
+    case rxkad_clear:
+	return "clear";
+    case rxkad_auth:
+	return "auth";
+    case rxkad_crypt:
+	return "crypt";
+    default:
+	return "null";
+    }
+}
+
 static void
-get_sec(int serverp, struct rx_securityClass **sec, int *secureindex)
+get_server_sec(struct rx_securityClass ***sec, int *nsec)
 {
-    if (serverp) {
-	*sec = rxnull_NewServerSecurityObject();
-	*secureindex = 1;
-    } else {
+    static struct rx_securityClass *secobjs[RX_SECIDX_KAD + 1];
+
+    secobjs[RX_SECIDX_NULL] = rxnull_NewServerSecurityObject();
+    secobjs[RX_SECIDX_KAD] =
+	rxkad_NewServerSecurityObject(rxkad_clear, NULL, get_key, NULL);
+    *sec = secobjs;
+    *nsec = RX_SECIDX_KAD + 1;
+}
+
+static void
+get_client_sec(struct rx_securityClass **sec, int *secureindex)
+{
+    struct ktc_encryptionKey key;
+    struct ktc_encryptionKey session;
+    char ticket[MAXKTCTICKETLEN];
+    int ticketLen = sizeof(ticket);
+
+    if (seclevel < 0) {
 	*sec = rxnull_NewClientSecurityObject();
-	*secureindex = 0;
+	*secureindex = RX_SECIDX_NULL;
+	return;
     }
+
+    get_key(NULL, RXPERF_KVNO, &key);
+    if (RAND_bytes(&session, sizeof(session)) != 1)
+	errx(1, "can't make a session key");
+    DES_set_odd_parity((DES_cblock *)&session);
+    if (tkt_MakeTicket(ticket, &ticketLen, &key, "rxperf", "", "", 0,
+		       0xffffffff, &session, 0, "afs", "") != 0)
+	errx(1, "can't make a ticket");
+    *sec = rxkad_NewClientSecurityObject(seclevel, &session, RXPERF_KVNO,
+					 ticketLen, ticket);
+    *secureindex = RX_SECIDX_KAD;
 }
 
 /*
@@ -188,6 +376,9 @@ char somebuf[RXPERF_BUFSIZE];
 afs_int32 rxwrite_size = sizeof(somebuf);
 afs_int32 rxread_size = sizeof(somebuf);
 afs_int32 use_rx_readv = 0;
+struct rx_impairment *impairment = NULL;
+int sendfd = -1;		/* file the server sends its replies from */
+int sendcopy = 0;		/* read the file into packets, not mapping it */
 
 static int
 do_readbytes(struct rx_call *call, afs_int32 bytes)
@@ -216,11 +407,66 @@ do_readbytes(struct rx_call *call, afs_int32 bytes)
     return 0;
 }
 
+#ifndef AFS_NT40_ENV
+/*
+ * Send the start of the server's file, either as rx_WritevFromFd does, or
+ * by reading it into packets as the fileserver's FetchData used to
+ */
+
+static int
+do_sendfile(struct rx_call *call, afs_int32 bytes)
+{
+    struct iovec tiov[RX_MAXIOVECS];
+    afs_foff_t offset = 0;
+    afs_int32 size;
+    int tnio, i;
+
+    /* rx_Writev can only fill a packet which rx_Write has begun, as the
+     * length FetchData writes first begins it for the fileserver */
+    if (sendcopy && bytes > 0) {
+	char head[4];
+
+	size = MIN(bytes, sizeof(head));
+	if (pread(sendfd, head, size, offset) != size
+	    || rx_Write(call, head, size) != size)
+	    return 1;
+	offset += size;
+	bytes -= size;
+    }
+    while (bytes > 0) {
+	if (sendcopy) {
+	    size = rx_WritevAlloc(call, tiov, &tnio, RX_MAXIOVECS, bytes);
+	    if (size <= 0)
+		return 1;
+	    for (i = 0; i < tnio; i++) {
+		if (pread(sendfd, tiov[i].iov_base, tiov[i].iov_len,
+			  offset) != tiov[i].iov_len)
+		    return 1;
+		offset += tiov[i].iov_len;
+	    }
+	    if (rx_Writev(call, tiov, tnio, size) != size)
+		return 1;
+	} else {
+	    size = bytes;
+	    if (rx_WritevFromFd(call, sendfd, offset, size) != size)
+		return 1;
+	    offset += size;
+	}
+	bytes -= size;
+    }
+    return 0;
+}
+#endif
+
 static int
 do_sendbytes(struct rx_call *call, afs_int32 bytes)
 {
     afs_int32 size;
 
+#ifndef AFS_NT40_ENV
+    if (sendfd != -1)
+	return do_sendfile(call, bytes);
+#endif
     while (bytes > 0) {
 	size = rxwrite_size;
 	if (size > bytes)
@@ -410,8 +656,8 @@ do_server(short port, int nojumbo, int maxmtu, int maxwsize, int minpeertimeout,
           int minprocs, int maxprocs)
 {
     struct rx_service *service;
-    struct rx_securityClass *secureobj;
-    int secureindex;
+    struct rx_securityClass **secureobjs;
+    int nsecureobjs;
     int ret;
 
 #ifdef AFS_NT40_ENV
@@ -433,6 +679,9 @@ do_server(short port, int nojumbo, int maxmtu, int maxwsize, int minpeertimeout,
     if (ret)
 	errx(1, "rx_Init failed");
 
+    if (impairment)
+	rx_SetImpairment(impairment);
+
     if (nojumbo)
       rx_SetNoJumbo();
 
@@ -448,10 +697,10 @@ do_server(short port, int nojumbo, int maxmtu, int maxwsize, int minpeertimeout,
         rx_SetMinPeerTimeout(minpeertimeout);
 
 
-    get_sec(1, &secureobj, &secureindex);
+    get_server_sec(&secureobjs, &nsecureobjs);
 
     service =
-	rx_NewService(0, RX_SERVER_ID, "rxperf", &secureobj, secureindex,
+	rx_NewService(0, RX_SERVER_ID, "rxperf", secureobjs, nsecureobjs,
 		      rxperf_ExecuteRequest);
     if (service == NULL)
 	errx(1, "Cant create server");
@@ -518,6 +767,21 @@ readfile(const char *filename, afs_uint32 ** readwrite, afs_uint32 * size)
     free(buf);
 }
 
+/*
+ * The sizes of the RPCs in a mix, as given with -M.  Each call picks one
+ * at random, in proportion to its weight.
+ */
+
+struct rpc_size {
+    afs_int32 sendbytes;
+    afs_int32 readbytes;
+    afs_int32 weight;
+};
+
+static struct rpc_size *rpc_mix = NULL;
+static int rpc_mix_len = 0;
+static afs_int32 rpc_mix_weight = 0;
+
 struct client_data {
     struct rx_connection *conn;
     char *filename;
@@ -526,22 +790,71 @@ struct client_data {
     afs_int32 bytes;
     afs_int32 sendbytes;
     afs_int32 readbytes;
+    int index;			/* of this thread */
+    int threads;		/* all told */
+    afs_int32 rate;		/* calls per second, or 0 for flat out */
+    afs_uint32 random;		/* for picking sizes from the mix */
+    long long transferred;	/* bytes sent and received */
+    struct histogram latency;
 };
 
+static struct rpc_size *
+pick_rpc_size(struct client_data *params)
+{
+    afs_uint32 x = params->random;
+    afs_int32 pick;
+    int i;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    params->random = x;
+
+    pick = x % rpc_mix_weight;
+    for (i = 0; pick >= rpc_mix[i].weight; i++)
+	pick -= rpc_mix[i].weight;
+    return &rpc_mix[i];
+}
+
+static void
+sleep_until(long long when)
+{
+    long long now;
+
+    while ((now = timer_now()) < when)
+	usleep(when - now > 500000 ? 500000 : when - now);
+}
+
 static void *
 client_thread( void *vparams)
 {
     struct client_data *params = (struct client_data *)vparams;
     struct rx_call *call;
+    struct rpc_size *rpcsize;
     afs_int32 data;
+    afs_int32 sendbytes, readbytes;
     int i, j;
     afs_uint32 *readwrite;
     int readp = FALSE;
     afs_uint32 size;
     afs_uint32 num;
+    long long due;
 
     for (i = 0; i < params->times; i++) {
 
+	/*
+	 * Open loop clients start their calls at a fixed rate, spread evenly
+	 * over the threads, and time each from when it was due rather than
+	 * from when it started, so that a server which falls behind is
+	 * charged for the calls queued behind it too.
+	 */
+	if (params->rate > 0) {
+	    due = ((long long)i * params->threads + params->index)
+		* 1000000 / params->rate;
+	    sleep_until(due);
+	} else
+	    due = timer_now();
+
 	DBFPRINT(("starting command "));
 
 	call = rx_NewCall(params->conn);
@@ -582,6 +895,8 @@ client_thread( void *vparams)
 	    if (data != htonl(RXPERF_MAGIC_COOKIE))
 		warn("server send wrong magic cookie in responce");
 
+	    params->transferred += params->bytes;
+
 	    DBFPRINT(("done\n"));
 
 	    break;
@@ -602,26 +917,36 @@ client_thread( void *vparams)
 	    if (data != htonl(RXPERF_MAGIC_COOKIE))
 		warn("server send wrong magic cookie in responce");
 
+	    params->transferred += params->bytes;
+
 	    DBFPRINT(("done\n"));
 
 	    break;
 	case RX_PERF_RPC:
 	    DBFPRINT(("commands "));
 
-	    data = htonl(params->sendbytes);
+	    sendbytes = params->sendbytes;
+	    readbytes = params->readbytes;
+	    if (rpc_mix_len > 0) {
+		rpcsize = pick_rpc_size(params);
+		sendbytes = rpcsize->sendbytes;
+		readbytes = rpcsize->readbytes;
+	    }
+
+	    data = htonl(sendbytes);
 	    if (rx_Write32(call, &data) != 4)
 		errx(1, "rx_Write failed to send command (err %d)", rx_Error(call));
 
-	    data = htonl(params->readbytes);
+	    data = htonl(readbytes);
 	    if (rx_Write32(call, &data) != 4)
 		errx(1, "rx_Write failed to send command (err %d)", rx_Error(call));
 
-	    DBFPRINT(("send(%d) ", params->sendbytes));
-	    if (do_sendbytes(call, params->sendbytes))
+	    DBFPRINT(("send(%d) ", sendbytes));
+	    if (do_sendbytes(call, sendbytes))
 		errx(1, "sendbytes (err %d)", rx_Error(call));
 
-	    DBFPRINT(("recv(%d) ", params->readbytes));
-	    if (do_readbytes(call, params->readbytes))
+	    DBFPRINT(("recv(%d) ", readbytes));
+	    if (do_readbytes(call, readbytes))
 		errx(1, "sendbytes (err %d)", rx_Error(call));
 
 	    if (rx_Read32(call, &data) != 4)
@@ -630,6 +955,8 @@ client_thread( void *vparams)
 	    if (data != htonl(RXPERF_MAGIC_COOKIE))
 		warn("server send wrong magic cookie in responce");
 
+	    params->transferred += sendbytes + readbytes;
+
 	    DBFPRINT(("done\n"));
 
 	    break;
@@ -661,12 +988,14 @@ client_thread( void *vparams)
 		    DBFPRINT(("send\n"));
 		}
 	    }
+	    params->transferred += params->bytes;
 	    break;
 	default:
 	    abort();
 	}
 
 	rx_EndCall(call, 0);
+	hist_add(&params->latency, timer_now() - due);
     }
 
 #ifdef AFS_PTHREAD_ENV
@@ -676,6 +1005,88 @@ client_thread( void *vparams)
     return NULL;
 }
 
+/*
+ * Print the results of a run as a JSON object, for tracking over time
+ */
+
+static void
+print_json(afs_int32 command, int nconns, int callsperconn, int threads,
+	   afs_int32 times, afs_int32 rate, long long usec,
+	   long long transferred, struct histogram *latency,
+	   long long cpuusec, struct rx_statistics *before,
+	   struct rx_statistics *after)
+{
+    static const char *commands[] = { "send", "recv", "", "rpc", "file" };
+
+    printf("{\n");
+    printf("  \"command\": \"%s\",\n", commands[command]);
+    printf("  \"security\": \"%s\",\n", sec_name());
+    printf("  \"connections\": %d,\n", nconns);
+    printf("  \"calls_per_connection\": %d,\n", callsperconn);
+    printf("  \"threads\": %d,\n", threads);
+    printf("  \"times\": %d,\n", times);
+    printf("  \"rate\": %d,\n", rate);
+    printf("  \"calls\": %llu,\n", (unsigned long long)latency->count);
+    printf("  \"elapsed_usec\": %lld,\n", usec);
+    printf("  \"bytes\": %lld,\n", transferred);
+    printf("  \"calls_per_sec\": %.1f,\n", latency->count * 1000000.0 / usec);
+    printf("  \"bits_per_sec\": %.0f,\n", transferred * 8000000.0 / usec);
+    printf("  \"latency_usec\": {\n");
+    printf("    \"min\": %llu,\n", (unsigned long long)latency->min);
+    printf("    \"mean\": %llu,\n", latency->count == 0 ? 0ULL
+	   : (unsigned long long)(latency->sum / latency->count));
+    printf("    \"p50\": %llu,\n",
+	   (unsigned long long)hist_percentile(latency, 0.5));
+    printf("    \"p90\": %llu,\n",
+	   (unsigned long long)hist_percentile(latency, 0.9));
+    printf("    \"p99\": %llu,\n",
+	   (unsigned long long)hist_percentile(latency, 0.99));
+    printf("    \"p999\": %llu,\n",
+	   (unsigned long long)hist_percentile(latency, 0.999));
+    printf("    \"max\": %llu\n", (unsigned long long)latency->max);
+    printf("  },\n");
+    if (cpuusec < 0) {
+	printf("  \"cpu_usec\": null,\n");
+	printf("  \"cpu_ns_per_byte\": null,\n");
+    } else {
+	printf("  \"cpu_usec\": %lld,\n", cpuusec);
+	printf("  \"cpu_ns_per_byte\": %.3f,\n",
+	       transferred == 0 ? 0.0 : cpuusec * 1000.0 / transferred);
+    }
+    if (before == NULL || after == NULL) {
+	printf("  \"data_packets_sent\": null,\n");
+	printf("  \"retransmits\": null,\n");
+	printf("  \"duplicates_read\": null\n");
+    } else {
+	printf("  \"data_packets_sent\": %d,\n",
+	       after->dataPacketsSent - before->dataPacketsSent);
+	printf("  \"retransmits\": %d,\n",
+	       after->dataPacketsReSent - before->dataPacketsReSent);
+	printf("  \"duplicates_read\": %d\n",
+	       after->dupPacketsRead - before->dupPacketsRead);
+    }
+    printf("}\n");
+}
+
+/*
+ * CPU time used by this process, in usec, or -1 if we can't tell
+ */
+
+static long long
+cpu_time(void)
+{
+#ifdef AFS_NT40_ENV
+    return -1;
+#else
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+	return -1;
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000LL
+	+ ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#endif
+}
+
 /*
  *
  */
@@ -684,24 +1095,35 @@ static void
 do_client(const char *server, short port, char *filename, afs_int32 command,
 	  afs_int32 times, afs_int32 bytes, afs_int32 sendbytes, afs_int32 readbytes,
           int dumpstats, int nojumbo, int maxmtu, int maxwsize, int minpeertimeout,
-          int udpbufsz, int nostats, int hotthread, int threads)
+          int udpbufsz, int nostats, int hotthread, int threads,
+          int callsperconn, afs_int32 rate, int json)
 {
-    struct rx_connection *conn;
+    struct rx_connection **conns;
+    int nconns;
     afs_uint32 addr;
     struct rx_securityClass *secureobj;
     int secureindex;
     int ret;
     char stamp[2048];
     struct client_data *params;
+    struct histogram *latency;
+    struct rx_statistics *before = NULL;
+    struct rx_statistics *after = NULL;
+    long long usec, transferred, cpuusec;
+    int i;
 
 #ifdef AFS_PTHREAD_ENV
-    int i;
     pthread_t thread[MAX_THREADS];
     pthread_attr_t tattr;
     void *status;
 #endif
 
-    params = calloc(1, sizeof(struct client_data));
+    nconns = (threads + callsperconn - 1) / callsperconn;
+    params = calloc(threads, sizeof(struct client_data));
+    conns = calloc(nconns, sizeof(struct rx_connection *));
+    latency = calloc(1, sizeof(struct histogram));
+    if (params == NULL || conns == NULL || latency == NULL)
+	err(1, "calloc");
 
 #ifdef AFS_NT40_ENV
     if (afs_winsockInit() < 0) {
@@ -724,6 +1146,9 @@ do_client(const char *server, short port, char *filename, afs_int32 command,
     if (ret)
 	errx(1, "rx_Init failed");
 
+    if (impairment)
+	rx_SetImpairment(impairment);
+
     if (nojumbo)
       rx_SetNoJumbo();
 
@@ -739,12 +1164,16 @@ do_client(const char *server, short port, char *filename, afs_int32 command,
         rx_SetMinPeerTimeout(minpeertimeout);
 
 
-    get_sec(0, &secureobj, &secureindex);
+    get_client_sec(&secureobj, &secureindex);
 
     switch (command) {
     case RX_PERF_RPC:
-        sprintf(stamp, "RPC: threads\t%d, times\t%d, write bytes\t%d, read bytes\t%d",
-                 threads, times, sendbytes, readbytes);
+	if (rpc_mix_len > 0)
+	    sprintf(stamp, "RPC: threads\t%d, times\t%d, mix of\t%d sizes",
+		    threads, times, rpc_mix_len);
+	else
+	    sprintf(stamp, "RPC: threads\t%d, times\t%d, write bytes\t%d, read bytes\t%d",
+		    threads, times, sendbytes, readbytes);
         break;
     case RX_PERF_RECV:
         sprintf(stamp, "RECV: threads\t%d, times\t%d, bytes\t%d",
@@ -760,38 +1189,46 @@ do_client(const char *server, short port, char *filename, afs_int32 command,
         break;
     }
 
-    conn = rx_NewConnection(addr, htons(port), RX_SERVER_ID, secureobj, secureindex);
-    if (conn == NULL)
-	errx(1, "failed to contact server");
+    for (i = 0; i < nconns; i++) {
+	if (callsperconn > RX_MAXCALLS)
+	    conns[i] = rx_NewWideConnection(addr, htons(port), RX_SERVER_ID,
+					    secureobj, secureindex,
+					    callsperconn);
+	else
+	    conns[i] = rx_NewConnection(addr, htons(port), RX_SERVER_ID,
+					secureobj, secureindex);
+	if (conns[i] == NULL)
+	    errx(1, "failed to contact server");
+    }
 
 #ifdef AFS_PTHREAD_ENV
     pthread_attr_init(&tattr);
     pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_JOINABLE);
 #endif
 
-    params->conn = conn;
-    params->filename = filename;
-    params->command = command;
-    params->times = times;
-    params->bytes = bytes;
-    params->sendbytes = sendbytes;
-    params->readbytes = readbytes;
+    for (i = 0; i < threads; i++) {
+	params[i].conn = conns[i / callsperconn];
+	params[i].filename = filename;
+	params[i].command = command;
+	params[i].times = times;
+	params[i].bytes = bytes;
+	params[i].sendbytes = sendbytes;
+	params[i].readbytes = readbytes;
+	params[i].index = i;
+	params[i].threads = threads;
+	params[i].rate = rate;
+	params[i].random = 2463534242U + i;
+    }
+
+    if (!nostats)
+	before = rx_GetStatistics();
+    cpuusec = cpu_time();
 
     start_timer();
 
 #ifdef AFS_PTHREAD_ENV
-    for ( i=0; i<threads; i++) {
-        pthread_create(&thread[i], &tattr, client_thread, params);
-        if ( (i + 1) % RX_MAXCALLS == 0 ) {
-            conn = rx_NewConnection(addr, htons(port), RX_SERVER_ID, secureobj, secureindex);
-            if (conn != NULL) {
-                struct client_data *new_params = malloc(sizeof(struct client_data));
-                memcpy(new_params, params, sizeof(struct client_data));
-                new_params->conn = conn;
-                params = new_params;
-            }
-        }
-    }
+    for ( i=0; i<threads; i++)
+        pthread_create(&thread[i], &tattr, client_thread, &params[i]);
 #else
         client_thread(params);
 #endif
@@ -801,22 +1238,45 @@ do_client(const char *server, short port, char *filename, afs_int32 command,
         pthread_join(thread[i], &status);
 #endif
 
-    switch (command) {
-    case RX_PERF_RPC:
-        end_and_print_timer(stamp, (long long)threads*times*(sendbytes+readbytes));
-        break;
-    case RX_PERF_RECV:
-    case RX_PERF_SEND:
-    case RX_PERF_FILE:
-        end_and_print_timer(stamp, (long long)threads*times*bytes);
-        break;
+    usec = end_timer();
+    if (cpuusec >= 0)
+	cpuusec = cpu_time() - cpuusec;
+    if (!nostats)
+	after = rx_GetStatistics();
+
+    transferred = 0;
+    for (i = 0; i < threads; i++) {
+	transferred += params[i].transferred;
+	hist_merge(latency, &params[i].latency);
+    }
+
+    if (json) {
+	print_json(command, nconns, callsperconn, threads, times, rate, usec,
+		   transferred, latency, cpuusec, before, after);
+    } else {
+	print_timer(stamp, transferred, usec);
+	printf("latency:\tp50 %llu usec, p99 %llu usec, p999 %llu usec, "
+	       "max %llu usec\n",
+	       (unsigned long long)hist_percentile(latency, 0.5),
+	       (unsigned long long)hist_percentile(latency, 0.99),
+	       (unsigned long long)hist_percentile(latency, 0.999),
+	       (unsigned long long)latency->max);
     }
 
     DBFPRINT(("done for good\n"));
 
     if (dumpstats) {
 	rx_PrintStats(stdout);
-	rx_PrintPeerStats(stdout, rx_PeerOf(conn));
+	rx_PrintPeerStats(stdout, rx_PeerOf(conns[0]));
+	if (impairment) {
+	    struct rx_impairmentStats istats;
+
+	    rx_GetImpairmentStats(&istats);
+	    printf("impairment: %u datagrams, %u dropped, %u overflowed, "
+		   "%u duplicated, %u reordered, %u delayed\n",
+		   istats.datagrams, istats.dropped, istats.overflowed,
+		   istats.duplicated, istats.reordered, istats.delayed);
+	}
     }
     rx_Finalize();
 
@@ -824,6 +1284,12 @@ do_client(const char *server, short port, char *filename, afs_int32 command,
     pthread_attr_destroy(&tattr);
 #endif
 
+    if (before != NULL)
+	rx_FreeStatistics(&before);
+    if (after != NULL)
+	rx_FreeStatistics(&after);
+    free(latency);
+    free(conns);
     free(params);
 }
 
@@ -838,17 +1304,59 @@ usage(void)
 	    "usage: %s client -c rpc  -S <sendbytes> -R <recvbytes>\n",
 	    getprogname());
     fprintf(stderr, "usage: %s client -c file -f filename\n", getprogname());
+    fprintf(stderr,
+	    "usage: %s client -c rpc  -M <sendbytes>:<recvbytes>[:<weight>],...\n",
+	    getprogname());
     fprintf(stderr,
 	    "%s: usage:	common option to the client "
-	    "-w <write-bytes> -r <read-bytes> -T times -p port -s server -D\n",
+	    "-w <write-bytes> -r <read-bytes> -T times -p port -s server -D "
+	    "-C <newreno|cubic> -I <impairment> -t threads -n connections "
+	    "-O <calls/s> -z <null|clear|auth|crypt> -J\n",
 	    getprogname());
-    fprintf(stderr, "usage: %s server -p port\n", getprogname());
+    fprintf(stderr, "usage: %s server -p port [-l listeners] [-C <newreno|cubic>] [-I <impairment>] [-f <file> [-c]]\n", getprogname());
 #undef COMMMON
     exit(1);
 }
 
 
 
+static void
+parse_rpc_mix(char *spec)
+{
+    struct rpc_size *size;
+    char *entry;
+    char *ptr;
+
+    for (entry = strtok(spec, ","); entry != NULL; entry = strtok(NULL, ",")) {
+	rpc_mix = realloc(rpc_mix, (rpc_mix_len + 1) * sizeof(*rpc_mix));
+	if (rpc_mix == NULL)
+	    err(1, "realloc");
+	size = &rpc_mix[rpc_mix_len++];
+
+	size->sendbytes = strtol(entry, &ptr, 0);
+	if (*ptr != ':')
+	    errx(1, "can't resolve rpc sizes %s", entry);
+	size->readbytes = strtol(ptr + 1, &ptr, 0);
+	size->weight = 1;
+	if (*ptr == ':')
+	    size->weight = strtol(ptr + 1, &ptr, 0);
+	if (*ptr != '\0' || size->sendbytes < 0 || size->readbytes < 0
+	    || size->weight <= 0)
+	    errx(1, "can't resolve rpc sizes %s", entry);
+	rpc_mix_weight += size->weight;
+    }
+}
+
+static void
+parse_impairment(const char *spec)
+{
+    static struct rx_impairment imp;
+
+    if (rx_ParseImpairment(spec, &imp) != 0)
+	errx(1, "can't resolve impairment %s", spec);
+    impairment = &imp;
+}
+
 /*
  * do argument processing and call networking functions
  */
@@ -866,11 +1374,22 @@ rxperf_server(int argc, char **argv)
     int maxprocs = 20;
     int maxwsize = 0;
     int minpeertimeout = 0;
+    int listeners = 1;
     char *ptr;
     int ch;
 
-    while ((ch = getopt(argc, argv, "r:d:p:P:w:W:HNjm:u:4:s:S:V")) != -1) {
+    while ((ch = getopt(argc, argv, "r:d:l:p:P:w:W:C:I:f:HNcjm:u:4:s:S:V")) != -1) {
 	switch (ch) {
+#ifndef AFS_NT40_ENV
+	case 'f':
+	    sendfd = open(optarg, O_RDONLY);
+	    if (sendfd < 0)
+		err(1, "open %s", optarg);
+	    break;
+	case 'c':
+	    sendcopy = 1;
+	    break;
+#endif
 	case 'd':
 #ifdef RXDEBUG
 	    rx_debugFile = fopen(optarg, "w");
@@ -880,6 +1399,11 @@ rxperf_server(int argc, char **argv)
 	    errx(1, "compiled without RXDEBUG");
 #endif
 	    break;
+	case 'l':
+	    listeners = strtol(optarg, &ptr, 0);
+	    if (ptr != 0 && ptr[0] != '\0')
+		errx(1, "can't resolve number of listeners");
+	    break;
 	case 'r':
 	    rxread_size = strtol(optarg, &ptr, 0);
 	    if (ptr != 0 && ptr[0] != '\0')
@@ -946,6 +1470,13 @@ rxperf_server(int argc, char **argv)
 	case '4':
 	  RX_IPUDP_SIZE = 28;
 	  break;
+	case 'C':
+	    if (rx_SetCongestionControl(optarg) != 0)
+		errx(1, "unknown congestion control algorithm %s", optarg);
+	    break;
+	case 'I':
+	    parse_impairment(optarg);
+	    break;
 	default:
 	    usage();
 	}
@@ -954,6 +1485,9 @@ rxperf_server(int argc, char **argv)
     if (optind != argc)
 	usage();
 
+    if (listeners != 1 && rx_SetNumListeners(listeners) != 0)
+	errx(1, "can't use %d listeners", listeners);
+
     do_server(port, nojumbo, maxmtu, maxwsize, minpeertimeout, udpbufsz,
               nostats, hotthreads, minprocs, maxprocs);
 
@@ -981,6 +1515,10 @@ rxperf_client(int argc, char **argv)
     int maxmtu = 0;
     int hotthreads = 0;
     int threads = 1;
+    int callsperconn;
+    int nconns = 0;
+    afs_int32 rate = 0;
+    int json = 0;
     int udpbufsz = 64 * 1024;
     int maxwsize = 0;
     int minpeertimeout = 0;
@@ -989,7 +1527,7 @@ rxperf_client(int argc, char **argv)
 
     cmd = RX_PERF_UNKNOWN;
 
-    while ((ch = getopt(argc, argv, "T:S:R:b:c:d:p:P:r:s:w:W:f:HDNjm:u:4:t:V")) != -1) {
+    while ((ch = getopt(argc, argv, "T:S:R:b:c:d:p:P:r:s:w:W:f:C:I:M:n:O:z:HDJNjm:u:4:t:V")) != -1) {
 	switch (ch) {
 	case 'b':
 	    bytes = strtol(optarg, &ptr, 0);
@@ -1110,6 +1648,49 @@ rxperf_client(int argc, char **argv)
 	case '4':
 	  RX_IPUDP_SIZE = 28;
 	  break;
+	case 'C':
+	    if (rx_SetCongestionControl(optarg) != 0)
+		errx(1, "unknown congestion control algorithm %s", optarg);
+	    break;
+	case 'I':
+	    parse_impairment(optarg);
+	    break;
+	case 'J':
+	    json = 1;
+	    break;
+	case 'M':
+	    parse_rpc_mix(optarg);
+	    break;
+	case 'n':
+#ifdef AFS_PTHREAD_ENV
+	    nconns = strtol(optarg, &ptr, 0);
+	    if ((ptr && *ptr != '\0') || nconns <= 0)
+		errx(1, "can't resolve number of connections");
+#else
+            errx(1, "Not built for pthreads");
+#endif
+	    break;
+	case 'O':
+#ifdef AFS_PTHREAD_ENV
+	    rate = strtol(optarg, &ptr, 0);
+	    if ((ptr && *ptr != '\0') || rate <= 0)
+		errx(1, "can't resolve rate of calls");
+#else
+            errx(1, "Not built for pthreads");
+#endif
+	    break;
+	case 'z':
+	    if (strcasecmp(optarg, "null") == 0)
+		seclevel = -1;
+	    else if (strcasecmp(optarg, "clear") == 0)
+		seclevel = rxkad_clear;
+	    else if (strcasecmp(optarg, "auth") == 0)
+		seclevel = rxkad_auth;
+	    else if (strcasecmp(optarg, "crypt") == 0)
+		seclevel = rxkad_crypt;
+	    else
+		errx(1, "unknown security class %s", optarg);
+	    break;
 	default:
 	    usage();
 	}
@@ -1118,18 +1699,36 @@ rxperf_client(int argc, char **argv)
     if (nostats && dumpstats)
         errx(1, "cannot set both -N and -D");
 
-    if (threads > 1 && cmd == RX_PERF_FILE)
-        errx(1, "cannot use multiple threads with file command");
-
     if (optind != argc)
 	usage();
 
     if (cmd == RX_PERF_UNKNOWN)
 	errx(1, "no command given to the client");
 
+    if (rpc_mix_len > 0 && cmd != RX_PERF_RPC)
+	errx(1, "a mix of sizes can only be used with the rpc command");
+
+    /*
+     * With -n, -t is the number of calls to make at once on each
+     * connection, which is made wide if it needs more than RX_MAXCALLS
+     * channels; otherwise it is the number of calls all told, and a new
+     * connection is made for every RX_MAXCALLS of them.
+     */
+    if (nconns > 0) {
+	callsperconn = threads;
+	if (threads > MAX_THREADS / nconns)
+	    errx(1, "too many threads");
+	threads *= nconns;
+    } else
+	callsperconn = RX_MAXCALLS;
+
+    if (threads > 1 && cmd == RX_PERF_FILE)
+        errx(1, "cannot use multiple threads with file command");
+
     do_client(host, port, filename, cmd, times, bytes, sendbytes,
 	      readbytes, dumpstats, nojumbo, maxmtu, maxwsize, minpeertimeout,
-              udpbufsz, nostats, hotthreads, threads);
+              udpbufsz, nostats, hotthreads, threads, callsperconn, rate,
+	      json);
 
     return 0;
 }
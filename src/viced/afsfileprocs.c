@@ -77,6 +77,7 @@
 #include <rx/rx_queue.h>
 #include <opr/lock.h>
 #include <opr/proc.h>
+#include <opr/jhash.h>
 #include <afs/nfs.h>
 #include <afs/afsint.h>
 #include <afs/vldbint.h>
@@ -90,6 +91,7 @@
 #include <afs/acl.h>
 #include <rx/rx.h>
 #include <rx/rx_globals.h>
+#include <rx/rxkad.h>
 
 #include <afs/cellconfig.h>
 #include <afs/keys.h>
@@ -743,18 +745,75 @@ client_HasAsMember(struct client *client, afs_int32 id)
     return code;
 }
 
+/*
+ * Bumped by StoreACL, to throw away all the rights GetRights has cached.
+ * Protected by H_LOCK.
+ */
+static afs_uint32 rightsAclGen;
+
+/* Usecs of rights computation not yet counted in fs_RightsMissMsec */
+static afs_uint32 rightsMissUsec;
+
+static_inline struct client_rights *
+client_RightsSlot(struct client *client, struct client_rights *key)
+{
+    afs_uint32 h;
+
+    h = opr_jhash_int2(key->volid, key->vnode, key->unique);
+    return &client->z.rights[h & (CLIENT_RIGHTS_ENTRIES - 1)];
+}
+
+static_inline int
+client_RightsMatch(struct client_rights *a, struct client_rights *b)
+{
+    return a->volid == b->volid && a->cacheCheck == b->cacheCheck
+	&& a->vnode == b->vnode && a->unique == b->unique
+	&& a->aclGen == b->aclGen && a->hcpsGen == b->hcpsGen
+	&& a->cpsGen == b->cpsGen;
+}
+
 /*
  * Compare the directory's ACL with the user's access rights in the client
  * connection and return the user's and everybody else's access permissions
- * in rights and anyrights, respectively
+ * in rights and anyrights, respectively.  The answer is remembered in the
+ * client's rights cache, which is consulted first.
  */
 static afs_int32
 GetRights(struct client *client, struct acl_accessList *ACL,
+	  Volume *volptr, Vnode *aclvnode,
 	  afs_int32 * rights, afs_int32 * anyrights)
 {
     extern prlist SystemAnyUserCPS;
     afs_int32 hrights = 0;
+    struct client_rights key, *slot;
+    struct timeval start, end;
+
+    key.volid = V_id(volptr);
+    key.cacheCheck = volptr->cacheCheck;
+    key.vnode = Vn_id(aclvnode);
+    key.unique = aclvnode->disk.uniquifier;
+
+    H_LOCK;
+    /* wait if somebody else is already doing the getCPS call */
+    while (client->z.host->z.hostFlags & HCPS_INPROGRESS) {
+	client->z.host->z.hostFlags |= HCPS_WAITING;	/* I am waiting */
+	opr_cv_wait(&client->z.host->cond, &host_glock_mutex);
+    }
+    key.aclGen = rightsAclGen;
+    key.hcpsGen = client->z.host->z.cpsGen;
+    key.cpsGen = client->z.cpsGen;
+    slot = client_RightsSlot(client, &key);
+    if (client_RightsMatch(slot, &key) && !client->z.deleted
+	&& !(client->z.host->z.hostFlags & HOSTDELETED)) {
+	*rights = slot->rights;
+	*anyrights = slot->anyrights;
+	afs_perfstats.fs_nRightsHits++;
+	H_UNLOCK;
+	return (0);
+    }
+    H_UNLOCK;
 
+    gettimeofday(&start, NULL);
     if (acl_CheckRights(ACL, &SystemAnyUserCPS, anyrights) != 0) {
 	ViceLog(0, ("CheckRights failed\n"));
 	*anyrights = 0;
@@ -786,6 +845,22 @@ GetRights(struct client *client, struct acl_accessList *ACL,
 
     *rights |= hrights;
     *anyrights |= hrights;
+    gettimeofday(&end, NULL);
+
+    /*
+     * If an ACL or CPS changed while we were computing, the generations
+     * in key are already stale and the entry will never be matched.
+     */
+    key.rights = *rights;
+    key.anyrights = *anyrights;
+    H_LOCK;
+    *slot = key;
+    afs_perfstats.fs_nRightsMisses++;
+    rightsMissUsec +=
+	(end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+    afs_perfstats.fs_RightsMissMsec += rightsMissUsec / 1000;
+    rightsMissUsec %= 1000;
+    H_UNLOCK;
 
     return (0);
 
@@ -885,7 +960,8 @@ GetVolumePackageWithCall(struct rx_call *acall, struct VCallByVol *cbv,
 		goto gvpdone;
 	    }
 	}
-	GetRights(*client, aCL, rights, anyrights);
+	GetRights(*client, aCL, *volptr, *parent ? *parent : *targetptr,
+		  rights, anyrights);
 	/* ok, if this is not a dir, set the PRSFS_ADMINISTER bit iff we're the owner */
 	if ((*targetptr)->disk.type != vDirectory) {
 	    /* anyuser can't be owner, so only have to worry about rights, not anyrights */
@@ -3093,6 +3169,11 @@ SRXAFS_StoreACL(struct rx_call * acall, struct AFSFid * Fid,
 	goto Bad_StoreACL;
     }
 
+    /* rights anyone has cached on the old ACL are now wrong */
+    H_LOCK;
+    rightsAclGen++;
+    H_UNLOCK;
+
     targetptr->changed_newTime = 1;	/* status change of directory */
 
     /* convert the write lock to a read lock before breaking callbacks */
@@ -3240,6 +3321,31 @@ SRXAFS_StoreStatus(struct rx_call * acall, struct AFSFid * Fid,
 }				/*SRXAFS_StoreStatus */
 
 
+/*
+ * Break the call backs on a directory after Name, for Fid, was added to or
+ * removed from it.  Clients which can are sent the change, rather than
+ * having to fetch the directory again.
+ */
+static void
+BreakDirEntryCallBack(struct host *xhost, AFSFid *DirFid,
+		      AFSFetchStatus *DirStatus, afs_int32 Op, char *Name,
+		      AFSFid *Fid)
+{
+    struct AFSDirDeltaStatus status;
+    struct AFSDirDelta delta;
+
+    status.DataVersion = DirStatus->DataVersion;
+    status.dataVersionHigh = DirStatus->dataVersionHigh;
+    status.Length = DirStatus->Length;
+    status.Length_hi = DirStatus->Length_hi;
+    status.ClientModTime = DirStatus->ClientModTime;
+    status.LinkCount = DirStatus->LinkCount;
+    delta.Op = Op;
+    delta.Fid = *Fid;
+    delta.Name = Name;
+    BreakDirCallBack(xhost, DirFid, &status, &delta, 1);
+}
+
 /*
  * This routine is called exclusively by SRXAFS_RemoveFile(), and should be
  * merged in when possible.
@@ -3324,7 +3430,8 @@ SAFSS_RemoveFile(struct rx_call *acall, struct AFSFid *DirFid, char *Name,
     }
 
     /* break call back on the directory */
-    BreakCallBack(client->z.host, DirFid, 0);
+    BreakDirEntryCallBack(client->z.host, DirFid, OutDirStatus,
+			  AFS_DIRDELTA_REMOVE, Name, &fileFid);
 
   Bad_RemoveFile:
     /* Update and store volume/vnode and parent vnodes back */
@@ -3453,7 +3560,8 @@ SAFSS_CreateFile(struct rx_call *acall, struct AFSFid *DirFid, char *Name,
     assert_vnode_success_or_salvaging(errorCode);
 
     /* break call back on parent dir */
-    BreakCallBack(client->z.host, DirFid, 0);
+    BreakDirEntryCallBack(client->z.host, DirFid, OutDirStatus,
+			  AFS_DIRDELTA_ADD, Name, OutFid);
 
     /* Return a callback promise for the newly created file to the caller */
     SetCallBackStruct(AddCallBack(client->z.host, OutFid), CallBack);
@@ -4133,7 +4241,8 @@ SAFSS_Symlink(struct rx_call *acall, struct AFSFid *DirFid, char *Name,
     assert_vnode_success_or_salvaging(errorCode);
 
     /* break call back on the parent dir */
-    BreakCallBack(client->z.host, DirFid, 0);
+    BreakDirEntryCallBack(client->z.host, DirFid, OutDirStatus,
+			  AFS_DIRDELTA_ADD, Name, OutFid);
 
   Bad_SymLink:
     /* Write the all modified vnodes (parent, new files) and volume back */
@@ -4309,7 +4418,8 @@ SAFSS_Link(struct rx_call *acall, struct AFSFid *DirFid, char *Name,
     assert_vnode_success_or_salvaging(errorCode);
 
     /* break call back on DirFid */
-    BreakCallBack(client->z.host, DirFid, 0);
+    BreakDirEntryCallBack(client->z.host, DirFid, OutDirStatus,
+			  AFS_DIRDELTA_ADD, Name, ExistingFid);
     /*
      * We also need to break the callback for the file that is hard-linked since part
      * of its status (like linkcount) is changed
@@ -4476,7 +4586,8 @@ SAFSS_MakeDir(struct rx_call *acall, struct AFSFid *DirFid, char *Name,
     assert_vnode_success_or_salvaging(errorCode);
 
     /* break call back on DirFid */
-    BreakCallBack(client->z.host, DirFid, 0);
+    BreakDirEntryCallBack(client->z.host, DirFid, OutDirStatus,
+			  AFS_DIRDELTA_ADD, Name, OutFid);
 
     /* Return a callback promise to caller */
     SetCallBackStruct(AddCallBack(client->z.host, OutFid), CallBack);
@@ -4610,7 +4721,8 @@ SAFSS_RemoveDir(struct rx_call *acall, struct AFSFid *DirFid, char *Name,
     assert_vnode_success_or_salvaging(errorCode);
 
     /* break call back on DirFid and fileFid */
-    BreakCallBack(client->z.host, DirFid, 0);
+    BreakDirEntryCallBack(client->z.host, DirFid, OutDirStatus,
+			  AFS_DIRDELTA_REMOVE, Name, &fileFid);
 
   Bad_RemoveDir:
     /* Write the all modified vnodes (parent, new files) and volume back */
@@ -5314,6 +5426,12 @@ FillPerfValues(struct afs_PerfStats *a_perfP)
     a_perfP->sysname_ID = afs_perfstats.sysname_ID;
     a_perfP->rx_nBusies = (afs_int32) stats->nBusies;
     a_perfP->fs_nBusies = afs_perfstats.fs_nBusies;
+    a_perfP->fs_nRightsHits = afs_perfstats.fs_nRightsHits;
+    a_perfP->fs_nRightsMisses = afs_perfstats.fs_nRightsMisses;
+    a_perfP->fs_RightsMissMsec = afs_perfstats.fs_RightsMissMsec;
+    a_perfP->fs_nCPSHits = afs_perfstats.fs_nCPSHits;
+    a_perfP->fs_nCPSMisses = afs_perfstats.fs_nCPSMisses;
+    a_perfP->fs_nCPSRefreshes = afs_perfstats.fs_nCPSRefreshes;
     rx_FreeStatistics(&stats);
 }				/*FillPerfValues */
 
@@ -5463,7 +5581,7 @@ SRXAFS_GetXStats(struct rx_call *a_call, afs_int32 a_clientVersionNum,
     case AFS_XSTATSCOLL_CBSTATS:
 	afs_perfstats.numPerfCalls++;
 
-	dataBytes = sizeof(struct cbcounters);
+	dataBytes = sizeof(struct cbcounters) + sizeof(struct cbqcounters);
 	dataBuffP = malloc(dataBytes);
 	{
 	    extern struct cbcounters cbstuff;
@@ -5483,6 +5601,13 @@ SRXAFS_GetXStats(struct rx_call *a_call, afs_int32 a_clientVersionNum,
 	    dataBuffP[13]=cbstuff.GSS3;
 	    dataBuffP[14]=cbstuff.GSS4;
 	    dataBuffP[15]=cbstuff.GSS5;
+	    dataBuffP[16]=cbqstuff.nQueued;
+	    dataBuffP[17]=cbqstuff.nBatches;
+	    dataBuffP[18]=cbqstuff.BreakRPCs;
+	    dataBuffP[19]=cbqstuff.Coalesced;
+	    dataBuffP[20]=cbqstuff.QueueWaits;
+	    dataBuffP[21]=cbqstuff.DirDeltas;
+	    dataBuffP[22]=cbqstuff.DownBatches;
 	}
 
 	a_dataP->AFS_CollData_len = dataBytes >> 2;
@@ -5653,6 +5778,9 @@ FlushClientCPS(struct client *client, void *arock)
     ObtainWriteLock(&client->lock);
 
     client->z.prfail = 2;	/* Means re-eval client's cps */
+    H_LOCK;
+    client->z.cpsGen++;
+    H_UNLOCK;
 
     if ((client->z.ViceId != ANONYMOUSID) && client->z.CPS.prlist_val) {
 	free(client->z.CPS.prlist_val);
@@ -5696,6 +5824,7 @@ SRXAFS_FlushCPS(struct rx_call * acall, struct ViceIds * vids,
     for (i = 0; i < nids; i++, vd++) {
 	if (!*vd)
 	    continue;
+	cps_FlushCPS(*vd);
 	h_EnumerateClients(*vd, FlushClientCPS, NULL);
     }
 
@@ -6125,6 +6254,31 @@ SRXAFS_GetTime(struct rx_call * acall, afs_uint32 * Seconds,
 }				/*SRXAFS_GetTime */
 
 
+#ifndef AFS_NT40_ENV
+/*
+ * Can the data for a fetch go straight from the file to the network?
+ * Only if the call's security class sends data largely as it finds it:
+ * rxkad at the crypt level encrypts it in place.
+ */
+static int
+CanSendFromFile(struct rx_call *acall)
+{
+    struct rx_connection *tcon = rx_ConnectionOf(acall);
+    rxkad_level level;
+
+    switch (rx_SecurityClassOf(tcon)) {
+    case RX_SECIDX_NULL:
+	return 1;
+    case RX_SECIDX_KAD:
+	if (rxkad_GetServerInfo(tcon, &level, NULL, NULL, NULL, NULL, NULL))
+	    return 0;
+	return level == rxkad_clear || level == rxkad_auth;
+    default:
+	return 0;
+    }
+}
+#endif
+
 /*
  * FetchData_RXStyle
  *
@@ -6161,6 +6315,9 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 #endif /* HAVE_PIOV */
     afs_sfsize_t tlen;
     afs_int32 optSize;
+#ifndef AFS_NT40_ENV
+    int fromFile;
+#endif
 
     /*
      * Initialize the byte count arguments.
@@ -6227,6 +6384,12 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 	rx_Write(Call, (char *)&low, sizeof(afs_int32));	/* send length on fetch */
     }
     (*a_bytesToFetchP) = Len;
+#ifndef AFS_NT40_ENV
+    /* Rx maps as much of the file as it needs, so hand it all over at once */
+    fromFile = CanSendFromFile(Call);
+    if (fromFile)
+	optSize = 0x40000000;
+#endif
 #ifndef HAVE_PIOV
     tbuffer = AllocSendBuffer();
 #endif /* HAVE_PIOV */
@@ -6237,6 +6400,26 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 	    wlen = optSize;
 	else
 	    wlen = Len;
+#ifndef AFS_NT40_ENV
+	if (fromFile) {
+	    /* Rx maps the file, so it must not have shrunk since we sized it */
+	    if (FDH_SIZE(fdP) < Pos + (afs_sfsize_t)wlen)
+		nBytes = 0;
+	    else
+		nBytes = rx_WritevFromFd(Call, fdP->fd_fd, Pos, wlen);
+	    if (nBytes != wlen && !rx_Error(Call)) {
+		/* The call is fine, so it was the file which failed us */
+		FDH_CLOSE(fdP);
+#ifndef HAVE_PIOV
+		FreeSendBuffer((struct afs_buffer *)tbuffer);
+#endif /* HAVE_PIOV */
+		VTakeOffline(volptr);
+		ViceLog(0, ("Volume %" AFS_VOLID_FMT " now offline, must be salvaged.\n",
+			    afs_printable_VolumeId_lu(volptr->hashid)));
+		return EIO;
+	    }
+	} else {
+#endif /* AFS_NT40_ENV */
 #ifndef HAVE_PIOV
 	nBytes = FDH_PREAD(fdP, tbuffer, wlen, Pos);
 	if (nBytes != wlen) {
@@ -6265,6 +6448,9 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 	}
 	nBytes = rx_Writev(Call, tiov, tnio, wlen);
 #endif /* HAVE_PIOV */
+#ifndef AFS_NT40_ENV
+	}
+#endif
 	Pos += wlen;
 	/*
 	 * Bump the number of bytes actually sent by the number from this
@@ -6520,6 +6706,11 @@ StoreData_RXStyle(Volume * volptr, Vnode * targetptr, struct AFSFid * Fid,
 #ifndef HAVE_PIOV
     tbuffer = AllocSendBuffer();
 #endif /* HAVE_PIOV */
+#ifndef AFS_NT40_ENV
+    /* Packets FetchData sent straight from this file may not all have been
+     * acknowledged yet */
+    rx_WaitForFileData(fdP->fd_fd);
+#endif
     /* truncate the file iff it needs it (ftruncate is slow even when its a noop) */
     if (FileLength < DataLength) {
 	errorCode = FDH_TRUNC(fdP, FileLength);
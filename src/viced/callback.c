@@ -35,7 +35,12 @@
  *
  * BreakCallBack(host, fid)
  *     Break all call backs for fid, except for the specified host.
- *     Delete all of them.
+ *     Delete all of them.  The breaks are queued, and sent to each
+ *     host in batches by the CallBackBreakerLWP threads.
+ *
+ * ShutdownCallBackBreakers()
+ *     Stop sending queued breaks; those not yet sent become delayed
+ *     call backs.
  *
  * BreakVolumeCallBacksLater(volume)
  *     Break all call backs on volume, using single call to each host
@@ -92,6 +97,7 @@
 #endif
 
 #include <afs/opr.h>
+#include <opr/jhash.h>
 #include <opr/lock.h>
 #include <afs/nfs.h>		/* yuck.  This is an abomination. */
 #include <rx/rx.h>
@@ -156,6 +162,56 @@ static afs_uint32 timeout[CB_NUM_TIMEOUT_QUEUES];
 
 static afs_int32 tfirst;	/* cbtime of oldest unexpired call back time queue */
 
+#ifndef INTERPRET_DUMP
+/*
+ * Callback breaks from BreakCallBack are not sent by the thread which
+ * caused them.  They are queued in batches, one batch open to each host at
+ * a time, so that several files broken on a host in quick succession go to
+ * it in a single CallBack RPC.  A few threads take batches from the queue
+ * in order, and each sends those it takes to their hosts at once with
+ * multi_Rx, with the same error handling as MultiBreakCallBack_r.  A host
+ * has at most one batch being sent at a time, so that one which doesn't
+ * answer holds up only its own breaks, and they reach it in order; once it
+ * is marked down, its queued batches become delayed call backs without
+ * being sent.  All of this is under H_LOCK.
+ */
+struct cbBatch {
+    struct cbBatch *next;	/* on the queue, or the free list */
+    struct cbBatch *hnext;	/* in cbBatchHash while open, and in
+				 * cbSendingHash while being sent */
+    struct host *hp;		/* held while the batch exists */
+    int open;			/* more breaks may be added */
+    int nfids;
+    AFSFid fids[AFSCBMAX];
+    afs_uint32 theads[AFSCBMAX];
+    struct cbDirDelta *delta;	/* if set, send this for fids[0] rather
+				 * than breaking it */
+};
+
+/* A change to a directory, shared by the batches sending it */
+struct cbDirDelta {
+    int refCount;
+    AFSFid dirFid;
+    struct AFSDirDeltaStatus status;
+    int ndeltas;
+    struct AFSDirDelta deltas[AFS_DIRDELTA_MAX];
+    char names[AFS_DIRDELTA_MAX][AFSNAMEMAX];
+};
+
+struct cbqcounters cbqstuff;
+
+static struct cbBatch *cbBatchHead, *cbBatchTail;	/* the queue */
+static struct cbBatch *cbBatchFree;
+static struct cbBatch *cbBatchHash[CB_BREAK_HASHSIZE];
+static struct cbBatch *cbSendingHash[CB_BREAK_HASHSIZE];
+static int cbBatchesSending;	/* taken from the queue, not yet done */
+static int cbBreakersStopped;
+static pthread_cond_t cbBatchCond;	/* something has been queued */
+static pthread_cond_t cbBatchDoneCond;	/* a batch has been finished with */
+
+#define CBBatchHash(host) (h_htoi(host) & (CB_BREAK_HASHSIZE - 1))
+#endif
+
 
 /* 16 byte object get/free routines */
 struct object {
@@ -200,7 +256,54 @@ static int DumpCallBackState_r(void);
 /* Other protos - move out sometime */
 void PrintCB(struct CallBack *cb, afs_uint32 now);
 
-static afs_uint32 HashTable[FEHASH_SIZE];	/* File entry hash table */
+static afs_uint32 *HashTable = NULL;	/* File entry hash table */
+static afs_uint32 FEHashSize;		/* buckets in HashTable */
+static afs_uint32 FEHashCount;		/* file entries in HashTable */
+
+/* Hash bucket for a fid.  Every part of the fid is mixed in, so that the
+ * many files of one volume are spread over the whole table. */
+static afs_uint32
+FEHash(VolumeId volume, afs_uint32 vnode, afs_uint32 unique)
+{
+    afs_uint32 buf[3];
+
+    buf[0] = volume;
+    buf[1] = vnode;
+    buf[2] = unique;
+    return opr_jhash(buf, 3, 0) & (FEHashSize - 1);
+}
+
+/* Rehash every file entry into a new table of the given size, which must be
+ * a power of 2.  The entries may have been hashed with a table of any size,
+ * or with an older hash function, as when restored from disk. */
+static int
+FEHashResize(afs_uint32 size)
+{
+    afs_uint32 *table, *old = HashTable;
+    afs_uint32 oldSize = FEHashSize, count = 0;
+    afs_uint32 fei, next, hash, i;
+    struct FileEntry *fe;
+
+    table = calloc(size, sizeof(afs_uint32));
+    if (table == NULL)
+	return -1;
+
+    HashTable = table;
+    FEHashSize = size;
+    for (i = 0; i < oldSize; i++) {
+	for (fei = old[i]; fei; fei = next) {
+	    fe = itofe(fei);
+	    next = fe->fnext;
+	    hash = FEHash(fe->volid, fe->vnode, fe->unique);
+	    fe->fnext = HashTable[hash];
+	    HashTable[hash] = fei;
+	    count++;
+	}
+    }
+    FEHashCount = count;
+    free(old);
+    return 0;
+}
 
 static struct FileEntry *
 FindFE(AFSFid * fid)
@@ -209,7 +312,7 @@ FindFE(AFSFid * fid)
     int fei;
     struct FileEntry *fe;
 
-    hash = FEHash(fid->Volume, fid->Unique);
+    hash = FEHash(fid->Volume, fid->Vnode, fid->Unique);
     for (fei = HashTable[hash]; fei; fei = fe->fnext) {
 	fe = itofe(fei);
 	if (fe->volid == fid->Volume && fe->unique == fid->Unique
@@ -263,6 +366,24 @@ iFreeFE(struct FileEntry *fe, int *nused)
     return 0;
 }
 
+/* Count a file entry added to the hash table, and double the table if it is
+ * getting full */
+static void
+FEHashAdded(void)
+{
+    if (++FEHashCount <= FEHashSize * FEHASH_LOAD
+	|| FEHashSize >= FEHASH_MAXSIZE)
+	return;
+
+    if (FEHashResize(FEHashSize * 2)) {
+	ViceLog(0, ("FEHashAdded: failed to grow the file entry hash table "
+		    "past %u buckets\n", FEHashSize));
+    } else {
+	ViceLog(1, ("FEHashAdded: file entry hash table now has %u buckets "
+		    "for %u entries\n", FEHashSize, FEHashCount));
+    }
+}
+
 /* Add cb to end of specified timeout list */
 static int
 TAdd(struct CallBack *cb, afs_uint32 * thead)
@@ -408,12 +529,13 @@ static int
 FDel(struct FileEntry *fe)
 {
     int fei = fetoi(fe);
-    afs_uint32 *p = &HashTable[FEHash(fe->volid, fe->unique)];
+    afs_uint32 *p = &HashTable[FEHash(fe->volid, fe->vnode, fe->unique)];
 
     while (*p && *p != fei)
 	p = &itofe(*p)->fnext;
     opr_Assert(*p);
     *p = fe->fnext;
+    FEHashCount--;
     FreeFE(fe);
     return 0;
 }
@@ -446,6 +568,14 @@ InitCallBack(int nblks)
 	FreeCB(&CB[cbstuff.nCBs]);	/* This is correct */
     cbstuff.nblks = nblks;
     cbstuff.nbreakers = 0;
+    HashTable = calloc(FEHASH_SIZE, sizeof(afs_uint32));
+    if (!HashTable) {
+	ViceLogThenPanic(0, ("Failed malloc in InitCallBack\n"));
+    }
+    FEHashSize = FEHASH_SIZE;
+    FEHashCount = 0;
+    opr_cv_init(&cbBatchCond);
+    opr_cv_init(&cbBatchDoneCond);
     H_UNLOCK;
     return 0;
 }
@@ -591,9 +721,10 @@ AddCallBack1_r(struct host *host, AFSFid * fid, afs_uint32 * thead, int type,
 	fe->unique = fid->Unique;
 	fe->ncbs = 0;
 	fe->status = 0;
-	hash = FEHash(fid->Volume, fid->Unique);
+	hash = FEHash(fid->Volume, fid->Vnode, fid->Unique);
 	fe->fnext = HashTable[hash];
 	HashTable[hash] = fetoi(fe);
+	FEHashAdded();
     }
     for (safety = 0, lastcb = cb = itocb(fe->firstcb); cb;
 	 lastcb = cb, cb = itocb(cb->cnext), safety++) {
@@ -791,6 +922,436 @@ MultiBreakCallBack_r(struct cbstruct cba[], int ncbas,
     return;
 }
 
+/* Find the batch for host in cbBatchHash or cbSendingHash */
+static struct cbBatch *
+FindBatch(struct cbBatch **hash, struct host *host)
+{
+    struct cbBatch *batch;
+
+    for (batch = hash[CBBatchHash(host)]; batch; batch = batch->hnext)
+	if (batch->hp == host)
+	    return batch;
+    return NULL;
+}
+
+static void
+CloseBatch(struct cbBatch *batch)
+{
+    struct cbBatch **bp;
+
+    if (!batch->open)
+	return;
+    for (bp = &cbBatchHash[CBBatchHash(batch->hp)]; *bp != batch;
+	 bp = &(*bp)->hnext)
+	opr_Assert(*bp);
+    *bp = batch->hnext;
+    batch->open = 0;
+}
+
+/* Queue a new batch for a host, which must be checked to have room */
+static struct cbBatch *
+NewBatch_r(struct host *hp, int open)
+{
+    struct cbBatch *batch;
+
+    if (cbBatchFree) {
+	batch = cbBatchFree;
+	cbBatchFree = batch->next;
+    } else {
+	batch = malloc(sizeof(*batch));
+	if (!batch) {
+	    ViceLogThenPanic(0, ("Failed malloc in NewBatch_r\n"));
+	}
+    }
+    h_Hold_r(hp);
+    batch->hp = hp;
+    batch->nfids = 0;
+    batch->delta = NULL;
+    batch->open = open;
+    if (open) {
+	batch->hnext = cbBatchHash[CBBatchHash(hp)];
+	cbBatchHash[CBBatchHash(hp)] = batch;
+    }
+    batch->next = NULL;
+    if (cbBatchTail)
+	cbBatchTail->next = batch;
+    else
+	cbBatchHead = batch;
+    cbBatchTail = batch;
+    cbqstuff.nBatches++;
+    opr_cv_signal(&cbBatchCond);
+    return batch;
+}
+
+/* Wait for room on the queue, dropping H_LOCK.  Returns 0 if there was room
+ * already, and 1 if we waited, in which case the caller must look again. */
+static int
+WaitForBatchRoom_r(void)
+{
+    if (cbqstuff.nBatches < CB_BREAK_MAXBATCHES)
+	return 0;
+    cbqstuff.QueueWaits++;
+    opr_cv_wait(&cbBatchDoneCond, &host_glock_mutex);
+    return 1;
+}
+
+static void
+PutDirDelta_r(struct cbDirDelta *delta)
+{
+    if (--delta->refCount == 0)
+	free(delta);
+}
+
+/* Return a batch which has been sent, or dropped, to the free list */
+static void
+FreeBatch_r(struct cbBatch *batch)
+{
+    if (batch->delta)
+	PutDirDelta_r(batch->delta);
+    cbqstuff.nBatches--;
+    batch->next = cbBatchFree;
+    cbBatchFree = batch;
+    opr_cv_broadcast(&cbBatchDoneCond);
+}
+
+/* Queue a break of fid to each of the held hosts in cba[], taking over the
+ * holds.  This may drop H_LOCK while it waits for room on the queue. */
+static void
+QueueCallBackBreaks_r(struct cbstruct cba[], int ncbas, AFSFid *fid)
+{
+    struct cbBatch *batch;
+    struct host *hp;
+    int i, j;
+
+    for (i = 0; i < ncbas; i++) {
+	hp = cba[i].hp;
+	while ((batch = FindBatch(cbBatchHash, hp)) == NULL) {
+	    if (!WaitForBatchRoom_r()) {
+		batch = NewBatch_r(hp, 1);
+		break;
+	    }
+	}
+
+	if (batch->nfids > 0)
+	    cbqstuff.Coalesced++;
+	for (j = 0; j < batch->nfids; j++) {
+	    if (batch->fids[j].Volume == fid->Volume
+		&& batch->fids[j].Vnode == fid->Vnode
+		&& batch->fids[j].Unique == fid->Unique)
+		break;
+	}
+	if (j == batch->nfids) {
+	    batch->fids[j] = *fid;
+	    batch->theads[j] = cba[i].thead;
+	    batch->nfids++;
+	    cbqstuff.nQueued++;
+	    if (batch->nfids == AFSCBMAX)
+		CloseBatch(batch);
+	}
+	h_Release_r(hp);
+    }
+}
+
+/* Queue a directory delta to each of the held hosts in cba[], taking over
+ * the holds.  Deltas aren't coalesced, since each applies to the version of
+ * the directory the one before it left.  This may drop H_LOCK while it
+ * waits for room on the queue. */
+static void
+QueueDirDeltas_r(struct cbstruct cba[], int ncbas, struct cbDirDelta *delta)
+{
+    struct cbBatch *batch;
+    int i;
+
+    for (i = 0; i < ncbas; i++) {
+	while (WaitForBatchRoom_r())
+	    ;
+	batch = NewBatch_r(cba[i].hp, 0);
+	batch->fids[0] = delta->dirFid;
+	batch->theads[0] = cba[i].thead;
+	batch->nfids = 1;
+	batch->delta = delta;
+	delta->refCount++;
+	cbqstuff.nQueued++;
+	cbqstuff.DirDeltas++;
+	h_Release_r(cba[i].hp);
+    }
+}
+
+/* Keep a batch's breaks as delayed call backs, marking its host down, as
+ * for a host which didn't answer them.  Called with the host locked. */
+static void
+DelayBatch_r(struct cbBatch *batch)
+{
+    struct host *hp = batch->hp;
+    int i;
+
+    if (!(hp->z.hostFlags & HOSTDELETED)) {
+	hp->z.hostFlags |= VENUSDOWN;
+	for (i = 0; i < batch->nfids; i++)
+	    AddCallBack1_r(hp, &batch->fids[i], itot(batch->theads[i]),
+			   CB_DELAYED, 1);
+    }
+}
+
+/*
+ * Take up to max batches from the queue to send.  They are taken in order,
+ * passing over those for hosts which already have a batch being sent.
+ * Batches for hosts which are down, or gone, are finished with here rather
+ * than sent.  Returns the number of batches put in batches[].
+ */
+static int
+TakeBatches_r(struct cbBatch *batches[], int max)
+{
+    struct cbBatch *batch, *prev, *next, *down = NULL;
+    struct host *hp;
+    int n = 0;
+
+    prev = NULL;
+    for (batch = cbBatchHead; batch && n < max; batch = next) {
+	next = batch->next;
+	hp = batch->hp;
+	if (FindBatch(cbSendingHash, hp)) {
+	    prev = batch;
+	    continue;
+	}
+	if (prev)
+	    prev->next = next;
+	else
+	    cbBatchHead = next;
+	if (cbBatchTail == batch)
+	    cbBatchTail = prev;
+	CloseBatch(batch);
+	cbqstuff.nQueued -= batch->nfids;
+
+	if (hp->z.hostFlags & (VENUSDOWN | HOSTDELETED)) {
+	    /* locking the host drops H_LOCK, so do these after */
+	    batch->next = down;
+	    down = batch;
+	    continue;
+	}
+	batch->hnext = cbSendingHash[CBBatchHash(hp)];
+	cbSendingHash[CBBatchHash(hp)] = batch;
+	cbBatchesSending++;
+	batches[n++] = batch;
+    }
+
+    while ((batch = down) != NULL) {
+	down = batch->next;
+	hp = batch->hp;
+	h_Lock_r(hp);
+	DelayBatch_r(batch);
+	h_Unlock_r(hp);
+	h_Release_r(hp);
+	cbqstuff.DownBatches++;
+	FreeBatch_r(batch);
+    }
+    return n;
+}
+
+/* Finish with a batch taken by TakeBatches_r, and let its host's next one
+ * be taken */
+static void
+DoneBatch_r(struct cbBatch *batch)
+{
+    struct cbBatch **bp;
+
+    for (bp = &cbSendingHash[CBBatchHash(batch->hp)]; *bp != batch;
+	 bp = &(*bp)->hnext)
+	opr_Assert(*bp);
+    *bp = batch->hnext;
+    cbBatchesSending--;
+    h_Release_r(batch->hp);
+    FreeBatch_r(batch);
+    if (cbBatchHead)
+	opr_cv_signal(&cbBatchCond);
+}
+
+/* A batch's breaks, in tf, couldn't be sent.  Try the host's other
+ * addresses, and if they fail too, keep the breaks as delayed call backs.
+ * Called without H_LOCK. */
+static void
+BatchFailed(struct cbBatch *batch, struct AFSCBFids *tf)
+{
+    struct host *hp = batch->hp;
+    char hoststr[16];
+
+    if (!MultiBreakCallBackAlternateAddress(hp, tf))
+	return;
+    if (ShowProblems) {
+	ViceLog(7,
+		("BCB: Failed on %d files from %u.%u.%u, "
+		 "Host %p (%s:%d) is down\n", batch->nfids,
+		 tf->AFSCBFids_val->Volume, tf->AFSCBFids_val->Vnode,
+		 tf->AFSCBFids_val->Unique, hp,
+		 afs_inet_ntoa_r(hp->z.host, hoststr),
+		 ntohs(hp->z.port)));
+    }
+
+    H_LOCK;
+    h_Lock_r(hp);
+    DelayBatch_r(batch);
+    h_Unlock_r(hp);
+    H_UNLOCK;
+}
+
+/* Send a batch carrying a directory delta, breaking the callback instead if
+ * the host turns out not to take them */
+static void
+SendDirDeltaBatch_r(struct cbBatch *batch)
+{
+    struct host *hp = batch->hp;
+    struct cbDirDelta *delta = batch->delta;
+    struct rx_connection *conn;
+    struct AFSCBFids tf;
+    static struct AFSCBs tc = { 0, 0 };
+    AFSDirDeltas deltas;
+    int code;
+
+    conn = hp->z.callback_rxcon;
+    rx_GetConnection(conn);
+    rx_SetConnDeadTime(conn, 4);
+    rx_SetConnHardDeadTime(conn, AFS_HARDDEADTIME);
+    tf.AFSCBFids_len = batch->nfids;
+    tf.AFSCBFids_val = batch->fids;
+    deltas.AFSDirDeltas_len = delta->ndeltas;
+    deltas.AFSDirDeltas_val = delta->deltas;
+
+    cbstuff.nbreakers++;
+    cbqstuff.BreakRPCs++;
+    H_UNLOCK;
+    code = RXAFSCB_CallBackDirDelta(conn, &delta->dirFid, &delta->status,
+				    &deltas);
+    if (code == RXGEN_OPCODE) {
+	/* it said it could, but it can't; just break it from now on */
+	H_LOCK;
+	h_Lock_r(hp);
+	hp->z.hostFlags &= ~HDIRDELTA;
+	h_Unlock_r(hp);
+	H_UNLOCK;
+	code = RXAFSCB_CallBack(conn, &tf, &tc);
+    }
+    if (code)
+	BatchFailed(batch, &tf);
+    /* as in MultiBreakCallBack_r, put the connection without H_LOCK */
+    rx_PutConnection(conn);
+    H_LOCK;
+    cbstuff.nbreakers--;
+}
+
+static int
+CompareBatch(const void *e1, const void *e2)
+{
+    const struct cbBatch *b1 = *(const struct cbBatch **)e1;
+    const struct cbBatch *b2 = *(const struct cbBatch **)e2;
+    return (b1->hp->index - b2->hp->index);
+}
+
+/* Send the batches taken by TakeBatches_r, each to a different host, all at
+ * once.  As in MultiBreakCallBack_r, the calls are made in host order, so
+ * that this can't deadlock waiting for call channels with another thread
+ * doing the same. */
+static void
+SendCallBackBatches_r(struct cbBatch *batches[], int nbatches)
+{
+    struct rx_connection *conns[CB_BREAK_FANOUT];
+    struct AFSCBFids tfs[CB_BREAK_FANOUT];
+    struct cbBatch *sent[CB_BREAK_FANOUT];
+    static struct AFSCBs tc = { 0, 0 };
+    struct cbBatch *batch;
+    struct host *hp;
+    int i, j;
+
+    qsort(batches, nbatches, sizeof(batches[0]), CompareBatch);
+    for (i = 0, j = 0; i < nbatches; i++) {
+	batch = batches[i];
+	hp = batch->hp;
+	if (hp->z.hostFlags & HOSTDELETED)
+	    continue;
+	if (batch->delta) {
+	    SendDirDeltaBatch_r(batch);
+	    continue;
+	}
+	rx_GetConnection(hp->z.callback_rxcon);
+	rx_SetConnDeadTime(hp->z.callback_rxcon, 4);
+	rx_SetConnHardDeadTime(hp->z.callback_rxcon, AFS_HARDDEADTIME);
+	conns[j] = hp->z.callback_rxcon;
+	tfs[j].AFSCBFids_len = batch->nfids;
+	tfs[j].AFSCBFids_val = batch->fids;
+	sent[j++] = batch;
+    }
+    if (j == 0)
+	return;
+
+    cbstuff.nbreakers++;
+    cbqstuff.BreakRPCs += j;
+    H_UNLOCK;
+    multi_Rx(conns, j) {
+	multi_RXAFSCB_CallBack(&tfs[multi_i], &tc);
+	if (multi_error)
+	    BatchFailed(sent[multi_i], &tfs[multi_i]);
+    }
+    multi_End;
+    /* as in MultiBreakCallBack_r, put the connections without H_LOCK */
+    for (i = 0; i < j; i++)
+	rx_PutConnection(conns[i]);
+    H_LOCK;
+    cbstuff.nbreakers--;
+}
+
+/* A thread which sends the breaks on the queue */
+void *
+CallBackBreakerLWP(void *unused)
+{
+    struct cbBatch *batches[CB_BREAK_FANOUT];
+    int i, n;
+
+    afs_pthread_setname_self("CallBackBreaker");
+    H_LOCK;
+    for (;;) {
+	while (cbBreakersStopped
+	       || (n = TakeBatches_r(batches, CB_BREAK_FANOUT)) == 0)
+	    opr_cv_wait(&cbBatchCond, &host_glock_mutex);
+
+	SendCallBackBatches_r(batches, n);
+
+	for (i = 0; i < n; i++)
+	    DoneBatch_r(batches[i]);
+    }
+    H_UNLOCK;
+    return NULL;
+}
+
+/*
+ * Stop sending queued breaks, and wait for those being sent.  The breaks
+ * still queued become delayed callbacks, as if their hosts were down, so
+ * that they are saved with the rest of the callback state and are broken
+ * once the hosts are heard from again.
+ */
+void
+ShutdownCallBackBreakers(void)
+{
+    struct cbBatch *batch;
+    struct host *hp;
+
+    H_LOCK;
+    cbBreakersStopped = 1;
+    while (cbBatchesSending)
+	opr_cv_wait(&cbBatchDoneCond, &host_glock_mutex);
+    while ((batch = cbBatchHead) != NULL) {
+	cbBatchHead = batch->next;
+	CloseBatch(batch);
+	hp = batch->hp;
+	h_Lock_r(hp);
+	DelayBatch_r(batch);
+	h_Unlock_r(hp);
+	h_Release_r(hp);
+	cbqstuff.nQueued -= batch->nfids;
+	FreeBatch_r(batch);
+    }
+    cbBatchTail = NULL;
+    H_UNLOCK;
+}
+
 /*
  * Break all call backs for fid, except for the specified host (unless flag
  * is true, in which case all get a callback message. Assumption: the specified
@@ -799,16 +1360,22 @@ MultiBreakCallBack_r(struct cbstruct cba[], int ncbas,
  * host was down in two places, once right after the host was h_held, and
  * again after it was locked.  That race condition is incredibly rare and
  * relatively harmless even when it does occur, so we don't check for it now.
+ * The breaks are queued for the CallBackBreakerLWP threads to send; this
+ * does not wait for them.
+ *
+ * If delta is given, hosts which take directory deltas are sent it instead,
+ * and keep their call backs.
  */
 /* if flag is true, send a break callback msg to "host", too */
-int
-BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
+static int
+BreakCallBack1(struct host *xhost, AFSFid * fid, int flag,
+	       struct cbDirDelta *delta)
 {
     struct FileEntry *fe;
     struct CallBack *cb, *nextcb;
     struct cbstruct cba[MAX_CB_HOSTS];
-    int ncbas;
-    struct AFSCBFids tf;
+    struct cbstruct dcba[MAX_CB_HOSTS];
+    int ncbas, ndcbas;
     int hostindex;
     char hoststr[16];
 
@@ -834,8 +1401,6 @@ BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
 	/* the most common case is what follows the || */
 	goto done;
     }
-    tf.AFSCBFids_len = 1;
-    tf.AFSCBFids_val = fid;
 
     /* Set CBFLAG_BREAKING flag on all CBs we're looking at. We do this so we
      * can loop through all relevant CBs while dropping H_LOCK, and not lose
@@ -857,7 +1422,9 @@ BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
     /* loop through all CBs, only looking at ones with the CBFLAG_BREAKING
      * flag set */
     for (; cb;) {
-	for (ncbas = 0; cb && ncbas < MAX_CB_HOSTS; cb = nextcb) {
+	for (ncbas = ndcbas = 0;
+	     cb && ncbas < MAX_CB_HOSTS && ndcbas < MAX_CB_HOSTS;
+	     cb = nextcb) {
 	    nextcb = itocb(cb->cnext);
 	    if ((cb->flags & CBFLAG_BREAKING)) {
 		struct host *thishost = h_itoh(cb->hhead);
@@ -870,6 +1437,13 @@ BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
 			     thishost, afs_inet_ntoa_r(thishost->z.host, hoststr),
 			     ntohs(thishost->z.port)));
 		    cb->status = CB_DELAYED;
+		} else if (delta && (thishost->z.hostFlags & HDIRDELTA)) {
+		    if (!(thishost->z.hostFlags & HOSTDELETED)) {
+			h_Hold_r(thishost);
+			dcba[ndcbas].hp = thishost;
+			dcba[ndcbas].thead = cb->thead;
+			ndcbas++;
+		    }
 		} else {
 		    if (!(thishost->z.hostFlags & HOSTDELETED)) {
 			h_Hold_r(thishost);
@@ -885,10 +1459,11 @@ BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
 	    }
 	}
 
-	if (ncbas) {
-	    MultiBreakCallBack_r(cba, ncbas, &tf);
+	if (ncbas || ndcbas) {
+	    QueueCallBackBreaks_r(cba, ncbas, fid);
+	    QueueDirDeltas_r(dcba, ndcbas, delta);
 
-	    /* we need to to all these initializations again because MultiBreakCallBack may block */
+	    /* we need to to all these initializations again because the Queue functions may block */
 	    fe = FindFE(fid);
 	    if (!fe) {
 		goto done;
@@ -906,6 +1481,51 @@ BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
     return 0;
 }
 
+int
+BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
+{
+    return BreakCallBack1(xhost, fid, flag, NULL);
+}
+
+/*
+ * Break the call backs on a directory after the changes in deltas[] were
+ * made to it, leaving it with the status dirStatus.  Hosts which take
+ * directory deltas are sent the changes instead, to make to their own
+ * copies.  As with BreakCallBack, xhost is not told.
+ */
+int
+BreakDirCallBack(struct host *xhost, AFSFid * dirFid,
+		 struct AFSDirDeltaStatus *dirStatus,
+		 struct AFSDirDelta *deltas, int ndeltas)
+{
+    struct cbDirDelta *delta;
+    int i;
+
+    opr_Assert(ndeltas <= AFS_DIRDELTA_MAX);
+
+    delta = malloc(sizeof(*delta));
+    if (!delta) {
+	ViceLogThenPanic(0, ("Failed malloc in BreakDirCallBack\n"));
+    }
+    delta->refCount = 1;
+    delta->dirFid = *dirFid;
+    delta->status = *dirStatus;
+    delta->ndeltas = ndeltas;
+    for (i = 0; i < ndeltas; i++) {
+	delta->deltas[i].Op = deltas[i].Op;
+	delta->deltas[i].Fid = deltas[i].Fid;
+	strlcpy(delta->names[i], deltas[i].Name, AFSNAMEMAX);
+	delta->deltas[i].Name = delta->names[i];
+    }
+
+    BreakCallBack1(xhost, dirFid, 0, delta);
+
+    H_LOCK;
+    PutDirDelta_r(delta);
+    H_UNLOCK;
+    return 0;
+}
+
 /* Delete (do not break) single call back for fid */
 int
 DeleteCallBack(struct host *host, AFSFid * fid)
@@ -1229,7 +1849,7 @@ BreakVolumeCallBacksLater(VolumeId volume)
     ViceLog(25, ("Setting later on volume %" AFS_VOLID_FMT "\n",
 		 afs_printable_VolumeId_lu(volume)));
     H_LOCK;
-    for (hash = 0; hash < FEHASH_SIZE; hash++) {
+    for (hash = 0; hash < FEHashSize; hash++) {
 	for (feip = &HashTable[hash]; (fe = itofe(*feip)) != NULL; ) {
 	    if (fe->volid == volume) {
 		struct CallBack *cbnext;
@@ -1281,7 +1901,7 @@ BreakLaterCallBacks(void)
     /* Pick the first volume we see to clean up */
     fid.Volume = fid.Vnode = fid.Unique = 0;
 
-    for (hash = 0; hash < FEHASH_SIZE; hash++) {
+    for (hash = 0; hash < FEHashSize; hash++) {
 	for (feip = &HashTable[hash]; (fe = itofe(*feip)) != NULL; ) {
 	    if (fe && (fe->status & FE_LATER)
 		&& (fid.Volume == 0 || fid.Volume == fe->volid)) {
@@ -1292,6 +1912,7 @@ BreakLaterCallBacks(void)
 			 fe->unique, afs_printable_VolumeId_lu(fe->volid)));
 		fid.Volume = fe->volid;
 		*feip = fe->fnext;
+		FEHashCount--;
 		fe->status &= ~FE_LATER; /* not strictly needed */
 		/* Works since volid is deeper than the largest pointer */
 		tmpfe = (struct object *)fe;
@@ -1694,6 +2315,7 @@ PrintCallBackStats(void)
 
 #define MAGIC 0x12345678	/* To check byte ordering of dump when it is read in */
 #define MAGICV2 0x12345679      /* To check byte ordering & version of dump when it is read in */
+#define MAGICV3 0x1234567a      /* As MAGICV2, with the size of the FE hash table */
 
 
 #ifndef INTERPRET_DUMP
@@ -1827,6 +2449,7 @@ int
 cb_stateRestoreIndices(struct fs_dump_state * state)
 {
     int i, ret = 0;
+    afs_uint32 size;
     struct FileEntry * fe;
     struct CallBack * cb;
 
@@ -1914,6 +2537,17 @@ cb_stateRestoreIndices(struct fs_dump_state * state)
 	}
     }
 
+    /* the FE hash table may have been saved at another size, or by a
+     * fileserver with another hash function, so rehash it */
+    size = FEHASH_SIZE;
+    while (size < FEHASH_MAXSIZE && state->cb_hdr->nFEs > size * FEHASH_LOAD)
+	size *= 2;
+    if (FEHashResize(size)) {
+	ViceLog(0, ("cb_stateRestoreIndices: failed to rehash the FE hash table\n"));
+	ret = 1;
+	goto done;
+    }
+
  done:
     return ret;
 }
@@ -1941,7 +2575,7 @@ cb_stateVerifyFEHash(struct fs_dump_state * state)
     struct FileEntry * fe;
     afs_uint32 fei, chain_len;
 
-    for (i = 0; i < FEHASH_SIZE; i++) {
+    for (i = 0; i < FEHashSize; i++) {
 	chain_len = 0;
 	for (fei = HashTable[i], fe = itofe(fei);
 	     fe;
@@ -2229,14 +2863,14 @@ cb_stateSaveFEHash(struct fs_dump_state * state)
 
     memset(state->cb_fehash_hdr, 0, sizeof(struct callback_state_fehash_header));
     state->cb_fehash_hdr->magic = CALLBACK_STATE_FEHASH_MAGIC;
-    state->cb_fehash_hdr->records = FEHASH_SIZE;
+    state->cb_fehash_hdr->records = FEHashSize;
     state->cb_fehash_hdr->len = sizeof(struct callback_state_fehash_header) +
 	(state->cb_fehash_hdr->records * sizeof(afs_uint32));
 
     iov[0].iov_base = (char *)state->cb_fehash_hdr;
     iov[0].iov_len = sizeof(struct callback_state_fehash_header);
     iov[1].iov_base = (char *)HashTable;
-    iov[1].iov_len = sizeof(HashTable);
+    iov[1].iov_len = FEHashSize * sizeof(afs_uint32);
 
     if (fs_stateSeek(state, &state->cb_hdr->fehash_offset)) {
 	ret = 1;
@@ -2258,6 +2892,7 @@ static int
 cb_stateRestoreFEHash(struct fs_dump_state * state)
 {
     int ret = 0, len;
+    afs_uint32 records, *table = NULL;
 
     if (fs_stateReadHeader(state, &state->cb_hdr->fehash_offset,
 			   state->cb_fehash_hdr,
@@ -2270,12 +2905,15 @@ cb_stateRestoreFEHash(struct fs_dump_state * state)
 	ret = 1;
 	goto done;
     }
-    if (state->cb_fehash_hdr->records != FEHASH_SIZE) {
+    /* any power of 2 will do, since the table is rehashed once restored */
+    records = state->cb_fehash_hdr->records;
+    if (records == 0 || records > FEHASH_MAXSIZE
+	|| (records & (records - 1)) != 0) {
 	ret = 1;
 	goto done;
     }
 
-    len = state->cb_fehash_hdr->records * sizeof(afs_uint32);
+    len = records * sizeof(afs_uint32);
 
     if (state->cb_fehash_hdr->len !=
 	(sizeof(struct callback_state_fehash_header) + len)) {
@@ -2283,12 +2921,24 @@ cb_stateRestoreFEHash(struct fs_dump_state * state)
 	goto done;
     }
 
-    if (fs_stateRead(state, HashTable, len)) {
+    table = malloc(len);
+    if (table == NULL) {
+	ret = 1;
+	goto done;
+    }
+
+    if (fs_stateRead(state, table, len)) {
 	ret = 1;
 	goto done;
     }
 
+    free(HashTable);
+    HashTable = table;
+    FEHashSize = records;
+    table = NULL;
+
  done:
+    free(table);
     return ret;
 }
 
@@ -2301,7 +2951,7 @@ cb_stateSaveFEs(struct fs_dump_state * state)
 
     AssignInt64(state->eof_offset, &state->cb_hdr->fe_offset);
 
-    for (hash = 0; hash < FEHASH_SIZE ; hash++) {
+    for (hash = 0; hash < FEHashSize ; hash++) {
 	for (fei = HashTable[hash]; fei; fei = fe->fnext) {
 	    fe = itofe(fei);
 	    if (cb_stateSaveFE(state, fe)) {
@@ -2530,7 +3180,8 @@ cb_stateCheckHeader(struct callback_state_header * hdr)
 
     if (hdr->stamp.magic != CALLBACK_STATE_MAGIC) {
 	ret = 1;
-    } else if (hdr->stamp.version != CALLBACK_STATE_VERSION) {
+    } else if (hdr->stamp.version > CALLBACK_STATE_VERSION
+	       || hdr->stamp.version < CALLBACK_STATE_VERSION_MIN) {
 	ret = 1;
     } else if ((hdr->nFEs > cbstuff.nblks) || (hdr->nCBs > cbstuff.nblks)) {
 	ViceLog(0, ("cb_stateCheckHeader: saved callback state larger than callback memory allocation\n"));
@@ -2674,7 +3325,7 @@ static int
 DumpCallBackState_r(void)
 {
     int fd, oflag;
-    afs_uint32 magic = MAGICV2, now = (afs_int32) time(NULL), freelisthead;
+    afs_uint32 magic = MAGICV3, now = (afs_int32) time(NULL), freelisthead;
 
     oflag = O_WRONLY | O_CREAT | O_TRUNC;
 #ifdef AFS_NT40_ENV
@@ -2701,7 +3352,8 @@ DumpCallBackState_r(void)
     DumpBytes(fd, &freelisthead, sizeof(freelisthead));	/* This is a pointer */
     freelisthead = fetoi((struct FileEntry *)FEfree);
     DumpBytes(fd, &freelisthead, sizeof(freelisthead));	/* This is a pointer */
-    DumpBytes(fd, HashTable, sizeof(HashTable));
+    DumpBytes(fd, &FEHashSize, sizeof(FEHashSize));
+    DumpBytes(fd, HashTable, FEHashSize * sizeof(afs_uint32));
     DumpBytes(fd, &CB[1], sizeof(CB[1]) * cbstuff.nblks);	/* CB stuff */
     DumpBytes(fd, &FE[1], sizeof(FE[1]) * cbstuff.nblks);	/* FE stuff */
     close(fd);
@@ -2760,7 +3412,7 @@ ReadDump(char *file, int timebits)
 	exit(1);
     }
     ReadBytes(fd, &magic, sizeof(magic));
-    if (magic == MAGICV2) {
+    if (magic == MAGICV2 || magic == MAGICV3) {
 	timebits = 32;
     } else {
 	if (magic != MAGIC) {
@@ -2790,13 +3442,29 @@ ReadDump(char *file, int timebits)
     CBfree = (struct CallBack *)itocb(freelisthead);
     ReadBytes(fd, &freelisthead, sizeof(freelisthead));
     FEfree = (struct FileEntry *)itofe(freelisthead);
-    ReadBytes(fd, HashTable, sizeof(HashTable));
+    if (magic == MAGICV3) {
+	ReadBytes(fd, &FEHashSize, sizeof(FEHashSize));
+	if (FEHashSize == 0 || FEHashSize > FEHASH_MAXSIZE
+	    || (FEHashSize & (FEHashSize - 1)) != 0) {
+	    fprintf(stderr, "FE hash table size %u in %s is invalid.\n",
+		    FEHashSize, file);
+	    exit(1);
+	}
+    } else
+	FEHashSize = FEHASH_SIZE;
+    HashTable = calloc(FEHashSize, sizeof(afs_uint32));
+    ReadBytes(fd, HashTable, FEHashSize * sizeof(afs_uint32));
     ReadBytes(fd, &CB[1], sizeof(CB[1]) * cbstuff.nblks);	/* CB stuff */
     ReadBytes(fd, &FE[1], sizeof(FE[1]) * cbstuff.nblks);	/* FE stuff */
     if (close(fd)) {
 	perror("Error reading dumpfile");
 	exit(1);
     }
+    /* Older dumps were hashed differently */
+    if (FEHashResize(FEHashSize)) {
+	fprintf(stderr, "Couldn't rehash the FE hash table\n");
+	exit(1);
+    }
     return now;
 }
 
@@ -2897,7 +3565,7 @@ main(int argc, char **argv)
 	struct CallBack *cb;
 	struct FileEntry *fe;
 
-	for (hash = 0; hash < FEHASH_SIZE; hash++) {
+	for (hash = 0; hash < FEHashSize; hash++) {
 	    for (feip = &HashTable[hash]; (fe = itofe(*feip));) {
 		if (!vol || (fe->volid == vol)) {
 		    afs_uint32 fe_i = fetoi(fe);
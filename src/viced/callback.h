@@ -46,6 +46,32 @@ struct cbstruct {
     afs_uint32 thead;
 };
 
+/* Counters for the queue of callback breaks waiting to be sent.  These are
+ * kept apart from cbcounters, which is written to callback dumps. */
+struct cbqcounters {
+    afs_int32 nQueued;		/* fids waiting to be broken */
+    afs_int32 nBatches;		/* batches queued or being sent */
+    afs_int32 BreakRPCs;	/* CallBack RPCs sent from the queue */
+    afs_int32 Coalesced;	/* breaks that joined a batch already queued */
+    afs_int32 QueueWaits;	/* times a breaker waited for room */
+    afs_int32 DirDeltas;	/* directory deltas queued, in place of breaks */
+    afs_int32 DownBatches;	/* batches delayed unsent, their hosts down */
+};
+extern struct cbqcounters cbqstuff;
+
+extern int BreakDirCallBack(struct host *xhost, AFSFid * dirFid,
+			    struct AFSDirDeltaStatus *dirStatus,
+			    struct AFSDirDelta *deltas, int ndeltas);
+
+/* Breaks from BreakCallBack are queued, a batch of up to AFSCBMAX fids to a
+ * host, and sent by CB_BREAK_THREADS threads, each sending up to
+ * CB_BREAK_FANOUT batches to different hosts at once.  No more than
+ * CB_BREAK_MAXBATCHES batches are queued or being sent at once. */
+#define CB_BREAK_THREADS 4
+#define CB_BREAK_FANOUT 64
+#define CB_BREAK_MAXBATCHES 1024
+#define CB_BREAK_HASHSIZE 256	/* must be a power of 2 */
+
 /* structure MUST be multiple of 8 bytes, otherwise the casts to
  * struct object will have alignment issues on *P64 userspaces */
 struct FileEntry {
@@ -82,10 +108,12 @@ struct VCBParams {
 };
 
 
-/* callback hash macros */
-#define FEHASH_SIZE 512		/* Power of 2 */
-#define FEHASH_MASK (FEHASH_SIZE-1)
-#define FEHash(volume, unique) (((volume)+(unique))&(FEHASH_MASK))
+/* FileEntry hash table sizes.  The table starts with FEHASH_SIZE buckets,
+ * and doubles whenever it holds more than FEHASH_LOAD entries a bucket, up
+ * to FEHASH_MAXSIZE buckets.  Sizes are always powers of 2. */
+#define FEHASH_SIZE 512		/* Initial size, and the size in old dumps */
+#define FEHASH_MAXSIZE (1 << 24)
+#define FEHASH_LOAD 2
 
 #define CB_NUM_TIMEOUT_QUEUES 128
 
@@ -0,0 +1,476 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * A cache of the CPSes the fileserver gets from the ptserver.
+ *
+ * Every new client structure needs its user's CPS, and every host needs
+ * its host CPS each hostaclRefresh period.  Rather than asking the
+ * ptserver each time, and having every thread that wants the same CPS
+ * queue up behind its own RPC, the answers are kept here for cpsCacheTTL
+ * seconds (hostaclRefresh for hosts).
+ *
+ * - Only one fetch for a given id is outstanding at a time; anyone else
+ *   who wants it waits for that fetch.
+ * - Definite failures (e.g. no such user) are cached for
+ *   CPS_NEGATIVE_TTL seconds.
+ * - If the ptserver can't be reached and an expired CPS is on hand, it is
+ *   used for another CPS_RETRY_TTL seconds rather than failing the call.
+ *   With nothing on hand, the failure itself is kept for CPS_FAILED_TTL
+ *   seconds, so that those waiting on the fetch (and those right behind
+ *   them) fail at once instead of each timing out against the ptserver.
+ * - The cps_RefreshLWP thread fetches entries that are in use again
+ *   shortly before they expire, several at a time with multi_Rx spread
+ *   over the ptservers, so that ptserver latency is mostly kept off the
+ *   request path.
+ *
+ * FlushCPS drops the cached CPSes it names.  A cpsCacheTTL of 0 turns the
+ * cache off.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+#include <afs/stds.h>
+
+#include <roken.h>
+#include <afs/opr.h>
+#include <opr/lock.h>
+#include <opr/jhash.h>
+
+#include <rx/rx.h>
+#include <rx/rx_multi.h>
+#include <afs/afsint.h>
+#include <afs/nfs.h>
+#include <afs/errors.h>
+#include <afs/ihandle.h>
+#include <afs/ptclient.h>
+#include <afs/ptuser.h>
+#include <afs/afsutil.h>
+#include <ubik.h>
+#include "viced_prototypes.h"
+#include "viced.h"
+#include "host.h"
+
+#define CPS_HASHSIZE		1024	/* Power of 2 */
+#define CPS_MAXENTRIES		16384	/* beyond this, don't cache */
+#define CPS_NEGATIVE_TTL	60	/* secs to remember a failure */
+#define CPS_RETRY_TTL		60	/* secs to keep using a stale CPS */
+#define CPS_FAILED_TTL		5	/* secs to remember an unreachable ptserver */
+#define CPS_BATCH		16	/* most fetches in one refresh pass */
+
+int cpsCacheTTL = 600;			/* secs a user CPS is good for */
+
+struct cpsEntry {
+    struct cpsEntry *next;	/* hash chain */
+    afs_int32 id;		/* user id, or host address in host order */
+    char isHost;		/* this is a host CPS */
+    char fetching;		/* a fetch is outstanding */
+    char flushed;		/* flushed while fetching */
+    char valid;			/* code and cps hold an answer */
+    short waiters;		/* threads waiting on fetching */
+    afs_int32 code;		/* nonzero for a cached failure */
+    prlist cps;
+    afs_uint32 expires;		/* time this answer goes stale */
+    afs_uint32 lastUsed;	/* time it was last asked for */
+};
+
+static struct cpsEntry *cpsHashTable[CPS_HASHSIZE];
+static int cpsEntries;
+static pthread_mutex_t cps_mutex;
+static pthread_cond_t cps_cond;		/* a fetch has finished */
+
+#define CPS_LOCK	opr_mutex_enter(&cps_mutex)
+#define CPS_UNLOCK	opr_mutex_exit(&cps_mutex)
+
+static_inline int
+cps_HashIndex(afs_int32 id, int isHost)
+{
+    return opr_jhash_int(id, isHost) & (CPS_HASHSIZE - 1);
+}
+
+static_inline int
+cps_TTL(struct cpsEntry *e)
+{
+    extern int hostaclRefresh;
+
+    return e->isHost ? hostaclRefresh : cpsCacheTTL;
+}
+
+/* Errors after which the ptserver may well answer if asked again */
+static_inline int
+cps_Transient(afs_int32 code)
+{
+    return code < 0 || code == UNOQUORUM || code == UNOTSYNC;
+}
+
+static struct cpsEntry *
+cps_Find_r(afs_int32 id, int isHost)
+{
+    struct cpsEntry *e;
+
+    for (e = cpsHashTable[cps_HashIndex(id, isHost)]; e; e = e->next)
+	if (e->id == id && e->isHost == isHost)
+	    return e;
+    return NULL;
+}
+
+static struct cpsEntry *
+cps_Create_r(afs_int32 id, int isHost)
+{
+    struct cpsEntry *e;
+    int index;
+
+    if (cpsEntries >= CPS_MAXENTRIES)
+	return NULL;
+    e = calloc(1, sizeof(*e));
+    if (!e)
+	return NULL;
+    e->id = id;
+    e->isHost = isHost;
+    index = cps_HashIndex(id, isHost);
+    e->next = cpsHashTable[index];
+    cpsHashTable[index] = e;
+    cpsEntries++;
+    return e;
+}
+
+static void
+cps_Delete_r(struct cpsEntry **ep)
+{
+    struct cpsEntry *e = *ep;
+
+    *ep = e->next;
+    free(e->cps.prlist_val);
+    free(e);
+    cpsEntries--;
+}
+
+/* Give the caller its own copy of the cached answer */
+static afs_int32
+cps_Copy_r(struct cpsEntry *e, prlist *CPS)
+{
+    CPS->prlist_len = 0;
+    CPS->prlist_val = NULL;
+    if (e->code || !e->cps.prlist_len)
+	return e->code;
+    CPS->prlist_val = malloc(e->cps.prlist_len * sizeof(afs_int32));
+    if (!CPS->prlist_val)
+	return ENOMEM;
+    memcpy(CPS->prlist_val, e->cps.prlist_val,
+	   e->cps.prlist_len * sizeof(afs_int32));
+    CPS->prlist_len = e->cps.prlist_len;
+    return 0;
+}
+
+/*
+ * Record the result of a fetch.  The entry's old CPS, if any, is kept
+ * when the ptserver couldn't be reached.  Takes ownership of list.
+ */
+static void
+cps_Store_r(struct cpsEntry *e, afs_int32 code, prlist *list,
+	    afs_uint32 now)
+{
+    if (cps_Transient(code)) {
+	free(list->prlist_val);
+	if (e->valid && !e->code) {
+	    ViceLog(0, ("CPS for %s %d could not be refreshed (%d); "
+			"using the old one\n", e->isHost ? "host" : "id",
+			e->id, code));
+	    e->expires = now + CPS_RETRY_TTL;
+	} else {
+	    free(e->cps.prlist_val);
+	    e->cps.prlist_len = 0;
+	    e->cps.prlist_val = NULL;
+	    e->code = code;
+	    e->valid = 1;
+	    e->expires = now + CPS_FAILED_TTL;
+	}
+    } else {
+	free(e->cps.prlist_val);
+	e->cps = *list;
+	e->code = code;
+	e->valid = 1;
+	if (code) {
+	    e->cps.prlist_len = 0;
+	    free(e->cps.prlist_val);
+	    e->cps.prlist_val = NULL;
+	    e->expires = now + CPS_NEGATIVE_TTL;
+	} else
+	    e->expires = now + cps_TTL(e);
+    }
+    list->prlist_len = 0;
+    list->prlist_val = NULL;
+
+    /* A flush raced with the fetch, so don't trust the answer for long */
+    if (e->flushed)
+	e->expires = 0;
+    e->flushed = 0;
+}
+
+static afs_int32
+cps_Fetch(afs_int32 id, int isHost, prlist *CPS)
+{
+    CPS->prlist_len = 0;
+    CPS->prlist_val = NULL;
+    if (isHost)
+	return hpr_GetHostCPS(id, CPS);
+    return hpr_GetCPS(id, CPS);
+}
+
+static afs_int32
+cps_Get(afs_int32 id, int isHost, prlist *CPS)
+{
+    struct cpsEntry *e;
+    afs_uint32 now;
+    afs_int32 code;
+    prlist list;
+
+    if (!cpsCacheTTL)
+	return cps_Fetch(id, isHost, CPS);
+
+    now = time(NULL);
+    CPS_LOCK;
+    e = cps_Find_r(id, isHost);
+    if (!e && !(e = cps_Create_r(id, isHost))) {
+	afs_perfstats.fs_nCPSMisses++;
+	CPS_UNLOCK;
+	return cps_Fetch(id, isHost, CPS);
+    }
+    e->lastUsed = now;
+    while (!(e->valid && now < e->expires) && e->fetching) {
+	e->waiters++;
+	opr_cv_wait(&cps_cond, &cps_mutex);
+	e->waiters--;
+	now = time(NULL);
+    }
+    if (e->valid && now < e->expires) {
+	afs_perfstats.fs_nCPSHits++;
+	code = cps_Copy_r(e, CPS);
+	CPS_UNLOCK;
+	return code;
+    }
+
+    afs_perfstats.fs_nCPSMisses++;
+    e->fetching = 1;
+    CPS_UNLOCK;
+
+    code = cps_Fetch(id, isHost, &list);
+
+    CPS_LOCK;
+    now = time(NULL);
+    cps_Store_r(e, code, &list, now);
+    e->fetching = 0;
+    opr_cv_broadcast(&cps_cond);
+    code = cps_Copy_r(e, CPS);
+    CPS_UNLOCK;
+    return code;
+}
+
+int
+cps_GetCPS(afs_int32 id, prlist *CPS)
+{
+    return cps_Get(id, 0, CPS);
+}
+
+/* addr is in host byte order */
+int
+cps_GetHostCPS(afs_uint32 addr, prlist *CPS)
+{
+    return cps_Get(addr, 1, CPS);
+}
+
+static void
+cps_Flush(afs_int32 id, int isHost)
+{
+    struct cpsEntry *e;
+
+    if (!cpsCacheTTL)
+	return;
+
+    CPS_LOCK;
+    e = cps_Find_r(id, isHost);
+    if (e) {
+	e->expires = 0;
+	if (e->fetching)
+	    e->flushed = 1;
+    }
+    CPS_UNLOCK;
+}
+
+void
+cps_FlushCPS(afs_int32 id)
+{
+    cps_Flush(id, 0);
+}
+
+/* addr is in host byte order */
+void
+cps_FlushHostCPS(afs_uint32 addr)
+{
+    cps_Flush(addr, 1);
+}
+
+/*
+ * Fetch the CPSes for a batch of entries, all at once.  The calls are
+ * dealt out over the ptservers that ubik doesn't think are down, never
+ * more than RX_MAXCALLS on one connection, since multi_Rx starts every
+ * call before reading any.  Returns the number of fetches that failed.
+ */
+static int
+cps_FetchBatch(struct ubik_client *uclient, struct cpsEntry **batch, int n)
+{
+    struct rx_connection *conns[CPS_BATCH];
+    struct rx_connection *up[MAXSERVERS];
+    prlist lists[CPS_BATCH];
+    afs_int32 over[CPS_BATCH];
+    afs_int32 codes[CPS_BATCH];
+    afs_uint32 now;
+    int nservers = 0, i, failed = 0;
+    struct rx_connection *tconn;
+
+    LOCK_UBIK_CLIENT(uclient);
+    for (i = 0; i < MAXSERVERS; i++) {
+	if (!(tconn = uclient->conns[i]))
+	    break;
+	if (!(uclient->states[i] & CFLastFailed))
+	    up[nservers++] = tconn;
+    }
+    UNLOCK_UBIK_CLIENT(uclient);
+    if (n > nservers * RX_MAXCALLS)
+	n = nservers * RX_MAXCALLS;
+
+    for (i = 0; i < n; i++) {
+	conns[i] = up[i % nservers];
+	lists[i].prlist_len = 0;
+	lists[i].prlist_val = NULL;
+	over[i] = 0;
+	codes[i] = RX_CALL_DEAD;
+    }
+
+    if (n > 0) {
+	multi_Rx(conns, n) {
+	    multi_Body(batch[multi_i]->isHost
+		       ? StartPR_GetHostCPS(multi_call, batch[multi_i]->id)
+		       : StartPR_GetCPS(multi_call, batch[multi_i]->id),
+		       batch[multi_i]->isHost
+		       ? EndPR_GetHostCPS(multi_call, &lists[multi_i],
+					  &over[multi_i])
+		       : EndPR_GetCPS(multi_call, &lists[multi_i],
+				      &over[multi_i]));
+	    codes[multi_i] = multi_error;
+	} multi_End;
+    }
+
+    CPS_LOCK;
+    now = time(NULL);
+    for (i = 0; i < n; i++) {
+	if (codes[i] == 0 && over[i])
+	    ViceLog(0, ("membership list for %s %d exceeds display limit\n",
+			batch[i]->isHost ? "host" : "id", batch[i]->id));
+	/* Leave it to the next pass, or a caller, to try again */
+	if (cps_Transient(codes[i])) {
+	    free(lists[i].prlist_val);
+	    batch[i]->flushed = 0;
+	    failed++;
+	} else {
+	    afs_perfstats.fs_nCPSRefreshes++;
+	    cps_Store_r(batch[i], codes[i], &lists[i], now);
+	}
+	batch[i]->fetching = 0;
+    }
+    /* Any left over because there weren't enough servers up */
+    for (; batch[i]; i++) {
+	batch[i]->fetching = 0;
+	failed++;
+    }
+    opr_cv_broadcast(&cps_cond);
+    CPS_UNLOCK;
+    return failed;
+}
+
+/*
+ * Pick out entries that are about to expire and have been used lately
+ * enough to be worth refreshing, and throw away those that are expired and
+ * idle.  Returns the number of entries put in batch.
+ */
+static int
+cps_Sweep_r(struct cpsEntry **batch, afs_uint32 now)
+{
+    struct cpsEntry **ep, *e;
+    int i, n = 0, ttl;
+
+    for (i = 0; i < CPS_HASHSIZE; i++) {
+	for (ep = &cpsHashTable[i]; (e = *ep) != NULL;) {
+	    ttl = cps_TTL(e);
+	    if (e->fetching || e->waiters) {
+		ep = &e->next;
+		continue;
+	    }
+	    if (e->lastUsed + ttl + ttl / 4 < now) {
+		if (e->expires <= now) {
+		    cps_Delete_r(ep);
+		    continue;
+		}
+	    } else if (n < CPS_BATCH && e->valid && !e->code
+		       && e->expires <= now + ttl / 4) {
+		e->fetching = 1;
+		batch[n++] = e;
+	    }
+	    ep = &e->next;
+	}
+    }
+    return n;
+}
+
+void *
+cps_RefreshLWP(void *unused)
+{
+    struct ubik_client *uclient = NULL;
+    struct cpsEntry *batch[CPS_BATCH + 1];
+    int n, failed, interval;
+
+    afs_pthread_setname_self("CPS refresh");
+    interval = cpsCacheTTL / 8;
+    if (interval < 1)
+	interval = 1;
+    for (;;) {
+	sleep(interval);
+	CPS_LOCK;
+	do {
+	    memset(batch, 0, sizeof(batch));
+	    n = cps_Sweep_r(batch, time(NULL));
+	    if (!n)
+		break;
+	    CPS_UNLOCK;
+	    if (!uclient && hpr_Initialize(&uclient) != 0)
+		uclient = NULL;
+	    if (uclient) {
+		failed = cps_FetchBatch(uclient, batch, n);
+	    } else {
+		/* No ptserver connections; try again next time */
+		CPS_LOCK;
+		for (n = 0; batch[n]; n++)
+		    batch[n]->fetching = 0;
+		opr_cv_broadcast(&cps_cond);
+		break;
+	    }
+	    CPS_LOCK;
+	    /* More may be due, unless the ptservers are in trouble */
+	} while (n == CPS_BATCH && !failed);
+	CPS_UNLOCK;
+    }
+    return NULL;
+}
+
+void
+cps_Init(void)
+{
+    opr_mutex_init(&cps_mutex);
+    opr_cv_init(&cps_cond);
+}
@@ -126,10 +126,24 @@ struct afs_PerfStats {
      * Can't count this as an RPC because it breaks the data structure
      */
     afs_int32 fs_nGetCaps;	/* Number of GetCapabilities calls */
+
+    /*
+     * Access rights cache
+     */
+    afs_int32 fs_nRightsHits;	/* Rights found in the cache */
+    afs_int32 fs_nRightsMisses;	/* Rights computed from the ACL */
+    afs_int32 fs_RightsMissMsec;	/* msecs spent computing them */
+
+    /*
+     * CPS cache
+     */
+    afs_int32 fs_nCPSHits;	/* CPSes found in the cache */
+    afs_int32 fs_nCPSMisses;	/* CPSes fetched on the request path */
+    afs_int32 fs_nCPSRefreshes;	/* CPSes refreshed in the background */
     /*
      * Spares
      */
-    afs_int32 spare[28];
+    afs_int32 spare[22];
 };
 
 /*
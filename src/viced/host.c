@@ -578,10 +578,11 @@ h_gethostcps_r(struct host *host, afs_int32 now)
 	free(host->z.hcps.prlist_val);	/* this is for hostaclRefresh */
     host->z.hcps.prlist_val = NULL;
     host->z.hcps.prlist_len = 0;
+    host->z.cpsGen++;
     host->z.cpsCall = slept ? time(NULL) : (now);
 
     H_UNLOCK;
-    code = hpr_GetHostCPS(ntohl(host->z.host), &host->z.hcps);
+    code = cps_GetHostCPS(ntohl(host->z.host), &host->z.hcps);
     H_LOCK;
     if (code) {
         char hoststr[16];
@@ -621,6 +622,7 @@ h_gethostcps_r(struct host *host, afs_int32 now)
     } else
 	host->z.hcpsfailed = 0;
 
+    host->z.cpsGen++;
     host->z.hostFlags &= ~HCPS_INPROGRESS;
     /* signal all who are waiting */
     if (host->z.hostFlags & HCPS_WAITING) {	/* somebody is waiting */
@@ -635,10 +637,13 @@ h_flushhostcps(afs_uint32 hostaddr, afs_uint16 hport)
 {
     struct host *host;
 
+    cps_FlushHostCPS(ntohl(hostaddr));
+
     H_LOCK;
     h_Lookup_r(hostaddr, hport, &host);
     if (host) {
 	host->z.hcpsfailed = 1;
+	host->z.cpsGen++;
 	h_Release_r(host);
     }
     H_UNLOCK;
@@ -2117,6 +2122,11 @@ h_GetHost_r(struct rx_connection *tcon)
 	    host->z.hostFlags |= HERRORTRANS;
 	else
 	    host->z.hostFlags &= ~(HERRORTRANS);
+	if (caps.Capabilities_val
+	    && (caps.Capabilities_val[0] & CLIENT_CAPABILITY_DIRDELTA))
+	    host->z.hostFlags |= HDIRDELTA;
+	else
+	    host->z.hostFlags &= ~(HDIRDELTA);
 	host->z.hostFlags |= ALTADDR;
 	host->z.hostFlags &= ~HWHO_INPROGRESS;
 	h_Unlock_r(host);
@@ -2394,6 +2404,11 @@ h_GetHost_r(struct rx_connection *tcon)
 	    host->z.hostFlags |= HERRORTRANS;
 	else
 	    host->z.hostFlags &= ~(HERRORTRANS);
+	if (caps.Capabilities_val
+	    && (caps.Capabilities_val[0] & CLIENT_CAPABILITY_DIRDELTA))
+	    host->z.hostFlags |= HDIRDELTA;
+	else
+	    host->z.hostFlags &= ~(HDIRDELTA);
 	host->z.hostFlags |= ALTADDR;	/* host structure initialization complete */
 	host->z.hostFlags &= ~HWHO_INPROGRESS;
 	h_Unlock_r(host);
@@ -2719,6 +2734,7 @@ h_FindClient_r(struct rx_connection *tcon, afs_int32 *a_viceid)
     client->z.prfail = fail;
 
     if (!(client->z.CPS.prlist_val) || (viceid != client->z.ViceId)) {
+	client->z.cpsGen++;
 	client->z.CPS.prlist_len = 0;
 	if (client->z.CPS.prlist_val && (client->z.ViceId != ANONYMOUSID))
 	    free(client->z.CPS.prlist_val);
@@ -2731,7 +2747,7 @@ h_FindClient_r(struct rx_connection *tcon, afs_int32 *a_viceid)
 	    client->z.CPS.prlist_val = AnonCPS.prlist_val;
 	} else {
 	    H_UNLOCK;
-	    code = hpr_GetCPS(viceid, &client->z.CPS);
+	    code = cps_GetCPS(viceid, &client->z.CPS);
 	    H_LOCK;
 	    if (code) {
 		char hoststr[16];
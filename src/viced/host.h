@@ -66,6 +66,7 @@ struct host_to_zero {
 				 * the File Server's? */
     char hcpsfailed;	 	/* Retry the cps call next time */
     prlist hcps;		/* cps for hostip acls */
+    afs_uint32 cpsGen;		/* bumped whenever hcps changes */
     afs_uint32 LastCall;	/* time of last call from host */
     afs_uint32 ActiveCall;	/* time of any call but gettime,
 				 * getstats and getcaps */
@@ -104,6 +105,25 @@ struct h_UuidHashChain {
     struct h_UuidHashChain *next;
 };
 
+/*
+ * Rights GetRights computed for a client on one ACL.  An entry is only
+ * good while the volume stays attached, nobody has stored an ACL, and
+ * neither the client's nor the host's CPS has changed since.
+ */
+#define CLIENT_RIGHTS_ENTRIES 8	/* Power of 2 */
+
+struct client_rights {
+    afs_uint32 volid;		/* volume of the ACL vnode */
+    afs_uint32 cacheCheck;	/* volume attach sequence number */
+    afs_uint32 vnode;		/* vnode holding the ACL */
+    afs_uint32 unique;
+    afs_uint32 aclGen;		/* ACL generation when computed */
+    afs_uint32 hcpsGen;		/* host's cpsGen when computed */
+    afs_uint32 cpsGen;		/* client's cpsGen when computed */
+    afs_int32 rights;
+    afs_int32 anyrights;
+};
+
 struct client_to_zero {
     struct client *next;	/* next client entry for host */
     struct host *host;		/* ptr to parent host entry */
@@ -124,6 +144,10 @@ struct client_to_zero {
     char prfail;		/* True if prserver couldn't be contacted */
     char InSameNetwork;		/* Is client's IP address in the same
 				 * network as ours? */
+    afs_uint32 cpsGen;		/* bumped whenever CPS changes */
+    struct client_rights rights[CLIENT_RIGHTS_ENTRIES];
+				/* cache of rights on recent ACLs,
+				 * protected by H_LOCK */
 };
 
 struct client {
@@ -241,6 +265,17 @@ extern afs_int32 hpr_Initialize(struct ubik_client **);
 extern int hpr_End(struct ubik_client *);
 extern int hpr_IdToName(idlist *ids, namelist *names);
 extern int hpr_NameToId(namelist *names, idlist *ids);
+extern int hpr_GetCPS(afs_int32 id, prlist *CPS);
+extern int hpr_GetHostCPS(afs_int32 host, prlist *CPS);
+
+/* cpscache.c */
+extern int cpsCacheTTL;
+extern void cps_Init(void);
+extern void *cps_RefreshLWP(void *);
+extern int cps_GetCPS(afs_int32 id, prlist *CPS);
+extern int cps_GetHostCPS(afs_uint32 addr, prlist *CPS);
+extern void cps_FlushCPS(afs_int32 id);
+extern void cps_FlushHostCPS(afs_uint32 addr);
 
 #ifdef AFS_DEMAND_ATTACH_FS
 /*
@@ -279,4 +314,5 @@ struct host *(hosttableptrs[h_MAXHOSTTABLES]);	/* Used by h_itoh */
 #define HERRORTRANS                    0x100	/* do error translation */
 #define HWHO_INPROGRESS                0x200    /* set when WhoAreYou running */
 #define HCBREAK                        0x400    /* flag for a multi CB break */
+#define HDIRDELTA                      0x800    /* takes directory deltas */
 #endif /* _AFS_VICED_HOST_H */
@@ -862,7 +862,8 @@ dump_cb_hdr(void)
     if (hdrs.cb_hdr.stamp.magic != CALLBACK_STATE_MAGIC) {
 	fprintf(stderr, "* magic check failed\n");
     }
-    if (hdrs.cb_hdr.stamp.version != CALLBACK_STATE_VERSION) {
+    if (hdrs.cb_hdr.stamp.version > CALLBACK_STATE_VERSION
+	|| hdrs.cb_hdr.stamp.version < CALLBACK_STATE_VERSION_MIN) {
 	fprintf(stderr, "* version check failed\n");
     }
 }
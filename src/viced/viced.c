@@ -75,6 +75,7 @@
 #include "viced_prototypes.h"
 #include "viced.h"
 #include "host.h"
+#include "callback.h"
 #if defined(AFS_SGI_ENV)
 # include "sys/schedctl.h"
 # include "sys/lock.h"
@@ -160,6 +161,8 @@ int novbc = 0;			/* Enable Volume Break calls */
 int busy_threshold = 600;
 int abort_threshold = 10;
 int udpBufSize = 0;		/* UDP buffer size for receive */
+int rxListeners = 1;		/* rx listener threads (sockets) */
+char *rxCongestion = NULL;	/* rx congestion control algorithm */
 int sendBufSize = 16384;	/* send buffer size */
 int saneacls = 0;		/* Sane ACLs Flag */
 static int unsafe_attach = 0;   /* avoid inUse check on vol attach? */
@@ -280,6 +283,40 @@ CheckSignal_Signal(int x)
     PrintCounters();
 }
 
+/* Signal number for starting and stopping Rx call tracing */
+#ifndef AFS_NT40_ENV
+# define AFS_SIG_RXTRACE  SIGUSR2
+
+/*
+ * The first signal starts tracing Rx calls; the next stops it, and dumps
+ * what was recorded to RxTrace in the log directory, for rxtracedecode.
+ */
+void
+RxTrace_Signal(int x)
+{
+    char *path;
+    int code;
+
+    if (!rx_TraceEnabled()) {
+	rx_TraceEnable(1);
+	ViceLog(0, ("Rx call tracing started\n"));
+	return;
+    }
+    rx_TraceEnable(0);
+    if (asprintf(&path, "%s/RxTrace", AFSDIR_SERVER_LOGS_DIRPATH) < 0) {
+	ViceLog(0, ("Rx call tracing stopped; no memory to dump it\n"));
+	return;
+    }
+    code = rx_TraceDump(path);
+    if (code)
+	ViceLog(0, ("Rx call tracing stopped; can't dump it to %s (%d)\n",
+		    path, code));
+    else
+	ViceLog(0, ("Rx call tracing stopped; dumped to %s\n", path));
+    free(path);
+}
+#endif
+
 void
 ShutDown_Signal(int x)
 {
@@ -609,6 +646,25 @@ ClearXStatValues(void)
 int CopyOnWrite_calls = 0, CopyOnWrite_off0 = 0, CopyOnWrite_size0 = 0;
 afs_fsize_t CopyOnWrite_maxsize = 0;
 
+/* Log percentiles of the time taken to serve each kind of RXAFS call */
+static void
+PrintRPCLatencies(void)
+{
+    afs_uint32 ppm[3] = { 500000, 990000, 999000 };
+    afs_uint32 usecs[3];
+    afs_uint64 calls;
+    int i;
+
+    for (i = 0; i < RXAFS_NO_OF_STAT_FUNCS; i++) {
+	calls = rx_GetProcessRPCLatency(RXAFS_STATINDEX, i, 3, ppm, usecs);
+	if (calls == 0)
+	    continue;
+	ViceLog(0, ("%s: %llu calls, p50 %u usec, p99 %u usec, "
+		    "p99.9 %u usec\n", RXAFS_function_names[i], calls,
+		    usecs[0], usecs[1], usecs[2]));
+    }
+}
+
 static void
 PrintCounters(void)
 {
@@ -643,6 +699,7 @@ PrintCounters(void)
 	    ("With %d directory buffers; %d reads resulted in %d read I/Os\n",
 	     dirbuff, dircall, dirio));
     rx_PrintStats(stderr);
+    PrintRPCLatencies();
     audit_PrintStats(stderr);
     h_PrintStats();
     PrintCallBackStats();
@@ -746,6 +803,9 @@ ShutDownAndCore(int dopanic)
 	    }
 	    FS_STATE_UNLOCK;
 
+	    /* queued callback breaks are saved as delayed callbacks */
+	    ShutdownCallBackBreakers();
+
 	    /* ok. it should now be fairly safe. let's do the state dump */
 	    fs_stateSave();
 	}
@@ -885,6 +945,7 @@ enum optionsList {
     OPT_spare,
     OPT_pctspare,
     OPT_hostcpsrefresh,
+    OPT_cpsttl,
     OPT_vattachthreads,
     OPT_abortthreshold,
     OPT_busyat,
@@ -925,6 +986,8 @@ enum optionsList {
     OPT_rxpck,
     OPT_rxmaxmtu,
     OPT_udpsize,
+    OPT_rxlisteners,
+    OPT_rxcongestion,
     OPT_dotted,
     OPT_realm,
     OPT_sync,
@@ -995,6 +1058,8 @@ ParseArgs(int argc, char *argv[])
 
     cmd_AddParmAtOffset(opts, OPT_hostcpsrefresh, "-hr", CMD_SINGLE,
 			CMD_OPTIONAL, "hours between host CPS refreshes");
+    cmd_AddParmAtOffset(opts, OPT_cpsttl, "-cpsttl", CMD_SINGLE,
+			CMD_OPTIONAL, "seconds to cache user CPSes");
 
     cmd_AddParmAtOffset(opts, OPT_vattachthreads, "-vattachpar", CMD_SINGLE,
 			CMD_OPTIONAL, "# of volume attachment threads");
@@ -1096,6 +1161,10 @@ ParseArgs(int argc, char *argv[])
 			CMD_OPTIONAL, "maximum MTU for RX");
     cmd_AddParmAtOffset(opts, OPT_udpsize, "-udpsize", CMD_SINGLE,
 			CMD_OPTIONAL, "size of socket buffer in bytes");
+    cmd_AddParmAtOffset(opts, OPT_rxlisteners, "-rxlisteners", CMD_SINGLE,
+			CMD_OPTIONAL, "number of rx listener threads");
+    cmd_AddParmAtOffset(opts, OPT_rxcongestion, "-rxcongestion", CMD_SINGLE,
+			CMD_OPTIONAL, "rx congestion control (newreno | cubic)");
 
     /* rxkad options */
     cmd_AddParmAtOffset(opts, OPT_dotted, "-allow-dotted-principals",
@@ -1214,6 +1283,15 @@ ParseArgs(int argc, char *argv[])
 	hostaclRefresh = optval * 60 * 60;
     }
 
+    if (cmd_OptionAsInt(opts, OPT_cpsttl, &optval) == 0) {
+	if ((optval < 0) || (optval > 86400)) {
+	    printf("CPS cache time of %d seconds is invalid; "
+		   "seconds must be between 0 and 86400\n\n", optval);
+	    return -1;
+	}
+	cpsCacheTTL = optval;
+    }
+
     cmd_OptionAsInt(opts, OPT_vattachthreads, &vol_attach_threads);
 
     cmd_OptionAsInt(opts, OPT_abortthreshold, &abort_threshold);
@@ -1382,6 +1460,8 @@ ParseArgs(int argc, char *argv[])
 	} else
 	    udpBufSize = optval;
     }
+    cmd_OptionAsInt(opts, OPT_rxlisteners, &rxListeners);
+    cmd_OptionAsString(opts, OPT_rxcongestion, &rxCongestion);
 
     /* rxkad options */
     cmd_OptionAsFlag(opts, OPT_dotted, &rxkadDisableDotCheck);
@@ -1822,6 +1902,7 @@ main(int argc, char *argv[])
     struct tm tm;
     afs_uint32 rx_bindhost;
     VolumePackageOptions opts;
+    int i;
 
 #ifdef	AFS_AIX32_ENV
     struct sigaction nsa;
@@ -1888,6 +1969,7 @@ main(int argc, char *argv[])
     opr_softsig_Register(AFS_SIG_CHECK, CheckSignal_Signal);
 #ifndef AFS_NT40_ENV
     opr_softsig_Register(SIGTERM, CheckDescriptors_Signal);
+    opr_softsig_Register(AFS_SIG_RXTRACE, RxTrace_Signal);
 #endif
 
 #if defined(AFS_SGI_ENV)
@@ -1985,6 +2067,19 @@ main(int argc, char *argv[])
 #endif
     if (udpBufSize)
 	rx_SetUdpBufSize(udpBufSize);	/* set the UDP buffer size for receive */
+    if (rxListeners != 1) {
+	if (rx_SetNumListeners(rxListeners) != 0) {
+	    ViceLog(0, ("rxlisteners %d is invalid\n", rxListeners));
+	    exit(1);
+	}
+    }
+    if (rxCongestion != NULL) {
+	if (rx_SetCongestionControl(rxCongestion) != 0) {
+	    ViceLog(0, ("Unknown rx congestion control algorithm %s\n",
+			rxCongestion));
+	    exit(1);
+	}
+    }
     rx_bindhost = SetupVL();
 
     if (rx_InitHost(rx_bindhost, (int)htons(7000)) < 0) {
@@ -2023,6 +2118,8 @@ main(int argc, char *argv[])
     rx_SetMinProcs(tservice, 3);
     rx_SetMaxProcs(tservice, lwps);
     rx_SetCheckReach(tservice, 1);
+    /* Don't let stores hold up the small calls behind them */
+    rx_SetServiceBulkPriority(tservice, RX_PRIORITY_LOW);
 
     tservice =
 	rx_NewService(0, RX_STATS_SERVICE_ID, "rpcstats", securityClasses,
@@ -2045,6 +2142,7 @@ main(int argc, char *argv[])
 
     init_sys_error_to_et();	/* Set up error table translation */
     h_InitHostPackage(host_thread_quota); /* set up local cellname and realmname */
+    cps_Init();
     InitCallBack(numberofcbs);
     ClearXStatValues();
 
@@ -2167,6 +2265,12 @@ main(int argc, char *argv[])
 			      &fiveminutes) == 0);
     opr_Verify(pthread_create(&serverPid, &tattr, FsyncCheckLWP,
 			      &fiveminutes) == 0);
+    for (i = 0; i < CB_BREAK_THREADS; i++)
+	opr_Verify(pthread_create(&serverPid, &tattr, CallBackBreakerLWP,
+				  NULL) == 0);
+    if (cpsCacheTTL)
+	opr_Verify(pthread_create(&serverPid, &tattr, cps_RefreshLWP,
+				  NULL) == 0);
 
     gettimeofday(&tp, 0);
 
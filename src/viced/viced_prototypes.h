@@ -22,6 +22,8 @@ extern afs_int32 PctSpare;
 extern int InitCallBack(int);
 extern int BreakLaterCallBacks(void);
 extern int BreakVolumeCallBacksLater(VolumeId);
+extern void *CallBackBreakerLWP(void *);
+extern void ShutdownCallBackBreakers(void);
 
 #ifdef AFS_DEMAND_ATTACH_FS
 /*
@@ -43,10 +43,25 @@ int maxnservers;
 #define VLDBALLOCLIMIT	10000
 #define VLDBALLOCINCR	2048
 
-static int put_attributeentry(struct vl_ctx *ctx,
-			      struct vldbentry **, struct vldbentry **,
-			      struct vldbentry **, bulkentries *,
-			      struct nvlentry *, afs_int32 *, afs_int32 *);
+static int match_attributes(struct vl_ctx *ctx,
+			    struct VldbListByAttributes *attributes,
+			    struct nvlentry *tentry, int maxservers);
+/* Entries matching a listing's attributes, in the form they are sent in */
+struct vl_attrsnap {
+    char *entries;		/* vldbentry or nvldbentry array */
+    size_t entrysize;
+    int newformat;
+    afs_int32 nentries;
+    afs_int32 alloccnt;
+};
+
+static int put_snapentry(struct vl_ctx *ctx, struct nvlentry *tentry,
+			 struct vl_attrsnap *snap);
+static int snap_attributeentries(struct vl_ctx *ctx,
+				 struct VldbListByAttributes *attributes,
+				 int newformat, struct vl_attrsnap *snap);
+static int stream_attributeentries(struct vl_attrsnap *snap,
+				   struct xdr_arraystream *vldbentries);
 static int put_nattributeentry(struct vl_ctx *ctx,
 			       struct nvldbentry **, struct nvldbentry **,
 			       struct nvldbentry **, nbulkentries *,
@@ -1350,19 +1365,23 @@ SVL_ListEntryN(struct rx_call *rxcall, afs_int32 previous_index,
  * id is specified then the associated list for that entry is returned.
  * CAUTION: This could be a very expensive call since in most cases
  * sequential search of all vldb entries is performed.
+ *
+ * The matching entries are copied out under the read transaction, which
+ * is ended before they are sent to the caller. Since their number is sent
+ * ahead of them, they can't be gathered in chunks under separate
+ * transactions without the listing going wrong if the database changes
+ * in between; so this takes as much memory as an unstreamed reply would.
  */
 static afs_int32
 ListAttributes(struct rx_call *rxcall,
 	       struct VldbListByAttributes *attributes,
 	       afs_int32 *nentries,
-	       bulkentries *vldbentries)
+	       struct xdr_arraystream *vldbentries)
 {
     int this_op = VLLISTATTRIBUTES;
-    int code, allocCount = 0;
+    int code;
     struct vl_ctx ctx;
-    struct nvlentry tentry;
-    struct vldbentry *Vldbentry = 0, *VldbentryFirst = 0, *VldbentryLast = 0;
-    int pollcount = 0;
+    struct vl_attrsnap snap;
     char rxstr[AFS_RXINFO_LEN];
 
     countRequest(this_op);
@@ -1371,117 +1390,26 @@ ListAttributes(struct rx_call *rxcall,
 				      restrictedQueryLevel))
 	return VL_PERM;
 
-    vldbentries->bulkentries_val = 0;
-    vldbentries->bulkentries_len = *nentries = 0;
+    *nentries = 0;
     if ((code = Init_VLdbase(&ctx, LOCKREAD, this_op)))
 	return code;
-    allocCount = VLDBALLOCCOUNT;
-    Vldbentry = VldbentryFirst = vldbentries->bulkentries_val =
-	malloc(allocCount * sizeof(vldbentry));
-    if (Vldbentry == NULL) {
-	code = VL_NOMEM;
+    code = snap_attributeentries(&ctx, attributes, 0, &snap);
+    if (code)
 	goto abort;
+    code = ubik_EndTrans(ctx.trans);
+    if (code) {
+	free(snap.entries);
+	return code;
     }
-    VldbentryLast = VldbentryFirst + allocCount;
-    /* Handle the attribute by volume id totally separate of the rest
-     * (thus additional Mask values are ignored if VLLIST_VOLUMEID is set!) */
-    if (attributes->Mask & VLLIST_VOLUMEID) {
-	afs_int32 blockindex;
-
-	blockindex =
-	    FindByID(&ctx, attributes->volumeid, -1, &tentry, &code);
-	if (blockindex == 0) {
-	    if (!code)
-		code = VL_NOENT;
-	    goto abort;
-	}
-
-	code = put_attributeentry(&ctx, &Vldbentry, &VldbentryFirst,
-				  &VldbentryLast, vldbentries, &tentry,
-				  nentries, &allocCount);
-	if (code)
-	    goto abort;
-    } else {
-	afs_int32 nextblockindex = 0, count = 0, k = 0, match = 0;
-	while ((nextblockindex =
-	       NextEntry(&ctx, nextblockindex, &tentry, &count))) {
-	    if (++pollcount > 50) {
-#ifndef AFS_PTHREAD_ENV
-		IOMGR_Poll();
-#endif
-		pollcount = 0;
-	    }
-	    match = 0;
-	    if (attributes->Mask & VLLIST_SERVER) {
-		int serverindex;
-		if ((serverindex =
-		     IpAddrToRelAddr(&ctx, attributes->server, 0)) == -1)
-		    continue;
-		for (k = 0; k < OMAXNSERVERS; k++) {
-		    if (tentry.serverNumber[k] == BADSERVERID)
-			break;
-		    if (tentry.serverNumber[k] == serverindex) {
-			match = 1;
-			break;
-		    }
-		}
-		if (!match)
-		    continue;
-	    }
-	    if (attributes->Mask & VLLIST_PARTITION) {
-		if (match) {
-		    if (tentry.serverPartition[k] != attributes->partition)
-			continue;
-		} else {
-		    for (k = 0; k < OMAXNSERVERS; k++) {
-			if (tentry.serverNumber[k] == BADSERVERID)
-			    break;
-			if (tentry.serverPartition[k] ==
-			    attributes->partition) {
-			    match = 1;
-			    break;
-			}
-		    }
-		    if (!match)
-			continue;
-		}
-	    }
-
-	    if (attributes->Mask & VLLIST_FLAG) {
-		if (!(tentry.flags & attributes->flag))
-		    continue;
-	    }
-	    code = put_attributeentry(&ctx, &Vldbentry, &VldbentryFirst,
-				      &VldbentryLast, vldbentries, &tentry,
-				      nentries, &allocCount);
-	    if (code)
-		goto abort;
-	}
-    }
-    if (vldbentries->bulkentries_len
-	&& (allocCount > vldbentries->bulkentries_len)) {
-
-	vldbentries->bulkentries_val =
-	    realloc(vldbentries->bulkentries_val,
-		    vldbentries->bulkentries_len * sizeof(vldbentry));
-	if (vldbentries->bulkentries_val == NULL) {
-	    code = VL_NOMEM;
-	    goto abort;
-	}
-    }
+    *nentries = snap.nentries;
     VLog(5,
-	 ("ListAttrs nentries=%d %s\n", vldbentries->bulkentries_len,
-	  rxinfo(rxstr, rxcall)));
-    return ubik_EndTrans(ctx.trans);
+	 ("ListAttrs nentries=%d %s\n", *nentries, rxinfo(rxstr, rxcall)));
+    return stream_attributeentries(&snap, vldbentries);
 
 abort:
-    if (vldbentries->bulkentries_val)
-	free(vldbentries->bulkentries_val);
-    vldbentries->bulkentries_val = 0;
-    vldbentries->bulkentries_len = 0;
-
     countAbort(this_op);
     ubik_AbortTrans(ctx.trans);
+    free(snap.entries);
     return code;
 }
 
@@ -1489,7 +1417,7 @@ afs_int32
 SVL_ListAttributes(struct rx_call *rxcall,
 		   struct VldbListByAttributes *attributes,
 		   afs_int32 *nentries,
-		   bulkentries *vldbentries)
+		   struct xdr_arraystream *vldbentries)
 {
     afs_int32 code;
 
@@ -1502,14 +1430,12 @@ static afs_int32
 ListAttributesN(struct rx_call *rxcall,
 		struct VldbListByAttributes *attributes,
 		afs_int32 *nentries,
-		nbulkentries *vldbentries)
+		struct xdr_arraystream *vldbentries)
 {
     int this_op = VLLISTATTRIBUTESN;
-    int code, allocCount = 0;
+    int code;
     struct vl_ctx ctx;
-    struct nvlentry tentry;
-    struct nvldbentry *Vldbentry = 0, *VldbentryFirst = 0, *VldbentryLast = 0;
-    int pollcount = 0;
+    struct vl_attrsnap snap;
     char rxstr[AFS_RXINFO_LEN];
 
     countRequest(this_op);
@@ -1518,117 +1444,26 @@ ListAttributesN(struct rx_call *rxcall,
 				      restrictedQueryLevel))
 	return VL_PERM;
 
-    vldbentries->nbulkentries_val = 0;
-    vldbentries->nbulkentries_len = *nentries = 0;
+    *nentries = 0;
     if ((code = Init_VLdbase(&ctx, LOCKREAD, this_op)))
 	return code;
-    allocCount = VLDBALLOCCOUNT;
-    Vldbentry = VldbentryFirst = vldbentries->nbulkentries_val =
-	malloc(allocCount * sizeof(nvldbentry));
-    if (Vldbentry == NULL) {
-	code = VL_NOMEM;
+    code = snap_attributeentries(&ctx, attributes, 1, &snap);
+    if (code)
 	goto abort;
+    code = ubik_EndTrans(ctx.trans);
+    if (code) {
+	free(snap.entries);
+	return code;
     }
-    VldbentryLast = VldbentryFirst + allocCount;
-    /* Handle the attribute by volume id totally separate of the rest
-     * (thus additional Mask values are ignored if VLLIST_VOLUMEID is set!) */
-    if (attributes->Mask & VLLIST_VOLUMEID) {
-	afs_int32 blockindex;
-
-	blockindex =
-	    FindByID(&ctx, attributes->volumeid, -1, &tentry, &code);
-	if (blockindex == 0) {
-	    if (!code)
-		code = VL_NOENT;
-	    goto abort;
-	}
-
-	code = put_nattributeentry(&ctx, &Vldbentry, &VldbentryFirst,
-				   &VldbentryLast, vldbentries, &tentry,
-				   0, 0, nentries, &allocCount);
-	if (code)
-	    goto abort;
-    } else {
-	afs_int32 nextblockindex = 0, count = 0, k = 0, match = 0;
-	while ((nextblockindex =
-	       NextEntry(&ctx, nextblockindex, &tentry, &count))) {
-	    if (++pollcount > 50) {
-#ifndef AFS_PTHREAD_ENV
-		IOMGR_Poll();
-#endif
-		pollcount = 0;
-	    }
-
-	    match = 0;
-	    if (attributes->Mask & VLLIST_SERVER) {
-		int serverindex;
-		if ((serverindex =
-		     IpAddrToRelAddr(&ctx, attributes->server, 0)) == -1)
-		    continue;
-		for (k = 0; k < NMAXNSERVERS; k++) {
-		    if (tentry.serverNumber[k] == BADSERVERID)
-			break;
-		    if (tentry.serverNumber[k] == serverindex) {
-			match = 1;
-			break;
-		    }
-		}
-		if (!match)
-		    continue;
-	    }
-	    if (attributes->Mask & VLLIST_PARTITION) {
-		if (match) {
-		    if (tentry.serverPartition[k] != attributes->partition)
-			continue;
-		} else {
-		    for (k = 0; k < NMAXNSERVERS; k++) {
-			if (tentry.serverNumber[k] == BADSERVERID)
-			    break;
-			if (tentry.serverPartition[k] ==
-			    attributes->partition) {
-			    match = 1;
-			    break;
-			}
-		    }
-		    if (!match)
-			continue;
-		}
-	    }
-
-	    if (attributes->Mask & VLLIST_FLAG) {
-		if (!(tentry.flags & attributes->flag))
-		    continue;
-	    }
-	    code = put_nattributeentry(&ctx, &Vldbentry, &VldbentryFirst,
-				       &VldbentryLast, vldbentries,
-				       &tentry, 0, 0, nentries, &allocCount);
-	    if (code)
-		goto abort;
-	}
-    }
-    if (vldbentries->nbulkentries_len
-	&& (allocCount > vldbentries->nbulkentries_len)) {
-
-	vldbentries->nbulkentries_val =
-	    realloc(vldbentries->nbulkentries_val,
-		    vldbentries->nbulkentries_len * sizeof(nvldbentry));
-	if (vldbentries->nbulkentries_val == NULL) {
-	    code = VL_NOMEM;
-	    goto abort;
-	}
-    }
+    *nentries = snap.nentries;
     VLog(5,
-	 ("NListAttrs nentries=%d %s\n", vldbentries->nbulkentries_len,
-	  rxinfo(rxstr, rxcall)));
-    return ubik_EndTrans(ctx.trans);
+	 ("NListAttrs nentries=%d %s\n", *nentries, rxinfo(rxstr, rxcall)));
+    return stream_attributeentries(&snap, vldbentries);
 
 abort:
     countAbort(this_op);
     ubik_AbortTrans(ctx.trans);
-    if (vldbentries->nbulkentries_val)
-	free(vldbentries->nbulkentries_val);
-    vldbentries->nbulkentries_val = 0;
-    vldbentries->nbulkentries_len = 0;
+    free(snap.entries);
     return code;
 }
 
@@ -1636,7 +1471,7 @@ afs_int32
 SVL_ListAttributesN(struct rx_call *rxcall,
 		    struct VldbListByAttributes *attributes,
 		    afs_int32 *nentries,
-		    nbulkentries *vldbentries)
+		    struct xdr_arraystream *vldbentries)
 {
     afs_int32 code;
 
@@ -2870,51 +2705,170 @@ abort:
 /* ============> End of Exported vldb RPC functions <============= */
 
 
-/* Routine that copies the given vldb entry to the output buffer, vldbentries. */
+/* Does the entry match the attributes given to ListAttributes? */
 static int
-put_attributeentry(struct vl_ctx *ctx,
-		   struct vldbentry **Vldbentry,
-		   struct vldbentry **VldbentryFirst,
-		   struct vldbentry **VldbentryLast,
-		   bulkentries *vldbentries,
-		   struct nvlentry *entry,
-		   afs_int32 *nentries,
-		   afs_int32 *alloccnt)
+match_attributes(struct vl_ctx *ctx, struct VldbListByAttributes *attributes,
+		 struct nvlentry *tentry, int maxservers)
 {
-    vldbentry *reall;
+    int k = 0, match = 0;
+
+    if (attributes->Mask & VLLIST_SERVER) {
+	int serverindex;
+	if ((serverindex =
+	     IpAddrToRelAddr(ctx, attributes->server, 0)) == -1)
+	    return 0;
+	for (k = 0; k < maxservers; k++) {
+	    if (tentry->serverNumber[k] == BADSERVERID)
+		break;
+	    if (tentry->serverNumber[k] == serverindex) {
+		match = 1;
+		break;
+	    }
+	}
+	if (!match)
+	    return 0;
+    }
+    if (attributes->Mask & VLLIST_PARTITION) {
+	if (match) {
+	    if (tentry->serverPartition[k] != attributes->partition)
+		return 0;
+	} else {
+	    for (k = 0; k < maxservers; k++) {
+		if (tentry->serverNumber[k] == BADSERVERID)
+		    break;
+		if (tentry->serverPartition[k] == attributes->partition) {
+		    match = 1;
+		    break;
+		}
+	    }
+	    if (!match)
+		return 0;
+	}
+    }
+
+    if (attributes->Mask & VLLIST_FLAG) {
+	if (!(tentry->flags & attributes->flag))
+	    return 0;
+    }
+    return 1;
+}
+
+/* Routine that adds the given vldb entry to a snapshot, as a vldbentry or
+ * an nvldbentry. */
+static int
+put_snapentry(struct vl_ctx *ctx, struct nvlentry *tentry,
+	      struct vl_attrsnap *snap)
+{
+    char *reall;
     afs_int32 allo;
     int code;
 
-    if (*Vldbentry == *VldbentryLast) {
-	if (smallMem)
+    if (snap->nentries == snap->alloccnt) {
+	if (smallMem && snap->alloccnt > 0)
 	    return VL_SIZEEXCEEDED;	/* no growing if smallMem defined */
 
-	/* Allocate another set of memory; each time allocate twice as
-	 * many blocks as the last time. When we reach VLDBALLOCLIMIT,
-	 * then grow in increments of VLDBALLOCINCR.
+	/* Each time allocate twice as many entries as the last time, until
+	 * we reach VLDBALLOCLIMIT; then grow in increments of VLDBALLOCINCR.
 	 */
-	allo = (*alloccnt > VLDBALLOCLIMIT) ? VLDBALLOCINCR : *alloccnt;
-	reall = realloc(*VldbentryFirst,
-			(*alloccnt + allo) * sizeof(vldbentry));
+	if (snap->alloccnt == 0)
+	    allo = VLDBALLOCCOUNT;
+	else if (snap->alloccnt > VLDBALLOCLIMIT)
+	    allo = VLDBALLOCINCR;
+	else
+	    allo = snap->alloccnt;
+	reall = realloc(snap->entries,
+			(snap->alloccnt + allo) * snap->entrysize);
 	if (reall == NULL)
 	    return VL_NOMEM;
-
-	*VldbentryFirst = vldbentries->bulkentries_val = reall;
-	*Vldbentry = *VldbentryFirst + *alloccnt;
-	*VldbentryLast = *Vldbentry + allo;
-	*alloccnt += allo;
+	snap->entries = reall;
+	snap->alloccnt += allo;
     }
 
-    code = vlentry_to_vldbentry(ctx, entry, *Vldbentry);
+    if (snap->newformat) {
+	struct nvldbentry *entry;
+
+	entry = (struct nvldbentry *)snap->entries + snap->nentries;
+	code = vlentry_to_nvldbentry(ctx, tentry, entry);
+	entry->matchindex = 0;
+    } else {
+	code = vlentry_to_vldbentry(ctx, tentry,
+				    (struct vldbentry *)snap->entries
+				    + snap->nentries);
+    }
     if (code)
 	return code;
+    snap->nentries++;
+    return 0;
+}
 
-    (*Vldbentry)++;
-    (*nentries)++;
-    vldbentries->bulkentries_len++;
+/* Copy all of the entries matching the attributes into a snapshot, so
+ * that they can be sent once the transaction has ended. Sending them
+ * under it would let a slow caller hold up writes to the database for
+ * as long as it liked. */
+static int
+snap_attributeentries(struct vl_ctx *ctx,
+		      struct VldbListByAttributes *attributes,
+		      int newformat, struct vl_attrsnap *snap)
+{
+    struct nvlentry tentry;
+    afs_int32 blockindex, count = 0;
+    int code, pollcount = 0;
+    int maxservers = newformat ? NMAXNSERVERS : OMAXNSERVERS;
+
+    memset(snap, 0, sizeof(*snap));
+    snap->newformat = newformat;
+    snap->entrysize = newformat ? sizeof(struct nvldbentry)
+				: sizeof(struct vldbentry);
+
+    /* Handle the attribute by volume id totally separate of the rest
+     * (thus additional Mask values are ignored if VLLIST_VOLUMEID is set!) */
+    if (attributes->Mask & VLLIST_VOLUMEID) {
+	blockindex =
+	    FindByID(ctx, attributes->volumeid, -1, &tentry, &code);
+	if (blockindex == 0)
+	    return code ? code : VL_NOENT;
+	return put_snapentry(ctx, &tentry, snap);
+    }
+
+    blockindex = 0;
+    while ((blockindex = NextEntry(ctx, blockindex, &tentry, &count))) {
+	if (++pollcount > 50) {
+#ifndef AFS_PTHREAD_ENV
+	    IOMGR_Poll();
+#endif
+	    pollcount = 0;
+	}
+	if (!match_attributes(ctx, attributes, &tentry, maxservers))
+	    continue;
+	code = put_snapentry(ctx, &tentry, snap);
+	if (code)
+	    return code;
+    }
+    if (count < 0)
+	return VL_IO;
     return 0;
 }
 
+/* Send the caller the entries in a snapshot, and free it. */
+static int
+stream_attributeentries(struct vl_attrsnap *snap,
+			struct xdr_arraystream *vldbentries)
+{
+    afs_int32 i;
+    int code = 0;
+
+    if (!xdr_arraystream_begin(vldbentries, snap->nentries))
+	code = RXGEN_SS_MARSHAL;
+    for (i = 0; i < snap->nentries && !code; i++) {
+	if (!xdr_arraystream_next(vldbentries,
+				  snap->entries + i * snap->entrysize))
+	    code = RXGEN_SS_MARSHAL;
+    }
+    free(snap->entries);
+    snap->entries = NULL;
+    return code;
+}
+
 static int
 put_nattributeentry(struct vl_ctx *ctx,
 		    struct nvldbentry **Vldbentry,
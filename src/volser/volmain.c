@@ -72,6 +72,7 @@ int debuglevel = 0;
 #define MAXLWP 128
 int lwps = 9;
 int udpBufSize = 0;		/* UDP buffer size for receive */
+int rxListeners = 1;		/* rx listener threads (sockets) */
 int restrictedQueryLevel = RESTRICTED_QUERY_ANYUSER;
 
 int rxBind = 0;
@@ -79,6 +80,7 @@ int rxkadDisableDotCheck = 0;
 int DoPreserveVolumeStats = 1;
 int rxJumbograms = 0;	/* default is to not send and receive jumbograms. */
 int rxMaxMTU = -1;
+int rxMaxWindow = 0;
 char *auditFileName = NULL;
 static struct logOptions logopts;
 char *configDir = NULL;
@@ -232,8 +234,10 @@ enum optionsList {
     OPT_nojumbo,
     OPT_jumbo,
     OPT_rxmaxmtu,
+    OPT_rxmaxwindow,
     OPT_sleep,
     OPT_udpsize,
+    OPT_rxlisteners,
     OPT_peer,
     OPT_process,
     OPT_preserve_vol_stats,
@@ -281,8 +285,12 @@ ParseArgs(int argc, char **argv) {
 	    "enable jumbograms");
     cmd_AddParmAtOffset(opts, OPT_rxmaxmtu, "-rxmaxmtu", CMD_SINGLE,
 	    CMD_OPTIONAL, "maximum MTU for RX");
+    cmd_AddParmAtOffset(opts, OPT_rxmaxwindow, "-rxmaxwindow", CMD_SINGLE,
+	    CMD_OPTIONAL, "maximum RX window size in packets");
     cmd_AddParmAtOffset(opts, OPT_udpsize, "-udpsize", CMD_SINGLE,
 	    CMD_OPTIONAL, "size of socket buffer in bytes");
+    cmd_AddParmAtOffset(opts, OPT_rxlisteners, "-rxlisteners", CMD_SINGLE,
+	    CMD_OPTIONAL, "number of rx listener threads");
     cmd_AddParmAtOffset(opts, OPT_sleep, "-sleep", CMD_SINGLE,
 	    CMD_OPTIONAL, "make background daemon sleep (LWP only)");
     cmd_AddParmAtOffset(opts, OPT_peer, "-enable_peer_stats", CMD_FLAG,
@@ -363,6 +371,7 @@ ParseArgs(int argc, char **argv) {
     cmd_OptionAsInt(opts, OPT_debug, &logopts.lopt_logLevel);
 
     cmd_OptionAsInt(opts, OPT_rxmaxmtu, &rxMaxMTU);
+    cmd_OptionAsInt(opts, OPT_rxmaxwindow, &rxMaxWindow);
     if (cmd_OptionAsInt(opts, OPT_udpsize, &optval) == 0) {
 	if (optval < rx_GetMinUdpBufSize()) {
 	    printf("Warning:udpsize %d is less than minimum %d; ignoring\n",
@@ -370,6 +379,7 @@ ParseArgs(int argc, char **argv) {
 	} else
 	    udpBufSize = optval;
     }
+    cmd_OptionAsInt(opts, OPT_rxlisteners, &rxListeners);
     cmd_OptionAsString(opts, OPT_auditlog, &auditFileName);
 
     if (cmd_OptionAsString(opts, OPT_audit_interface, &optstring) == 0) {
@@ -516,6 +526,12 @@ main(int argc, char **argv)
     rx_nPackets = rxpackets;	/* set the max number of packets */
     if (udpBufSize)
 	rx_SetUdpBufSize(udpBufSize);	/* set the UDP buffer size for receive */
+    if (rxListeners != 1) {
+	if (rx_SetNumListeners(rxListeners) != 0) {
+	    fprintf(stderr, "rxlisteners %d is invalid\n", rxListeners);
+	    exit(1);
+	}
+    }
     if (rxBind) {
 	afs_int32 ccode;
         if (AFSDIR_SERVER_NETRESTRICT_FILEPATH ||
@@ -549,6 +565,14 @@ main(int argc, char **argv)
 	    VS_EXIT(1);
 	}
     }
+    if (rxMaxWindow) {
+	if (rxMaxWindow < 1 || rxMaxWindow > RX_MAXEXTWINDOW) {
+	    fprintf(stderr, "rxmaxwindow %d is invalid\n", rxMaxWindow);
+	    VS_EXIT(1);
+	}
+	rx_SetMaxReceiveWindow(rxMaxWindow);
+	rx_SetMaxSendWindow(rxMaxWindow);
+    }
     rx_GetIFInfo();
     rx_SetRxDeadTime(420);
     memset(busyFlags, 0, sizeof(busyFlags));
@@ -111,9 +111,9 @@ static afs_int32 VolListOneVolume(struct rx_call *, afs_int32, VolumeId,
 static afs_int32 VolXListOneVolume(struct rx_call *, afs_int32, VolumeId,
 				   volXEntries *);
 static afs_int32 VolListVolumes(struct rx_call *, afs_int32, afs_int32,
-				volEntries *);
+				struct xdr_arraystream *);
 static afs_int32 VolXListVolumes(struct rx_call *, afs_int32, afs_int32,
-				volXEntries *);
+				struct xdr_arraystream *);
 static afs_int32 VolMonitor(struct rx_call *, transDebugEntries *);
 static afs_int32 VolSetIdsTypes(struct rx_call *, afs_int32, char [],
 				afs_int32, VolumeId, VolumeId,
@@ -2570,11 +2570,101 @@ VolXListOneVolume(struct rx_call *a_rxCidP, afs_int32 a_partID,
     return (found) ? 0 : ENODEV;
 }				/*SAFSVolXListOneVolume */
 
+/*
+ * Collect the IDs of all the volumes on partition partid. The listing RPCs
+ * send the number of volumes ahead of the volumes themselves, so they
+ * gather the IDs first.
+ */
+static afs_int32
+GetVolIds(afs_int32 partid, char *pname, VolumeId **volidsp,
+	  afs_uint32 *nvolsp)
+{
+    struct DiskPartition64 *partP;
+    afs_uint32 allocSize = 1000, nvols = 0;
+    char volname[20];
+    VolumeId volid, *volids, *pntr;
+    DIR *dirp;
+
+    if (GetPartName(partid, pname))
+	return VOLSERILLEGAL_PARTITION;
+    if (!(partP = VGetPartition(pname, 0)))
+	return VOLSERILLEGAL_PARTITION;
+    dirp = opendir(VPartitionPath(partP));
+    if (dirp == NULL)
+	return VOLSERILLEGAL_PARTITION;
+
+    volids = malloc(allocSize * sizeof(VolumeId));
+    if (volids == NULL) {
+	closedir(dirp);
+	return VOLSERNO_MEMORY;
+    }
+    while (GetNextVol(dirp, volname, &volid)) {
+	if (nvols == allocSize) {
+	    allocSize = (allocSize * 3) / 2;
+	    pntr = realloc(volids, allocSize * sizeof(VolumeId));
+	    if (pntr == NULL) {
+		free(volids);
+		closedir(dirp);
+		return VOLSERNO_MEMORY;
+	    }
+	    volids = pntr;
+	}
+	volids[nvols++] = volid;
+    }
+    closedir(dirp);
+
+    *volidsp = volids;
+    *nvolsp = nvols;
+    return 0;
+}
+
+/*
+ * Get the information about each of the volumes being listed, leaving out
+ * any which are due to be destroyed. The listing RPCs send the number of
+ * volumes ahead of the volumes themselves, and which volumes are to be
+ * destroyed is only known once their headers have been read, so this is
+ * all done before any of them is sent. The infos take as much memory as
+ * an unstreamed reply would.
+ *
+ * The handle points at room for nvols entries of its type; the number
+ * filled in is returned in *ninfosp.
+ */
+static void
+GetListedVolInfos(afs_int32 partid, char *pname, VolumeId *volids,
+		  afs_uint32 nvols, volint_info_handle_t *handle,
+		  afs_uint32 *ninfosp)
+{
+    char volname[20];
+    afs_uint32 i, ninfos = 0;
+
+    for (i = 0; i < nvols; i++) {
+#ifndef AFS_PTHREAD_ENV
+	IOMGR_Poll();	/*make sure that the client does not time out */
+#endif
+	ConvertVolume(volids[i], volname, sizeof(volname));
+	if (GetVolInfo(partid, volids[i], pname, volname, handle,
+		       VOL_INFO_LIST_MULTIPLE) == -2) {
+	    /* DESTROY_ME flag set; reuse its entry */
+	    if (handle->volinfo_type == VOLINT_INFO_TYPE_BASE)
+		memset(handle->volinfo_ptr.base, 0, sizeof(volintInfo));
+	    else
+		memset(handle->volinfo_ptr.ext, 0, sizeof(volintXInfo));
+	    continue;
+	}
+	if (handle->volinfo_type == VOLINT_INFO_TYPE_BASE)
+	    handle->volinfo_ptr.base++;
+	else
+	    handle->volinfo_ptr.ext++;
+	ninfos++;
+    }
+    *ninfosp = ninfos;
+}
+
 /*returns all the volumes on partition partid. If flags = 1 then all the
 * relevant info about the volumes  is also returned */
 afs_int32
 SAFSVolListVolumes(struct rx_call *acid, afs_int32 partid, afs_int32 flags,
-		   volEntries *volumeInfo)
+		   struct xdr_arraystream *volumeInfo)
 {
     afs_int32 code;
 
@@ -2585,76 +2675,48 @@ SAFSVolListVolumes(struct rx_call *acid, afs_int32 partid, afs_int32 flags,
 
 static afs_int32
 VolListVolumes(struct rx_call *acid, afs_int32 partid, afs_int32 flags,
-		   volEntries *volumeInfo)
+	       struct xdr_arraystream *volumeInfo)
 {
-    volintInfo *pntr;
-    struct DiskPartition64 *partP;
-    afs_int32 allocSize = 1000;	/*to be changed to a larger figure */
-    char pname[9], volname[20];
-    DIR *dirp;
-    VolumeId volid;
-    int code;
+    volintInfo entry, *infos = NULL;
+    char pname[9];
+    VolumeId *volids;
+    afs_uint32 nvols, i;
+    afs_int32 code = 0;
     volint_info_handle_t handle;
 
     if (!afsconf_CheckRestrictedQuery(tdir, acid, restrictedQueryLevel))
         return VOLSERBAD_ACCESS;
 
-    volumeInfo->volEntries_val = calloc(allocSize, sizeof(volintInfo));
-    if (!volumeInfo->volEntries_val)
-	return ENOMEM;
-
-    pntr = volumeInfo->volEntries_val;
-    volumeInfo->volEntries_len = 0;
-    if (GetPartName(partid, pname))
-	return VOLSERILLEGAL_PARTITION;
-    if (!(partP = VGetPartition(pname, 0)))
-	return VOLSERILLEGAL_PARTITION;
-    dirp = opendir(VPartitionPath(partP));
-    if (dirp == NULL)
-	return VOLSERILLEGAL_PARTITION;
-
-    while (GetNextVol(dirp, volname, &volid)) {
-	if (flags) {		/*copy other things too */
-#ifndef AFS_PTHREAD_ENV
-	    IOMGR_Poll();	/*make sure that the client does not time out */
-#endif
-
-	    handle.volinfo_type = VOLINT_INFO_TYPE_BASE;
-	    handle.volinfo_ptr.base = pntr;
-
+    code = GetVolIds(partid, pname, &volids, &nvols);
+    if (code)
+	return code;
 
-	    code = GetVolInfo(partid,
-			      volid,
-			      pname,
-			      volname,
-			      &handle,
-			      VOL_INFO_LIST_MULTIPLE);
-	    if (code == -2)	/* DESTROY_ME flag set */
-		continue;
-	} else {
-	    pntr->volid = volid;
-	    /*just volids are needed */
+    if (flags) {		/*copy other things too */
+	infos = calloc(nvols ? nvols : 1, sizeof(volintInfo));
+	if (infos == NULL) {
+	    free(volids);
+	    return VOLSERNO_MEMORY;
 	}
+	handle.volinfo_type = VOLINT_INFO_TYPE_BASE;
+	handle.volinfo_ptr.base = infos;
+	GetListedVolInfos(partid, pname, volids, nvols, &handle, &nvols);
+    }
 
-	pntr++;
-	volumeInfo->volEntries_len += 1;
-	if ((allocSize - volumeInfo->volEntries_len) < 5) {
-	    /*running out of space, allocate more space */
-	    allocSize = (allocSize * 3) / 2;
-	    pntr = realloc(volumeInfo->volEntries_val,
-			   allocSize * sizeof(volintInfo));
-	    if (pntr == NULL) {
-		closedir(dirp);
-		return VOLSERNO_MEMORY;
-	    }
-	    volumeInfo->volEntries_val = pntr;	/* point to new block */
-	    /* set pntr to the right position */
-	    pntr = volumeInfo->volEntries_val + volumeInfo->volEntries_len;
+    if (!xdr_arraystream_begin(volumeInfo, nvols))
+	code = RXGEN_SS_MARSHAL;
+    for (i = 0; i < nvols && !code; i++) {
+	if (infos == NULL) {
+	    memset(&entry, 0, sizeof(entry));
+	    entry.volid = volids[i];
+	    /*just volids are needed */
 	}
+	if (!xdr_arraystream_next(volumeInfo, infos ? &infos[i] : &entry))
+	    code = RXGEN_SS_MARSHAL;
     }
 
-    closedir(dirp);
-    return 0;
+    free(infos);
+    free(volids);
+    return code;
 }
 
 /*------------------------------------------------------------------------
@@ -2669,13 +2731,14 @@ VolListVolumes(struct rx_call *acid, afs_int32 partid, afs_int32 flags,
  *	a_rxCidP       : Pointer to the Rx call we're performing.
  *	a_partID       : Partition for which we want the extended list.
  *	a_flags        : Various flags.
- *	a_volumeXInfoP : Ptr to the extended info blob.
+ *	a_volumeXInfoP : Stream to send the extended info to.
  *
  * Returns:
  *	0			Successful operation
  *	VOLSERILLEGAL_PARTITION if we got a bogus partition ID
- *	VOLSERNO_MEMORY         if we ran out of memory allocating
- *				our return blob
+ *	VOLSERNO_MEMORY         if we ran out of memory listing the
+ *				partition
+ *	RXGEN_SS_MARSHAL	if the info couldn't be sent
  *
  * Environment:
  *	Nothing interesting.
@@ -2686,7 +2749,7 @@ VolListVolumes(struct rx_call *acid, afs_int32 partid, afs_int32 flags,
 
 afs_int32
 SAFSVolXListVolumes(struct rx_call *a_rxCidP, afs_int32 a_partID,
-		    afs_int32 a_flags, volXEntries *a_volumeXInfoP)
+		    afs_int32 a_flags, struct xdr_arraystream *a_volumeXInfoP)
 {
     afs_int32 code;
 
@@ -2697,115 +2760,63 @@ SAFSVolXListVolumes(struct rx_call *a_rxCidP, afs_int32 a_partID,
 
 static afs_int32
 VolXListVolumes(struct rx_call *a_rxCidP, afs_int32 a_partID,
-		    afs_int32 a_flags, volXEntries *a_volumeXInfoP)
+		afs_int32 a_flags, struct xdr_arraystream *a_volumeXInfoP)
 {				/*SAFSVolXListVolumes */
 
-    volintXInfo *xInfoP;	/*Ptr to the extended vol info */
-    struct DiskPartition64 *partP;	/*Ptr to partition */
-    afs_int32 allocSize = 1000;	/*To be changed to a larger figure */
-    char pname[9], volname[20];	/*Partition, volume names */
-    DIR *dirp;			/*Partition directory ptr */
-    VolumeId volid;		/*Current volume ID */
-    int code;
+    volintXInfo xInfo;		/*Extended info for one volume */
+    volintXInfo *xInfos = NULL;	/*Extended info for all of them */
+    char pname[9];		/*Partition name */
+    VolumeId *volids;		/*IDs of the volumes on the partition */
+    afs_uint32 nvols, i;
+    afs_int32 code = 0;
     volint_info_handle_t handle;
 
     if (!afsconf_CheckRestrictedQuery(tdir, a_rxCidP, restrictedQueryLevel))
         return VOLSERBAD_ACCESS;
 
     /*
-     * Allocate a large array of extended volume info structures, then
-     * set it up for action.
+     * Find the volumes on the partition.
      */
-    a_volumeXInfoP->volXEntries_val = calloc(allocSize, sizeof(volintXInfo));
-    if (!a_volumeXInfoP->volXEntries_val)
-	return ENOMEM;
-
-    xInfoP = a_volumeXInfoP->volXEntries_val;
-    a_volumeXInfoP->volXEntries_len = 0;
+    code = GetVolIds(a_partID, pname, &volids, &nvols);
+    if (code)
+	return code;
 
-    /*
-     * If the partition name we've been given is bad, bogue out.
-     */
-    if (GetPartName(a_partID, pname))
-	return (VOLSERILLEGAL_PARTITION);
+    if (a_flags) {
+	/*
+	 * Full info about the volumes desired.  Get it all now, as the
+	 * volumes which are to be destroyed aren't counted.
+	 */
+	xInfos = calloc(nvols ? nvols : 1, sizeof(volintXInfo));
+	if (xInfos == NULL) {
+	    free(volids);
+	    return VOLSERNO_MEMORY;
+	}
+	handle.volinfo_type = VOLINT_INFO_TYPE_EXT;
+	handle.volinfo_ptr.ext = xInfos;
+	GetListedVolInfos(a_partID, pname, volids, nvols, &handle, &nvols);
+    }
 
     /*
-     * Open the directory representing the given AFS parttion.  If we can't
-     * do that, we lose.
+     * Tell our caller how many there are, and then send them.
      */
-    if (!(partP = VGetPartition(pname, 0)))
-	return VOLSERILLEGAL_PARTITION;
-    dirp = opendir(VPartitionPath(partP));
-    if (dirp == NULL)
-	return (VOLSERILLEGAL_PARTITION);
-    while (GetNextVol(dirp, volname, &volid)) {
-	if (a_flags) {
-	    /*
-	     * Full info about the volume desired.  Poll to make sure the
-	     * client doesn't time out, then start up a new transaction.
-	     */
-#ifndef AFS_PTHREAD_ENV
-	    IOMGR_Poll();
-#endif
-
-	    handle.volinfo_type = VOLINT_INFO_TYPE_EXT;
-	    handle.volinfo_ptr.ext = xInfoP;
-
-	    code = GetVolInfo(a_partID,
-			      volid,
-			      pname,
-			      volname,
-			      &handle,
-			      VOL_INFO_LIST_MULTIPLE);
-	    if (code == -2)	/* DESTROY_ME flag set */
-		continue;
-	} else {
+    if (!xdr_arraystream_begin(a_volumeXInfoP, nvols))
+	code = RXGEN_SS_MARSHAL;
+    for (i = 0; i < nvols && !code; i++) {
+	if (xInfos == NULL) {
 	    /*
 	     * Just volume IDs are needed.
 	     */
-	    xInfoP->volid = volid;
-	}
-
-	/*
-	 * Bump the pointer in the data area we're building, along with
-	 * the count of the number of entries it contains.
-	 */
-	xInfoP++;
-	(a_volumeXInfoP->volXEntries_len)++;
-	if ((allocSize - a_volumeXInfoP->volXEntries_len) < 5) {
-	    /*
-	     * We're running out of space in the area we've built.  Grow it.
-	     */
-	    allocSize = (allocSize * 3) / 2;
-	    xInfoP = (volintXInfo *)
-		realloc((char *)a_volumeXInfoP->volXEntries_val,
-			(allocSize * sizeof(volintXInfo)));
-	    if (xInfoP == NULL) {
-		/*
-		 * Bummer, no memory. Bag it, tell our caller what went wrong.
-		 */
-		closedir(dirp);
-		return (VOLSERNO_MEMORY);
-	    }
-
-	    /*
-	     * Memory reallocation worked.  Correct our pointers so they
-	     * now point to the new block and the current open position within
-	     * the new block.
-	     */
-	    a_volumeXInfoP->volXEntries_val = xInfoP;
-	    xInfoP =
-		a_volumeXInfoP->volXEntries_val +
-		a_volumeXInfoP->volXEntries_len;
+	    memset(&xInfo, 0, sizeof(xInfo));
+	    xInfo.volid = volids[i];
 	}
+	if (!xdr_arraystream_next(a_volumeXInfoP,
+				  xInfos ? &xInfos[i] : &xInfo))
+	    code = RXGEN_SS_MARSHAL;
     }
 
-    /*
-     * We've examined all entries in the partition directory.  Close it,
-     * delete our transaction (if any), and go home happy.
-     */
-    closedir(dirp);
-    return (0);
+    free(xInfos);
+    free(volids);
+    return code;
 
 }				/*SAFSVolXListVolumes */
 
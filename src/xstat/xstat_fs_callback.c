@@ -775,3 +775,10 @@ int SRXAFSCB_GetDE(struct rx_call *a_call, afs_int32 a_index, afs_int32 addr,
 {
     return RXGEN_OPCODE;
 }
+
+int SRXAFSCB_CallBackDirDelta(struct rx_call *a_call, struct AFSFid *a_dirFid,
+			      struct AFSDirDeltaStatus *a_dirStatus,
+			      AFSDirDeltas *a_deltas)
+{
+    return RXGEN_OPCODE;
+}
@@ -237,6 +237,21 @@ PrintOverallPerfInfo(struct afs_PerfStats *a_ovP)
 
     printf("\t%10u fs_nBusies\n", a_ovP->fs_nBusies);
     printf("\t%10u fs_GetCapabilities\n\n", a_ovP->fs_nGetCaps);
+
+    printf("\t%10u fs_nRightsHits\n", a_ovP->fs_nRightsHits);
+    printf("\t%10u fs_nRightsMisses\n", a_ovP->fs_nRightsMisses);
+    printf("\t%10u fs_RightsMissMsec\n", a_ovP->fs_RightsMissMsec);
+    if (a_ovP->fs_nRightsMisses)
+	printf("\t%10.0f fs_RightsSavedMsec (estimated)\n\n",
+	       (double)(afs_uint32)a_ovP->fs_RightsMissMsec
+	       / (afs_uint32)a_ovP->fs_nRightsMisses
+	       * (afs_uint32)a_ovP->fs_nRightsHits);
+    else
+	printf("\n");
+
+    printf("\t%10u fs_nCPSHits\n", a_ovP->fs_nCPSHits);
+    printf("\t%10u fs_nCPSMisses\n", a_ovP->fs_nCPSMisses);
+    printf("\t%10u fs_nCPSRefreshes\n\n", a_ovP->fs_nCPSRefreshes);
     /*
      * Host module fields.
      */
@@ -475,7 +490,9 @@ static char *CbCounterStrings[] = {
     "nFEs", "nCBs", "nblks",
     "CBsTimedOut",
     "nbreakers",
-    "GSS1", "GSS2", "GSS3", "GSS4", "GSS5"
+    "GSS1", "GSS2", "GSS3", "GSS4", "GSS5",
+    "BreaksQueued", "BreakBatches", "BreakRPCs", "BreaksCoalesced",
+    "BreakQueueWaits", "DirDeltas", "BreakBatchesDown"
 };
 
 
@@ -0,0 +1,181 @@
+/* Tests that extended ACKs are only sent to peers which ask for them */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+#include <stddef.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/rx_packet.h>
+#include <rx/rx_null.h>
+#include <rx/rx_globals.h>
+
+#define TEST_SERVICE_ID 4
+#define TEST_EPOCH 0x12345678
+
+struct testpeer {
+    int sock;
+    afs_uint32 cid;
+    afs_uint32 serial;
+    afs_uint32 caps;	/* RX_ACKCAP flags for our ACKs, or 0 to send
+			 * the four word trailer of older peers */
+};
+
+static afs_int32
+ExecuteRequest(struct rx_call *call)
+{
+    char buf[8];
+
+    /* The peer never finishes its request, so this keeps the call open */
+    rx_Read(call, buf, sizeof(buf));
+    return 0;
+}
+
+static void
+SendPacket(struct testpeer *tp, int type, int flags, afs_uint32 seq,
+	   void *data, int len)
+{
+    struct sockaddr_in sin;
+    afs_uint32 buf[RX_HEADER_SIZE / sizeof(afs_uint32) + 64];
+
+    buf[0] = htonl(TEST_EPOCH);
+    buf[1] = htonl(tp->cid);
+    buf[2] = htonl(1);
+    buf[3] = htonl(seq);
+    buf[4] = htonl(++tp->serial);
+    buf[5] = htonl((type << 24) | ((flags | RX_CLIENT_INITIATED) << 16));
+    buf[6] = htonl(TEST_SERVICE_ID);
+    memcpy(buf + RX_HEADER_SIZE / sizeof(afs_uint32), data, len);
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin.sin_port = rx_port;
+    sendto(tp->sock, (char *)buf, RX_HEADER_SIZE + len, 0,
+	   (struct sockaddr *)&sin, sizeof(sin));
+}
+
+/* Ping the server on our call, and return the length of the trailer of
+ * the ping response, or -1 if none came. *capsp gets its RX_ACKCAP
+ * flags. */
+static int
+Ping(struct testpeer *tp, afs_uint32 *capsp, afs_uint32 *trailer)
+{
+    unsigned char ack[rx_AckDataSize(0)
+		      + RX_ACKTRAILER_WORDS * sizeof(afs_uint32)];
+    unsigned char buf[RX_HEADER_SIZE + 2048];
+    struct rx_ackPacket *ap;
+    afs_uint32 word, serial;
+    struct timeval tv;
+    fd_set fds;
+    int len;
+
+    memset(ack, 0, sizeof(ack));
+    ap = (struct rx_ackPacket *)ack;
+    ap->firstPacket = htonl(1);
+    ap->reason = RX_ACK_PING;
+    ap->nAcks = 0;
+    word = htonl(RX_MAX_PACKET_SIZE);
+    memcpy(ack + rx_AckDataSize(0), &word, sizeof(word));
+    memcpy(ack + rx_AckDataSize(0) + sizeof(word), &word, sizeof(word));
+    word = htonl(32);
+    memcpy(ack + rx_AckDataSize(0) + 2 * sizeof(word), &word, sizeof(word));
+    word = htonl(1);
+    memcpy(ack + rx_AckDataSize(0) + 3 * sizeof(word), &word, sizeof(word));
+    word = htonl(tp->caps);
+    memcpy(ack + rx_AckDataSize(0) + 4 * sizeof(word), &word, sizeof(word));
+
+    SendPacket(tp, RX_PACKET_TYPE_ACK, RX_REQUEST_ACK, 0, ack,
+	       tp->caps != 0 ? sizeof(ack) : sizeof(ack) - sizeof(word));
+    serial = tp->serial;
+
+    for (;;) {
+	FD_ZERO(&fds);
+	FD_SET(tp->sock, &fds);
+	tv.tv_sec = 5;
+	tv.tv_usec = 0;
+	if (select(tp->sock + 1, &fds, NULL, NULL, &tv) <= 0)
+	    return -1;
+	len = recv(tp->sock, buf, sizeof(buf), 0);
+	if (len < RX_HEADER_SIZE + (int)rx_AckDataSize(0)
+	    || buf[20] != RX_PACKET_TYPE_ACK)
+	    continue;
+	ap = (struct rx_ackPacket *)(buf + RX_HEADER_SIZE);
+	if (ap->reason != RX_ACK_PING_RESPONSE || ntohl(ap->serial) != serial)
+	    continue;
+	len -= RX_HEADER_SIZE + rx_AckDataSize(ap->nAcks);
+	if (len < 0)
+	    continue;
+	memset(trailer, 0, RX_EXTACKTRAILER_WORDS * sizeof(afs_uint32));
+	memcpy(trailer, (char *)ap + rx_AckDataSize(ap->nAcks),
+	       MIN(len, RX_EXTACKTRAILER_WORDS * sizeof(afs_uint32)));
+	*capsp = ntohl(trailer[4]);
+	return len;
+    }
+}
+
+static void
+StartPeer(struct testpeer *tp, afs_uint32 cid, afs_uint32 caps)
+{
+    struct sockaddr_in sin;
+    char data[4] = { 0 };
+
+    memset(tp, 0, sizeof(*tp));
+    tp->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(tp->sock, (struct sockaddr *)&sin, sizeof(sin));
+    tp->cid = cid;
+    tp->caps = caps;
+
+    /* Start a call, which the pings can then be made on */
+    SendPacket(tp, RX_PACKET_TYPE_DATA, 0, 1, data, sizeof(data));
+}
+
+int
+main(void)
+{
+    struct rx_securityClass *secobj;
+    struct rx_service *service;
+    struct testpeer old, new;
+    afs_uint32 trailer[RX_EXTACKTRAILER_WORDS];
+    afs_uint32 caps;
+    int len;
+
+    plan(8);
+
+    is_int(0, rx_Init(0), "Initialised rx");
+    secobj = rxnull_NewServerSecurityObject();
+    service = rx_NewService(0, TEST_SERVICE_ID, "test", &secobj, 1,
+			    ExecuteRequest);
+    ok(service != NULL, "Created a service");
+    rx_StartServer(0);
+
+    /* A peer which doesn't know about extended ACKs */
+    StartPeer(&old, 0x1000, 0);
+    len = Ping(&old, &caps, trailer);
+    is_int(RX_ACKTRAILER_WORDS * sizeof(afs_uint32), len,
+	   "Old peer gets the old ACK trailer");
+    ok(caps == RX_ACKCAP_EXTACKS, "... in an ACK offering extended ACKs");
+    len = Ping(&old, &caps, trailer);
+    is_int(RX_ACKTRAILER_WORDS * sizeof(afs_uint32), len,
+	   "... and still does once it has been heard from");
+
+    /* A peer which does */
+    StartPeer(&new, 0x2000, RX_ACKCAP_EXTACKS);
+    len = Ping(&new, &caps, trailer);
+    is_int(RX_ACKTRAILER_WORDS * sizeof(afs_uint32), len,
+	   "New peer gets the old ACK trailer before it is heard from");
+    len = Ping(&new, &caps, trailer);
+    is_int(RX_EXTACKTRAILER_WORDS * sizeof(afs_uint32), len,
+	   "... and the extended trailer after");
+    ok((caps & RX_ACKCAP_EXTENDED)
+       && ntohl(trailer[5]) >= ntohl(trailer[2]) && ntohl(trailer[6]) == 0,
+       "... saying so, and giving the uncapped window and no extended ACKs");
+
+    return 0;
+}
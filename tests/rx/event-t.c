@@ -13,6 +13,10 @@
 
 #define NUMEVENTS 10000
 
+/* Events posted and cancelled in each round of the throughput benchmark */
+#define NUMBENCH 100000
+#define BENCHROUNDS 10
+
 /* Mutexes and condvars for the scheduler */
 static int rescheduled = 0;
 static pthread_mutex_t eventMutex;
@@ -28,6 +32,11 @@ struct testEvent {
 };
 
 static struct testEvent events[NUMEVENTS];
+static struct rxevent *benchEvents[NUMBENCH];
+
+/* When the timing test event was due, and when it actually fired */
+static struct clock timedWhen;
+static struct clock timedFired;
 
 static void
 reschedule(void)
@@ -58,6 +67,55 @@ reportSub(struct rxevent *event, void *arg, void *arg1, int arg2)
     printf("Event fired\n");
 }
 
+static void
+timedSub(struct rxevent *event, void *arg, void *arg1, int arg2)
+{
+    clock_GetTime(&timedFired);
+}
+
+static void
+benchSub(struct rxevent *event, void *arg, void *arg1, int arg2)
+{
+}
+
+/* Post, and then cancel, a large number of events spread over the next
+ * minute, and report how long that takes */
+static void
+benchmark(void)
+{
+    struct clock now, eventTime, start, end;
+    double postTime = 0, cancelTime = 0;
+    int round, counter, cancelled = 0;
+
+    for (round = 0; round < BENCHROUNDS; round++) {
+	clock_GetTime(&now);
+	start = now;
+	for (counter = 0; counter < NUMBENCH; counter++) {
+	    eventTime = now;
+	    clock_Addmsec(&eventTime, 10000 + random() % 60000);
+	    benchEvents[counter] = rxevent_Post(&eventTime, &now, benchSub,
+						NULL, NULL, 0);
+	}
+	clock_GetTime(&end);
+	clock_Sub(&end, &start);
+	postTime += clock_Float(&end);
+
+	clock_GetTime(&start);
+	for (counter = 0; counter < NUMBENCH; counter++)
+	    cancelled += rxevent_Cancel(&benchEvents[counter]);
+	clock_GetTime(&end);
+	clock_Sub(&end, &start);
+	cancelTime += clock_Float(&end);
+    }
+
+    ok(cancelled == NUMBENCH * BENCHROUNDS,
+       "Cancelled all %d benchmark events", NUMBENCH * BENCHROUNDS);
+    if (postTime > 0 && cancelTime > 0)
+	diag("%.0f posts/sec, %.0f cancels/sec",
+	     NUMBENCH * BENCHROUNDS / postTime,
+	     NUMBENCH * BENCHROUNDS / cancelTime);
+}
+
 static void *
 eventHandler(void *dummy) {
     struct timespec nextEvent;
@@ -100,7 +158,7 @@ main(void)
     struct rxevent *event;
     pthread_t handler;
 
-    plan(8);
+    plan(10);
 
     pthread_mutex_init(&eventMutex, NULL);
     pthread_cond_init(&eventCond, NULL);
@@ -124,6 +182,13 @@ main(void)
     ok(pthread_create(&handler, NULL, eventHandler, NULL) == 0,
        "Created handler thread");
 
+    /* An event to check that nothing fires before it is due */
+    clock_GetTime(&now);
+    timedWhen = now;
+    clock_Addmsec(&timedWhen, 1500);
+    event = rxevent_Post(&timedWhen, &now, timedSub, NULL, NULL, 0);
+    rxevent_Put(&event);
+
     /* Add 1000 random events to fire over the next 3 seconds */
 
     for (counter = 0; counter < NUMEVENTS; counter++) {
@@ -173,6 +238,9 @@ main(void)
     ok(!fail, "Didn't fire any cancelled events");
     ok(fired+cancelled == NUMEVENTS,
 	"Number of fired and cancelled events sum to correct total");
+    ok(clock_Ge(&timedFired, &timedWhen), "Timed event didn't fire early");
+
+    benchmark();
 
     return 0;
 }
@@ -0,0 +1,145 @@
+/* Tests of sending data straight from a file with rx_WritevFromFd */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/rx_null.h>
+#include <rx/rx_globals.h>
+#include <rx/rx_impair.h>
+
+#define TEST_SERVICE_ID 4
+#define FILE_WORDS (1024 * 1024 + 3)
+
+static int fd;
+
+/* Send the range of the file the client asks for */
+static afs_int32
+ExecuteRequest(struct rx_call *call)
+{
+    afs_int32 offset, length;
+
+    if (rx_Read32(call, &offset) != 4 || rx_Read32(call, &length) != 4)
+	return RX_PROTOCOL_ERROR;
+    offset = ntohl(offset);
+    length = ntohl(length);
+    if (rx_WritevFromFd(call, fd, offset, length) != length)
+	return EIO;
+    return 0;
+}
+
+/* Fetch a range of the file, and check that it holds what was written to
+ * it. Returns the call's error, or -1 if the data was wrong. */
+static int
+Fetch(struct rx_connection *conn, afs_int32 offset, afs_int32 length)
+{
+    struct rx_call *call;
+    unsigned char *buf;
+    afs_int32 data;
+    int i, code, good;
+
+    call = rx_NewCall(conn);
+    data = htonl(offset);
+    rx_Write32(call, &data);
+    data = htonl(length);
+    rx_Write32(call, &data);
+
+    buf = bcalloc(1, length);
+    good = (rx_Read(call, (char *)buf, length) == length);
+    for (i = 0; good && i < length; i++) {
+	if (buf[i] != (unsigned char)((offset + i) * 7 + (offset + i) / 4093))
+	    good = 0;
+    }
+    free(buf);
+
+    code = rx_EndCall(call, 0);
+    return code ? code : (good ? 0 : -1);
+}
+
+int
+main(void)
+{
+    struct rx_securityClass *secobj;
+    struct rx_service *service;
+    struct rx_connection *conn;
+    struct rx_statistics *stats;
+    struct rx_impairment imp;
+    struct rx_impairmentStats istats;
+    char template[] = "/tmp/fromfd-XXXXXX";
+    unsigned char *buf;
+    int i, sent, resent;
+
+    plan(11);
+
+    fd = mkstemp(template);
+    if (fd < 0)
+	sysbail("mkstemp");
+    unlink(template);
+    buf = bmalloc(FILE_WORDS * 4);
+    for (i = 0; i < FILE_WORDS * 4; i++)
+	buf[i] = (unsigned char)(i * 7 + i / 4093);
+    if (write(fd, buf, FILE_WORDS * 4) != FILE_WORDS * 4)
+	sysbail("write");
+    free(buf);
+
+    is_int(0, rx_Init(0), "Initialised rx");
+    secobj = rxnull_NewServerSecurityObject();
+    service = rx_NewService(0, TEST_SERVICE_ID, "test", &secobj, 1,
+			    ExecuteRequest);
+    ok(service != NULL, "Created a service");
+    rx_StartServer(0);
+
+    conn = rx_NewConnection(htonl(INADDR_LOOPBACK), rx_port, TEST_SERVICE_ID,
+			    rxnull_NewClientSecurityObject(), 0);
+
+    is_int(0, Fetch(conn, 0, 1000), "Short ranges are copied");
+    is_int(0, Fetch(conn, 12345, 3 * 1024 * 1024 + 7),
+	   "Long ranges from anywhere in the file are sent whole");
+    is_int(0, Fetch(conn, 4096, FILE_WORDS * 4 - 4096),
+	   "Ranges may run to the end of the file");
+    ok(Fetch(conn, 4096, FILE_WORDS * 4) != 0,
+       "Ranges past the end of the file fail");
+
+    /* Every datagram now goes over a lossy link, so some of the mapped
+     * data must be resent, after the rx_WritevFromFd which sent it may
+     * have returned */
+    memset(&imp, 0, sizeof(imp));
+    imp.loss = 20000;
+    imp.seed = 1;
+    stats = rx_GetStatistics();
+    sent = -stats->dataPacketsSent;
+    resent = -stats->dataPacketsReSent;
+    rx_FreeStatistics(&stats);
+    rx_SetImpairment(&imp);
+
+    is_int(0, Fetch(conn, 777, 2 * 1024 * 1024),
+	   "Data resent from a mapping arrives intact");
+
+    rx_GetImpairmentStats(&istats);
+    rx_SetImpairment(NULL);
+    stats = rx_GetStatistics();
+    sent += stats->dataPacketsSent;
+    resent += stats->dataPacketsReSent;
+    rx_FreeStatistics(&stats);
+    ok(resent > 0, "Mapped packets were resent");
+
+    /* Every datagram counts, the client's ACKs among them */
+    ok(istats.datagrams < sent + resent,
+       "Mapped packets were sent in jumbograms");
+
+    /* A new call acknowledges everything sent on the last one, after which
+     * nothing refers to the file any more */
+    is_int(0, Fetch(conn, 0, 1000), "Made another call");
+    rx_WaitForFileData(fd);
+    ok(ftruncate(fd, 0) == 0,
+       "Waited for the file's data to be acknowledged");
+
+    rx_DestroyConnection(conn);
+    close(fd);
+
+    return 0;
+}
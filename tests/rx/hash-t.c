@@ -0,0 +1,91 @@
+/* Tests of the growth of the Rx connection and peer hash tables */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/rx_null.h>
+#include <rx/rx_globals.h>
+
+#define TEST_SERVICE_ID 4
+#define NCONNS 1000
+
+static afs_int32
+ExecuteRequest(struct rx_call *call)
+{
+    afs_int32 value;
+
+    if (rx_Read(call, (char *)&value, sizeof(value)) != sizeof(value))
+	return RX_PROTOCOL_ERROR;
+    if (rx_Write(call, (char *)&value, sizeof(value)) != sizeof(value))
+	return RX_PROTOCOL_ERROR;
+    return 0;
+}
+
+static int
+doCall(struct rx_connection *conn)
+{
+    struct rx_call *call;
+    afs_int32 value = 42;
+
+    call = rx_NewCall(conn);
+    rx_Write(call, (char *)&value, sizeof(value));
+    rx_Read(call, (char *)&value, sizeof(value));
+    return rx_EndCall(call, 0);
+}
+
+int
+main(void)
+{
+    struct rx_securityClass *secobj;
+    struct rx_service *service;
+    struct rx_connection **conns;
+    afs_uint32 size;
+    int i, failed;
+
+    plan(6);
+
+    /* Start small, so that the tables must grow */
+    rx_hashTableSize = 1;
+    is_int(0, rx_Init(0), "Initialised rx");
+    is_int(RX_HASH_SHARDS, rx_connHashTableSize,
+	   "Connection table starts with one bucket a shard");
+    secobj = rxnull_NewServerSecurityObject();
+    service = rx_NewService(0, TEST_SERVICE_ID, "test", &secobj, 1,
+			    ExecuteRequest);
+    ok(service != NULL, "Created a service");
+    rx_StartServer(0);
+
+    conns = bcalloc(NCONNS, sizeof(*conns));
+    failed = 0;
+    for (i = 0; i < NCONNS; i++) {
+	conns[i] = rx_NewConnection(htonl(INADDR_LOOPBACK), rx_port,
+				    TEST_SERVICE_ID,
+				    rxnull_NewClientSecurityObject(), 0);
+	if (doCall(conns[i]) != 0)
+	    failed++;
+    }
+    is_int(0, failed, "Made a call on each of %d connections", NCONNS);
+
+    /* Both ends of each connection are in the table, with no more than
+     * two entries to a bucket */
+    size = rx_connHashTableSize;
+    ok(size >= NCONNS && (size & (size - 1)) == 0,
+       "Connection table grew to %u buckets", size);
+
+    /* Every connection can still be found, and destroyed */
+    failed = 0;
+    for (i = 0; i < NCONNS; i++) {
+	if (doCall(conns[i]) != 0)
+	    failed++;
+	rx_DestroyConnection(conns[i]);
+    }
+    is_int(0, failed, "Made calls again once the table had grown");
+
+    free(conns);
+    return 0;
+}
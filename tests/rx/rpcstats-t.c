@@ -0,0 +1,194 @@
+/* Tests of Rx's per thread RPC statistics and call latency histograms */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/xdr.h>
+#include <rx/rx_null.h>
+#include <rx/rx_globals.h>
+#include <rx/rxstat.h>
+
+#include "stream.h"
+
+#define NUMCALLS 50
+#define NUMTHREADS 4
+#define STAT_WORDS 28	/* in each marshalled rx_function_entry_v1_t */
+
+afs_int32
+SSTREAM_List(struct rx_call *call, afs_int32 count, afs_int32 *nentries,
+	     struct xdr_arraystream *entries)
+{
+    *nentries = 0;
+    return 0;
+}
+
+afs_int32
+SSTREAM_Sum(struct rx_call *call, afs_int32 toread,
+	    struct xdr_arraystream *entries, afs_int32 *total)
+{
+    *total = 0;
+    return 0;
+}
+
+afs_int32
+SSTREAM_Head(struct rx_call *call, afs_int32 count,
+	     struct xdr_arraystream *in, struct xdr_arraystream *out)
+{
+    return EINVAL;
+}
+
+static struct rx_connection *conn;
+
+/* Make calls from several threads, so that the server's threads all serve
+ * some of them */
+static void *
+caller(void *arg)
+{
+    streamEntries entries;
+    afs_int32 nentries;
+    int i, *failed = arg;
+
+    for (i = 0; i < NUMCALLS; i++) {
+	memset(&entries, 0, sizeof(entries));
+	if (STREAM_List(conn, 0, &nentries, &entries) != 0)
+	    (*failed)++;
+	xdr_free((xdrproc_t) xdr_streamEntries, &entries);
+    }
+    return NULL;
+}
+
+int
+main(void)
+{
+    struct rx_securityClass *secobj;
+    struct rx_service *service;
+    struct rx_connection *statconn;
+    rx_function_entry_v1_p fstats;
+    pthread_t threads[NUMTHREADS];
+    int failed[NUMTHREADS];
+    afs_uint32 *pstats;
+    afs_uint32 version, bucketCount, count, sec, usec;
+    afs_uint32 rxInterface;
+    afs_uint64 op, calls;
+    rpcStats histograms;
+    size_t allocSize;
+    int i, bucket, nfailed;
+
+    plan(15);
+
+    is_int(0, rx_Init(0), "Initialised rx");
+    ok(rx_enable_stats, "Stubs record call statistics by default");
+
+    secobj = rxnull_NewServerSecurityObject();
+    service = rx_NewService(0, STREAM_SERVICE_ID, "stream", &secobj, 1,
+			    STREAM_ExecuteRequest);
+    ok(service != NULL, "Created a service");
+    rx_SetMinProcs(service, NUMTHREADS);
+    rx_SetMaxProcs(service, NUMTHREADS);
+    service = rx_NewService(0, RX_STATS_SERVICE_ID, "rpcstats", &secobj, 1,
+			    RXSTATS_ExecuteRequest);
+    ok(service != NULL, "Created an rxstat service");
+    rx_StartServer(0);
+
+    rx_enableProcessRPCStats();
+    rx_enablePeerRPCStats();
+
+    conn = rx_NewConnection(htonl(INADDR_LOOPBACK), rx_port,
+			    STREAM_SERVICE_ID,
+			    rxnull_NewClientSecurityObject(), 0);
+    for (i = 0; i < NUMTHREADS; i++) {
+	failed[i] = 0;
+	pthread_create(&threads[i], NULL, caller, &failed[i]);
+    }
+    nfailed = 0;
+    for (i = 0; i < NUMTHREADS; i++) {
+	pthread_join(threads[i], NULL);
+	nfailed += failed[i];
+    }
+    is_int(0, nfailed, "Made calls from %d threads", NUMTHREADS);
+
+    /* A stub without a statindex names its interface by service and port,
+     * as rxgen's stubs compute it */
+    rxInterface = ((afs_uint32)ntohs(STREAM_SERVICE_ID) << 16)
+	| ntohs(rx_port);
+    op = ((afs_uint64)rxInterface << 32) | 0;
+
+    /* Both ends of each call are counted, and as the process is both client
+     * and server of the one peer, they share the peer's entries */
+    is_int(0, rx_RetrieveProcessRPCStats(RX_STATS_RETRIEVAL_VERSION,
+					 &version, &sec, &usec, &allocSize,
+					 &count, &pstats),
+	   "Retrieved process stats");
+    calls = 0;
+    for (i = 0; i < count; i++) {
+	afs_uint32 *entry = &pstats[i * STAT_WORDS];
+
+	/* As rx_MarshallProcessRPCStats lays out the entry */
+	if (entry[3] == rxInterface && entry[5] == 0)
+	    calls = ((afs_uint64)entry[6] << 32) | entry[7];
+    }
+    ok(calls == 2 * NUMCALLS * NUMTHREADS,
+       "Process stats total the calls counted by every thread");
+    rx_FreeRPCStats(pstats, allocSize);
+
+    fstats = rx_CopyPeerRPCStats(op, htonl(INADDR_LOOPBACK), rx_port);
+    ok(fstats != NULL && fstats->invocations == 2 * NUMCALLS * NUMTHREADS,
+       "Peer stats total the calls counted by every thread");
+    rx_ReleaseRPCStats(fstats);
+
+    is_int(0, rx_RetrievePeerRPCStats(RX_STATS_RETRIEVAL_VERSION, &version,
+				      &sec, &usec, &allocSize, &count,
+				      &pstats),
+	   "Retrieved peer stats");
+    is_int(STREAM_NO_OF_STAT_FUNCS, count,
+	   "Peer stats are totalled into one entry for each function");
+    rx_FreeRPCStats(pstats, allocSize);
+
+    statconn = rx_NewConnection(htonl(INADDR_LOOPBACK), rx_port,
+				RX_STATS_SERVICE_ID,
+				rxnull_NewClientSecurityObject(), 0);
+    memset(&histograms, 0, sizeof(histograms));
+    is_int(0, RXSTATS_RetrieveProcessRPCLatency(statconn,
+						RX_STATS_RETRIEVAL_VERSION,
+						&version, &bucketCount,
+						&count, &histograms),
+	   "Retrieved latency histograms over rxstat");
+    ok(count > 0
+       && histograms.rpcStats_len == count * (2 + bucketCount),
+       "Got whole histograms");
+
+    calls = 0;
+    for (i = 0; i < count; i++) {
+	afs_uint32 *histogram
+	    = &histograms.rpcStats_val[i * (2 + bucketCount)];
+
+	if (histogram[0] != rxInterface || histogram[1] != 0)
+	    continue;
+	for (bucket = 0; bucket < bucketCount; bucket++)
+	    calls += histogram[2 + bucket];
+    }
+    is_int(NUMCALLS * NUMTHREADS, calls,
+	   "Histogram counts every call served");
+    xdr_free((xdrproc_t) xdr_rpcStats, &histograms);
+
+    ok(rx_RPCLatencyBucketMax(0) == 0 && rx_RPCLatencyBucketMax(8) == 8
+       && rx_RPCLatencyBucketMax(16) == 17,
+       "Bucket bounds are exact, then eight to a power of two");
+
+    rx_disablePeerRPCStats();
+    rx_enablePeerRPCStats();
+    is_int(0, rx_RetrievePeerRPCStats(RX_STATS_RETRIEVAL_VERSION, &version,
+				      &sec, &usec, &allocSize, &count,
+				      &pstats) || count,
+	   "Disabling peer stats frees them");
+
+    rx_DestroyConnection(statconn);
+    rx_DestroyConnection(conn);
+
+    return 0;
+}
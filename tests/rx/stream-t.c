@@ -0,0 +1,183 @@
+/* Tests of rxgen's streamed array parameters */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/xdr.h>
+#include <rx/rx_null.h>
+
+#include "stream.h"
+
+#define NUMENTRIES 2000
+
+static void
+fillEntry(streamEntry *entry, int i)
+{
+    entry->index = i;
+    entry->name = malloc(16);
+    snprintf(entry->name, 16, "entry%d", i);
+}
+
+static int
+entriesMatch(streamEntries *entries, int count)
+{
+    char name[16];
+    int i;
+
+    if (entries->streamEntries_len != count)
+	return 0;
+    for (i = 0; i < count; i++) {
+	snprintf(name, sizeof(name), "entry%d", i);
+	if (entries->streamEntries_val[i].index != i
+	    || strcmp(entries->streamEntries_val[i].name, name) != 0)
+	    return 0;
+    }
+    return 1;
+}
+
+afs_int32
+SSTREAM_List(struct rx_call *call, afs_int32 count, afs_int32 *nentries,
+	     struct xdr_arraystream *entries)
+{
+    streamEntry entry;
+    int i;
+
+    if (count < 0)
+	return EINVAL;
+    *nentries = count;
+    /* Leave an empty list for the stub to send */
+    if (count == 0)
+	return 0;
+    if (!xdr_arraystream_begin(entries, count))
+	return RXGEN_SS_MARSHAL;
+    for (i = 0; i < count; i++) {
+	fillEntry(&entry, i);
+	if (!xdr_arraystream_next(entries, &entry))
+	    return RXGEN_SS_MARSHAL;
+	xdr_free((xdrproc_t) xdr_streamEntry, &entry);
+    }
+    return 0;
+}
+
+/* Add up the indices of the first toread entries, leaving the rest for the
+ * stub to skip */
+afs_int32
+SSTREAM_Sum(struct rx_call *call, afs_int32 toread,
+	    struct xdr_arraystream *entries, afs_int32 *total)
+{
+    streamEntry entry;
+    int i;
+
+    *total = 0;
+    for (i = 0; i < toread && i < entries->count; i++) {
+	if (!xdr_arraystream_next(entries, &entry))
+	    return RXGEN_SS_UNMARSHAL;
+	*total += entry.index;
+	xdr_free((xdrproc_t) xdr_streamEntry, &entry);
+    }
+    return 0;
+}
+
+/* Send back the first count entries. The rest of the input has to be
+ * skipped before the output can begin. */
+afs_int32
+SSTREAM_Head(struct rx_call *call, afs_int32 count,
+	     struct xdr_arraystream *in, struct xdr_arraystream *out)
+{
+    streamEntry entries[10];
+    afs_int32 code = 0;
+    int i, nread;
+
+    if (count > 10 || count > in->count)
+	return EINVAL;
+    for (nread = 0; nread < count; nread++) {
+	if (!xdr_arraystream_next(in, &entries[nread])) {
+	    code = RXGEN_SS_UNMARSHAL;
+	    goto out;
+	}
+    }
+    if (!xdr_arraystream_begin(out, count)) {
+	code = RXGEN_SS_MARSHAL;
+	goto out;
+    }
+    for (i = 0; i < count; i++) {
+	if (!xdr_arraystream_next(out, &entries[i])) {
+	    code = RXGEN_SS_MARSHAL;
+	    goto out;
+	}
+    }
+out:
+    for (i = 0; i < nread; i++)
+	xdr_free((xdrproc_t) xdr_streamEntry, &entries[i]);
+    return code;
+}
+
+int
+main(void)
+{
+    struct rx_securityClass *secobj;
+    struct rx_service *service;
+    struct rx_connection *conn;
+    streamEntries entries, echoed;
+    afs_int32 nentries, total;
+    int i;
+
+    plan(13);
+
+    is_int(0, rx_Init(0), "Initialised rx");
+    secobj = rxnull_NewServerSecurityObject();
+    service = rx_NewService(0, STREAM_SERVICE_ID, "stream", &secobj, 1,
+			    STREAM_ExecuteRequest);
+    ok(service != NULL, "Created a service");
+    rx_StartServer(0);
+
+    conn = rx_NewConnection(htonl(INADDR_LOOPBACK), rx_port,
+			    STREAM_SERVICE_ID,
+			    rxnull_NewClientSecurityObject(), 0);
+
+    memset(&entries, 0, sizeof(entries));
+    is_int(0, STREAM_List(conn, NUMENTRIES, &nentries, &entries),
+	   "Listed entries");
+    ok(nentries == NUMENTRIES && entriesMatch(&entries, NUMENTRIES),
+       "Got the entries the server streamed");
+    xdr_free((xdrproc_t) xdr_streamEntries, &entries);
+
+    memset(&entries, 0, sizeof(entries));
+    nentries = -1;
+    is_int(0, STREAM_List(conn, 0, &nentries, &entries),
+	   "Listed no entries");
+    ok(nentries == 0 && entries.streamEntries_len == 0,
+       "A list which is never begun is sent empty");
+
+    is_int(EINVAL, STREAM_List(conn, -1, &nentries, &entries),
+	   "Errors from the server routine are returned");
+
+    entries.streamEntries_len = NUMENTRIES;
+    entries.streamEntries_val = calloc(NUMENTRIES, sizeof(streamEntry));
+    for (i = 0; i < NUMENTRIES; i++)
+	fillEntry(&entries.streamEntries_val[i], i);
+
+    is_int(0, STREAM_Sum(conn, NUMENTRIES, &entries, &total),
+	   "Sent entries");
+    is_int(NUMENTRIES * (NUMENTRIES - 1) / 2, total,
+	   "Server read the entries as they were streamed");
+    is_int(0, STREAM_Sum(conn, 10, &entries, &total),
+	   "Entries left unread are skipped");
+    is_int(45, total, "Server read the entries it asked for");
+
+    memset(&echoed, 0, sizeof(echoed));
+    is_int(0, STREAM_Head(conn, 10, &entries, &echoed),
+	   "Streamed entries in and out of one call");
+    ok(entriesMatch(&echoed, 10), "Got back the entries the server read");
+    xdr_free((xdrproc_t) xdr_streamEntries, &echoed);
+    xdr_free((xdrproc_t) xdr_streamEntries, &entries);
+
+    rx_DestroyConnection(conn);
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+/* Tests of the binary trace of Rx call events */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/rx_null.h>
+#include <rx/rx_globals.h>
+#include <rx/rx_packet.h>
+#include <rx/rx_tracering.h>
+
+#define TEST_SERVICE_ID 4
+
+static afs_int32
+ExecuteRequest(struct rx_call *call)
+{
+    afs_int32 value;
+
+    if (rx_Read(call, (char *)&value, sizeof(value)) != sizeof(value))
+	return RX_PROTOCOL_ERROR;
+    if (rx_Write(call, (char *)&value, sizeof(value)) != sizeof(value))
+	return RX_PROTOCOL_ERROR;
+    return 0;
+}
+
+static int
+doCall(struct rx_connection *conn)
+{
+    struct rx_call *call;
+    afs_int32 value = 42;
+
+    call = rx_NewCall(conn);
+    rx_Write(call, (char *)&value, sizeof(value));
+    rx_Read(call, (char *)&value, sizeof(value));
+    return rx_EndCall(call, 0);
+}
+
+/* Read back a dump, and count the events recorded for one connection */
+static int
+countEvents(char *path, afs_uint32 cid, int *counts)
+{
+    struct rx_traceFileHeader header;
+    struct rx_traceRecord rec;
+    FILE *fp;
+    afs_uint32 i;
+
+    memset(counts, 0, 2 * RX_TRACE_NEVENTS * sizeof(int));
+    fp = fopen(path, "r");
+    if (fp == NULL)
+	return 0;
+    if (fread(&header, sizeof(header), 1, fp) != 1
+	|| header.magic != RX_TRACE_MAGIC
+	|| header.version != RX_TRACE_VERSION
+	|| header.recordSize != sizeof(rec)) {
+	fclose(fp);
+	return 0;
+    }
+    for (i = 0; i < header.nRecords; i++) {
+	if (fread(&rec, sizeof(rec), 1, fp) != 1) {
+	    fclose(fp);
+	    return 0;
+	}
+	if ((rec.cid & RX_CIDMASK) != cid)
+	    continue;
+	if ((rec.event & ~RX_TRACE_SERVER) >= RX_TRACE_NEVENTS)
+	    continue;
+	counts[((rec.event & RX_TRACE_SERVER) ? RX_TRACE_NEVENTS : 0)
+	       + (rec.event & ~RX_TRACE_SERVER)]++;
+    }
+    fclose(fp);
+    return 1;
+}
+
+int
+main(void)
+{
+    struct rx_securityClass *secobj;
+    struct rx_service *service;
+    struct rx_connection *conn, *conn2;
+    int client[RX_TRACE_NEVENTS], server[RX_TRACE_NEVENTS];
+    int counts[2 * RX_TRACE_NEVENTS];
+    char *path;
+    int fd;
+
+    plan(10);
+
+    is_int(0, rx_Init(0), "Initialised rx");
+    secobj = rxnull_NewServerSecurityObject();
+    service = rx_NewService(0, TEST_SERVICE_ID, "test", &secobj, 1,
+			    ExecuteRequest);
+    ok(service != NULL, "Created a service");
+    rx_StartServer(0);
+
+    if (asprintf(&path, "%s/afs_XXXXXX",
+		 getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp") < 0
+	|| (fd = mkstemp(path)) < 0)
+	sysbail("can't make a temporary file");
+    close(fd);
+
+    conn = rx_NewConnection(htonl(INADDR_LOOPBACK), rx_port,
+			    TEST_SERVICE_ID,
+			    rxnull_NewClientSecurityObject(), 0);
+    conn2 = rx_NewConnection(htonl(INADDR_LOOPBACK), rx_port,
+			     TEST_SERVICE_ID,
+			     rxnull_NewClientSecurityObject(), 0);
+
+    rx_TraceEnable(1);
+    ok(rx_TraceEnabled(), "Tracing is enabled");
+    is_int(0, doCall(conn), "Made a call while tracing");
+    rx_TraceEnable(0);
+    is_int(0, rx_TraceDump(path), "Dumped the trace");
+
+    ok(countEvents(path, rx_GetConnectionId(conn), counts),
+       "Read back the dump");
+    memcpy(client, counts, sizeof(client));
+    memcpy(server, counts + RX_TRACE_NEVENTS, sizeof(server));
+    ok(client[RX_TRACE_CALL_START] == 1 && client[RX_TRACE_CALL_END] == 1
+       && server[RX_TRACE_CALL_START] == 1 && server[RX_TRACE_CALL_END] == 1,
+       "Both ends of the call started and ended once");
+    ok(client[RX_TRACE_SEND] > 0 && server[RX_TRACE_RECV] > 0
+       && server[RX_TRACE_SEND] > 0 && client[RX_TRACE_RECV] > 0,
+       "Packets were recorded going each way");
+
+    /* Nothing more is recorded once tracing is off */
+    is_int(0, doCall(conn2), "Made a call after tracing");
+    rx_TraceDump(path);
+    countEvents(path, rx_GetConnectionId(conn2), counts);
+    ok(counts[RX_TRACE_CALL_START] == 0
+       && counts[RX_TRACE_NEVENTS + RX_TRACE_CALL_START] == 0,
+       "Calls aren't recorded with tracing off");
+
+    unlink(path);
+    free(path);
+    rx_DestroyConnection(conn);
+    rx_DestroyConnection(conn2);
+    return 0;
+}
@@ -0,0 +1,94 @@
+/* Tests of wide connections, which can have more than RX_MAXCALLS calls
+ * in progress at once */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/rx_null.h>
+#include <rx/rx_globals.h>
+
+#define TEST_SERVICE_ID 4
+#define NCALLS 16
+
+static afs_int32
+ExecuteRequest(struct rx_call *call)
+{
+    afs_int32 value;
+
+    if (rx_Read(call, (char *)&value, sizeof(value)) != sizeof(value))
+	return RX_PROTOCOL_ERROR;
+    value = ~value;
+    if (rx_Write(call, (char *)&value, sizeof(value)) != sizeof(value))
+	return RX_PROTOCOL_ERROR;
+    return 0;
+}
+
+int
+main(void)
+{
+    struct rx_securityClass *secobj;
+    struct rx_service *service;
+    struct rx_connection *conn, *conns[NCALLS];
+    struct rx_call *calls[NCALLS];
+    afs_int32 value;
+    int i, j, nconns, replied, ended;
+
+    plan(7);
+
+    is_int(0, rx_Init(0), "Initialised rx");
+    secobj = rxnull_NewServerSecurityObject();
+    service = rx_NewService(0, TEST_SERVICE_ID, "test", &secobj, 1,
+			    ExecuteRequest);
+    ok(service != NULL, "Created a service");
+    rx_StartServer(0);
+
+    conn = rx_NewWideConnection(htonl(INADDR_LOOPBACK), rx_port,
+				TEST_SERVICE_ID,
+				rxnull_NewClientSecurityObject(), 0, NCALLS);
+    ok(conn != NULL, "Created a connection with %d channels", NCALLS);
+
+    /* Start every call before finishing any, which would wait forever on
+     * an ordinary connection */
+    nconns = 0;
+    for (i = 0; i < NCALLS; i++) {
+	calls[i] = rx_NewCall(conn);
+	value = i;
+	rx_Write(calls[i], (char *)&value, sizeof(value));
+	for (j = 0; j < nconns; j++) {
+	    if (conns[j] == rx_ConnectionOf(calls[i]))
+		break;
+	}
+	if (j == nconns)
+	    conns[nconns++] = rx_ConnectionOf(calls[i]);
+    }
+    ok(conns[0] == conn, "First calls are on the connection itself");
+    is_int(NCALLS / RX_MAXCALLS, nconns,
+	   "%d calls are carried by %d connections", NCALLS,
+	   NCALLS / RX_MAXCALLS);
+
+    replied = ended = 1;
+    for (i = 0; i < NCALLS; i++) {
+	if (rx_Read(calls[i], (char *)&value, sizeof(value)) != sizeof(value)
+	    || value != ~i)
+	    replied = 0;
+	if (rx_EndCall(calls[i], 0) != 0)
+	    ended = 0;
+    }
+    ok(replied && ended, "All %d calls completed", NCALLS);
+
+    /* With its channels free again, there's no need to go past the
+     * connection itself */
+    calls[0] = rx_NewCall(conn);
+    ok(rx_ConnectionOf(calls[0]) == conn,
+       "Later calls go back to the connection itself");
+    rx_EndCall(calls[0], 0);
+
+    rx_DestroyConnection(conn);
+
+    return 0;
+}
@@ -0,0 +1,259 @@
+/* Tests of the fixed-layout XDR routines generated by rxgen, and of
+ * decoding into an XDR arena */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/xdr.h>
+#include <rx/rx_null.h>
+#include <rx/rx_globals.h>
+#include <afs/afsint.h>
+
+#define NUMSTATS AFSCBMAX
+
+/* Encodings done each way in the benchmark */
+#define BENCHROUNDS 20000
+
+#define TEST_SERVICE_ID 4
+
+static AFSFetchStatus stats[NUMSTATS];
+static char inlineBuf[NUMSTATS * sizeof(AFSFetchStatus) + 64];
+static char genericBuf[NUMSTATS * sizeof(AFSFetchStatus) + 64];
+
+static afs_int32 *
+noInline(XDR *xdrs, u_int len)
+{
+    return NULL;
+}
+
+/* Set up a memory stream which won't give out its buffer, so that every
+ * field goes through the stream's ops */
+static void
+genericCreate(XDR *xdrs, struct xdr_ops *ops, char *buf, u_int len,
+	      enum xdr_op op)
+{
+    xdrmem_create(xdrs, buf, len, op);
+    *ops = *xdrs->x_ops;
+    ops->x_inline = noInline;
+    xdrs->x_ops = ops;
+}
+
+static void
+fillStats(void)
+{
+    int i, j;
+    afs_uint32 *words;
+
+    for (i = 0; i < NUMSTATS; i++) {
+	words = (afs_uint32 *)&stats[i];
+	for (j = 0; j < sizeof(AFSFetchStatus) / sizeof(afs_uint32); j++)
+	    words[j] = (i << 16) ^ (j * 0x01010101) ^ 0x80000000;
+    }
+}
+
+static int
+encode(XDR *xdrs)
+{
+    AFSBulkStats bulk;
+
+    bulk.AFSBulkStats_len = NUMSTATS;
+    bulk.AFSBulkStats_val = stats;
+    return xdr_AFSBulkStats(xdrs, &bulk);
+}
+
+static int
+decodeMatches(XDR *xdrs)
+{
+    AFSBulkStats bulk;
+    XDR fxdrs;
+    int match;
+
+    memset(&bulk, 0, sizeof(bulk));
+    if (!xdr_AFSBulkStats(xdrs, &bulk))
+	return 0;
+    match = (bulk.AFSBulkStats_len == NUMSTATS
+	     && memcmp(bulk.AFSBulkStats_val, stats, sizeof(stats)) == 0);
+    xdrmem_create(&fxdrs, NULL, 0, XDR_FREE);
+    xdr_AFSBulkStats(&fxdrs, &bulk);
+    return match;
+}
+
+/* Decode the statuses into an arena, as a server stub would, and check
+ * that freeing them leaves the arena's storage alone */
+static void
+arenaDecode(char *buf, u_int len)
+{
+    struct xdr_arena arena;
+    struct xdr_arena_chunk *spare = NULL, *chunk;
+    AFSBulkStats bulk;
+    XDR xdrs;
+    char *p, *q;
+    int decoded;
+
+    memset(&arena, 0, sizeof(arena));
+    memset(&bulk, 0, sizeof(bulk));
+    xdrmem_create(&xdrs, buf, len, XDR_DECODE);
+    xdrs.x_arena = &arena;
+    decoded = (xdr_AFSBulkStats(&xdrs, &bulk)
+	       && bulk.AFSBulkStats_len == NUMSTATS
+	       && memcmp(bulk.AFSBulkStats_val, stats, sizeof(stats)) == 0);
+    p = (char *)bulk.AFSBulkStats_val;
+    for (chunk = arena.chunks; chunk != NULL; chunk = chunk->next) {
+	if (p >= (char *)chunk && p < (char *)chunk + chunk->size)
+	    break;
+    }
+    ok(decoded && chunk != NULL,
+       "Decoded statuses into an arena");
+    xdrs.x_op = XDR_FREE;
+    ok(xdr_AFSBulkStats(&xdrs, &bulk) && bulk.AFSBulkStats_val == NULL,
+       "Freed statuses decoded into an arena");
+    xdr_arena_release(&arena);
+
+    arena.spare = &spare;
+    p = xdr_arena_alloc(&arena, 10);
+    q = xdr_arena_alloc(&arena, 10);
+    ok(p != NULL && q == p + 16 && ((uintptr_t)p & 7) == 0,
+       "Small allocations are packed and aligned");
+    chunk = arena.chunks;
+    xdr_arena_release(&arena);
+    ok(spare == chunk && arena.chunks == NULL,
+       "Released arena keeps a spare chunk");
+    p = xdr_arena_alloc(&arena, 10);
+    ok(arena.chunks == chunk && spare == NULL, "Spare chunk is reused");
+    arena.spare = NULL;
+    xdr_arena_release(&arena);
+}
+
+static afs_int32
+ExecuteRequest(struct rx_call *call)
+{
+    AFSBulkStats bulk;
+    XDR xdrs;
+    afs_int32 code = 0;
+
+    memset(&bulk, 0, sizeof(bulk));
+    xdrrx_create(&xdrs, call, XDR_DECODE);
+    if (!xdr_AFSBulkStats(&xdrs, &bulk))
+	return RXGEN_SS_UNMARSHAL;
+    xdrs.x_op = XDR_ENCODE;
+    if (!xdr_AFSBulkStats(&xdrs, &bulk))
+	code = RXGEN_SS_MARSHAL;
+    xdrs.x_op = XDR_FREE;
+    xdr_AFSBulkStats(&xdrs, &bulk);
+    return code;
+}
+
+/* Send the statuses to a server, which decodes them and sends them back,
+ * so that they are marshalled in and out of Rx packets, across packet
+ * boundaries as well as within packets */
+static void
+rxRoundTrip(void)
+{
+    struct rx_securityClass *secobj;
+    struct rx_service *service;
+    struct rx_connection *conn;
+    struct rx_call *call;
+    XDR xdrs;
+    int encoded, matched;
+
+    is_int(0, rx_Init(0), "Initialised rx");
+    secobj = rxnull_NewServerSecurityObject();
+    service = rx_NewService(0, TEST_SERVICE_ID, "test", &secobj, 1,
+			    ExecuteRequest);
+    ok(service != NULL, "Created a service");
+    rx_StartServer(0);
+
+    conn = rx_NewConnection(htonl(INADDR_LOOPBACK), rx_port,
+			    TEST_SERVICE_ID,
+			    rxnull_NewClientSecurityObject(), 0);
+    call = rx_NewCall(conn);
+    xdrrx_create(&xdrs, call, XDR_ENCODE);
+    encoded = encode(&xdrs);
+    xdrs.x_op = XDR_DECODE;
+    matched = decodeMatches(&xdrs);
+    is_int(0, rx_EndCall(call, 0), "Call completed");
+    ok(encoded, "Encoded statuses into an Rx call");
+    ok(matched, "Decoded the same statuses from an Rx call");
+    rx_DestroyConnection(conn);
+}
+
+/* Encode the statuses repeatedly, each way, and report how long that
+ * takes */
+static void
+benchmark(void)
+{
+    struct clock start, end;
+    struct xdr_ops ops;
+    double inlineTime, genericTime;
+    XDR xdrs;
+    int round, good = 1;
+
+    clock_GetTime(&start);
+    for (round = 0; round < BENCHROUNDS; round++) {
+	xdrmem_create(&xdrs, inlineBuf, sizeof(inlineBuf), XDR_ENCODE);
+	good &= encode(&xdrs);
+    }
+    clock_GetTime(&end);
+    clock_Sub(&end, &start);
+    inlineTime = clock_Float(&end);
+
+    clock_GetTime(&start);
+    for (round = 0; round < BENCHROUNDS; round++) {
+	genericCreate(&xdrs, &ops, genericBuf, sizeof(genericBuf),
+		      XDR_ENCODE);
+	good &= encode(&xdrs);
+    }
+    clock_GetTime(&end);
+    clock_Sub(&end, &start);
+    genericTime = clock_Float(&end);
+
+    ok(good, "Encoded statuses %d times each way", BENCHROUNDS);
+    if (inlineTime > 0 && genericTime > 0)
+	diag("%.0f statuses/sec fixed-layout, %.0f statuses/sec generic",
+	     NUMSTATS * BENCHROUNDS / inlineTime,
+	     NUMSTATS * BENCHROUNDS / genericTime);
+}
+
+int
+main(void)
+{
+    struct xdr_ops ops;
+    XDR xdrs;
+    u_int inlineLen, genericLen;
+
+    plan(17);
+
+    fillStats();
+
+    xdrmem_create(&xdrs, inlineBuf, sizeof(inlineBuf), XDR_ENCODE);
+    ok(encode(&xdrs), "Encoded statuses in place");
+    inlineLen = sizeof(inlineBuf) - xdrs.x_handy;
+    genericCreate(&xdrs, &ops, genericBuf, sizeof(genericBuf), XDR_ENCODE);
+    ok(encode(&xdrs), "Encoded statuses field by field");
+    genericLen = sizeof(genericBuf) - xdrs.x_handy;
+    ok(inlineLen == genericLen
+       && memcmp(inlineBuf, genericBuf, inlineLen) == 0,
+       "Both encodings are the same");
+
+    xdrmem_create(&xdrs, inlineBuf, inlineLen, XDR_DECODE);
+    ok(decodeMatches(&xdrs), "Decoded statuses in place");
+    genericCreate(&xdrs, &ops, genericBuf, genericLen, XDR_DECODE);
+    ok(decodeMatches(&xdrs), "Decoded statuses field by field");
+
+    /* A buffer which isn't word aligned can't be used in place */
+    memmove(genericBuf + 1, inlineBuf, inlineLen);
+    xdrmem_create(&xdrs, genericBuf + 1, inlineLen, XDR_DECODE);
+    ok(decodeMatches(&xdrs), "Decoded statuses from an unaligned buffer");
+
+    arenaDecode(inlineBuf, inlineLen);
+
+    rxRoundTrip();
+    benchmark();
+
+    return 0;
+}
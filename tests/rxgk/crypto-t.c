@@ -0,0 +1,86 @@
+/* Tests of the RFC3961 crypto wrappers used by rxgk */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/rx_opaque.h>
+#include <rx/rxgk.h>
+
+/* ETYPE_AES128_CTS_HMAC_SHA1_96 */
+#define TEST_ENCTYPE 17
+
+#define NBUFS 4
+
+static unsigned char rawkey[16] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+
+static int
+same(RXGK_Data *a, RXGK_Data *b)
+{
+    return a->len == b->len && memcmp(a->val, b->val, a->len) == 0;
+}
+
+int
+main(void)
+{
+    RXGK_Data plain[NBUFS], sealed[NBUFS], opened[NBUFS], one;
+    char bufs[NBUFS][1200];
+    rxgk_key key = NULL;
+    int i, matched;
+
+    plan(9);
+
+    is_int(RXGK_BADETYPE, rxgk_make_key(&key, rawkey, sizeof(rawkey), -1),
+	   "Can't make a key for a bad enctype");
+    ok(key == NULL, "... and get no key");
+    is_int(0, rxgk_make_key(&key, rawkey, sizeof(rawkey), TEST_ENCTYPE),
+	   "Made an AES128 key");
+
+    for (i = 0; i < NBUFS; i++) {
+	memset(bufs[i], 'a' + i, sizeof(bufs[i]));
+	plain[i].val = bufs[i];
+	plain[i].len = sizeof(bufs[i]) - i;
+    }
+    memset(sealed, 0, sizeof(sealed));
+    memset(opened, 0, sizeof(opened));
+    is_int(0, rxgk_encrypt_batch(key, RXGK_CLIENT_ENC_PACKET, plain, sealed,
+				 NBUFS),
+	   "Encrypted a batch of buffers");
+    is_int(0, rxgk_decrypt_batch(key, RXGK_CLIENT_ENC_PACKET, sealed, opened,
+				 NBUFS),
+	   "Decrypted them");
+    matched = 1;
+    for (i = 0; i < NBUFS; i++)
+	matched = matched && same(&plain[i], &opened[i]);
+    ok(matched, "... getting back what was encrypted");
+
+    memset(&one, 0, sizeof(one));
+    is_int(0, rxgk_decrypt_in_key(key, RXGK_CLIENT_ENC_PACKET, &sealed[0],
+				  &one), "Decrypted one of them singly");
+    rx_opaque_freeContents(&one);
+
+    /* The wrong usage fails the integrity check, for the whole batch */
+    for (i = 0; i < NBUFS; i++)
+	rx_opaque_freeContents(&opened[i]);
+    is_int(RXGK_SEALED_INCON,
+	   rxgk_decrypt_batch(key, RXGK_SERVER_ENC_PACKET, sealed, opened,
+			      NBUFS),
+	   "Decrypting with the wrong usage fails");
+    matched = 1;
+    for (i = 0; i < NBUFS; i++)
+	matched = matched && opened[i].val == NULL;
+    ok(matched, "... leaving nothing to free");
+
+    for (i = 0; i < NBUFS; i++)
+	rx_opaque_freeContents(&sealed[i]);
+    rxgk_release_key(&key);
+
+    return 0;
+}
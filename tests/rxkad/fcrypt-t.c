@@ -0,0 +1,145 @@
+/* Tests of the fcrypt routines used by rxkad's crypt level */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/rxkad.h>
+#include <rx/rxkad_prototypes.h>
+
+/* Bytes crypted each way in the benchmark */
+#define BENCHBYTES (16 * 1024 * 1024)
+
+/* Not a multiple of the number of blocks decrypted at once */
+#define BUFSIZE 1416
+
+static const char the_quick[] =
+    "The quick brown fox jumps over the lazy dogs.\0\0";
+
+static const unsigned char key1[8] =
+    { 0xf0, 0xe1, 0xd2, 0xc3, 0xb4, 0xa5, 0x96, 0x87 };
+static const unsigned char ciph1[] = {
+    0x00, 0xf0, 0x0e, 0x11, 0x75, 0xe6, 0x23, 0x82, 0xee, 0xac, 0x98, 0x62,
+    0x44, 0x51, 0xe4, 0x84, 0xc3, 0x59, 0xd8, 0xaa, 0x64, 0x60, 0xae, 0xf7,
+    0xd2, 0xd9, 0x13, 0x79, 0x72, 0xa3, 0x45, 0x03, 0x23, 0xb5, 0x62, 0xd7,
+    0x0c, 0xf5, 0x27, 0xd1, 0xf8, 0x91, 0x3c, 0xac, 0x44, 0x22, 0x92, 0xef
+};
+
+static const unsigned char key2[8] =
+    { 0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10 };
+static const unsigned char ciph2[] = {
+    0xca, 0x90, 0xf5, 0x9d, 0xcb, 0xd4, 0xd2, 0x3c, 0x01, 0x88, 0x7f, 0x3e,
+    0x31, 0x6e, 0x62, 0x9d, 0xd8, 0xe0, 0x57, 0xa3, 0x06, 0x3a, 0x42, 0x58,
+    0x2a, 0x28, 0xfe, 0x72, 0x52, 0x2f, 0xdd, 0xe0, 0x19, 0x89, 0x09, 0x1c,
+    0x2a, 0x8e, 0x8c, 0x94, 0xfc, 0xc7, 0x68, 0xe4, 0x88, 0xaa, 0xde, 0x0f
+};
+
+static afs_uint32 plain[BUFSIZE / sizeof(afs_uint32)];
+static afs_uint32 cipher[BUFSIZE / sizeof(afs_uint32)];
+static afs_uint32 clear[BUFSIZE / sizeof(afs_uint32)];
+
+/* Check the known answers, encrypting the text with key and decrypting
+ * it again, with ivkey as the initialisation vector */
+static void
+knownAnswer(const unsigned char *key, const unsigned char *ivkey,
+	    const unsigned char *expected, const char *name)
+{
+    fc_KeySchedule sched;
+    afs_uint32 iv[2];
+    char ciph[sizeof(the_quick)], text[sizeof(the_quick)];
+
+    fc_keysched((struct ktc_encryptionKey *)key, sched);
+    memcpy(iv, ivkey, sizeof(iv));
+    fc_cbc_encrypt((void *)the_quick, ciph, sizeof(the_quick), sched, iv,
+		   ENCRYPT);
+    ok(memcmp(ciph, expected, sizeof(ciph)) == 0, "Encrypted with %s", name);
+    memcpy(iv, ivkey, sizeof(iv));
+    fc_cbc_encrypt(ciph, text, sizeof(the_quick), sched, iv, DECRYPT);
+    ok(memcmp(text, the_quick, sizeof(text)) == 0, "Decrypted with %s", name);
+}
+
+/* Decrypting a buffer all at once, in place, and a block at a time must
+ * all give the same answer */
+static void
+multiBlock(void)
+{
+    fc_KeySchedule sched;
+    afs_uint32 iv[2];
+    int i;
+
+    for (i = 0; i < sizeof(plain) / sizeof(afs_uint32); i++)
+	plain[i] = i * 0x9e3779b9;
+
+    fc_keysched((struct ktc_encryptionKey *)key1, sched);
+    memcpy(iv, key2, sizeof(iv));
+    fc_cbc_encrypt(plain, cipher, sizeof(plain), sched, iv, ENCRYPT);
+
+    memcpy(iv, key2, sizeof(iv));
+    fc_cbc_encrypt(cipher, clear, sizeof(cipher), sched, iv, DECRYPT);
+    ok(memcmp(clear, plain, sizeof(plain)) == 0,
+       "Decrypted %d bytes at once", (int)sizeof(cipher));
+
+    memset(clear, 0, sizeof(clear));
+    memcpy(iv, key2, sizeof(iv));
+    for (i = 0; i < sizeof(cipher); i += 8)
+	fc_cbc_encrypt((char *)cipher + i, (char *)clear + i, 8, sched, iv,
+		       DECRYPT);
+    ok(memcmp(clear, plain, sizeof(plain)) == 0,
+       "Decrypted %d bytes a block at a time", (int)sizeof(cipher));
+
+    memcpy(clear, cipher, sizeof(cipher));
+    memcpy(iv, key2, sizeof(iv));
+    fc_cbc_encrypt(clear, clear, sizeof(clear), sched, iv, DECRYPT);
+    ok(memcmp(clear, plain, sizeof(plain)) == 0,
+       "Decrypted %d bytes in place", (int)sizeof(cipher));
+}
+
+/* Crypt the buffer repeatedly, each way, and report how long that takes */
+static void
+benchmark(void)
+{
+    struct clock start, end;
+    double encTime, decTime;
+    fc_KeySchedule sched;
+    afs_uint32 iv[2];
+    int i;
+
+    fc_keysched((struct ktc_encryptionKey *)key2, sched);
+    memcpy(iv, key1, sizeof(iv));
+
+    clock_GetTime(&start);
+    for (i = 0; i < BENCHBYTES / sizeof(plain); i++)
+	fc_cbc_encrypt(plain, cipher, sizeof(plain), sched, iv, ENCRYPT);
+    clock_GetTime(&end);
+    clock_Sub(&end, &start);
+    encTime = clock_Float(&end);
+
+    clock_GetTime(&start);
+    for (i = 0; i < BENCHBYTES / sizeof(plain); i++)
+	fc_cbc_encrypt(cipher, clear, sizeof(cipher), sched, iv, DECRYPT);
+    clock_GetTime(&end);
+    clock_Sub(&end, &start);
+    decTime = clock_Float(&end);
+
+    ok(1, "Crypted %d bytes each way", BENCHBYTES);
+    if (encTime > 0 && decTime > 0)
+	diag("%.1f MB/sec encrypting, %.1f MB/sec decrypting",
+	     BENCHBYTES / encTime / 1e6, BENCHBYTES / decTime / 1e6);
+}
+
+int
+main(void)
+{
+    plan(8);
+
+    knownAnswer(key1, key2, ciph1, "first key");
+    knownAnswer(key2, key1, ciph2, "second key");
+    multiBlock();
+    benchmark();
+
+    return 0;
+}